@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdbcache.h"
+#include "sdbbatch.h"
+
+//Looks up BENCH_DEF_IDS random ids with a get_student() loop and with one
+//get_students() call per backend.  The file is dropped from the page cache
+//before every run (posix_fadvise, so it needs a file system that honours
+//it) and the pread engine is used without its page cache, so every record
+//comes from the device.  Usage:
+//  batchbench [db_file [ids]]
+#define BENCH_DEF_FILE      "/var/tmp/sdbsc_batchbench.db"
+#define BENCH_DEF_IDS       5000
+#define BENCH_NRECS         100000
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ *  fill_db
+ *      *path:  database file to create
+ *
+ *  Writes BENCH_NRECS records in one run.
+ *
+ *  returns:  true on success
+ */
+static bool fill_db(char *path)
+{
+    student_t *recs = calloc(BENCH_NRECS, sizeof(student_t));
+    int fd = open_db(path, true);
+    bool ok = (recs != NULL && fd >= 0);
+    for (int i = 0; ok && i < BENCH_NRECS; i++)
+    {
+        recs[i].id = MIN_STD_ID + i;
+        snprintf(recs[i].fname, sizeof(recs[i].fname), "first%d", recs[i].id);
+        snprintf(recs[i].lname, sizeof(recs[i].lname), "last%d", recs[i].id);
+        recs[i].gpa = recs[i].id % (MAX_STD_GPA + 1);
+    }
+    if (ok)
+        ok = store_write_run(fd, MIN_STD_ID, recs, BENCH_NRECS) == NO_ERROR;
+    if (fd >= 0 && close_db(fd) != NO_ERROR)
+        ok = false;
+    free(recs);
+    return ok;
+}
+
+/*
+ *  drop_cache
+ *      *path:  database file
+ *
+ *  Asks the kernel to forget the cached pages of the file.
+ */
+static void drop_cache(char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+/*
+ *  run
+ *      *path:   database file
+ *      *ids:    ids to look up
+ *      n:       number of ids
+ *      *label:  "loop" for a get_student() loop, otherwise the SDB_BATCH_ENV
+ *               backend handed to get_students()
+ *
+ *  returns:  false if the database could not be opened or a lookup failed
+ */
+static bool run(char *path, int *ids, int n, char *label)
+{
+    student_t *out = malloc((size_t)n * sizeof(student_t));
+    bool ok = (out != NULL);
+    int found = 0;
+
+    drop_cache(path);
+    setenv(SDB_BATCH_ENV, label, 1);
+    int fd = open_db(path, false);
+    if (fd < 0 || !ok)
+    {
+        free(out);
+        return false;
+    }
+    db_store_t *st = store_lookup(fd);
+
+    double t0 = now_sec();
+    if (strcmp(label, "loop") == 0)
+    {
+        for (int i = 0; ok && i < n; i++)
+        {
+            ok = get_student(fd, ids[i], &out[i]) == NO_ERROR;
+            found += ok;
+        }
+    }
+    else
+    {
+        found = get_students(fd, ids, n, out);
+        ok = (found >= 0);
+    }
+    double t = now_sec() - t0;
+
+    if (strcmp(label, "uring") == 0 && st->batch_io != SDB_BATCH_URING)
+        label = "uring (unavailable, read with preadv)";
+    printf("%-8s %10.3f ms %12.0f lookups/sec  %d found  %s\n",
+           strcmp(label, "loop") == 0 ? "single" : "batch", t * 1e3, n / t, found, label);
+    free(out);
+    return close_db(fd) == NO_ERROR && ok && found == n;
+}
+
+int main(int argc, char *argv[])
+{
+    char *path = (argc > 1) ? argv[1] : BENCH_DEF_FILE;
+    int n = (argc > 2) ? atoi(argv[2]) : BENCH_DEF_IDS;
+
+    setenv(SDB_ENGINE_ENV, "pread", 1);
+    setenv(SDB_CACHE_ENV, "0", 1);
+    int *ids = malloc((n > 0 ? n : 1) * sizeof(int));
+    if (n < 1 || ids == NULL || !fill_db(path))
+    {
+        printf("Cant create benchmark db %s\n", path);
+        free(ids);
+        return 1;
+    }
+
+    srand(61);
+    for (int i = 0; i < n; i++)
+        ids[i] = MIN_STD_ID + rand() % BENCH_NRECS;
+
+    printf("%d random lookups over %d records, cold file cache\n", n, BENCH_NRECS);
+    int rc = (run(path, ids, n, "loop") && run(path, ids, n, "preadv") &&
+              run(path, ids, n, "uring")) ? 0 : 1;
+
+    char sidecar[4096];
+    const char *exts[] = {"", ".occ", ".gpa", ".sum", ".snap", ".seq", ".lidx", ".wal", ".pgv"};
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); i++)
+    {
+        snprintf(sidecar, sizeof(sidecar), "%s%s", path, exts[i]);
+        unlink(sidecar);
+    }
+    free(ids);
+    return rc;
+}
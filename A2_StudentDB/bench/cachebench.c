@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdbcache.h"
+
+//Skewed lookups against the pread engine with and without the page cache.
+//BENCH_HOT_PERCENT of the lookups go to BENCH_HOT_IDS ids picked at random,
+//the rest are spread over the whole id space, and BENCH_WRITE_PERCENT of the
+//operations rewrite a hot record so the write-through path is exercised.
+//pread() calls are counted from /proc/self/io.  Usage:
+//  cachebench [db_file [ops]]
+#define BENCH_DEF_FILE      "/tmp/sdbsc_cachebench.db"
+#define BENCH_DEF_OPS       500000
+#define BENCH_HOT_IDS       500
+#define BENCH_HOT_PERCENT   90
+#define BENCH_WRITE_PERCENT 2
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ *  read_syscalls
+ *
+ *  returns:  read system calls made by this process so far, or 0 if the
+ *            kernel does not report them
+ */
+static unsigned long long read_syscalls(void)
+{
+    unsigned long long n = 0;
+    char line[128];
+    FILE *f = fopen("/proc/self/io", "r");
+    if (f == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        if (sscanf(line, "syscr: %llu", &n) == 1)
+            break;
+    }
+    fclose(f);
+    return n;
+}
+
+/*
+ *  fill_db
+ *      *path:  database file to create
+ *
+ *  Writes a record for every id in one run.
+ *
+ *  returns:  true on success
+ */
+static bool fill_db(char *path)
+{
+    student_t *recs = calloc(MAX_STD_ID, sizeof(student_t));
+    int fd = open_db(path, true);
+    bool ok = (recs != NULL && fd >= 0);
+    for (int i = 0; ok && i < MAX_STD_ID; i++)
+    {
+        recs[i].id = MIN_STD_ID + i;
+        snprintf(recs[i].fname, sizeof(recs[i].fname), "first%d", recs[i].id);
+        snprintf(recs[i].lname, sizeof(recs[i].lname), "last%d", recs[i].id);
+        recs[i].gpa = recs[i].id % (MAX_STD_GPA + 1);
+    }
+    if (ok)
+        ok = store_write_run(fd, MIN_STD_ID, recs, MAX_STD_ID) == NO_ERROR;
+    if (fd >= 0 && close_db(fd) != NO_ERROR)
+        ok = false;
+    free(recs);
+    return ok;
+}
+
+/*
+ *  run
+ *      *path:   database file
+ *      *hot:    the hot ids
+ *      ops:     operations to run
+ *      pages:   page cache size, 0 for none
+ *
+ *  returns:  false if the database could not be opened or a lookup failed
+ */
+static bool run(char *path, int *hot, int ops, char *pages)
+{
+    student_t s;
+    bool ok = true;
+
+    setenv(SDB_CACHE_ENV, pages, 1);
+    int fd = open_db(path, false);
+    if (fd < 0)
+        return false;
+    db_store_t *st = store_lookup(fd);
+
+    srand(283);
+    unsigned long long reads = read_syscalls();
+    double t0 = now_sec();
+    for (int i = 0; ok && i < ops; i++)
+    {
+        int pick = rand() % 100;
+        int id = (pick < BENCH_HOT_PERCENT) ? hot[rand() % BENCH_HOT_IDS]
+                                            : MIN_STD_ID + rand() % MAX_STD_ID;
+        if (pick < BENCH_WRITE_PERCENT)
+        {
+            ok = get_student(fd, id, &s) == NO_ERROR;
+            s.gpa = (s.gpa + 1) % (MAX_STD_GPA + 1);
+            ok = ok && store_write_slot(fd, id, &s) == NO_ERROR;
+        }
+        else
+            ok = get_student(fd, id, &s) == NO_ERROR && s.id == id;
+    }
+    double t = now_sec() - t0;
+    reads = read_syscalls() - reads;
+
+    printf("cache %5s pages %10.3f s %12.0f ops/sec %8.3f preads/op", pages, t, ops / t,
+           (double)reads / ops);
+    if (st->cache != NULL)
+        printf("  %llu hits, %llu misses", (unsigned long long)st->cache->hits,
+               (unsigned long long)st->cache->misses);
+    printf("\n");
+    return close_db(fd) == NO_ERROR && ok;
+}
+
+int main(int argc, char *argv[])
+{
+    char *path = (argc > 1) ? argv[1] : BENCH_DEF_FILE;
+    int ops = (argc > 2) ? atoi(argv[2]) : BENCH_DEF_OPS;
+    int hot[BENCH_HOT_IDS];
+    char def_pages[16];
+
+    setenv(SDB_ENGINE_ENV, "pread", 1);
+    if (ops < 1 || !fill_db(path))
+    {
+        printf("Cant create benchmark db %s\n", path);
+        return 1;
+    }
+
+    srand(97);
+    for (int i = 0; i < BENCH_HOT_IDS; i++)
+        hot[i] = MIN_STD_ID + rand() % MAX_STD_ID;
+
+    printf("pread engine, %d ops: %d%% on %d hot ids, %d%% rewrites\n",
+           ops, BENCH_HOT_PERCENT, BENCH_HOT_IDS, BENCH_WRITE_PERCENT);
+    snprintf(def_pages, sizeof(def_pages), "%d", SDB_CACHE_DEFAULT);
+    int rc = (run(path, hot, ops, "0") && run(path, hot, ops, def_pages)) ? 0 : 1;
+
+    char sidecar[4096];
+    const char *exts[] = {"", ".occ", ".gpa", ".sum", ".snap", ".seq", ".lidx", ".wal", ".pgv"};
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); i++)
+    {
+        snprintf(sidecar, sizeof(sidecar), "%s%s", path, exts[i]);
+        unlink(sidecar);
+    }
+    return rc;
+}
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// database include files
+#include "db.h"
+#include "sdbcrc.h"
+
+//Checksums BENCH_DEF_MB of records with crc32c() one record at a time and
+//with crc32c_rows(), once with the kernel the CPU gets and once with the
+//table, against a memcpy() of the same buffer for the memory bandwidth.
+//Each kernel runs in its own child process since the choice is made once.
+//Usage:
+//  crcbench [megabytes [rounds]]
+#define BENCH_DEF_MB        64
+#define BENCH_DEF_ROUNDS    5
+#define BENCH_ROWS          1024
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ *  report
+ *      *name:   row label
+ *      best:    fastest round in seconds
+ *      len:     bytes processed per round
+ *      check:   result folded over the buffer, printed so the work is kept
+ */
+static void report(const char *name, double best, size_t len, uint32_t check)
+{
+    printf("%-24s %10.3f ms %8.2f GB/s  %08x\n", name, best * 1e3, len / best / 1e9, check);
+}
+
+/*
+ *  run_kernel
+ *      *buf:    records to checksum
+ *      nrecs:   number of records
+ *      rounds:  number of timed rounds
+ *
+ *  Times both entry points with the kernel crc32c_impl_name() reports.
+ */
+static void run_kernel(const student_t *buf, size_t nrecs, int rounds)
+{
+    size_t len = nrecs * sizeof(student_t);
+    uint32_t *out = malloc(BENCH_ROWS * sizeof(uint32_t));
+    double best_one = 1e9, best_rows = 1e9;
+    uint32_t check_one = 0, check_rows = 0;
+    char name[64];
+
+    for (int r = 0; out != NULL && r < rounds; r++)
+    {
+        double t0 = now_sec();
+        check_one = 0;
+        for (size_t i = 0; i < nrecs; i++)
+            check_one ^= crc32c(0, &buf[i], sizeof(student_t));
+        double t = now_sec() - t0;
+        best_one = (t < best_one) ? t : best_one;
+
+        t0 = now_sec();
+        check_rows = 0;
+        for (size_t i = 0; i < nrecs; i += BENCH_ROWS)
+        {
+            int n = (nrecs - i < BENCH_ROWS) ? (int)(nrecs - i) : BENCH_ROWS;
+            crc32c_rows(&buf[i], sizeof(student_t), n, out);
+            for (int k = 0; k < n; k++)
+                check_rows ^= out[k];
+        }
+        t = now_sec() - t0;
+        best_rows = (t < best_rows) ? t : best_rows;
+    }
+
+    snprintf(name, sizeof(name), "crc32c %s", crc32c_impl_name());
+    report(name, best_one, len, check_one);
+    snprintf(name, sizeof(name), "crc32c_rows %s", crc32c_impl_name());
+    report(name, best_rows, len, check_rows);
+    free(out);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t mb = (argc > 1) ? (size_t)atol(argv[1]) : BENCH_DEF_MB;
+    int rounds = (argc > 2) ? atoi(argv[2]) : BENCH_DEF_ROUNDS;
+    size_t nrecs = (mb << 20) / sizeof(student_t);
+    student_t *buf = malloc(nrecs * sizeof(student_t));
+    char *copy = malloc(nrecs * sizeof(student_t));
+
+    if (nrecs == 0 || rounds < 1 || buf == NULL || copy == NULL)
+    {
+        printf("Cant allocate %zu MB\n", mb);
+        return 1;
+    }
+    for (size_t i = 0; i < nrecs; i++)
+    {
+        memset(&buf[i], 0, sizeof(student_t));
+        buf[i].id = (int)(i % MAX_STD_ID) + MIN_STD_ID;
+        snprintf(buf[i].fname, sizeof(buf[i].fname), "first%zu", i);
+        snprintf(buf[i].lname, sizeof(buf[i].lname), "last%zu", i);
+        buf[i].gpa = (int)(i % (MAX_STD_GPA + 1));
+    }
+
+    printf("checksum of %zu records (%zu MB), best of %d rounds\n", nrecs, mb, rounds);
+    double best = 1e9;
+    for (int r = 0; r < rounds; r++)
+    {
+        double t0 = now_sec();
+        memcpy(copy, buf, nrecs * sizeof(student_t));
+        double t = now_sec() - t0;
+        best = (t < best) ? t : best;
+    }
+    report("memcpy", best, nrecs * sizeof(student_t), (uint32_t)copy[nrecs * sizeof(student_t) - 1]);
+    fflush(stdout);
+
+    const char *kernels[] = {NULL, "table"};
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            if (kernels[k] != NULL)
+                setenv(SDB_CRC_ENV, kernels[k], 1);
+            run_kernel(buf, nrecs, rounds);
+            fflush(stdout);
+            _exit(0);
+        }
+        if (pid > 0)
+            waitpid(pid, NULL, 0);
+    }
+    free(copy);
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+//Runs several processes against one database.  First every process tries
+//to add the same ids, exactly one add per id must succeed.  Then N
+//processes run a mix of lookups, adds and deletes on random ids and the
+//aggregate throughput is reported for N = 1, 2, 4 ... max_procs.  Usage:
+//  lockbench [db_file [max_procs [ops_per_proc]]]
+#define BENCH_DEF_FILE      "/tmp/sdbsc_lockbench.db"
+#define BENCH_DEF_PROCS     8
+#define BENCH_DEF_OPS       20000
+#define BENCH_RACE_IDS      2000
+#define BENCH_GET_PERCENT   80
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ *  race_adds
+ *      *path:  database file
+ *      proc:   index of this process, picks where in the id range to start
+ *
+ *  returns:  number of adds that succeeded
+ */
+static int race_adds(char *path, int proc)
+{
+    int fd = open_db(path, false);
+    int won = 0;
+    if (fd < 0)
+        return 0;
+    for (int i = 0; i < BENCH_RACE_IDS; i++)
+    {
+        int id = MIN_STD_ID + (i + proc * 97) % BENCH_RACE_IDS;
+        if (add_student(fd, id, "race", "proc", 100 + proc) == NO_ERROR)
+            won++;
+    }
+    close_db(fd);
+    return won;
+}
+
+/*
+ *  mixed_ops
+ *      *path:  database file
+ *      proc:   index of this process, seeds its id sequence
+ *      ops:    number of operations
+ *
+ *  returns:  0, or 1 if the database could not be opened
+ */
+static int mixed_ops(char *path, int proc, int ops)
+{
+    student_t s;
+    int fd = open_db(path, false);
+    if (fd < 0)
+        return 1;
+    srand(283 + proc);
+    for (int i = 0; i < ops; i++)
+    {
+        int id = MIN_STD_ID + rand() % MAX_STD_ID;
+        int pick = rand() % 100;
+        if (pick < BENCH_GET_PERCENT)
+            get_student(fd, id, &s);
+        else if (pick % 2 == 0)
+            add_student(fd, id, "mixed", "proc", id % (MAX_STD_GPA + 1));
+        else
+            del_student(fd, id);
+    }
+    close_db(fd);
+    return 0;
+}
+
+/*
+ *  run_procs
+ *      nprocs:  processes to start
+ *      *path:   database file
+ *      ops:     operations per process, 0 for the add race
+ *      *total:  sum of the results of the processes
+ *
+ *  returns:  wall time in seconds until every process finished
+ */
+static double run_procs(int nprocs, char *path, int ops, int *total)
+{
+    int pipes[2];
+    if (pipe(pipes) == -1)
+        exit(1);
+
+    fflush(stdout);
+    double t0 = now_sec();
+    for (int p = 0; p < nprocs; p++)
+    {
+        if (fork() == 0)
+        {
+            if (freopen("/dev/null", "w", stdout) == NULL)
+                _exit(1);
+            int result = (ops == 0) ? race_adds(path, p) : mixed_ops(path, p, ops);
+            _exit(write(pipes[1], &result, sizeof(result)) == sizeof(result) ? 0 : 1);
+        }
+    }
+    close(pipes[1]);
+    *total = 0;
+    for (int p = 0; p < nprocs; p++)
+    {
+        int result;
+        if (read(pipes[0], &result, sizeof(result)) == sizeof(result))
+            *total += result;
+        wait(NULL);
+    }
+    close(pipes[0]);
+    return now_sec() - t0;
+}
+
+static bool reset_db(char *path)
+{
+    int fd = open_db(path, true);
+    return fd >= 0 && close_db(fd) == NO_ERROR;
+}
+
+int main(int argc, char *argv[])
+{
+    char *path = (argc > 1) ? argv[1] : BENCH_DEF_FILE;
+    int max_procs = (argc > 2) ? atoi(argv[2]) : BENCH_DEF_PROCS;
+    int ops = (argc > 3) ? atoi(argv[3]) : BENCH_DEF_OPS;
+    int total;
+
+    if (max_procs < 1 || ops < 1 || !reset_db(path))
+    {
+        printf("Cant create benchmark db %s\n", path);
+        return 1;
+    }
+
+    run_procs(max_procs, path, 0, &total);
+    int fd = open_db(path, false);
+    int count = 0;
+    student_t s;
+    if (fd < 0)
+        return 1;
+    for (int id = MIN_STD_ID; id <= MAX_STD_ID; id++)
+        count += (get_student(fd, id, &s) == NO_ERROR);
+    close_db(fd);
+    printf("add race: %d processes x %d ids, %d adds won, %d records (%s)\n",
+           max_procs, BENCH_RACE_IDS, total, count,
+           (total == BENCH_RACE_IDS && count == BENCH_RACE_IDS) ? "ok" : "FAILED");
+    if (total != BENCH_RACE_IDS || count != BENCH_RACE_IDS)
+        return 1;
+
+    printf("mixed ops: %d%% get, rest add/delete, %d ops per process\n", BENCH_GET_PERCENT, ops);
+    for (int n = 1; n <= max_procs; n *= 2)
+    {
+        if (!reset_db(path))
+            return 1;
+        double t = run_procs(n, path, ops, &total);
+        printf("%2d procs %10.3f s %14.0f ops/sec\n", n, t, (double)n * ops / t);
+    }
+
+    char sidecar[4096];
+    const char *exts[] = {"", ".occ", ".gpa", ".sum", ".snap", ".seq", ".lidx", ".wal", ".pgv"};
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); i++)
+    {
+        snprintf(sidecar, sizeof(sidecar), "%s%s", path, exts[i]);
+        unlink(sidecar);
+    }
+    return 0;
+}
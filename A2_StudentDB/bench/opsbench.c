@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+
+//Latency and throughput of the sdbsc operations, for tracking regressions.
+//Every scenario loads BENCH_SIZES[i] students spread evenly over an id span
+//of size / density ids, then times each operation on its own:
+//  add, delete    a present id is deleted and added back, ops times
+//  get_hit        a present id, ops times
+//  get_miss       an id in a hole of the span (or past it when the span is
+//                 full), ops times
+//  count, print   whole database, BENCH_SCAN_REPS times, print to /dev/null
+//  compress       BENCH_COMPRESS_REPS times, the last operation of a scenario
+//Results go out as one JSON document, a summary table to stderr.  The
+//engine is picked with SDB_ENGINE as for sdbsc.  Usage:
+//  opsbench [json_file|- [ops [db_file]]]
+#define BENCH_DEF_FILE      "/tmp/sdbsc_opsbench.db"
+#define BENCH_DEF_OPS       20000
+#define BENCH_SCAN_REPS     10
+#define BENCH_COMPRESS_REPS 3
+
+static const int BENCH_SIZES[] = {1000, 10000, 100000};
+static const int BENCH_DENSITY_PERCENT[] = {10, 50, 100};
+
+//Latencies of one operation in one scenario, in nanoseconds
+typedef struct op_times {
+    const char  *name;
+    long long   *ns;
+    int         n;
+    int         failed;
+} op_times_t;
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_ll(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ *  percentile
+ *      *ns:  sorted latencies
+ *      n:    number of latencies, at least 1
+ *      p:    percentile, 0..100
+ *
+ *  returns:  the nearest-rank percentile in microseconds
+ */
+static double percentile(const long long *ns, int n, int p)
+{
+    int rank = (int)(((long long)p * n + 99) / 100);
+    if (rank < 1)
+        rank = 1;
+    return ns[rank - 1] / 1e3;
+}
+
+/*
+ *  present_id
+ *      i:     index of the student, 0..size-1
+ *      span:  ids the students are spread over
+ *      size:  number of students
+ *
+ *  returns:  the id of the i-th student
+ */
+static int present_id(int i, int span, int size)
+{
+    return MIN_STD_ID + (int)((long long)i * span / size);
+}
+
+/*
+ *  fill_db
+ *      *path:     database file to create
+ *      size:      number of students
+ *      span:      ids they are spread over
+ *      capacity:  id space of the file
+ *
+ *  returns:  open descriptor of the filled database, or -1
+ */
+static int fill_db(char *path, int size, int span, int capacity)
+{
+    student_t *rows = calloc(size, sizeof(student_t));
+    int rejected = 0;
+    int fd = open_db(path, true);
+    bool ok = (rows != NULL && fd >= 0);
+
+    if (ok && capacity > store_capacity(fd))
+        ok = grow_db(fd, capacity) == NO_ERROR;
+    for (int i = 0; ok && i < size; i++)
+    {
+        rows[i].id = present_id(i, span, size);
+        snprintf(rows[i].fname, sizeof(rows[i].fname), "first%d", rows[i].id);
+        snprintf(rows[i].lname, sizeof(rows[i].lname), "last%d", rows[i].id);
+        rows[i].gpa = rows[i].id % (MAX_STD_GPA + 1);
+    }
+    if (ok)
+        ok = load_rows(fd, rows, size, &rejected) == size;
+    free(rows);
+    if (!ok && fd >= 0)
+    {
+        close_db(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/*
+ *  report
+ *      *json:      JSON output
+ *      *first:     no result has been written yet, cleared
+ *      size:       students in the scenario
+ *      density:    percent of the span they fill
+ *      *t:         latencies of the operation, sorted in place
+ *
+ *  Writes one result object and a summary line to stderr.
+ */
+static void report(FILE *json, bool *first, int size, int density, op_times_t *t)
+{
+    long long total = 0;
+    qsort(t->ns, t->n, sizeof(long long), cmp_ll);
+    for (int i = 0; i < t->n; i++)
+        total += t->ns[i];
+    double ops_sec = (total > 0) ? t->n / (total / 1e9) : 0;
+    double p50 = (t->n > 0) ? percentile(t->ns, t->n, 50) : 0;
+    double p99 = (t->n > 0) ? percentile(t->ns, t->n, 99) : 0;
+
+    fprintf(json, "%s\n    {\"size\": %d, \"density\": %.2f, \"op\": \"%s\", \"ops\": %d, "
+            "\"failed\": %d, \"ops_per_sec\": %.1f, \"p50_us\": %.3f, \"p99_us\": %.3f}",
+            *first ? "" : ",", size, density / 100.0, t->name, t->n, t->failed, ops_sec, p50, p99);
+    *first = false;
+    fprintf(stderr, "%7d %4d%% %-9s %8d ops %14.1f ops/sec p50 %11.3f us p99 %11.3f us%s\n",
+            size, density, t->name, t->n, ops_sec, p50, p99, t->failed ? "  FAILED" : "");
+}
+
+/*
+ *  scenario
+ *      *path:     database file
+ *      size:      number of students
+ *      density:   percent of the span they fill
+ *      ops:       operations timed for add, delete and get
+ *      *json:     JSON output
+ *      *first:    no result has been written yet
+ *
+ *  returns:  false if the database could not be created or an operation
+ *            failed
+ */
+static bool scenario(char *path, int size, int density, int ops, FILE *json, bool *first)
+{
+    int span = (int)((long long)size * 100 / density);
+    int capacity = span + size / 10 + 1;
+    student_t s;
+    bool ok = true;
+
+    op_times_t t[] = {{"add", NULL, 0, 0}, {"delete", NULL, 0, 0}, {"get_hit", NULL, 0, 0},
+                      {"get_miss", NULL, 0, 0}, {"count", NULL, 0, 0}, {"print", NULL, 0, 0},
+                      {"compress", NULL, 0, 0}};
+    int nt = sizeof(t) / sizeof(t[0]);
+    for (int i = 0; i < nt; i++)
+    {
+        t[i].ns = calloc((ops > BENCH_SCAN_REPS) ? ops : BENCH_SCAN_REPS, sizeof(long long));
+        ok = ok && t[i].ns != NULL;
+    }
+
+    int fd = ok ? fill_db(path, size, span, capacity) : -1;
+    ok = fd >= 0;
+    srand(size + density);
+    for (int i = 0; ok && i < ops; i++)
+    {
+        int id = present_id(rand() % size, span, size);
+        long long t0 = now_ns();
+        t[1].failed += del_student(fd, id) != NO_ERROR;
+        long long t1 = now_ns();
+        t[0].failed += add_student(fd, id, "added", "again", 300) != NO_ERROR;
+        long long t2 = now_ns();
+        t[1].ns[t[1].n++] = t1 - t0;
+        t[0].ns[t[0].n++] = t2 - t1;
+    }
+    for (int i = 0; ok && i < ops; i++)
+    {
+        int id = present_id(rand() % size, span, size);
+        long long t0 = now_ns();
+        t[2].failed += get_student(fd, id, &s) != NO_ERROR || s.id != id;
+        t[2].ns[t[2].n++] = now_ns() - t0;
+
+        // the id after a present one is a hole unless the span is full
+        id = (density < 100) ? id + 1 : span + 1 + rand() % (capacity - span);
+        t0 = now_ns();
+        t[3].failed += get_student(fd, id, &s) != SRCH_NOT_FOUND;
+        t[3].ns[t[3].n++] = now_ns() - t0;
+    }
+    for (int i = 0; ok && i < BENCH_SCAN_REPS; i++)
+    {
+        long long t0 = now_ns();
+        t[4].failed += count_db_records(fd) != size;
+        long long t1 = now_ns();
+        t[5].failed += print_db(fd) != NO_ERROR;
+        fflush(stdout);
+        long long t2 = now_ns();
+        t[4].ns[t[4].n++] = t1 - t0;
+        t[5].ns[t[5].n++] = t2 - t1;
+    }
+    for (int i = 0; ok && i < BENCH_COMPRESS_REPS; i++)
+    {
+        long long t0 = now_ns();
+        fd = compress_db(fd);
+        t[6].ns[t[6].n++] = now_ns() - t0;
+        ok = fd >= 0;
+        t[6].failed += !ok;
+    }
+
+    for (int i = 0; i < nt; i++)
+    {
+        if (ok)
+            report(json, first, size, density, &t[i]);
+        ok = ok && t[i].failed == 0;
+        free(t[i].ns);
+    }
+    if (fd >= 0 && close_db(fd) != NO_ERROR)
+        ok = false;
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    char *json_path = (argc > 1) ? argv[1] : "-";
+    int ops = (argc > 2) ? atoi(argv[2]) : BENCH_DEF_OPS;
+    char *path = (argc > 3) ? argv[3] : BENCH_DEF_FILE;
+    char *engine = getenv(SDB_ENGINE_ENV);
+    bool first = true;
+    int rc = 0;
+
+    // The operations report on stdout like sdbsc does, that output is part
+    // of their cost but goes to /dev/null.
+    int out_fd = dup(STDOUT_FILENO);
+    FILE *json = (strcmp(json_path, "-") == 0) ? fdopen(out_fd, "w") : fopen(json_path, "w");
+    if (ops < 1 || json == NULL || freopen("/dev/null", "w", stdout) == NULL)
+    {
+        fprintf(stderr, "usage: %s [json_file|- [ops [db_file]]]\n", argv[0]);
+        return 1;
+    }
+
+    fprintf(json, "{\n  \"benchmark\": \"sdbsc operations\",\n  \"engine\": \"%s\",\n"
+            "  \"ops\": %d,\n  \"scan_reps\": %d,\n  \"compress_reps\": %d,\n  \"results\": [",
+            (engine != NULL) ? engine : "default", ops, BENCH_SCAN_REPS, BENCH_COMPRESS_REPS);
+    for (size_t i = 0; rc == 0 && i < sizeof(BENCH_SIZES) / sizeof(BENCH_SIZES[0]); i++)
+    {
+        for (size_t j = 0; rc == 0 && j < sizeof(BENCH_DENSITY_PERCENT) / sizeof(int); j++)
+        {
+            if (!scenario(path, BENCH_SIZES[i], BENCH_DENSITY_PERCENT[j], ops, json, &first))
+            {
+                fprintf(stderr, "Benchmark failed at %d students, %d%% dense\n",
+                        BENCH_SIZES[i], BENCH_DENSITY_PERCENT[j]);
+                rc = 1;
+            }
+        }
+    }
+    fprintf(json, "\n  ]\n}\n");
+    if (fclose(json) != 0)
+        rc = 1;
+
+    char sidecar[4096];
+    const char *exts[] = {"", ".occ", ".gpa", ".sum", ".snap", ".seq", ".lidx", ".wal", ".pgv"};
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); i++)
+    {
+        snprintf(sidecar, sizeof(sidecar), "%s%s", path, exts[i]);
+        unlink(sidecar);
+    }
+    return rc;
+}
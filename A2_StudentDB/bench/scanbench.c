@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbscan.h"
+
+//Compares the original one read() per record scan against the block scan
+//iterator over the same database file, then counts with scan_parallel()
+//on 1, 2, 4 ... threads up to the number of online CPUs.  Usage:
+//  scanbench [db_file [live_percent [rounds]]]
+#define BENCH_DEF_FILE      "/tmp/sdbsc_scanbench.db"
+#define BENCH_DEF_DENSITY   50
+#define BENCH_DEF_ROUNDS    5
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ *  build_db
+ *      *path:     file to create
+ *      density:   percentage of ids 1..MAX_STD_ID holding a record
+ *
+ *  returns:  number of live records written, or -1 on error
+ */
+static int build_db(const char *path, int density)
+{
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1)
+        return -1;
+
+    student_t *all = calloc(MAX_STD_ID + 1, sizeof(student_t));
+    if (all == NULL)
+    {
+        close(fd);
+        return -1;
+    }
+
+    int live = 0;
+    srand(283);
+    for (int id = MIN_STD_ID; id <= MAX_STD_ID; id++)
+    {
+        if (rand() % 100 >= density)
+            continue;
+        all[id].id = id;
+        snprintf(all[id].fname, sizeof(all[id].fname), "first%d", id);
+        snprintf(all[id].lname, sizeof(all[id].lname), "last%d", id);
+        all[id].gpa = id % (MAX_STD_GPA + 1);
+        live++;
+    }
+
+    size_t len = (size_t)(MAX_STD_ID + 1) * sizeof(student_t);
+    bool ok = write(fd, all, len) == (ssize_t)len;
+    free(all);
+    close(fd);
+    return ok ? live : -1;
+}
+
+//The scan loop count_db_records() used before the block iterator
+static int scan_per_record(int fd)
+{
+    student_t s;
+    int count = 0;
+    lseek(fd, 0, SEEK_SET);
+    while (read(fd, &s, STUDENT_RECORD_SIZE) == STUDENT_RECORD_SIZE)
+    {
+        if (memcmp(&s, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0)
+            count++;
+    }
+    return count;
+}
+
+static int scan_block_iter(int fd)
+{
+    scan_iter_t it;
+    int count = 0;
+    if (scan_open(&it, fd) != NO_ERROR)
+        return -1;
+    while (scan_next(&it) != NULL)
+        count++;
+    return scan_close(&it) == NO_ERROR ? count : -1;
+}
+
+static int scan_block_count(int fd)
+{
+    scan_iter_t it;
+    if (scan_open(&it, fd) != NO_ERROR)
+        return -1;
+    int count = scan_count(&it);
+    return scan_close(&it) == NO_ERROR ? count : -1;
+}
+
+static int count_part(scan_iter_t *it, void *ctx, void *arg)
+{
+    (void)arg;
+    *(int *)ctx = scan_count(it);
+    return NO_ERROR;
+}
+
+static int count_merge(void *ctx, void *arg, int rc)
+{
+    if (rc == NO_ERROR)
+        *(int *)arg += *(int *)ctx;
+    return NO_ERROR;
+}
+
+static int scan_parallel_count(int fd)
+{
+    int count = 0;
+    scan_job_t job = {count_part, count_merge, sizeof(int), &count, NULL, 0};
+    return scan_parallel(fd, &job) == NO_ERROR ? count : -1;
+}
+
+static void run(const char *name, int (*scan)(int), int fd, int rounds, int live)
+{
+    double best = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+        double t0 = now_sec();
+        int count = scan(fd);
+        double t = now_sec() - t0;
+        if (count != live)
+        {
+            printf("%-14s counted %d records, expected %d\n", name, count, live);
+            exit(1);
+        }
+        if (r == 0 || t < best)
+            best = t;
+    }
+    printf("%-14s %10.3f ms %14.0f slots/sec %14.0f records/sec\n", name,
+           best * 1e3, (MAX_STD_ID + 1) / best, live / best);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = (argc > 1) ? argv[1] : BENCH_DEF_FILE;
+    int density = (argc > 2) ? atoi(argv[2]) : BENCH_DEF_DENSITY;
+    int rounds = (argc > 3) ? atoi(argv[3]) : BENCH_DEF_ROUNDS;
+
+    int live = build_db(path, density);
+    if (live < 0)
+    {
+        printf("Cant create benchmark db %s\n", path);
+        return 1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        printf("Cant open benchmark db %s\n", path);
+        return 1;
+    }
+
+    printf("scan of %d slots, %d live (%d%%), best of %d rounds, %s classifier\n",
+           MAX_STD_ID + 1, live, density, rounds, classify_impl_name());
+    run("read/record", scan_per_record, fd, rounds, live);
+    run("block iter", scan_block_iter, fd, rounds, live);
+    run("block count", scan_block_count, fd, rounds, live);
+
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int t = 1; t == 1 || t <= ncpus; t *= 2)
+    {
+        char name[32], threads[16];
+        snprintf(name, sizeof(name), "parallel x%d", t);
+        snprintf(threads, sizeof(threads), "%d", t);
+        setenv(SDB_SCAN_THREADS_ENV, threads, 1);
+        run(name, scan_parallel_count, fd, rounds, live);
+    }
+
+    close(fd);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbclient.h"
+
+//Compares a lookup through a running sdbsc -S server against running one
+//sdbsc -f process per lookup.  The server and its database live in a
+//scratch directory that is removed afterwards.  Usage:
+//  servebench path/to/sdbsc [records [lookups]]
+#define BENCH_DIR_TEMPLATE  "/tmp/sdbsc_servebench.XXXXXX"
+#define BENCH_SOCK          "bench.sock"
+#define BENCH_DEF_RECORDS   10000
+#define BENCH_DEF_LOOKUPS   100000
+#define BENCH_EXEC_LOOKUPS  200
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static pid_t spawn(char *exe, char *opt, char *arg)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        if (freopen("/dev/null", "w", stdout) == NULL)
+            _exit(127);
+        execl(exe, exe, opt, arg, (char *)NULL);
+        _exit(127);
+    }
+    return pid;
+}
+
+int main(int argc, char *argv[])
+{
+    char exe[PATH_MAX];
+    char dir[] = BENCH_DIR_TEMPLATE;
+    char id_arg[16];
+    student_t s;
+
+    if (argc < 2 || realpath(argv[1], exe) == NULL)
+    {
+        printf("usage: %s path/to/sdbsc [records [lookups]]\n", argv[0]);
+        return 1;
+    }
+    int records = (argc > 2) ? atoi(argv[2]) : BENCH_DEF_RECORDS;
+    int lookups = (argc > 3) ? atoi(argv[3]) : BENCH_DEF_LOOKUPS;
+    if (records < 1 || records > MAX_STD_ID || lookups < 1 ||
+        mkdtemp(dir) == NULL || chdir(dir) == -1)
+    {
+        printf("Cant set up benchmark directory %s\n", dir);
+        return 1;
+    }
+
+    pid_t server = spawn(exe, "-S", BENCH_SOCK);
+    int sock = ERR_DB_FILE;
+    for (int i = 0; i < 500 && sock < 0; i++)
+    {
+        usleep(10000);
+        sock = client_connect(BENCH_SOCK);
+    }
+    if (sock < 0)
+    {
+        printf("Server did not start\n");
+        kill(server, SIGTERM);
+        return 1;
+    }
+
+    double t0 = now_sec();
+    for (int id = MIN_STD_ID; id <= records; id++)
+    {
+        if (client_add(sock, id, "first", "last", id % (MAX_STD_GPA + 1)) != NO_ERROR)
+        {
+            printf("Add of %d failed\n", id);
+            kill(server, SIGTERM);
+            return 1;
+        }
+    }
+    double t_add = now_sec() - t0;
+
+    srand(283);
+    t0 = now_sec();
+    for (int i = 0; i < lookups; i++)
+    {
+        int id = MIN_STD_ID + rand() % records;
+        if (client_get(sock, id, &s) != NO_ERROR || s.id != id)
+        {
+            printf("Lookup of %d failed\n", id);
+            kill(server, SIGTERM);
+            return 1;
+        }
+    }
+    double t_get = now_sec() - t0;
+    close(sock);
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+
+    t0 = now_sec();
+    for (int i = 0; i < BENCH_EXEC_LOOKUPS; i++)
+    {
+        snprintf(id_arg, sizeof(id_arg), "%d", MIN_STD_ID + rand() % records);
+        waitpid(spawn(exe, "-f", id_arg), NULL, 0);
+    }
+    double t_exec = now_sec() - t0;
+
+    printf("%d records, %d server lookups, %d process lookups\n",
+           records, lookups, BENCH_EXEC_LOOKUPS);
+    printf("%-16s %10.2f us/op\n", "server add", t_add * 1e6 / records);
+    printf("%-16s %10.2f us/op\n", "server get", t_get * 1e6 / lookups);
+    printf("%-16s %10.2f us/op\n", "sdbsc -f", t_exec * 1e6 / BENCH_EXEC_LOOKUPS);
+
+    // the database and its sidecars are the only files in the directory
+    char cmd[sizeof(dir) + 16];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    return system(cmd) == 0 ? 0 : 1;
+}
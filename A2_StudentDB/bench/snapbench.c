@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdbscan.h"
+#include "sdbsnap.h"
+
+//Runs full table reports while a writer process rewrites every record, one
+//pass after another, each pass raising the gpa of every id in id order.  A
+//report that sees one point in time finds the ids rewritten by the current
+//pass one gpa point above the rest and at most one id missing, the one
+//between its delete and add.  Reports are taken with copy-on-write
+//snapshots and with SDB_SNAP_ENV=lock, and the writer's throughput during
+//the reports is given for each.  Usage:
+//  snapbench [db_file [num_students [num_reports]]]
+#define BENCH_DEF_FILE      "/tmp/sdbsc_snapbench.db"
+#define BENCH_DEF_STUDENTS  MAX_STD_ID
+#define BENCH_DEF_REPORTS   20
+
+//shared between the report process and the writer
+typedef struct bench_shared {
+    volatile int stop;
+    volatile long writes;
+} bench_shared_t;
+
+//one report: gpa[id] as seen by the snapshot, -1 where the slot is empty
+typedef struct bench_report {
+    int *gpa;
+    int n;
+} bench_report_t;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ *  rewrite_loop
+ *      *path:    database file
+ *      n:        number of students, ids 1 to n
+ *      *shared:  stop flag and write counter
+ *
+ *  Rewrites ids 1 to n in order with the pass number as gpa until told to
+ *  stop, counting writes.
+ *
+ *  returns:  0, or 1 if a write failed
+ */
+static int rewrite_loop(char *path, int n, bench_shared_t *shared)
+{
+    int fd = open_db(path, false);
+    if (fd < 0)
+        return 1;
+    for (int pass = 1; !shared->stop; pass++)
+    {
+        for (int id = 1; id <= n && !shared->stop; id++)
+        {
+            if (del_student(fd, id) != NO_ERROR ||
+                add_student(fd, id, "snap", "bench", pass % (MAX_STD_GPA + 1)) != NO_ERROR)
+            {
+                close_db(fd);
+                return 1;
+            }
+            __atomic_fetch_add(&shared->writes, 2, __ATOMIC_RELAXED);
+        }
+    }
+    close_db(fd);
+    return 0;
+}
+
+static int report_part(scan_iter_t *it, void *ctx, void *arg)
+{
+    (void)ctx;
+    bench_report_t *rep = arg;
+    student_t *rec;
+    while ((rec = scan_next(it)) != NULL)
+    {
+        if (rec->id >= 1 && rec->id <= rep->n)
+            rep->gpa[rec->id] = rec->gpa;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  report_consistent
+ *      *rep:  report filled by one snapshot scan
+ *
+ *  returns:  true if the report matches a point in the writer's passes
+ */
+static bool report_consistent(bench_report_t *rep)
+{
+    int first = -1, drops = 0, missing = 0;
+    for (int id = 1; id <= rep->n; id++)
+    {
+        int g = rep->gpa[id];
+        if (g == -1)
+        {
+            missing++;
+            continue;
+        }
+        if (first == -1)
+            first = g;
+        else if (g != first && (drops++ > 0 || g != (first + MAX_STD_GPA) % (MAX_STD_GPA + 1)))
+            return false;
+        first = g;
+    }
+    return missing <= 1;
+}
+
+/*
+ *  run_reports
+ *      *path:     database file
+ *      n:         number of students
+ *      reports:   number of reports to take
+ *      *bad:      receives the number of inconsistent reports
+ *      *wps:      receives the writer's writes per second during the reports
+ *
+ *  returns:  seconds per report, or -1 if the benchmark could not run
+ */
+static double run_reports(char *path, int n, int reports, int *bad, double *wps)
+{
+    bench_shared_t *shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    bench_report_t rep = {malloc((size_t)(n + 1) * sizeof(int)), n};
+    int fd = open_db(path, false);
+    if (shared == MAP_FAILED || rep.gpa == NULL || fd < 0)
+        return -1;
+
+    fflush(stdout);
+    pid_t writer = fork();
+    if (writer == 0)
+    {
+        if (freopen("/dev/null", "w", stdout) == NULL)
+            _exit(1);
+        _exit(rewrite_loop(path, n, shared));
+    }
+
+    // let the writer get going
+    while (__atomic_load_n(&shared->writes, __ATOMIC_RELAXED) < 1000)
+        usleep(1000);
+
+    *bad = 0;
+    long w0 = shared->writes;
+    double t0 = now_sec();
+    for (int r = 0; r < reports; r++)
+    {
+        snap_view_t view;
+        scan_job_t job = {report_part, NULL, 0, &rep, &view, 0};
+        for (int id = 0; id <= n; id++)
+            rep.gpa[id] = -1;
+        if (snap_begin(fd, &view) != NO_ERROR)
+            break;
+        int rc = scan_parallel(fd, &job);
+        snap_end(&view);
+        if (rc != NO_ERROR || !report_consistent(&rep))
+            (*bad)++;
+    }
+    double t = now_sec() - t0;
+    *wps = (shared->writes - w0) / t;
+
+    shared->stop = 1;
+    int status;
+    waitpid(writer, &status, 0);
+    close_db(fd);
+    free(rep.gpa);
+    munmap(shared, sizeof(*shared));
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? t / reports : -1;
+}
+
+/*
+ *  load_db
+ *      *path:  database file to create
+ *      n:      number of students, ids 1 to n
+ *
+ *  Writes every record with gpa 0 in one run.
+ *
+ *  returns:  true on success
+ */
+static bool load_db(char *path, int n)
+{
+    student_t *recs = calloc(n, sizeof(student_t));
+    int fd = open_db(path, true);
+    bool ok = (recs != NULL && fd >= 0);
+    for (int i = 0; ok && i < n; i++)
+    {
+        recs[i].id = MIN_STD_ID + i;
+        strcpy(recs[i].fname, "snap");
+        strcpy(recs[i].lname, "bench");
+    }
+    if (ok)
+        ok = store_write_run(fd, MIN_STD_ID, recs, n) == NO_ERROR;
+    if (fd >= 0 && close_db(fd) != NO_ERROR)
+        ok = false;
+    free(recs);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    char *path = (argc > 1) ? argv[1] : BENCH_DEF_FILE;
+    int n = (argc > 2) ? atoi(argv[2]) : BENCH_DEF_STUDENTS;
+    int reports = (argc > 3) ? atoi(argv[3]) : BENCH_DEF_REPORTS;
+    const char *modes[] = {"cow", "lock"};
+    int rc = 0;
+
+    if (n < 1 || n > MAX_STD_ID || reports < 1 || !load_db(path, n))
+    {
+        printf("Cant create benchmark db %s\n", path);
+        return 1;
+    }
+
+    printf("%d reports over %d students while one writer rewrites them\n", reports, n);
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+    {
+        int bad;
+        double wps;
+        setenv(SDB_SNAP_ENV, modes[i], 1);
+        double t = run_reports(path, n, reports, &bad, &wps);
+        if (t < 0)
+        {
+            printf("%-5s FAILED\n", modes[i]);
+            rc = 1;
+            continue;
+        }
+        printf("%-5s %8.2f ms/report %12.0f writes/sec  %d inconsistent (%s)\n",
+               modes[i], t * 1e3, wps, bad, bad == 0 ? "ok" : "FAILED");
+        if (bad != 0)
+            rc = 1;
+    }
+
+    char sidecar[4096];
+    const char *exts[] = {"", ".occ", ".gpa", ".sum", ".snap", ".seq", ".lidx", ".wal", ".pgv"};
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); i++)
+    {
+        snprintf(sidecar, sizeof(sidecar), "%s%s", path, exts[i]);
+        unlink(sidecar);
+    }
+    return rc;
+}
@@ -31,5 +31,6 @@ static const int DELETED_STUDENT_ID = 0;
 
 #define DB_FILE     "student.db"            //name of database file
 #define TMP_DB_FILE ".tmp_student.db"       //for extra credit
+#define TMP_DB_PREFIX ".tmp_"               //compaction copy of any db file
 
 #endif
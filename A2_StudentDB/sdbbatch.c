@@ -0,0 +1,339 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdbbatch.h"
+
+//One id of the batch and where its record goes, sorted by id
+typedef struct batch_slot {
+    int id;
+    int idx;
+} batch_slot_t;
+
+//A run of consecutive ids read with one vectored read
+typedef struct batch_run {
+    int             first_id;
+    int             nvec;
+    struct iovec    *iov;
+} batch_run_t;
+
+static int cmp_slot(const void *a, const void *b)
+{
+    const batch_slot_t *sa = a;
+    const batch_slot_t *sb = b;
+    return (sa->id > sb->id) - (sa->id < sb->id);
+}
+
+/*
+ *  ring_destroy
+ *      *r:  ring from ring_create(), may be NULL
+ */
+static void ring_destroy(batch_ring_t *r)
+{
+    if (r == NULL)
+        return;
+    if (r->sqes != NULL && r->sqes != MAP_FAILED)
+        munmap(r->sqes, r->sqes_len);
+    if (r->cq_ptr != NULL && r->cq_ptr != MAP_FAILED && r->cq_ptr != r->sq_ptr)
+        munmap(r->cq_ptr, r->cq_len);
+    if (r->sq_ptr != NULL && r->sq_ptr != MAP_FAILED)
+        munmap(r->sq_ptr, r->sq_len);
+    if (r->fd != -1)
+        close(r->fd);
+    free(r);
+}
+
+/*
+ *  ring_create
+ *
+ *  Sets up an io_uring of SDB_BATCH_DEPTH entries and maps its submission
+ *  queue, completion queue and submission entries.
+ *
+ *  returns:  the ring, or NULL if io_uring is not available
+ */
+static batch_ring_t *ring_create(void)
+{
+    struct io_uring_params p;
+    batch_ring_t *r = calloc(1, sizeof(*r));
+    if (r == NULL)
+        return NULL;
+
+    memset(&p, 0, sizeof(p));
+    r->fd = syscall(__NR_io_uring_setup, SDB_BATCH_DEPTH, &p);
+    if (r->fd == -1)
+    {
+        free(r);
+        return NULL;
+    }
+
+    r->entries = p.sq_entries;
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (r->cq_len > r->sq_len)
+            r->sq_len = r->cq_len;
+        r->cq_len = r->sq_len;
+    }
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     r->fd, IORING_OFF_SQ_RING);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        r->cq_ptr = r->sq_ptr;
+    else
+        r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         r->fd, IORING_OFF_CQ_RING);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   r->fd, IORING_OFF_SQES);
+    if (r->sq_ptr == MAP_FAILED || r->cq_ptr == MAP_FAILED || r->sqes == MAP_FAILED)
+    {
+        ring_destroy(r);
+        return NULL;
+    }
+
+    char *sq = r->sq_ptr;
+    char *cq = r->cq_ptr;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return r;
+}
+
+/*
+ *  read_run
+ *      fd:    database file descriptor
+ *      *run:  run to read
+ *
+ *  Reads a run with preadv(), the fallback backend and the retry path for
+ *  a read the ring could not complete.  Slots past the end of the file are
+ *  left empty.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int read_run(int fd, batch_run_t *run)
+{
+    off_t offset = (off_t)run->first_id * STUDENT_RECORD_SIZE;
+    ssize_t n;
+    do
+        n = preadv(fd, run->iov, run->nvec, offset);
+    while (n == -1 && errno == EINTR);
+    return (n == -1) ? ERR_DB_FILE : NO_ERROR;
+}
+
+/*
+ *  ring_read
+ *      r:      ring
+ *      fd:     database file descriptor
+ *      *runs:  runs to read
+ *      nruns:  number of runs
+ *
+ *  Keeps up to r->entries vectored reads in flight, topping the submission
+ *  queue up every time completions are reaped.  A read that fails or comes
+ *  back short is redone with preadv().
+ *
+ *  returns:  NO_ERROR       every run read
+ *            ERR_DB_OP      the ring stopped working, the caller should
+ *                           destroy it and read the batch with preadv()
+ *            ERR_DB_FILE    database file I/O issue
+ */
+static int ring_read(batch_ring_t *r, int fd, batch_run_t *runs, int nruns)
+{
+    int next = 0;
+    int done = 0;
+    unsigned inflight = 0;
+    unsigned unsubmitted = 0;
+    int rc = NO_ERROR;
+
+    while (done < nruns)
+    {
+        unsigned tail = *r->sq_tail;
+        while (next < nruns && inflight < r->entries)
+        {
+            unsigned idx = tail & *r->sq_mask;
+            struct io_uring_sqe *sqe = &r->sqes[idx];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READV;
+            sqe->fd = fd;
+            sqe->addr = (uint64_t)(uintptr_t)runs[next].iov;
+            sqe->len = runs[next].nvec;
+            sqe->off = (uint64_t)runs[next].first_id * STUDENT_RECORD_SIZE;
+            sqe->user_data = next;
+            r->sq_array[idx] = idx;
+            tail++;
+            next++;
+            inflight++;
+            unsubmitted++;
+        }
+        __atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+
+        int ret = syscall(__NR_io_uring_enter, r->fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret == -1)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                continue;
+            rc = ERR_DB_OP;
+            break;
+        }
+        unsubmitted -= ret;
+
+        unsigned head = *r->cq_head;
+        while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+        {
+            struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            batch_run_t *run = &runs[cqe->user_data];
+            size_t want = (size_t)run->nvec * STUDENT_RECORD_SIZE;
+            if ((cqe->res < 0 || (size_t)cqe->res < want) && read_run(fd, run) != NO_ERROR)
+                rc = ERR_DB_FILE;
+            head++;
+            inflight--;
+            done++;
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    if (rc == ERR_DB_OP)
+    {
+        // wait out the reads the kernel already has before the caller tears
+        // the ring down and gives the buffers back
+        while (inflight > unsubmitted &&
+               syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) != -1)
+        {
+            unsigned head = *r->cq_head;
+            while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+            {
+                head++;
+                inflight--;
+            }
+            __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+        }
+    }
+    return rc;
+}
+
+/*
+ *  batch_backend
+ *      st:  engine state
+ *
+ *  Picks the backend the first time a batch is read, creating the ring
+ *  unless SDB_BATCH_ENV asks for preadv().
+ *
+ *  returns:  SDB_BATCH_URING or SDB_BATCH_PREADV
+ */
+static int batch_backend(db_store_t *st)
+{
+    if (st->batch_io == SDB_BATCH_UNSET)
+    {
+        char *want = getenv(SDB_BATCH_ENV);
+        st->batch_io = SDB_BATCH_PREADV;
+        if (want == NULL || strcmp(want, "preadv") != 0)
+        {
+            st->ring = ring_create();
+            if (st->ring != NULL)
+                st->batch_io = SDB_BATCH_URING;
+        }
+    }
+    return st->batch_io;
+}
+
+/*
+ *  batch_read
+ *      st:    engine state of a direct layout database
+ *      *ids:  ids to read, in any order, duplicates allowed
+ *      n:     number of ids
+ *      *out:  out[i] receives the slot of ids[i]
+ *
+ *  Ids outside the capacity and slots past the end of the file come back
+ *  as empty records.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int batch_read(db_store_t *st, const int *ids, int n, student_t *out)
+{
+    batch_slot_t *slots = malloc((size_t)n * sizeof(batch_slot_t));
+    struct iovec *iov = malloc((size_t)n * sizeof(struct iovec));
+    batch_run_t *runs = malloc((size_t)n * sizeof(batch_run_t));
+    int nslots = 0;
+    int nruns = 0;
+    int rc = NO_ERROR;
+
+    if (slots == NULL || iov == NULL || runs == NULL)
+    {
+        rc = ERR_DB_FILE;
+        goto done;
+    }
+
+    memset(out, 0, (size_t)n * STUDENT_RECORD_SIZE);
+    for (int i = 0; i < n; i++)
+    {
+        if (ids[i] >= MIN_STD_ID && ids[i] <= st->capacity)
+        {
+            slots[nslots].id = ids[i];
+            slots[nslots++].idx = i;
+        }
+    }
+    qsort(slots, nslots, sizeof(batch_slot_t), cmp_slot);
+
+    for (int i = 0; i < nslots; i++)
+    {
+        batch_run_t *run = (nruns > 0) ? &runs[nruns - 1] : NULL;
+        if (run == NULL || slots[i].id != run->first_id + run->nvec ||
+            run->nvec == SDB_BATCH_RUN_MAX)
+        {
+            run = &runs[nruns++];
+            run->first_id = slots[i].id;
+            run->nvec = 0;
+            run->iov = &iov[i];
+        }
+        run->iov[run->nvec].iov_base = &out[slots[i].idx];
+        run->iov[run->nvec++].iov_len = STUDENT_RECORD_SIZE;
+    }
+
+    if (batch_backend(st) == SDB_BATCH_URING)
+    {
+        rc = ring_read(st->ring, st->fd, runs, nruns);
+        if (rc != ERR_DB_OP)
+            goto done;
+        ring_destroy(st->ring);
+        st->ring = NULL;
+        st->batch_io = SDB_BATCH_PREADV;
+        rc = NO_ERROR;
+    }
+    for (int i = 0; rc == NO_ERROR && i < nruns; i++)
+        rc = read_run(st->fd, &runs[i]);
+
+done:
+    free(runs);
+    free(iov);
+    free(slots);
+    return rc;
+}
+
+/*
+ *  batch_detach
+ *      st:  engine state
+ *
+ *  Tears down the ring, if one was created.
+ */
+void batch_detach(db_store_t *st)
+{
+    ring_destroy(st->ring);
+    st->ring = NULL;
+    st->batch_io = SDB_BATCH_UNSET;
+}
@@ -0,0 +1,53 @@
+#ifndef __SDB_BATCH_H__
+#define __SDB_BATCH_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+#include "sdbstore.h"
+
+//Batched record reads for get_students().  The ids are sorted, runs of
+//consecutive ids become one vectored read each, and the reads are kept in
+//flight SDB_BATCH_DEPTH at a time on an io_uring so the device sees a full
+//queue instead of one request at a time.  Kernels or sandboxes without
+//io_uring get the same runs read one after the other with preadv().
+#define SDB_BATCH_DEPTH     64
+#define SDB_BATCH_RUN_MAX   64
+
+//Ids a caller with an unbounded id list hands to get_students() at a time
+#define SDB_BATCH_IDS       4096
+
+//Environment variable used to force the backend, "uring" (default) or "preadv"
+#define SDB_BATCH_ENV       "SDB_BATCH_IO"
+
+#define SDB_BATCH_UNSET     0
+#define SDB_BATCH_URING     1
+#define SDB_BATCH_PREADV    2
+
+//An io_uring set up with io_uring_setup() and its three shared mappings,
+//created the first time a process reads a batch and kept until close_db().
+typedef struct batch_ring {
+    int                 fd;
+    unsigned            entries;
+    unsigned            *sq_head;
+    unsigned            *sq_tail;
+    unsigned            *sq_mask;
+    unsigned            *sq_array;
+    unsigned            *cq_head;
+    unsigned            *cq_tail;
+    unsigned            *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void                *sq_ptr;
+    void                *cq_ptr;
+    size_t              sq_len;
+    size_t              cq_len;
+    size_t              sqes_len;
+} batch_ring_t;
+
+//prototypes for batched reads
+int batch_read(db_store_t *st, const int *ids, int n, student_t *out);
+void batch_detach(db_store_t *st);
+
+#endif
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdbbitmap.h"
+#include "sdbscan.h"
+
+/*
+ *  occ_valid
+ *      st:  engine state with the sidecar mapped
+ *      sb:  stat of the database file
+ *
+ *  returns:  true if the sidecar header matches this database file and,
+ *            in the direct layout, no bit is set for an id past the end of
+ *            the file
+ */
+static bool occ_valid(db_store_t *st, struct stat *sb)
+{
+    occ_header_t *hdr = st->occ_hdr;
+    if (hdr->magic != SDB_OCC_MAGIC || hdr->version != SDB_OCC_VERSION ||
+        hdr->nbits != (uint64_t)st->occ_nwords * 64 ||
+        hdr->db_ino != (uint64_t)sb->st_ino || hdr->db_dev != (uint64_t)sb->st_dev)
+        return false;
+    if (st->layout != SDB_LAYOUT_DIRECT)
+        return true;
+
+    long nbits = (long)st->occ_nwords * 64;
+    long first_beyond = sb->st_size / STUDENT_RECORD_SIZE;
+    return occ_next(st, (int)(first_beyond < nbits ? first_beyond : nbits)) == -1;
+}
+
+/*
+ *  occ_attach
+ *      st:               engine state of a freshly opened database
+ *      should_truncate:  the database was just emptied
+ *
+ *  Maps the occupancy sidecar sized for st->capacity, creating or growing
+ *  it if needed.  A missing, foreign or stale sidecar is rebuilt with one
+ *  scan of the database file.  If the sidecar cannot be created the
+ *  database still works, callers fall back to scanning when st->occ is NULL.
+ *
+ *  returns:  NO_ERROR       sidecar attached (or unavailable)
+ *            ERR_DB_FILE    database file I/O issue during the rebuild
+ */
+int occ_attach(db_store_t *st, bool should_truncate)
+{
+    int nwords = (int)(((long)st->capacity + 1 + 63) / 64);
+    size_t len = sizeof(occ_header_t) + (size_t)nwords * sizeof(uint64_t);
+    char path[SDB_PATH_MAX];
+    struct stat sb, isb;
+
+    if (fstat(st->fd, &sb) == -1)
+        return ERR_DB_FILE;
+    if (snprintf(path, sizeof(path), "%s%s", st->path, SDB_OCC_EXT) >= (int)sizeof(path))
+        return NO_ERROR;
+
+    int flags = O_RDWR | O_CREAT;
+    if (should_truncate)
+        flags |= O_TRUNC;
+    int fd = open(path, flags, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (fd == -1)
+        return NO_ERROR;
+
+    // a process that grew the database may already have grown the sidecar
+    if (fstat(fd, &isb) == 0 && isb.st_size > (off_t)len &&
+        (isb.st_size - sizeof(occ_header_t)) % sizeof(uint64_t) == 0)
+    {
+        len = isb.st_size;
+        nwords = (len - sizeof(occ_header_t)) / sizeof(uint64_t);
+    }
+    if (ftruncate(fd, len) == -1)
+    {
+        close(fd);
+        return NO_ERROR;
+    }
+    void *base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NO_ERROR;
+
+    st->occ_hdr = base;
+    st->occ = (uint64_t *)((char *)base + sizeof(occ_header_t));
+    st->occ_nwords = nwords;
+    st->occ_len = len;
+
+    // Growing the id space only adds empty ids, which the zero filled tail
+    // of the file already describes.
+    if (st->occ_hdr->magic == SDB_OCC_MAGIC && st->occ_hdr->nbits < (uint64_t)nwords * 64)
+        st->occ_hdr->nbits = (uint64_t)nwords * 64;
+
+    if (occ_valid(st, &sb))
+        return NO_ERROR;
+
+    st->occ_hdr->magic = SDB_OCC_MAGIC;
+    st->occ_hdr->version = SDB_OCC_VERSION;
+    st->occ_hdr->nbits = (uint64_t)nwords * 64;
+    st->occ_hdr->db_ino = sb.st_ino;
+    st->occ_hdr->db_dev = sb.st_dev;
+    return occ_rebuild(st);
+}
+
+/*
+ *  occ_detach
+ *      st:  engine state
+ *
+ *  Unmaps the sidecar, the kernel writes back the shared pages.
+ */
+void occ_detach(db_store_t *st)
+{
+    if (st->occ_hdr != NULL)
+        munmap(st->occ_hdr, st->occ_len);
+    st->occ_hdr = NULL;
+    st->occ = NULL;
+}
+
+/*
+ *  occ_update
+ *      st:  engine state
+ *      id:  slot that was just written
+ *      *s:  record now stored in the slot
+ *
+ *  Sets the bit of id for a live record and clears it for an empty one.
+ */
+void occ_update(db_store_t *st, int id, const student_t *s)
+{
+    if (st == NULL || st->occ == NULL || id < 0 || id >= st->occ_nwords * 64)
+        return;
+
+    uint64_t bit = 1ULL << (id % 64);
+    if (memcmp(s, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0)
+        __atomic_fetch_or(&st->occ[id / 64], bit, __ATOMIC_RELAXED);
+    else
+        __atomic_fetch_and(&st->occ[id / 64], ~bit, __ATOMIC_RELAXED);
+}
+
+/*
+ *  occ_rebuild
+ *      st:  engine state with the sidecar mapped
+ *
+ *  Recomputes every bit from a block scan of the database file.
+ *
+ *  returns:  NO_ERROR       bitmap rebuilt
+ *            ERR_DB_FILE    database file I/O issue
+ */
+int occ_rebuild(db_store_t *st)
+{
+    if (st->occ == NULL)
+        return NO_ERROR;
+
+    memset(st->occ, 0, (size_t)st->occ_nwords * sizeof(uint64_t));
+
+    scan_iter_t it;
+    student_t *rec;
+    if (scan_open(&it, st->fd) != NO_ERROR)
+        return ERR_DB_FILE;
+    while ((rec = scan_next(&it)) != NULL)
+        occ_update(st, rec->id, rec);
+    return scan_close(&it);
+}
+
+/*
+ *  occ_count
+ *      st:  engine state with the sidecar mapped
+ *
+ *  returns:  number of live records, one popcount per 64 ids
+ */
+int occ_count(db_store_t *st)
+{
+    int count = 0;
+    for (int w = 0; w < st->occ_nwords; w++)
+        count += __builtin_popcountll(st->occ[w]);
+    return count;
+}
+
+/*
+ *  occ_next
+ *      st:    engine state with the sidecar mapped
+ *      from:  first id to consider
+ *
+ *  returns:  the smallest live id >= from, or -1 if there is none
+ */
+int occ_next(db_store_t *st, int from)
+{
+    if (from < 0)
+        from = 0;
+    int w = from / 64;
+    if (w >= st->occ_nwords)
+        return -1;
+
+    uint64_t word = st->occ[w] & (~0ULL << (from % 64));
+    while (word == 0)
+    {
+        if (++w == st->occ_nwords)
+            return -1;
+        word = st->occ[w];
+    }
+    return w * 64 + __builtin_ctzll(word);
+}
@@ -0,0 +1,36 @@
+#ifndef __SDB_BITMAP_H__
+#define __SDB_BITMAP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdbstore.h"
+
+//The occupancy bitmap is a sidecar file next to the database holding one bit
+//per student id, bit set means the slot holds a live record.  It is mapped
+//shared and updated with atomic bit operations from store_write_slot() and
+//store_write_run() so concurrent sdbsc processes see each others updates.
+#define SDB_OCC_EXT         ".occ"
+#define SDB_OCC_MAGIC       0x3143434fu     // "OCC1"
+#define SDB_OCC_VERSION     1
+
+//Sidecar file header, the bitmap words follow it.  The inode and device of
+//the database file are recorded so a sidecar left behind by a deleted or
+//replaced database is detected and rebuilt.
+typedef struct occ_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t nbits;
+    uint64_t db_ino;
+    uint64_t db_dev;
+} occ_header_t;
+
+//prototypes for the occupancy bitmap
+int occ_attach(db_store_t *st, bool should_truncate);
+void occ_detach(db_store_t *st);
+void occ_update(db_store_t *st, int id, const student_t *s);
+int occ_rebuild(db_store_t *st);
+int occ_count(db_store_t *st);
+int occ_next(db_store_t *st, int from);
+
+#endif
@@ -0,0 +1,345 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdbcache.h"
+
+/*
+ *  pgv_attach
+ *      st:               engine state of a freshly opened database
+ *      should_truncate:  the database was just emptied
+ *
+ *  Maps the page version sidecar sized for st->capacity, creating or
+ *  growing it if needed.  Versions are never reset while the database file
+ *  stays the same, emptying it bumps every page instead so other processes
+ *  drop what they cached.
+ */
+static void pgv_attach(db_store_t *st, bool should_truncate)
+{
+    int npages = st->capacity / SDB_CACHE_SLOTS + 1;
+    size_t len = sizeof(pgv_header_t) + (size_t)npages * sizeof(uint64_t);
+    char path[SDB_PATH_MAX];
+    struct stat sb, isb;
+
+    if (fstat(st->fd, &sb) == -1 ||
+        snprintf(path, sizeof(path), "%s%s", st->path, SDB_PGV_EXT) >= (int)sizeof(path))
+        return;
+
+    int fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (fd == -1)
+        return;
+
+    // a process that grew the database may already have grown the sidecar
+    if (fstat(fd, &isb) == 0 && isb.st_size > (off_t)len &&
+        (isb.st_size - sizeof(pgv_header_t)) % sizeof(uint64_t) == 0)
+    {
+        len = isb.st_size;
+        npages = (len - sizeof(pgv_header_t)) / sizeof(uint64_t);
+    }
+    if (ftruncate(fd, len) == -1)
+    {
+        close(fd);
+        return;
+    }
+    void *base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return;
+
+    st->pgv_hdr = base;
+    st->pgv = (uint64_t *)((char *)base + sizeof(pgv_header_t));
+    st->pgv_npages = npages;
+    st->pgv_len = len;
+
+    pgv_header_t *hdr = st->pgv_hdr;
+    if (hdr->magic != SDB_PGV_MAGIC || hdr->version != SDB_PGV_VERSION ||
+        hdr->db_ino != (uint64_t)sb.st_ino || hdr->db_dev != (uint64_t)sb.st_dev)
+    {
+        memset(st->pgv, 0, (size_t)npages * sizeof(uint64_t));
+        hdr->magic = SDB_PGV_MAGIC;
+        hdr->version = SDB_PGV_VERSION;
+        hdr->db_ino = sb.st_ino;
+        hdr->db_dev = sb.st_dev;
+    }
+    else if (should_truncate)
+    {
+        for (int p = 0; p < npages; p++)
+            __atomic_fetch_add(&st->pgv[p], PGV_WRITE_DONE + 1, __ATOMIC_RELEASE);
+    }
+    hdr->npages = npages;
+}
+
+/*
+ *  cache_attach
+ *      st:               engine state of a freshly opened database
+ *      should_truncate:  the database was just emptied
+ *
+ *  Attaches the page version sidecar, which every process writing a direct
+ *  layout database keeps current, and sets up the page cache if this
+ *  process reads through the pread engine.  Without the sidecar there is no
+ *  cache, reads go to the file as before.
+ *
+ *  returns:  NO_ERROR
+ */
+int cache_attach(db_store_t *st, bool should_truncate)
+{
+    if (st->layout != SDB_LAYOUT_DIRECT)
+        return NO_ERROR;
+    pgv_attach(st, should_truncate);
+
+    char *env = getenv(SDB_CACHE_ENV);
+    int nframes = (env != NULL) ? atoi(env) : SDB_CACHE_DEFAULT;
+    if (st->pgv == NULL || st->engine != SDB_ENGINE_PREAD || nframes <= 0)
+        return NO_ERROR;
+
+    page_cache_t *c = calloc(1, sizeof(*c));
+    if (c == NULL)
+        return NO_ERROR;
+    c->nbuckets = 1;
+    while (c->nbuckets < 2 * nframes)
+        c->nbuckets *= 2;
+    c->nframes = nframes;
+    c->frames = malloc((size_t)nframes * sizeof(cache_frame_t));
+    c->bucket = malloc((size_t)c->nbuckets * sizeof(int));
+    if (c->frames == NULL || c->bucket == NULL)
+    {
+        free(c->frames);
+        free(c->bucket);
+        free(c);
+        return NO_ERROR;
+    }
+    memset(c->bucket, -1, (size_t)c->nbuckets * sizeof(int));
+    st->cache = c;
+    return NO_ERROR;
+}
+
+/*
+ *  cache_detach
+ *      st:  engine state
+ *
+ *  Frees the cached pages and unmaps the page version sidecar.
+ */
+void cache_detach(db_store_t *st)
+{
+    page_cache_t *c = st->cache;
+    if (c != NULL)
+    {
+        free(c->frames);
+        free(c->bucket);
+        free(c);
+    }
+    st->cache = NULL;
+
+    if (st->pgv_hdr != NULL)
+        munmap(st->pgv_hdr, st->pgv_len);
+    st->pgv_hdr = NULL;
+    st->pgv = NULL;
+}
+
+static int bucket_of(page_cache_t *c, int page)
+{
+    return (int)(((uint32_t)page * 0x9e3779b1u) & (uint32_t)(c->nbuckets - 1));
+}
+
+/*
+ *  find_frame
+ *      c:     page cache
+ *      page:  page number
+ *
+ *  returns:  the frame holding page, or NULL if it is not cached
+ */
+static cache_frame_t *find_frame(page_cache_t *c, int page)
+{
+    for (int f = c->bucket[bucket_of(c, page)]; f != -1; f = c->frames[f].next)
+    {
+        if (c->frames[f].page == page)
+            return &c->frames[f];
+    }
+    return NULL;
+}
+
+/*
+ *  unlink_frame
+ *      c:  page cache
+ *      f:  index of a filled frame
+ *
+ *  Removes the frame from its hash chain.
+ */
+static void unlink_frame(page_cache_t *c, int f)
+{
+    int *link = &c->bucket[bucket_of(c, c->frames[f].page)];
+    while (*link != f)
+        link = &c->frames[*link].next;
+    *link = c->frames[f].next;
+}
+
+/*
+ *  claim_frame
+ *      c:     page cache
+ *      page:  page about to be cached
+ *
+ *  Takes an unused frame while there is one, otherwise advances the CLOCK
+ *  hand, giving every referenced frame a second chance, and evicts the
+ *  first one that was not used since the hand last passed it.
+ *
+ *  returns:  the frame, already chained under page
+ */
+static cache_frame_t *claim_frame(page_cache_t *c, int page)
+{
+    int f;
+    if (c->nused < c->nframes)
+        f = c->nused++;
+    else
+    {
+        while (c->frames[c->hand].ref)
+        {
+            c->frames[c->hand].ref = false;
+            c->hand = (c->hand + 1) % c->nframes;
+        }
+        f = c->hand;
+        c->hand = (c->hand + 1) % c->nframes;
+        unlink_frame(c, f);
+    }
+
+    cache_frame_t *fr = &c->frames[f];
+    int b = bucket_of(c, page);
+    fr->page = page;
+    fr->next = c->bucket[b];
+    c->bucket[b] = f;
+    return fr;
+}
+
+static uint64_t page_version(db_store_t *st, int page)
+{
+    return __atomic_load_n(&st->pgv[page], __ATOMIC_ACQUIRE);
+}
+
+/*
+ *  cache_get
+ *      st:  engine state
+ *      id:  student id
+ *      *s:  receives the slot contents on a hit
+ *
+ *  Looks the slot up without any lock or system call.  A page is only used
+ *  if nobody has written to it since it was cached.
+ *
+ *  returns:  true on a hit, false if the caller has to read the file
+ */
+bool cache_get(db_store_t *st, int id, student_t *s)
+{
+    page_cache_t *c = st->cache;
+    int page = id / SDB_CACHE_SLOTS;
+    if (c == NULL || id < MIN_STD_ID || page >= st->pgv_npages)
+        return false;
+
+    cache_frame_t *fr = find_frame(c, page);
+    if (fr == NULL || fr->ver != page_version(st, page))
+    {
+        c->misses++;
+        return false;
+    }
+    *s = fr->recs[id % SDB_CACHE_SLOTS];
+    fr->ref = true;
+    c->hits++;
+    return true;
+}
+
+/*
+ *  cache_read
+ *      st:  engine state with a page cache
+ *      id:  student id
+ *      *s:  receives the slot contents
+ *
+ *  Reads the whole page holding id and caches it if no writer was inside
+ *  the page while it was read.  Slots past the end of the file read as
+ *  empty records.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int cache_read(db_store_t *st, int id, student_t *s)
+{
+    page_cache_t *c = st->cache;
+    int page = id / SDB_CACHE_SLOTS;
+    student_t recs[SDB_CACHE_SLOTS];
+
+    uint64_t before = (page < st->pgv_npages) ? page_version(st, page) : 1;
+    ssize_t got = pread(st->fd, recs, SDB_CACHE_PAGE_SIZE, (off_t)page * SDB_CACHE_PAGE_SIZE);
+    if (got == -1)
+        return ERR_DB_FILE;
+    memset((char *)recs + got, 0, SDB_CACHE_PAGE_SIZE - got);
+    *s = recs[id % SDB_CACHE_SLOTS];
+
+    if (PGV_WRITERS(before) != 0 || page_version(st, page) != before)
+        return NO_ERROR;
+
+    cache_frame_t *fr = find_frame(c, page);
+    if (fr == NULL)
+        fr = claim_frame(c, page);
+    memcpy(fr->recs, recs, SDB_CACHE_PAGE_SIZE);
+    fr->ver = before;
+    fr->ref = true;
+    return NO_ERROR;
+}
+
+/*
+ *  cache_begin_write
+ *      st:        engine state
+ *      first_id:  first of n consecutive slots about to be written
+ *      n:         number of slots
+ *
+ *  Marks a writer inside every page of the range, no process caches these
+ *  pages until cache_end_write().
+ */
+void cache_begin_write(db_store_t *st, int first_id, int n)
+{
+    if (st->pgv == NULL)
+        return;
+    int last = (first_id + n - 1) / SDB_CACHE_SLOTS;
+    for (int p = first_id / SDB_CACHE_SLOTS; p <= last && p < st->pgv_npages; p++)
+        __atomic_fetch_add(&st->pgv[p], 1, __ATOMIC_ACQ_REL);
+}
+
+/*
+ *  cache_end_write
+ *      st:        engine state
+ *      first_id:  first of n consecutive slots just written
+ *      *recs:     contents now in the data file
+ *      n:         number of slots
+ *
+ *  Publishes a new version of every page of the range.  A page this
+ *  process has cached is updated in place if this write is the only change
+ *  since it was read, otherwise it stays stale until it is read again.
+ *  recs is NULL after a failed write, which leaves the pages stale.
+ */
+void cache_end_write(db_store_t *st, int first_id, const student_t *recs, int n)
+{
+    if (st->pgv == NULL)
+        return;
+    int last = (first_id + n - 1) / SDB_CACHE_SLOTS;
+    for (int p = first_id / SDB_CACHE_SLOTS; p <= last && p < st->pgv_npages; p++)
+    {
+        uint64_t ver = __atomic_add_fetch(&st->pgv[p], PGV_WRITE_DONE, __ATOMIC_ACQ_REL);
+        cache_frame_t *fr = (st->cache != NULL) ? find_frame(st->cache, p) : NULL;
+        if (fr == NULL || recs == NULL || fr->ver + PGV_WRITE_DONE + 1 != ver)
+            continue;
+
+        int lo = p * SDB_CACHE_SLOTS;
+        int hi = lo + SDB_CACHE_SLOTS;
+        if (lo < first_id)
+            lo = first_id;
+        if (hi > first_id + n)
+            hi = first_id + n;
+        memcpy(&fr->recs[lo % SDB_CACHE_SLOTS], &recs[lo - first_id],
+               (size_t)(hi - lo) * STUDENT_RECORD_SIZE);
+        fr->ver = ver;
+    }
+}
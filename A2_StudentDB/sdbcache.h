@@ -0,0 +1,74 @@
+#ifndef __SDB_CACHE_H__
+#define __SDB_CACHE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdbstore.h"
+
+//The page cache keeps recently read 4KB pages of the database (64 record
+//slots each) in process memory for the pread engine, so repeated lookups of
+//the same ids stop costing a lock and a pread() each.  It holds a fixed
+//number of pages, evicted in CLOCK order.  Writes made by this process go
+//through to the cached page.
+#define SDB_CACHE_SLOTS     64
+#define SDB_CACHE_PAGE_SIZE (SDB_CACHE_SLOTS * sizeof(student_t))
+
+//Environment variable with the number of cached pages, 0 disables the cache
+#define SDB_CACHE_ENV       "SDB_CACHE_PAGES"
+#define SDB_CACHE_DEFAULT   1024
+
+//Writes by other processes are noticed through the page version sidecar,
+//one 64 bit word per page mapped shared by every process.  The low half
+//counts writers inside the page, the high half is bumped when a write
+//finishes.  A cached page is only used while the word still has the value
+//it had when the page was read, with no writer inside, so a hit needs no
+//lock and no system call.
+#define SDB_PGV_EXT         ".pgv"
+#define SDB_PGV_MAGIC       0x31564750u     // "PGV1"
+#define SDB_PGV_VERSION     1
+#define PGV_WRITERS(v)      ((uint32_t)(v))
+#define PGV_WRITE_DONE      ((1ULL << 32) - 1)
+
+//Sidecar file header, the version words follow it.  See occ_header_t for
+//the reason the database inode and device are recorded.
+typedef struct pgv_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t npages;
+    uint64_t db_ino;
+    uint64_t db_dev;
+} pgv_header_t;
+
+//One cached page.  ver is the version word the page was read under, next
+//chains frames that share a hash bucket, -1 ends the chain.
+typedef struct cache_frame {
+    int         page;
+    int         next;
+    bool        ref;
+    uint64_t    ver;
+    student_t   recs[SDB_CACHE_SLOTS];
+} cache_frame_t;
+
+//Cache state for one database.  bucket heads the frame chains, nbuckets
+//is a power of two.  hand is the CLOCK hand, nused frames have been filled.
+typedef struct page_cache {
+    cache_frame_t   *frames;
+    int             nframes;
+    int             nused;
+    int             hand;
+    int             *bucket;
+    int             nbuckets;
+    uint64_t        hits;
+    uint64_t        misses;
+} page_cache_t;
+
+//prototypes for the page cache
+int cache_attach(db_store_t *st, bool should_truncate);
+void cache_detach(db_store_t *st);
+bool cache_get(db_store_t *st, int id, student_t *s);
+int cache_read(db_store_t *st, int id, student_t *s);
+void cache_begin_write(db_store_t *st, int first_id, int n);
+void cache_end_write(db_store_t *st, int first_id, const student_t *recs, int n);
+
+#endif
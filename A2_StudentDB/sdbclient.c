@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbclient.h"
+
+/*
+ *  client_connect
+ *      *sock_path:  socket a server started with -S listens on
+ *
+ *  returns:  connected socket, or ERR_DB_FILE
+ */
+int client_connect(const char *sock_path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(sock_path) >= sizeof(addr.sun_path))
+        return ERR_DB_FILE;
+    strcpy(addr.sun_path, sock_path);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1)
+        return ERR_DB_FILE;
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+        close(sock);
+        return ERR_DB_FILE;
+    }
+    return sock;
+}
+
+/*
+ *  recv_response
+ *      sock:   connected socket
+ *      *resp:  next response frame
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE if the connection broke
+ */
+static int recv_response(int sock, sdb_response_t *resp)
+{
+    ssize_t n;
+    do
+        n = recv(sock, resp, sizeof(*resp), MSG_WAITALL);
+    while (n == -1 && errno == EINTR);
+    return (n == sizeof(*resp)) ? NO_ERROR : ERR_DB_FILE;
+}
+
+/*
+ *  call
+ *      sock:   connected socket
+ *      op:     SDB_OP_* request
+ *      id:     student id, if the request takes one
+ *      *rec:   record to send, may be NULL
+ *      *resp:  response frame
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE if the connection broke
+ */
+static int call(int sock, int op, int id, const student_t *rec, sdb_response_t *resp)
+{
+    sdb_request_t req;
+    memset(&req, 0, sizeof(req));
+    req.op = op;
+    req.id = id;
+    if (rec != NULL)
+        req.rec = *rec;
+
+    if (send(sock, &req, sizeof(req), MSG_NOSIGNAL) != sizeof(req))
+        return ERR_DB_FILE;
+    return recv_response(sock, resp);
+}
+
+/*
+ *  client_get
+ *      sock:  connected socket
+ *      id:    the student id we are looking for
+ *      *s:    where the located student is copied
+ *
+ *  returns:  NO_ERROR, SRCH_NOT_FOUND or ERR_DB_FILE, as get_student()
+ */
+int client_get(int sock, int id, student_t *s)
+{
+    sdb_response_t resp;
+    if (call(sock, SDB_OP_GET, id, NULL, &resp) != NO_ERROR)
+        return ERR_DB_FILE;
+    if (resp.status == NO_ERROR)
+        *s = resp.rec;
+    return resp.status;
+}
+
+/*
+ *  client_add
+ *      sock:   connected socket
+ *      id, fname, lname, gpa:  the new student, as add_student()
+ *
+ *  returns:  NO_ERROR, ERR_DB_OP (already exists or out of range) or
+ *            ERR_DB_FILE
+ */
+int client_add(int sock, int id, char *fname, char *lname, int gpa)
+{
+    student_t s;
+    sdb_response_t resp;
+
+    memset(&s, 0, sizeof(s));
+    s.id = id;
+    strncpy(s.fname, fname, sizeof(s.fname) - 1);
+    strncpy(s.lname, lname, sizeof(s.lname) - 1);
+    s.gpa = gpa;
+    if (call(sock, SDB_OP_ADD, id, &s, &resp) != NO_ERROR)
+        return ERR_DB_FILE;
+    return resp.status;
+}
+
+/*
+ *  client_del
+ *      sock:  connected socket
+ *      id:    student id to be deleted
+ *
+ *  returns:  NO_ERROR, ERR_DB_OP (not found) or ERR_DB_FILE, as
+ *            del_student()
+ */
+int client_del(int sock, int id)
+{
+    sdb_response_t resp;
+    if (call(sock, SDB_OP_DEL, id, NULL, &resp) != NO_ERROR)
+        return ERR_DB_FILE;
+    return resp.status;
+}
+
+/*
+ *  client_count
+ *      sock:  connected socket
+ *
+ *  returns:  number of records, or ERR_DB_FILE
+ */
+int client_count(int sock)
+{
+    sdb_response_t resp;
+    if (call(sock, SDB_OP_COUNT, 0, NULL, &resp) != NO_ERROR)
+        return ERR_DB_FILE;
+    return (resp.status == NO_ERROR) ? resp.value : resp.status;
+}
+
+/*
+ *  client_print
+ *      sock:   connected socket
+ *      **recs: malloc'd array of every record in id order
+ *
+ *  returns:  number of records, or ERR_DB_FILE
+ */
+int client_print(int sock, student_t **recs)
+{
+    sdb_response_t resp;
+    int cap = 1024;
+    int n = 0;
+
+    *recs = malloc(cap * sizeof(student_t));
+    if (*recs == NULL || call(sock, SDB_OP_PRINT, 0, NULL, &resp) != NO_ERROR)
+    {
+        free(*recs);
+        return ERR_DB_FILE;
+    }
+    while (resp.status == SDB_STATUS_MORE)
+    {
+        if (n == cap)
+        {
+            student_t *grown = realloc(*recs, 2 * cap * sizeof(student_t));
+            if (grown == NULL)
+                break;
+            *recs = grown;
+            cap *= 2;
+        }
+        (*recs)[n++] = resp.rec;
+        if (recv_response(sock, &resp) != NO_ERROR)
+            break;
+    }
+    if (resp.status != NO_ERROR)
+    {
+        free(*recs);
+        *recs = NULL;
+        return ERR_DB_FILE;
+    }
+    return n;
+}
@@ -0,0 +1,17 @@
+#ifndef __SDB_CLIENT_H__
+#define __SDB_CLIENT_H__
+
+#include "db.h" //get student record type
+#include "sdbserver.h"
+
+//Client side of the server mode protocol.  Each call is one round trip on
+//a socket returned by client_connect(), the return codes are the ones of
+//the matching sdbsc.c function.
+int client_connect(const char *sock_path);
+int client_get(int sock, int id, student_t *s);
+int client_add(int sock, int id, char *fname, char *lname, int gpa);
+int client_del(int sock, int id);
+int client_count(int sock);
+int client_print(int sock, student_t **recs);
+
+#endif
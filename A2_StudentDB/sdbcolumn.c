@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdbcolumn.h"
+#include "sdbscan.h"
+
+/*
+ *  gpa_valid
+ *      st:  engine state with the sidecar mapped
+ *      sb:  stat of the database file
+ *
+ *  returns:  true if the sidecar header matches this database file and,
+ *            in the direct layout, no gpa is recorded for an id past the
+ *            end of the file
+ */
+static bool gpa_valid(db_store_t *st, struct stat *sb)
+{
+    gpa_header_t *hdr = st->gpa_hdr;
+    if (hdr->magic != SDB_GPA_MAGIC || hdr->version != SDB_GPA_VERSION ||
+        hdr->nslots != (uint64_t)st->gpa_nslots ||
+        hdr->db_ino != (uint64_t)sb->st_ino || hdr->db_dev != (uint64_t)sb->st_dev)
+        return false;
+    if (st->layout != SDB_LAYOUT_DIRECT)
+        return true;
+
+    long first_beyond = sb->st_size / STUDENT_RECORD_SIZE;
+    for (long id = first_beyond; id < st->gpa_nslots; id++)
+    {
+        if (st->gpa_col[id] != GPA_COL_EMPTY)
+            return false;
+    }
+    return true;
+}
+
+/*
+ *  gpa_attach
+ *      st:               engine state of a freshly opened database
+ *      should_truncate:  the database was just emptied
+ *
+ *  Maps the gpa column sized for st->capacity, creating or growing it if
+ *  needed.  A missing, foreign or stale column is rebuilt with one scan of
+ *  the database file.  If the column cannot be created the database still
+ *  works, gpa queries fall back to scanning when st->gpa_col is NULL.
+ *
+ *  returns:  NO_ERROR       column attached (or unavailable)
+ *            ERR_DB_FILE    database file I/O issue during the rebuild
+ */
+int gpa_attach(db_store_t *st, bool should_truncate)
+{
+    int nslots = st->capacity + 1;
+    size_t len = sizeof(gpa_header_t) + (size_t)nslots * sizeof(int16_t);
+    char path[SDB_PATH_MAX];
+    struct stat sb, isb;
+
+    if (fstat(st->fd, &sb) == -1)
+        return ERR_DB_FILE;
+    if (snprintf(path, sizeof(path), "%s%s", st->path, SDB_GPA_EXT) >= (int)sizeof(path))
+        return NO_ERROR;
+
+    int flags = O_RDWR | O_CREAT;
+    if (should_truncate)
+        flags |= O_TRUNC;
+    int fd = open(path, flags, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (fd == -1)
+        return NO_ERROR;
+
+    // a process that grew the database may already have grown the column
+    if (fstat(fd, &isb) == 0 && isb.st_size > (off_t)len &&
+        (isb.st_size - sizeof(gpa_header_t)) % sizeof(int16_t) == 0)
+    {
+        len = isb.st_size;
+        nslots = (len - sizeof(gpa_header_t)) / sizeof(int16_t);
+    }
+    if (ftruncate(fd, len) == -1)
+    {
+        close(fd);
+        return NO_ERROR;
+    }
+    void *base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NO_ERROR;
+
+    st->gpa_hdr = base;
+    st->gpa_col = (int16_t *)((char *)base + sizeof(gpa_header_t));
+    st->gpa_nslots = nslots;
+    st->gpa_len = len;
+
+    // Growing the id space only adds empty ids, mark the new tail of the
+    // column empty rather than rebuilding it.
+    if (st->gpa_hdr->magic == SDB_GPA_MAGIC && st->gpa_hdr->nslots < (uint64_t)nslots)
+    {
+        for (int id = (int)st->gpa_hdr->nslots; id < nslots; id++)
+            st->gpa_col[id] = GPA_COL_EMPTY;
+        st->gpa_hdr->nslots = nslots;
+    }
+
+    if (gpa_valid(st, &sb))
+        return NO_ERROR;
+
+    st->gpa_hdr->magic = SDB_GPA_MAGIC;
+    st->gpa_hdr->version = SDB_GPA_VERSION;
+    st->gpa_hdr->nslots = nslots;
+    st->gpa_hdr->db_ino = sb.st_ino;
+    st->gpa_hdr->db_dev = sb.st_dev;
+    return gpa_rebuild(st);
+}
+
+/*
+ *  gpa_detach
+ *      st:  engine state
+ *
+ *  Unmaps the column, the kernel writes back the shared pages.
+ */
+void gpa_detach(db_store_t *st)
+{
+    if (st->gpa_hdr != NULL)
+        munmap(st->gpa_hdr, st->gpa_len);
+    st->gpa_hdr = NULL;
+    st->gpa_col = NULL;
+}
+
+/*
+ *  gpa_update
+ *      st:  engine state
+ *      id:  slot that was just written
+ *      *s:  record now stored in the slot
+ *
+ *  Stores the gpa of a live record, GPA_COL_EMPTY for an empty slot.  The
+ *  16 bit store is atomic so concurrent readers see the old or new value.
+ */
+void gpa_update(db_store_t *st, int id, const student_t *s)
+{
+    if (st == NULL || st->gpa_col == NULL || id < 0 || id >= st->gpa_nslots)
+        return;
+
+    int16_t v = GPA_COL_EMPTY;
+    if (memcmp(s, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0)
+        v = (int16_t)s->gpa;
+    __atomic_store_n(&st->gpa_col[id], v, __ATOMIC_RELAXED);
+}
+
+/*
+ *  gpa_rebuild
+ *      st:  engine state with the column mapped
+ *
+ *  Recomputes the column from a block scan of the database file.
+ *
+ *  returns:  NO_ERROR       column rebuilt
+ *            ERR_DB_FILE    database file I/O issue
+ */
+int gpa_rebuild(db_store_t *st)
+{
+    if (st->gpa_col == NULL)
+        return NO_ERROR;
+
+    for (int id = 0; id < st->gpa_nslots; id++)
+        st->gpa_col[id] = GPA_COL_EMPTY;
+
+    scan_iter_t it;
+    student_t *rec;
+    if (scan_open(&it, st->fd) != NO_ERROR)
+        return ERR_DB_FILE;
+    while ((rec = scan_next(&it)) != NULL)
+        gpa_update(st, rec->id, rec);
+    return scan_close(&it);
+}
+
+/*
+ *  gpa_range
+ *      st:      engine state with the column mapped
+ *      lo, hi:  gpa range, inclusive
+ *      *ids:    filled with the matching ids in id order, room for
+ *               st->gpa_nslots entries, may be NULL
+ *      *stats:  count, sum and histogram of the matching gpas
+ *
+ *  Makes one sequential pass over the column, the records themselves are
+ *  never read.
+ *
+ *  returns:  number of matching ids
+ */
+int gpa_range(db_store_t *st, int lo, int hi, int *ids, gpa_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    for (int id = MIN_STD_ID; id < st->gpa_nslots; id++)
+    {
+        int v = st->gpa_col[id];
+        if (v < lo || v > hi)
+            continue;
+        if (ids != NULL)
+            ids[stats->count] = id;
+        stats->count++;
+        stats->sum += v;
+        stats->hist[(v - MIN_STD_GPA) / GPA_HIST_WIDTH]++;
+    }
+    return stats->count;
+}
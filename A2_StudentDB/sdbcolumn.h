@@ -0,0 +1,49 @@
+#ifndef __SDB_COLUMN_H__
+#define __SDB_COLUMN_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdbstore.h"
+
+//The GPA column is a sidecar file next to the database holding the gpa of
+//every id as a packed int16, GPA_COL_EMPTY for a slot without a record.
+//For MAX_STD_ID ids the column is 200KB against 6.4MB of records, so range
+//queries and aggregates over gpa read a thirtieth of the data a table scan
+//would.  It is mapped shared and kept current from store_write_slot() and
+//store_write_run() like the occupancy bitmap.
+#define SDB_GPA_EXT         ".gpa"
+#define SDB_GPA_MAGIC       0x31415047u     // "GPA1"
+#define SDB_GPA_VERSION     1
+#define GPA_COL_EMPTY       -1
+
+//Width of a histogram bucket in gpa units, 25 is a quarter of a grade point
+#define GPA_HIST_WIDTH      25
+#define GPA_HIST_BUCKETS    ((MAX_STD_GPA - MIN_STD_GPA) / GPA_HIST_WIDTH + 1)
+
+//Sidecar file header, the column follows it.  See occ_header_t for the
+//reason the database inode and device are recorded.
+typedef struct gpa_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t nslots;
+    uint64_t db_ino;
+    uint64_t db_dev;
+} gpa_header_t;
+
+//Aggregates of a gpa range, hist[b] counts gpas in
+//[b * GPA_HIST_WIDTH, (b + 1) * GPA_HIST_WIDTH)
+typedef struct gpa_stats {
+    int         count;
+    long long   sum;
+    int         hist[GPA_HIST_BUCKETS];
+} gpa_stats_t;
+
+//prototypes for the gpa column
+int gpa_attach(db_store_t *st, bool should_truncate);
+void gpa_detach(db_store_t *st);
+void gpa_update(db_store_t *st, int id, const student_t *s);
+int gpa_rebuild(db_store_t *st);
+int gpa_range(db_store_t *st, int lo, int hi, int *ids, gpa_stats_t *stats);
+
+#endif
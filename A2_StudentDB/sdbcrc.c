@@ -0,0 +1,182 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SDB_HAVE_X86_CRC
+#endif
+
+// database include files
+#include "sdbcrc.h"
+
+typedef uint32_t (*crc_fn)(uint32_t crc, const unsigned char *p, size_t len);
+typedef void (*crc_rows_fn)(const unsigned char *p, size_t row_len, int n, uint32_t *out);
+
+static uint32_t crc_table[256];
+
+/*
+ *  crc_bytes_table
+ *
+ *  Portable kernel, one table lookup per byte.  crc is the inverted running
+ *  checksum.
+ */
+static uint32_t crc_bytes_table(uint32_t crc, const unsigned char *p, size_t len)
+{
+    while (len--)
+        crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+/*
+ *  crc_rows_table
+ *
+ *  Portable kernel for crc32c_rows(), one row after the other.
+ */
+static void crc_rows_table(const unsigned char *p, size_t row_len, int n, uint32_t *out)
+{
+    for (int i = 0; i < n; i++, p += row_len)
+        out[i] = ~crc_bytes_table(~0u, p, row_len);
+}
+
+#ifdef SDB_HAVE_X86_CRC
+/*
+ *  crc_bytes_sse42
+ *
+ *  The SSE4.2 crc32 instruction computes CRC-32C eight bytes at a time.
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc_bytes_sse42(uint32_t crc, const unsigned char *p, size_t len)
+{
+    uint64_t c = crc;
+    for (; len >= 8; len -= 8, p += 8)
+    {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        c = _mm_crc32_u64(c, w);
+    }
+    crc = (uint32_t)c;
+    while (len--)
+        crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+
+/*
+ *  crc_rows_sse42
+ *
+ *  crc32 has a latency of three cycles but issues every cycle, so four
+ *  rows are checksummed side by side to keep the unit busy instead of
+ *  waiting on one dependency chain per row.
+ */
+__attribute__((target("sse4.2")))
+static void crc_rows_sse42(const unsigned char *p, size_t row_len, int n, uint32_t *out)
+{
+    int i = 0;
+    if (row_len % 8 == 0)
+    {
+        for (; i + 4 <= n; i += 4, p += 4 * row_len)
+        {
+            uint64_t c0 = ~0u, c1 = ~0u, c2 = ~0u, c3 = ~0u;
+            for (size_t k = 0; k < row_len; k += 8)
+            {
+                uint64_t w0, w1, w2, w3;
+                memcpy(&w0, p + k, 8);
+                memcpy(&w1, p + row_len + k, 8);
+                memcpy(&w2, p + 2 * row_len + k, 8);
+                memcpy(&w3, p + 3 * row_len + k, 8);
+                c0 = _mm_crc32_u64(c0, w0);
+                c1 = _mm_crc32_u64(c1, w1);
+                c2 = _mm_crc32_u64(c2, w2);
+                c3 = _mm_crc32_u64(c3, w3);
+            }
+            out[i] = ~(uint32_t)c0;
+            out[i + 1] = ~(uint32_t)c1;
+            out[i + 2] = ~(uint32_t)c2;
+            out[i + 3] = ~(uint32_t)c3;
+        }
+    }
+    for (; i < n; i++, p += row_len)
+        out[i] = ~crc_bytes_sse42(~0u, p, row_len);
+}
+#endif
+
+static crc_fn crc_impl = NULL;
+static crc_rows_fn crc_rows_impl = NULL;
+static const char *crc_name = "table";
+
+/*
+ *  select_impl
+ *
+ *  Uses the crc32 instruction when the CPU has SSE4.2 unless SDB_CRC_ENV
+ *  asks for the table.
+ */
+static void select_impl(void)
+{
+    const char *want = getenv(SDB_CRC_ENV);
+
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? (c >> 1) ^ 0x82f63b78u : c >> 1;
+        crc_table[i] = c;
+    }
+    crc_rows_impl = crc_rows_table;
+    crc_name = "table";
+
+#ifdef SDB_HAVE_X86_CRC
+    __builtin_cpu_init();
+    if ((want == NULL || strcmp(want, "table") != 0) && __builtin_cpu_supports("sse4.2"))
+    {
+        crc_rows_impl = crc_rows_sse42;
+        crc_name = "sse4.2";
+        crc_impl = crc_bytes_sse42;
+        return;
+    }
+#else
+    (void)want;
+#endif
+    crc_impl = crc_bytes_table;
+}
+
+/*
+ *  crc32c
+ *      crc:   checksum of the data before buf, 0 to start
+ *      *buf:  bytes to checksum
+ *      len:   number of bytes
+ *
+ *  returns:  CRC-32C of everything fed in so far
+ */
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+    if (crc_impl == NULL)
+        select_impl();
+    return ~crc_impl(~crc, buf, len);
+}
+
+/*
+ *  crc32c_rows
+ *      *buf:     n rows of row_len bytes each
+ *      row_len:  size of a row
+ *      n:        number of rows
+ *      *out:     out[i] receives crc32c(0, row i, row_len)
+ */
+void crc32c_rows(const void *buf, size_t row_len, int n, uint32_t *out)
+{
+    if (crc_impl == NULL)
+        select_impl();
+    crc_rows_impl(buf, row_len, n, out);
+}
+
+/*
+ *  crc32c_impl_name
+ *
+ *  returns:  name of the kernel crc32c() dispatches to
+ */
+const char *crc32c_impl_name(void)
+{
+    if (crc_impl == NULL)
+        select_impl();
+    return crc_name;
+}
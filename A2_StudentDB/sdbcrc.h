@@ -0,0 +1,19 @@
+#ifndef __SDB_CRC_H__
+#define __SDB_CRC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//CRC-32C (Castagnoli) used by the write-ahead log, the dump format and the
+//record checksums.  crc32c() continues a running checksum, start with 0 and
+//feed the data in as many pieces as needed.  CPUs with SSE4.2 compute it
+//with the crc32 instruction, others with a lookup table, picked at run
+//time.  SDB_CRC_ENV can force "table".
+#define SDB_CRC_ENV         "SDB_CRC"
+
+//prototypes for the checksum
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+void crc32c_rows(const void *buf, size_t row_len, int n, uint32_t *out);
+const char *crc32c_impl_name(void);
+
+#endif
@@ -0,0 +1,423 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdbscan.h"
+#include "sdbfmt.h"
+#include "sdbcrc.h"
+#include "sdbsnap.h"
+#include "sdblock.h"
+#include "sdbdump.h"
+
+_Static_assert(sizeof(dump_header_t) == sizeof(student_t), "dump header must be one row");
+_Static_assert(sizeof(dump_trailer_t) == sizeof(student_t), "dump trailer must be one row");
+
+//Header line of a CSV export, bulk_load() skips it
+#define DUMP_CSV_HEADER     "id,first_name,last_name,gpa\n"
+
+//Rows of one scan partition and how many there are
+typedef struct dump_part {
+    out_buf_t   out;
+    int         count;
+} dump_part_t;
+
+//Where an export goes and what has been written so far
+typedef struct dump_export {
+    bool        binary;
+    out_buf_t   *out;
+    uint32_t    crc;
+    int         count;
+} dump_export_t;
+
+/*
+ *  export_part
+ *      *it:   iterator over one partition
+ *      *ctx:  dump_part_t receiving the rows
+ *      *arg:  dump_export_t, for the format
+ *
+ *  returns:  NO_ERROR, or ERR_DB_FILE if the rows could not be buffered
+ */
+static int export_part(scan_iter_t *it, void *ctx, void *arg)
+{
+    dump_part_t *part = ctx;
+    dump_export_t *exp = arg;
+    student_t *rec;
+
+    if (out_open(&part->out, -1) != NO_ERROR)
+        return ERR_DB_FILE;
+    while ((rec = scan_next(it)) != NULL)
+    {
+        if (exp->binary)
+            out_bytes(&part->out, (const char *)rec, STUDENT_RECORD_SIZE);
+        else
+            out_csv(&part->out, rec);
+        part->count++;
+    }
+    return part->out.error;
+}
+
+/*
+ *  export_merge
+ *      *ctx:  dump_part_t filled by export_part()
+ *      *arg:  dump_export_t
+ *      rc:    status of the scan so far
+ *
+ *  Appends the partition to the export, folding binary rows into the
+ *  checksum.
+ *
+ *  returns:  NO_ERROR, or ERR_DB_FILE if the export could not be written
+ */
+static int export_merge(void *ctx, void *arg, int rc)
+{
+    dump_part_t *part = ctx;
+    dump_export_t *exp = arg;
+
+    if (rc == NO_ERROR)
+    {
+        if (exp->binary)
+            exp->crc = crc32c(exp->crc, part->out.buf, part->out.len);
+        out_bytes(exp->out, part->out.buf, part->out.len);
+        exp->count += part->count;
+        rc = exp->out->error;
+    }
+    out_close(&part->out);
+    return rc;
+}
+
+/*
+ *  export_db
+ *      fd:      database file descriptor
+ *      binary:  write the binary dump format (sdbdump.h) instead of CSV
+ *      *path:   file to write, or "-" for stdout
+ *
+ *  Streams every live record out in one parallel scan, SDB_OUT_BUF_SIZE
+ *  per write() and no system call per record.  CSV rows are the
+ *  "id,first_name,last_name,gpa" rows bulk_load() reads.  The scan reads a
+ *  snapshot (see sdbsnap.h) so the export is a consistent copy while
+ *  writers carry on.
+ *
+ *  returns:  <number>       number of students exported
+ *            ERR_DB_FILE    database or output file I/O issue
+ *
+ *  console:  M_DUMP_EXPORTED when writing to a file, M_ERR_DUMP_OPEN or
+ *            M_ERR_DB_READ on error
+ */
+int export_db(int fd, bool binary, char *path)
+{
+    bool to_stdout = (strcmp(path, "-") == 0);
+    int out_fd = to_stdout ? fileno(stdout)
+                           : open(path, O_WRONLY | O_CREAT | O_TRUNC,
+                                  S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    out_buf_t out;
+    dump_export_t exp = {binary, &out, 0, 0};
+    snap_view_t view;
+
+    if (out_fd == -1)
+    {
+        printf(M_ERR_DUMP_OPEN, path);
+        return ERR_DB_FILE;
+    }
+    if (out_open(&out, out_fd) != NO_ERROR ||
+        snap_begin(fd, &view) != NO_ERROR)
+    {
+        out_close(&out);
+        if (!to_stdout)
+            close(out_fd);
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    if (binary)
+    {
+        dump_header_t hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.magic = SDB_DUMP_MAGIC;
+        hdr.version = SDB_DUMP_VERSION;
+        hdr.record_size = STUDENT_RECORD_SIZE;
+        hdr.capacity = store_capacity(fd);
+        exp.crc = crc32c(0, &hdr, sizeof(hdr));
+        out_bytes(&out, (const char *)&hdr, sizeof(hdr));
+    }
+    else
+        out_bytes(&out, DUMP_CSV_HEADER, strlen(DUMP_CSV_HEADER));
+
+    scan_job_t job = {export_part, export_merge, sizeof(dump_part_t), &exp, &view, 0};
+    int rc = scan_parallel(fd, &job);
+    snap_end(&view);
+
+    if (rc == NO_ERROR && binary)
+    {
+        dump_trailer_t trailer;
+        memset(&trailer, 0, sizeof(trailer));
+        trailer.magic = SDB_DUMP_END_MAGIC;
+        trailer.crc = exp.crc;
+        trailer.nrecords = exp.count;
+        out_bytes(&out, (const char *)&trailer, sizeof(trailer));
+    }
+    if (out_close(&out) != NO_ERROR || (!to_stdout && close(out_fd) == -1))
+    {
+        printf(M_ERR_DUMP_OPEN, path);
+        return ERR_DB_FILE;
+    }
+    if (rc != NO_ERROR)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    if (!to_stdout)
+        printf(M_DUMP_EXPORTED, exp.count, path);
+    return exp.count;
+}
+
+/*
+ *  dump_read_all
+ *      in_fd:  file descriptor to read to the end
+ *      *len:   receives the number of bytes read
+ *
+ *  Reads SDB_DUMP_READ_SIZE at a time, for inputs that may be pipes.
+ *
+ *  returns:  malloc()ed contents, or NULL on a read or allocation error
+ */
+char *dump_read_all(int in_fd, size_t *len)
+{
+    size_t cap = SDB_DUMP_READ_SIZE;
+    char *buf = malloc(cap);
+    *len = 0;
+
+    while (buf != NULL)
+    {
+        if (cap - *len < SDB_DUMP_READ_SIZE)
+        {
+            char *grown = realloc(buf, cap * 2);
+            if (grown == NULL)
+                break;
+            buf = grown;
+            cap *= 2;
+        }
+        ssize_t n = read(in_fd, buf + *len, SDB_DUMP_READ_SIZE);
+        if (n == 0)
+            return buf;
+        if (n == -1 && errno != EINTR)
+            break;
+        if (n > 0)
+            *len += n;
+    }
+    free(buf);
+    return NULL;
+}
+
+/*
+ *  read_full
+ *      in_fd:  file descriptor to read, possibly a pipe
+ *      *buf:   where the bytes go
+ *      len:    bytes wanted
+ *
+ *  returns:  bytes read, less than len only at the end of the input, or -1
+ *            on a read error
+ */
+static ssize_t read_full(int in_fd, char *buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len)
+    {
+        ssize_t n = read(in_fd, buf + got, len - got);
+        if (n == 0)
+            break;
+        if (n == -1 && errno != EINTR)
+            return -1;
+        if (n > 0)
+            got += n;
+    }
+    return got;
+}
+
+/*
+ *  import_rows
+ *      fd:         database file descriptor
+ *      *rows:      records of the dump, validated and loaded in place
+ *      n:          number of records
+ *      first:      number of records of the dump before these
+ *      *added:     one bit per id, set for every record loaded
+ *      *rejected:  incremented for every record rejected
+ *
+ *  returns:  number of records loaded, or ERR_DB_FILE
+ *
+ *  console:  M_ERR_DUMP_REC for each record out of range and
+ *            M_ERR_DB_ADD_DUP for each id already taken
+ */
+static int import_rows(int fd, student_t *rows, int n, int first, uint64_t *added, int *rejected)
+{
+    int capacity = store_capacity(fd);
+    int nrows = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (validate_range(rows[i].id, rows[i].gpa) != NO_ERROR || rows[i].id > capacity)
+        {
+            printf(M_ERR_DUMP_REC, first + i + 1);
+            (*rejected)++;
+            continue;
+        }
+        rows[nrows++] = rows[i];
+    }
+
+    int loaded = load_rows(fd, rows, nrows, rejected);
+    for (int i = 0; i < loaded; i++)
+        added[rows[i].id / 64] |= 1ULL << (rows[i].id % 64);
+    return loaded;
+}
+
+/*
+ *  drop_added
+ *      fd:        database file descriptor
+ *      *added:    one bit per id, set for every record an import loaded
+ *      capacity:  largest id the bits cover
+ *
+ *  Deletes the records of an import that turned out to be bad.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int drop_added(int fd, const uint64_t *added, int capacity)
+{
+    int rc = NO_ERROR;
+    for (int id = MIN_STD_ID; id <= capacity; id++)
+    {
+        if (!(added[id / 64] & (1ULL << (id % 64))))
+            continue;
+        if (lock_slots(fd, id, 1, SDB_LOCK_WRITE) != NO_ERROR)
+            return ERR_DB_FILE;
+        if (store_write_slot(fd, id, &EMPTY_STUDENT_RECORD) != NO_ERROR)
+            rc = ERR_DB_FILE;
+        unlock_slots(fd, id, 1);
+    }
+    return rc;
+}
+
+/*
+ *  import_db
+ *      fd:      database file descriptor
+ *      binary:  read the binary dump format (sdbdump.h) instead of CSV
+ *      *path:   file to read, or "-" for stdin
+ *
+ *  CSV is loaded by bulk_load().  A binary dump is streamed in
+ *  SDB_DUMP_READ_SIZE pieces, each validated like bulk load rows and loaded
+ *  with the same coalesced window writes while its checksum is added up,
+ *  so memory does not grow with the dump.  When the trailer does not match,
+ *  the records loaded so far are deleted again.  Ids already in the
+ *  database are rejected.
+ *
+ *  returns:  NO_ERROR       every record was loaded
+ *            ERR_DB_OP      some records were rejected (the rest were loaded)
+ *            ERR_DB_FILE    database or input file I/O issue, or a bad dump
+ *
+ *  console:  M_ERR_DUMP_OPEN, M_ERR_DUMP_BAD, M_ERR_DUMP_REC for each
+ *            record out of range, M_ERR_DB_ADD_DUP for each id already
+ *            taken and M_DUMP_IMPORTED on completion
+ */
+int import_db(int fd, bool binary, char *path)
+{
+    if (!binary)
+        return bulk_load(fd, path);
+
+    bool from_stdin = (strcmp(path, "-") == 0);
+    int in_fd = from_stdin ? fileno(stdin) : open(path, O_RDONLY);
+    if (in_fd == -1)
+    {
+        printf(M_ERR_DUMP_OPEN, path);
+        return ERR_DB_FILE;
+    }
+
+    // buf holds a read and the record held back from the previous one,
+    // which may be the trailer
+    int capacity = store_capacity(fd);
+    char *buf = malloc(SDB_DUMP_READ_SIZE + STUDENT_RECORD_SIZE);
+    uint64_t *added = calloc((size_t)capacity / 64 + 1, sizeof(uint64_t));
+    dump_header_t hdr;
+    int loaded = 0, rejected = 0, nrecords = 0;
+    bool bad = false;
+    int rc = NO_ERROR;
+
+    if (buf == NULL || added == NULL || read_full(in_fd, (char *)&hdr, sizeof(hdr)) != sizeof(hdr))
+        rc = ERR_DB_FILE;
+    else
+        bad = hdr.magic != SDB_DUMP_MAGIC || hdr.version != SDB_DUMP_VERSION ||
+              hdr.record_size != sizeof(student_t);
+    uint32_t crc = crc32c(0, &hdr, sizeof(hdr));
+
+    size_t have = 0;
+    while (rc == NO_ERROR && !bad)
+    {
+        ssize_t n = read_full(in_fd, buf + have, SDB_DUMP_READ_SIZE);
+        if (n == -1)
+        {
+            rc = ERR_DB_FILE;
+            break;
+        }
+        have += n;
+        if (n < SDB_DUMP_READ_SIZE)
+            break;
+
+        // every whole record but the last is a row
+        int nrows = (int)(have / STUDENT_RECORD_SIZE) - 1;
+        size_t len = (size_t)nrows * STUDENT_RECORD_SIZE;
+        crc = crc32c(crc, buf, len);
+        int stored = import_rows(fd, (student_t *)buf, nrows, nrecords, added, &rejected);
+        if (stored < 0)
+            rc = ERR_DB_FILE;
+        loaded += stored;
+        nrecords += nrows;
+        have -= len;
+        memmove(buf, buf + len, have);
+    }
+
+    // what is left is the last rows and the trailer
+    if (rc == NO_ERROR && !bad)
+    {
+        bad = have < sizeof(dump_trailer_t) || have % STUDENT_RECORD_SIZE != 0;
+        int nrows = bad ? 0 : (int)(have / STUDENT_RECORD_SIZE) - 1;
+        size_t len = (size_t)nrows * STUDENT_RECORD_SIZE;
+        dump_trailer_t trailer;
+        if (!bad)
+        {
+            memcpy(&trailer, buf + len, sizeof(trailer));
+            crc = crc32c(crc, buf, len);
+            bad = trailer.magic != SDB_DUMP_END_MAGIC ||
+                  trailer.nrecords != (uint64_t)nrecords + nrows || trailer.crc != crc;
+        }
+        if (!bad)
+        {
+            int stored = import_rows(fd, (student_t *)buf, nrows, nrecords, added, &rejected);
+            if (stored < 0)
+                rc = ERR_DB_FILE;
+            loaded += stored;
+        }
+    }
+    if (!from_stdin)
+        close(in_fd);
+
+    // a dump that does not check out leaves the database as it was
+    if (rc != NO_ERROR || bad)
+    {
+        if (added != NULL && loaded > 0 && drop_added(fd, added, capacity) != NO_ERROR)
+            printf(M_ERR_DB_WRITE);
+        printf(bad ? M_ERR_DUMP_BAD : M_ERR_DUMP_OPEN, path);
+        rc = ERR_DB_FILE;
+    }
+    else
+    {
+        printf(M_DUMP_IMPORTED, loaded, rejected);
+        rc = (rejected > 0) ? ERR_DB_OP : NO_ERROR;
+    }
+    free(added);
+    free(buf);
+    return rc;
+}
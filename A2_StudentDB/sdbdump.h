@@ -0,0 +1,44 @@
+#ifndef __SDB_DUMP_H__
+#define __SDB_DUMP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "db.h" //get student record type
+
+//Binary dump format written by export_db() and read by import_db().  A
+//dump is a header, the live records as raw student_t rows in scan order
+//and a trailer, each exactly one record long, so the rows can be copied
+//between files, pipes and sockets with sendfile() or splice() untouched.
+//The trailer carries the record count and a CRC-32C of everything before
+//it, an interrupted or damaged dump is rejected as a whole.
+#define SDB_DUMP_MAGIC      0x504d4453u     // "SDMP"
+#define SDB_DUMP_END_MAGIC  0x454d4453u     // "SDME"
+#define SDB_DUMP_VERSION    1
+
+//Read size of import_db()
+#define SDB_DUMP_READ_SIZE  (1024 * 1024)
+
+//First row of a dump.  capacity is the id capacity of the exported
+//database, informational only.
+typedef struct dump_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+    uint64_t capacity;
+    uint8_t  pad[40];
+} dump_header_t;
+
+//Last row of a dump
+typedef struct dump_trailer {
+    uint32_t magic;
+    uint32_t crc;
+    uint64_t nrecords;
+    uint8_t  pad[48];
+} dump_trailer_t;
+
+//prototypes for the dump reader
+char *dump_read_all(int in_fd, size_t *len);
+
+#endif
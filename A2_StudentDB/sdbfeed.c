@@ -0,0 +1,472 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdbscan.h"
+#include "sdblock.h"
+#include "sdbfmt.h"
+#include "sdbcrc.h"
+#include "sdbsnap.h"
+#include "sdbdump.h"
+#include "sdbfeed.h"
+
+_Static_assert(sizeof(feed_entry_t) == 8, "feed entry header must be 8 bytes");
+
+//Longest entry, its header and two full names
+#define FEED_ENTRY_MAX      (sizeof(feed_entry_t) + 24 + 32)
+
+//Entries of one scan partition of a full feed and how many there are
+typedef struct feed_part {
+    out_buf_t   out;
+    int         count;
+} feed_part_t;
+
+//Where a feed goes and what has been written so far
+typedef struct feed_stream {
+    out_buf_t   *out;
+    uint32_t    crc;
+    int         count;
+} feed_stream_t;
+
+/*
+ *  feed_format
+ *      *dst:  at least FEED_ENTRY_MAX bytes
+ *      id:    id the entry is for
+ *      *s:    its record, NULL or an empty record if it was deleted
+ *
+ *  returns:  number of bytes written to dst
+ */
+static size_t feed_format(char *dst, int id, const student_t *s)
+{
+    feed_entry_t e = {id, FEED_DELETED, 0, 0};
+    if (s != NULL && memcmp(s, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0)
+    {
+        e.gpa = (int16_t)s->gpa;
+        e.flen = (uint8_t)strnlen(s->fname, sizeof(s->fname));
+        e.llen = (uint8_t)strnlen(s->lname, sizeof(s->lname));
+        memcpy(dst + sizeof(e), s->fname, e.flen);
+        memcpy(dst + sizeof(e) + e.flen, s->lname, e.llen);
+    }
+    memcpy(dst, &e, sizeof(e));
+    return sizeof(e) + e.flen + e.llen;
+}
+
+/*
+ *  feed_put
+ *      *fs:  feed being written
+ *      id:   id the entry is for
+ *      *s:   its record, NULL or an empty record if it was deleted
+ */
+static void feed_put(feed_stream_t *fs, int id, const student_t *s)
+{
+    char entry[FEED_ENTRY_MAX];
+    size_t len = feed_format(entry, id, s);
+    fs->crc = crc32c(fs->crc, entry, len);
+    out_bytes(fs->out, entry, len);
+    fs->count++;
+}
+
+/*
+ *  feed_part
+ *      *it:   iterator over one partition
+ *      *ctx:  feed_part_t receiving the entries
+ *      *arg:  unused
+ *
+ *  returns:  NO_ERROR, or ERR_DB_FILE if the entries could not be buffered
+ */
+static int feed_part(scan_iter_t *it, void *ctx, void *arg)
+{
+    feed_part_t *part = ctx;
+    student_t *rec;
+    char entry[FEED_ENTRY_MAX];
+    (void)arg;
+
+    if (out_open(&part->out, -1) != NO_ERROR)
+        return ERR_DB_FILE;
+    while ((rec = scan_next(it)) != NULL)
+    {
+        out_bytes(&part->out, entry, feed_format(entry, rec->id, rec));
+        part->count++;
+    }
+    return part->out.error;
+}
+
+/*
+ *  feed_merge
+ *      *ctx:  feed_part_t filled by feed_part()
+ *      *arg:  feed_stream_t
+ *      rc:    status of the scan so far
+ *
+ *  Appends the partition to the feed, folding it into the checksum.
+ *
+ *  returns:  NO_ERROR, or ERR_DB_FILE if the feed could not be written
+ */
+static int feed_merge(void *ctx, void *arg, int rc)
+{
+    feed_part_t *part = ctx;
+    feed_stream_t *fs = arg;
+
+    if (rc == NO_ERROR)
+    {
+        fs->crc = crc32c(fs->crc, part->out.buf, part->out.len);
+        out_bytes(fs->out, part->out.buf, part->out.len);
+        fs->count += part->count;
+        rc = fs->out->error;
+    }
+    out_close(&part->out);
+    return rc;
+}
+
+/*
+ *  feed_changed
+ *      *view:  snapshot to read the records from
+ *      since:  sequence number the feed starts after
+ *      *fs:    feed being written
+ *
+ *  Streams every id whose last change is numbered above since, as its
+ *  record in the snapshot.  An id changed again after the snapshot goes
+ *  out as of the snapshot and is numbered above upto, so the next feed
+ *  sends it again.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int feed_changed(snap_view_t *view, uint64_t since, feed_stream_t *fs)
+{
+    db_store_t *st = view->st;
+    student_t s;
+
+    for (int id = MIN_STD_ID; id < st->seq_nslots; id++)
+    {
+        if (__atomic_load_n(&st->seqs[id], __ATOMIC_ACQUIRE) <= since)
+            continue;
+        int rc = snap_read(view, id, &s);
+        if (rc == ERR_DB_FILE)
+            return ERR_DB_FILE;
+        feed_put(fs, id, (rc == NO_ERROR) ? &s : NULL);
+    }
+    return fs->out->error;
+}
+
+/*
+ *  change_feed
+ *      fd:     database file descriptor
+ *      since:  sequence number the replica is at, 0 for everything
+ *      *path:  file to write, or "-" for stdout
+ *
+ *  Streams the changes numbered above since in the feed format (see
+ *  sdbfeed.h), read from a snapshot so writers carry on.  The last number
+ *  handed out is taken first and the snapshot waits for the writes in
+ *  flight, so every change up to it is in the feed.  If since is older
+ *  than the sidecar's base_seq (or newer than anything handed out, a
+ *  replica of an older incarnation) every live record is sent with
+ *  FEED_FULL instead.  Only the changed ids are read, the sequence column
+ *  is all a feed scans.
+ *
+ *  returns:  <number>       number of entries streamed
+ *            ERR_DB_FILE    database or output file I/O issue, or no
+ *                           change sequence
+ *
+ *  console:  M_FEED_STREAMED when writing to a file, M_ERR_NO_SEQ,
+ *            M_ERR_FEED_OPEN or M_ERR_DB_READ on error
+ */
+int change_feed(int fd, unsigned long long since, char *path)
+{
+    db_store_t *st = store_lookup(fd);
+    if (st == NULL || st->seq_hdr == NULL)
+    {
+        printf(M_ERR_NO_SEQ);
+        return ERR_DB_FILE;
+    }
+
+    bool to_stdout = (strcmp(path, "-") == 0);
+    int out_fd = to_stdout ? fileno(stdout) : open(path, O_WRONLY | O_CREAT | O_TRUNC,
+                                                   S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    out_buf_t out;
+    feed_stream_t fs = {&out, 0, 0};
+    snap_view_t view;
+
+    if (out_fd == -1)
+    {
+        printf(M_ERR_FEED_OPEN, path);
+        return ERR_DB_FILE;
+    }
+    if (out_open(&out, out_fd) != NO_ERROR)
+    {
+        if (!to_stdout)
+            close(out_fd);
+        printf(M_ERR_FEED_OPEN, path);
+        return ERR_DB_FILE;
+    }
+
+    uint64_t upto = __atomic_load_n(&st->seq_hdr->last_seq, __ATOMIC_SEQ_CST);
+    uint64_t base = __atomic_load_n(&st->seq_hdr->base_seq, __ATOMIC_ACQUIRE);
+    feed_header_t hdr = {SDB_FEED_MAGIC, SDB_FEED_VERSION, 0, 0, since, upto};
+    if (since < base || since > upto)
+        hdr.flags |= FEED_FULL;
+
+    int rc = snap_begin(fd, &view);
+    if (rc == NO_ERROR)
+    {
+        fs.crc = crc32c(0, &hdr, sizeof(hdr));
+        out_bytes(&out, (const char *)&hdr, sizeof(hdr));
+        if (hdr.flags & FEED_FULL)
+        {
+            scan_job_t job = {feed_part, feed_merge, sizeof(feed_part_t), &fs, &view, 0};
+            rc = scan_parallel(fd, &job);
+        }
+        else
+            rc = feed_changed(&view, since, &fs);
+        snap_end(&view);
+    }
+    if (rc == NO_ERROR)
+    {
+        feed_trailer_t trailer = {SDB_FEED_END_MAGIC, fs.crc, (uint64_t)fs.count};
+        out_bytes(&out, (const char *)&trailer, sizeof(trailer));
+    }
+    if (out_close(&out) != NO_ERROR || (!to_stdout && close(out_fd) == -1))
+    {
+        printf(M_ERR_FEED_OPEN, path);
+        return ERR_DB_FILE;
+    }
+    if (rc != NO_ERROR)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    if (!to_stdout)
+        printf(M_FEED_STREAMED, fs.count, (unsigned long long)since, (unsigned long long)upto, path);
+    return fs.count;
+}
+
+/*
+ *  check_feed
+ *      *buf:  whole feed
+ *      len:   its length
+ *
+ *  returns:  true if the header, checksum and entries are consistent and
+ *            the entries end at the trailer
+ */
+static bool check_feed(const char *buf, size_t len)
+{
+    if (len < sizeof(feed_header_t) + sizeof(feed_trailer_t))
+        return false;
+
+    const feed_header_t *hdr = (const feed_header_t *)buf;
+    feed_trailer_t trailer;
+    size_t end = len - sizeof(trailer);
+    memcpy(&trailer, buf + end, sizeof(trailer));
+    if (hdr->magic != SDB_FEED_MAGIC || hdr->version != SDB_FEED_VERSION ||
+        trailer.magic != SDB_FEED_END_MAGIC || trailer.crc != crc32c(0, buf, end))
+        return false;
+
+    uint64_t count = 0;
+    size_t pos = sizeof(*hdr);
+    while (pos < end)
+    {
+        feed_entry_t e;
+        if (end - pos < sizeof(e))
+            return false;
+        memcpy(&e, buf + pos, sizeof(e));
+        if (e.flen > sizeof(((student_t *)0)->fname) || e.llen > sizeof(((student_t *)0)->lname))
+            return false;
+        pos += sizeof(e) + e.flen + e.llen;
+        count++;
+    }
+    return pos == end && count == trailer.count;
+}
+
+/*
+ *  apply_change
+ *      fd:  database file descriptor
+ *      id:  id to change
+ *      *s:  its new record, an empty record to delete it
+ *
+ *  Writes the slot under its write lock unless it already holds *s.
+ *
+ *  returns:  1 if the slot was written, 0 if it was unchanged, or
+ *            ERR_DB_FILE
+ */
+static int apply_change(int fd, int id, const student_t *s)
+{
+    student_t cur;
+    if (lock_slots(fd, id, 1, SDB_LOCK_WRITE) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    int rc = store_read_slot(fd, id, &cur);
+    if (rc == SRCH_NOT_FOUND)
+        memset(&cur, 0, sizeof(cur));
+    if (rc != ERR_DB_FILE)
+    {
+        rc = 0;
+        if (memcmp(&cur, s, STUDENT_RECORD_SIZE) != 0)
+            rc = (store_write_slot(fd, id, s) == NO_ERROR) ? 1 : ERR_DB_FILE;
+    }
+    unlock_slots(fd, id, 1);
+    return rc;
+}
+
+/*
+ *  drop_unlisted
+ *      fd:        replica database file descriptor
+ *      *listed:   one flag per id up to capacity, set for the ids a full
+ *                 feed holds
+ *      capacity:  largest id of the replica
+ *      *deleted:  incremented for every record deleted
+ *
+ *  Deletes the live records of the replica a full feed does not list.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int drop_unlisted(int fd, const bool *listed, int capacity, int *deleted)
+{
+    scan_iter_t it;
+    student_t *rec;
+    int *drop = NULL;
+    int ndrop = 0, cap = 0;
+
+    if (scan_open(&it, fd) != NO_ERROR)
+        return ERR_DB_FILE;
+    while ((rec = scan_next(&it)) != NULL)
+    {
+        if (rec->id < MIN_STD_ID || rec->id > capacity || listed[rec->id])
+            continue;
+        if (ndrop == cap)
+        {
+            cap = (cap == 0) ? 1024 : cap * 2;
+            int *grown = realloc(drop, (size_t)cap * sizeof(int));
+            if (grown == NULL)
+                break;
+            drop = grown;
+        }
+        drop[ndrop++] = rec->id;
+    }
+    int rc = scan_close(&it);
+    if (rc == NO_ERROR && rec != NULL)
+        rc = ERR_DB_FILE;
+
+    for (int i = 0; rc == NO_ERROR && i < ndrop; i++)
+    {
+        int changed = apply_change(fd, drop[i], &EMPTY_STUDENT_RECORD);
+        if (changed < 0)
+            rc = ERR_DB_FILE;
+        *deleted += (changed == 1);
+    }
+    free(drop);
+    return rc;
+}
+
+/*
+ *  apply_feed
+ *      fd:     replica database file descriptor
+ *      *path:  feed written by change_feed(), or "-" for stdin
+ *
+ *  Applies a change feed to this database.  The feed is read and checked
+ *  as a whole before anything is written.  Each entry overwrites or
+ *  deletes its id under the slot's write lock, entries the replica already
+ *  matches are skipped, and a full feed first deletes every record it does
+ *  not list.  Applying a feed twice changes nothing.
+ *
+ *  returns:  NO_ERROR       every entry was applied
+ *            ERR_DB_OP      some entries were rejected (the rest were applied)
+ *            ERR_DB_FILE    database or input file I/O issue, or a bad feed
+ *
+ *  console:  M_ERR_FEED_OPEN, M_ERR_FEED_BAD, M_ERR_FEED_REC for each
+ *            entry out of range, M_FEED_APPLIED on completion and
+ *            M_ERR_DB_WRITE on error
+ */
+int apply_feed(int fd, char *path)
+{
+    bool from_stdin = (strcmp(path, "-") == 0);
+    int in_fd = from_stdin ? fileno(stdin) : open(path, O_RDONLY);
+    size_t len = 0;
+    char *buf = (in_fd == -1) ? NULL : dump_read_all(in_fd, &len);
+    if (in_fd != -1 && !from_stdin)
+        close(in_fd);
+    if (buf == NULL)
+    {
+        printf(M_ERR_FEED_OPEN, path);
+        return ERR_DB_FILE;
+    }
+    if (!check_feed(buf, len))
+    {
+        free(buf);
+        printf(M_ERR_FEED_BAD, path);
+        return ERR_DB_FILE;
+    }
+
+    const feed_header_t *hdr = (const feed_header_t *)buf;
+    size_t end = len - sizeof(feed_trailer_t);
+    int capacity = store_capacity(fd);
+    int applied = 0, deleted = 0, rejected = 0, n = 0;
+    int rc = NO_ERROR;
+
+    if (hdr->flags & FEED_FULL)
+    {
+        bool *listed = calloc((size_t)capacity + 1, sizeof(bool));
+        for (size_t pos = sizeof(*hdr); listed != NULL && pos < end; )
+        {
+            feed_entry_t e;
+            memcpy(&e, buf + pos, sizeof(e));
+            if (e.id >= MIN_STD_ID && e.id <= capacity)
+                listed[e.id] = true;
+            pos += sizeof(e) + e.flen + e.llen;
+        }
+        rc = (listed == NULL) ? ERR_DB_FILE : drop_unlisted(fd, listed, capacity, &deleted);
+        free(listed);
+    }
+
+    for (size_t pos = sizeof(*hdr); rc == NO_ERROR && pos < end; n++)
+    {
+        feed_entry_t e;
+        student_t s = {0};
+        memcpy(&e, buf + pos, sizeof(e));
+        pos += sizeof(e);
+        bool del = (e.gpa == FEED_DELETED);
+        if (e.id > capacity || validate_range(e.id, del ? MIN_STD_GPA : e.gpa) != NO_ERROR)
+        {
+            printf(M_ERR_FEED_REC, n + 1);
+            rejected++;
+            pos += e.flen + e.llen;
+            continue;
+        }
+        if (!del)
+        {
+            s.id = e.id;
+            s.gpa = e.gpa;
+            memcpy(s.fname, buf + pos, e.flen);
+            memcpy(s.lname, buf + pos + e.flen, e.llen);
+        }
+        pos += e.flen + e.llen;
+
+        int changed = apply_change(fd, e.id, &s);
+        if (changed < 0)
+            rc = ERR_DB_FILE;
+        else if (changed)
+        {
+            if (del)
+                deleted++;
+            else
+                applied++;
+        }
+    }
+    unsigned long long upto = hdr->upto;
+    free(buf);
+    if (rc != NO_ERROR)
+    {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    printf(M_FEED_APPLIED, applied, deleted, rejected, upto);
+    return (rejected > 0) ? ERR_DB_OP : NO_ERROR;
+}
@@ -0,0 +1,48 @@
+#ifndef __SDB_FEED_H__
+#define __SDB_FEED_H__
+
+#include <stdint.h>
+
+#include "sdbseq.h"
+
+//Change feed.  change_feed() streams the ids changed since a sequence
+//number (see sdbseq.h) in the format below, apply_feed() applies a feed to
+//a replica.  Several changes to one id go out as its latest state only,
+//and a feed asked for from before base_seq resends every live record
+//instead.
+
+//Feed format.  A header, one entry per changed id in id order, each
+//followed by flen + llen bytes of names, and a trailer with the number of
+//entries and a CRC-32C of everything before it.  A deleted id has gpa
+//FEED_DELETED and no names.  With FEED_FULL set the feed holds every live
+//record and the replica drops the ids it does not list.  upto is the
+//sequence number to ask for the next feed from.
+#define SDB_FEED_MAGIC      0x44454653u     // "SFED"
+#define SDB_FEED_END_MAGIC  0x45454653u     // "SFEE"
+#define SDB_FEED_VERSION    1
+#define FEED_FULL           0x1
+#define FEED_DELETED        -1
+
+typedef struct feed_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t since;
+    uint64_t upto;
+} feed_header_t;
+
+typedef struct feed_entry {
+    int32_t  id;
+    int16_t  gpa;
+    uint8_t  flen;
+    uint8_t  llen;
+} feed_entry_t;
+
+typedef struct feed_trailer {
+    uint32_t magic;
+    uint32_t crc;
+    uint64_t count;
+} feed_trailer_t;
+
+#endif
@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbfmt.h"
+
+//%-6d and %-3.2f field widths of STUDENT_PRINT_FMT_STRING
+#define ID_WIDTH    6
+#define GPA_WIDTH   3
+
+/*
+ *  put_uint
+ *      *p:  where to write
+ *      v:   value
+ *
+ *  returns:  pointer past the decimal digits of v
+ */
+static char *put_uint(char *p, unsigned v)
+{
+    char digits[10];
+    int n = 0;
+    do
+    {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v != 0);
+    while (n > 0)
+        *p++ = digits[--n];
+    return p;
+}
+
+/*
+ *  put_field
+ *      *p:     where to write
+ *      *s:     name field, not necessarily NUL terminated
+ *      size:   size of the field, also the printed width and precision
+ *
+ *  returns:  pointer past the field, padded with spaces to size
+ */
+static char *put_field(char *p, const char *s, size_t size)
+{
+    size_t n = strnlen(s, size);
+    memcpy(p, s, n);
+    memset(p + n, ' ', size - n);
+    return p + size;
+}
+
+/*
+ *  format_student
+ *      *dst:  at least SDB_ROW_MAX bytes
+ *      *s:    student to format
+ *
+ *  Renders the row STUDENT_PRINT_FMT_STRING would, without a terminating
+ *  NUL.
+ *
+ *  returns:  length of the row
+ */
+size_t format_student(char *dst, const student_t *s)
+{
+    char *p = dst;
+
+    if (s->id < 0)
+        *p++ = '-';
+    p = put_uint(p, (s->id < 0) ? -(unsigned)s->id : (unsigned)s->id);
+    while (p - dst < ID_WIDTH)
+        *p++ = ' ';
+    *p++ = ' ';
+    p = put_field(p, s->fname, sizeof(s->fname));
+    *p++ = ' ';
+    p = put_field(p, s->lname, sizeof(s->lname));
+    *p++ = ' ';
+
+    char *gpa = p;
+    unsigned g = (s->gpa < 0) ? -(unsigned)s->gpa : (unsigned)s->gpa;
+    if (s->gpa < 0)
+        *p++ = '-';
+    p = put_uint(p, g / 100);
+    *p++ = '.';
+    *p++ = '0' + (g % 100) / 10;
+    *p++ = '0' + g % 10;
+    while (p - gpa < GPA_WIDTH)
+        *p++ = ' ';
+    *p++ = '\n';
+    return p - dst;
+}
+
+/*
+ *  format_csv
+ *      *dst:  at least SDB_ROW_MAX bytes
+ *      *s:    student to format
+ *
+ *  Renders the record as an "id,first_name,last_name,gpa" row, gpa as the
+ *  3 digit int bulk_load() reads back, without a terminating NUL.
+ *
+ *  returns:  length of the row
+ */
+size_t format_csv(char *dst, const student_t *s)
+{
+    char *p = dst;
+    size_t n;
+
+    if (s->id < 0)
+        *p++ = '-';
+    p = put_uint(p, (s->id < 0) ? -(unsigned)s->id : (unsigned)s->id);
+    *p++ = ',';
+    n = strnlen(s->fname, sizeof(s->fname));
+    memcpy(p, s->fname, n);
+    p += n;
+    *p++ = ',';
+    n = strnlen(s->lname, sizeof(s->lname));
+    memcpy(p, s->lname, n);
+    p += n;
+    *p++ = ',';
+    if (s->gpa < 0)
+        *p++ = '-';
+    p = put_uint(p, (s->gpa < 0) ? -(unsigned)s->gpa : (unsigned)s->gpa);
+    *p++ = '\n';
+    return p - dst;
+}
+
+/*
+ *  out_open
+ *      *ob:  output buffer to initialize
+ *      fd:   file descriptor the output goes to, -1 to keep it in memory
+ *
+ *  Anything already buffered by stdio on stdout is flushed first so the
+ *  rows come out after it.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE if the buffer could not be allocated
+ */
+int out_open(out_buf_t *ob, int fd)
+{
+    memset(ob, 0, sizeof(*ob));
+    ob->fd = fd;
+    ob->cap = SDB_OUT_BUF_SIZE;
+    ob->buf = malloc(ob->cap);
+    if (ob->buf == NULL)
+        return ERR_DB_FILE;
+    if (fd == fileno(stdout))
+        fflush(stdout);
+    return NO_ERROR;
+}
+
+/*
+ *  out_reserve
+ *      *ob:   output buffer
+ *      need:  bytes about to be appended
+ *
+ *  Makes room for need bytes, writing the buffer out or growing it.
+ *
+ *  returns:  true if there is room
+ */
+static bool out_reserve(out_buf_t *ob, size_t need)
+{
+    if (ob->cap - ob->len >= need)
+        return true;
+    if (ob->fd != -1)
+        return out_flush(ob) == NO_ERROR && ob->cap >= need;
+
+    size_t cap = ob->cap;
+    while (cap - ob->len < need)
+        cap *= 2;
+    char *buf = realloc(ob->buf, cap);
+    if (buf == NULL)
+    {
+        ob->error = ERR_DB_FILE;
+        return false;
+    }
+    ob->buf = buf;
+    ob->cap = cap;
+    return true;
+}
+
+/*
+ *  out_header
+ *      *ob:  output buffer
+ *
+ *  Appends the STUDENT_PRINT_HDR_STRING header line.
+ */
+void out_header(out_buf_t *ob)
+{
+    char hdr[SDB_ROW_MAX];
+    int n = snprintf(hdr, sizeof(hdr), STUDENT_PRINT_HDR_STRING,
+                     "ID", "FIRST_NAME", "LAST_NAME", "GPA");
+    out_bytes(ob, hdr, n);
+}
+
+/*
+ *  out_student
+ *      *ob:  output buffer
+ *      *s:   student to append as a row
+ */
+void out_student(out_buf_t *ob, const student_t *s)
+{
+    if (ob->error == NO_ERROR && out_reserve(ob, SDB_ROW_MAX))
+        ob->len += format_student(ob->buf + ob->len, s);
+}
+
+/*
+ *  out_csv
+ *      *ob:  output buffer
+ *      *s:   student to append as a CSV row
+ */
+void out_csv(out_buf_t *ob, const student_t *s)
+{
+    if (ob->error == NO_ERROR && out_reserve(ob, SDB_ROW_MAX))
+        ob->len += format_csv(ob->buf + ob->len, s);
+}
+
+/*
+ *  out_bytes
+ *      *ob:    output buffer
+ *      *data:  bytes to append
+ *      len:    number of bytes
+ *
+ *  Output bigger than the buffer of a file descriptor is written straight
+ *  through once the buffer is empty.
+ */
+void out_bytes(out_buf_t *ob, const char *data, size_t len)
+{
+    if (ob->error != NO_ERROR)
+        return;
+    if (ob->fd != -1 && len > ob->cap)
+    {
+        out_buf_t direct = *ob;
+        if (out_flush(ob) != NO_ERROR)
+            return;
+        direct.buf = (char *)data;
+        direct.len = len;
+        ob->error = out_flush(&direct);
+        return;
+    }
+    if (out_reserve(ob, len))
+    {
+        memcpy(ob->buf + ob->len, data, len);
+        ob->len += len;
+    }
+}
+
+/*
+ *  out_flush
+ *      *ob:  output buffer
+ *
+ *  Writes the buffered output with one write() (more only if the kernel
+ *  takes it in pieces).  Memory buffers are left alone.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int out_flush(out_buf_t *ob)
+{
+    size_t done = 0;
+    while (ob->fd != -1 && ob->error == NO_ERROR && done < ob->len)
+    {
+        ssize_t n = write(ob->fd, ob->buf + done, ob->len - done);
+        if (n == -1 && errno != EINTR)
+            ob->error = ERR_DB_FILE;
+        else if (n > 0)
+            done += n;
+    }
+    if (ob->fd != -1)
+        ob->len = 0;
+    return ob->error;
+}
+
+/*
+ *  out_close
+ *      *ob:  output buffer from out_open()
+ *
+ *  Flushes and frees the buffer.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE if any of the output was lost
+ */
+int out_close(out_buf_t *ob)
+{
+    int rc = out_flush(ob);
+    free(ob->buf);
+    ob->buf = NULL;
+    return rc;
+}
@@ -0,0 +1,43 @@
+#ifndef __SDB_FMT_H__
+#define __SDB_FMT_H__
+
+#include <stddef.h>
+
+#include "db.h" //get student record type
+
+//Rows printed by the full table dumps are rendered by hand into a large
+//output buffer instead of going through printf() once per row, and the
+//buffer goes out with one write() when it fills up.  format_student()
+//produces exactly what STUDENT_PRINT_FMT_STRING does for every gpa the
+//database accepts, the gpa is printed as fixed point from its integer
+//value rather than converted to float.
+#define SDB_OUT_BUF_SIZE    (256 * 1024)
+
+//Longest row format_student() or format_csv() can produce, a full id, both
+//names and the widest int gpa
+#define SDB_ROW_MAX         96
+
+//Output buffer.  Rows accumulate in buf and are written to fd when fewer
+//than SDB_ROW_MAX bytes are left.  An fd of -1 keeps everything in memory,
+//growing buf as needed, for output assembled on one thread and written by
+//another.  error is set once a write fails, later output is dropped.
+typedef struct out_buf {
+    int     fd;
+    char    *buf;
+    size_t  len;
+    size_t  cap;
+    int     error;
+} out_buf_t;
+
+//prototypes for the row formatter
+size_t format_student(char *dst, const student_t *s);
+size_t format_csv(char *dst, const student_t *s);
+int out_open(out_buf_t *ob, int fd);
+void out_header(out_buf_t *ob);
+void out_student(out_buf_t *ob, const student_t *s);
+void out_csv(out_buf_t *ob, const student_t *s);
+void out_bytes(out_buf_t *ob, const char *data, size_t len);
+int out_flush(out_buf_t *ob);
+int out_close(out_buf_t *ob);
+
+#endif
@@ -0,0 +1,505 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdbhash.h"
+#include "sdblock.h"
+
+/*
+ *  home_bucket
+ *      id:        student id
+ *      nbuckets:  number of home buckets, a power of two
+ *
+ *  Fibonacci hashing, the top bits of the product pick the bucket so ids
+ *  that are close together still land far apart.
+ *
+ *  returns:  the bucket the probe for id starts at
+ */
+static uint64_t home_bucket(int id, uint64_t nbuckets)
+{
+    uint64_t h = (uint64_t)(uint32_t)id * 0x9e3779b97f4a7c15ULL;
+    return h >> (64 - __builtin_ctzll(nbuckets));
+}
+
+static off_t bucket_offset(const db_header_t *hdr, uint64_t b)
+{
+    return (off_t)(hdr->table_slot + b) * STUDENT_RECORD_SIZE;
+}
+
+static uint64_t table_buckets(const db_header_t *hdr)
+{
+    return hdr->nbuckets + HASH_OVERFLOW;
+}
+
+/*
+ *  read_header
+ *      st:    engine state
+ *      *hdr:  receives the header
+ *
+ *  The table may have been rebuilt by another process, so the header is
+ *  read again under the table lock by every operation.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int read_header(db_store_t *st, db_header_t *hdr)
+{
+    if (pread(st->fd, hdr, sizeof(*hdr), 0) != sizeof(*hdr) ||
+        hdr->magic != SDB_HDR_MAGIC || hdr->layout != SDB_LAYOUT_HASH)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+static int write_header(db_store_t *st, const db_header_t *hdr)
+{
+    return pwrite(st->fd, hdr, sizeof(*hdr), 0) == sizeof(*hdr) ? NO_ERROR : ERR_DB_FILE;
+}
+
+/*
+ *  read_buckets
+ *      st, *hdr:  engine state and current header
+ *      first:     first bucket to read
+ *      *recs:     buffer for n buckets
+ *      n:         number of buckets
+ *
+ *  Buckets past the end of the file read as empty.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int read_buckets(db_store_t *st, const db_header_t *hdr, uint64_t first, student_t *recs, size_t n)
+{
+    size_t len = n * STUDENT_RECORD_SIZE;
+    ssize_t got = pread(st->fd, recs, len, bucket_offset(hdr, first));
+    if (got == -1)
+        return ERR_DB_FILE;
+    memset((char *)recs + got, 0, len - got);
+    return NO_ERROR;
+}
+
+static int write_buckets(db_store_t *st, const db_header_t *hdr, uint64_t first, const student_t *recs, size_t n)
+{
+    size_t len = n * STUDENT_RECORD_SIZE;
+    return pwrite(st->fd, recs, len, bucket_offset(hdr, first)) == (ssize_t)len ? NO_ERROR : ERR_DB_FILE;
+}
+
+/*
+ *  probe
+ *      st, *hdr:  engine state and current header
+ *      id:        student id to look for
+ *      *pos:      bucket holding id, or the empty bucket ending its cluster,
+ *                 or the table size if the cluster runs off the end
+ *      *s:        receives the record if found, may be NULL
+ *
+ *  returns:  1 if id is in the table, 0 if not, ERR_DB_FILE on I/O error
+ */
+static int probe(db_store_t *st, const db_header_t *hdr, int id, uint64_t *pos, student_t *s)
+{
+    student_t chunk[HASH_PROBE_CHUNK];
+    uint64_t total = table_buckets(hdr);
+
+    for (uint64_t b = home_bucket(id, hdr->nbuckets); b < total; b += HASH_PROBE_CHUNK)
+    {
+        size_t n = (total - b < HASH_PROBE_CHUNK) ? total - b : HASH_PROBE_CHUNK;
+        if (read_buckets(st, hdr, b, chunk, n) != NO_ERROR)
+            return ERR_DB_FILE;
+        for (size_t i = 0; i < n; i++)
+        {
+            if (chunk[i].id == id)
+            {
+                *pos = b + i;
+                if (s != NULL)
+                    *s = chunk[i];
+                return 1;
+            }
+            if (chunk[i].id == DELETED_STUDENT_ID)
+            {
+                *pos = b + i;
+                return 0;
+            }
+        }
+    }
+    *pos = total;
+    return 0;
+}
+
+/*
+ *  zero_range
+ *      fd:      database file descriptor
+ *      lo, hi:  byte range [lo, hi) to overwrite with empty records
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int zero_range(int fd, off_t lo, off_t hi)
+{
+    static const char zeros[HASH_PROBE_CHUNK * sizeof(student_t)];
+    while (lo < hi)
+    {
+        size_t len = (hi - lo < (off_t)sizeof(zeros)) ? (size_t)(hi - lo) : sizeof(zeros);
+        if (pwrite(fd, zeros, len, lo) != (ssize_t)len)
+            return ERR_DB_FILE;
+        lo += len;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  clear_region
+ *      fd:      database file descriptor
+ *      lo, hi:  byte range [lo, hi) of a table that is no longer in use
+ *
+ *  Deallocates the whole blocks of the range and zeroes the partial blocks
+ *  at its ends, or zeroes all of it if the filesystem cannot punch holes,
+ *  so scans never see the records of an old table.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int clear_region(int fd, off_t lo, off_t hi)
+{
+    struct stat sb;
+    if (fstat(fd, &sb) == -1)
+        return ERR_DB_FILE;
+    if (hi > sb.st_size)
+        hi = sb.st_size;
+    if (hi <= lo)
+        return NO_ERROR;
+
+    off_t blk = sb.st_blksize;
+    off_t inner_lo = ((lo + blk - 1) / blk) * blk;
+    off_t inner_hi = (hi / blk) * blk;
+    int rc = store_punch(fd, lo, hi);
+    if (rc == ERR_DB_FILE)
+        return ERR_DB_FILE;
+    if (rc == ERR_DB_OP || inner_hi <= inner_lo)
+        return zero_range(fd, lo, hi);
+    if (zero_range(fd, lo, inner_lo) != NO_ERROR)
+        return ERR_DB_FILE;
+    return zero_range(fd, inner_hi, hi);
+}
+
+/*
+ *  table_insert
+ *      *table:    buckets of a table being built in memory
+ *      nbuckets:  its number of home buckets
+ *      *s:        record to insert, its id is not in the table
+ *
+ *  returns:  true if inserted, false if its cluster ran off the end
+ */
+static bool table_insert(student_t *table, uint64_t nbuckets, const student_t *s)
+{
+    for (uint64_t b = home_bucket(s->id, nbuckets); b < nbuckets + HASH_OVERFLOW; b++)
+    {
+        if (table[b].id == DELETED_STUDENT_ID)
+        {
+            table[b] = *s;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ *  rehash
+ *      st, *hdr:  engine state and current header, updated on success
+ *      *s:        record to insert along with the current contents
+ *
+ *  Builds a table twice the size (or larger, if a cluster still runs off
+ *  the end) after the current one.  The new table is synced before the
+ *  header points to it and the old one is cleared only after that, a crash
+ *  at any point leaves one complete table for hash_attach() to keep.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int rehash(db_store_t *st, db_header_t *hdr, const student_t *s)
+{
+    uint64_t old_total = table_buckets(hdr);
+    student_t *old = malloc(old_total * sizeof(student_t));
+    student_t *table = NULL;
+    uint64_t nbuckets = hdr->nbuckets;
+    bool placed = false;
+
+    if (old == NULL || read_buckets(st, hdr, 0, old, old_total) != NO_ERROR)
+    {
+        free(old);
+        return ERR_DB_FILE;
+    }
+
+    while (!placed)
+    {
+        nbuckets *= 2;
+        free(table);
+        table = calloc(nbuckets + HASH_OVERFLOW, sizeof(student_t));
+        if (table == NULL)
+            break;
+        placed = table_insert(table, nbuckets, s);
+        for (uint64_t b = 0; placed && b < old_total; b++)
+        {
+            if (old[b].id != DELETED_STUDENT_ID)
+                placed = table_insert(table, nbuckets, &old[b]);
+        }
+    }
+    free(old);
+    if (!placed)
+        return ERR_DB_FILE;
+
+    db_header_t next = *hdr;
+    next.table_slot = hdr->table_slot + old_total;
+    next.nbuckets = nbuckets;
+    next.nlive = hdr->nlive + 1;
+    int rc = write_buckets(st, &next, 0, table, table_buckets(&next));
+    free(table);
+
+    if (rc != NO_ERROR || fdatasync(st->fd) == -1 ||
+        write_header(st, &next) != NO_ERROR || fdatasync(st->fd) == -1)
+        return ERR_DB_FILE;
+
+    rc = clear_region(st->fd, bucket_offset(hdr, 0), bucket_offset(hdr, old_total));
+    *hdr = next;
+    return rc;
+}
+
+/*
+ *  remove_at
+ *      st, *hdr:  engine state and current header
+ *      pos:       bucket holding the record to delete
+ *
+ *  Empties the bucket and moves later records of the cluster back into the
+ *  gap when their home bucket allows it, so lookups never need tombstones.
+ *  Every changed bucket is written back with one pwrite().
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int remove_at(db_store_t *st, const db_header_t *hdr, uint64_t pos)
+{
+    uint64_t total = table_buckets(hdr);
+    size_t cap = 0;
+    size_t len = 0;
+    student_t *run = NULL;
+
+    // read the rest of the cluster, up to its empty bucket
+    for (bool done = false; !done && pos + len < total; )
+    {
+        if (len + HASH_PROBE_CHUNK > cap)
+        {
+            cap = 2 * cap + HASH_PROBE_CHUNK;
+            student_t *grown = realloc(run, cap * sizeof(student_t));
+            if (grown == NULL)
+            {
+                free(run);
+                return ERR_DB_FILE;
+            }
+            run = grown;
+        }
+        size_t n = (total - pos - len < HASH_PROBE_CHUNK) ? total - pos - len : HASH_PROBE_CHUNK;
+        if (read_buckets(st, hdr, pos + len, &run[len], n) != NO_ERROR)
+        {
+            free(run);
+            return ERR_DB_FILE;
+        }
+        for (size_t i = 0; i < n && !done; i++, len++)
+            done = (run[len].id == DELETED_STUDENT_ID);
+        if (done)
+            len--;
+    }
+
+    size_t gap = 0;
+    for (size_t j = 1; j < len; j++)
+    {
+        if (home_bucket(run[j].id, hdr->nbuckets) <= pos + gap)
+        {
+            run[gap] = run[j];
+            gap = j;
+        }
+    }
+    run[gap] = EMPTY_STUDENT_RECORD;
+
+    int rc = write_buckets(st, hdr, pos, run, gap + 1);
+    free(run);
+    return rc;
+}
+
+/*
+ *  hash_init_header
+ *      *hdr:  header of a new, empty database
+ *
+ *  Sets up an empty table right after the header.  Nothing is written to
+ *  the table itself, past the end of the file every bucket reads as empty.
+ */
+void hash_init_header(db_header_t *hdr)
+{
+    hdr->layout = SDB_LAYOUT_HASH;
+    hdr->table_slot = 1;
+    hdr->nbuckets = HASH_MIN_BUCKETS;
+    hdr->nlive = 0;
+}
+
+/*
+ *  hash_attach
+ *      st:  engine state of a freshly opened hash layout database
+ *
+ *  Clears what a rehash interrupted by a crash may have left behind: a new
+ *  table after the current one that the header never pointed to, or an old
+ *  table before it that was not cleared yet.
+ *
+ *  returns:  NO_ERROR       table ready
+ *            ERR_DB_OP      the header does not describe a valid table
+ *            ERR_DB_FILE    database file I/O issue
+ */
+int hash_attach(db_store_t *st)
+{
+    db_header_t hdr;
+    struct stat sb;
+    off_t data, hole;
+
+    if (lock_slots(st->fd, 0, 1, SDB_LOCK_WRITE) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    int rc = read_header(st, &hdr);
+    if (rc == NO_ERROR && (hdr.table_slot < 1 || hdr.nbuckets < HASH_MIN_BUCKETS ||
+                           (hdr.nbuckets & (hdr.nbuckets - 1)) != 0))
+        rc = ERR_DB_OP;
+
+    off_t table_lo = (rc == NO_ERROR) ? bucket_offset(&hdr, 0) : 0;
+    off_t table_hi = (rc == NO_ERROR) ? bucket_offset(&hdr, table_buckets(&hdr)) : 0;
+    if (rc == NO_ERROR && fstat(st->fd, &sb) == -1)
+        rc = ERR_DB_FILE;
+    if (rc == NO_ERROR && sb.st_size > table_hi && store_truncate(st->fd, table_hi) != NO_ERROR)
+        rc = ERR_DB_FILE;
+    if (rc == NO_ERROR && store_next_extent(st->fd, STUDENT_RECORD_SIZE, &data, &hole) == 1 &&
+        data < table_lo)
+        rc = clear_region(st->fd, STUDENT_RECORD_SIZE, table_lo);
+
+    unlock_slots(st->fd, 0, 1);
+    return rc;
+}
+
+/*
+ *  hash_get
+ *      st:  engine state
+ *      id:  student id to look up
+ *      *s:  receives the record, or an empty record if id is not stored
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int hash_get(db_store_t *st, int id, student_t *s)
+{
+    db_header_t hdr;
+    uint64_t pos;
+
+    if (lock_slots(st->fd, 0, 1, SDB_LOCK_READ) != NO_ERROR)
+        return ERR_DB_FILE;
+    int rc = read_header(st, &hdr);
+    if (rc == NO_ERROR)
+        rc = probe(st, &hdr, id, &pos, s);
+    unlock_slots(st->fd, 0, 1);
+
+    if (rc == ERR_DB_FILE)
+        return ERR_DB_FILE;
+    if (rc == 0)
+        memset(s, 0, STUDENT_RECORD_SIZE);
+    return NO_ERROR;
+}
+
+/*
+ *  hash_get_run
+ *      st:        engine state
+ *      first_id:  first id of the run
+ *      *recs:     buffer for n records, indexed by id - first_id
+ *      n:         number of ids
+ *
+ *  Short runs are looked up id by id.  A run with more ids than the table
+ *  has probe chunks is cheaper to answer from one read of the whole table.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int hash_get_run(db_store_t *st, int first_id, student_t *recs, int n)
+{
+    db_header_t hdr;
+
+    if (lock_slots(st->fd, 0, 1, SDB_LOCK_READ) != NO_ERROR)
+        return ERR_DB_FILE;
+    int rc = read_header(st, &hdr);
+    uint64_t total = table_buckets(&hdr);
+    memset(recs, 0, (size_t)n * STUDENT_RECORD_SIZE);
+
+    if (rc == NO_ERROR && (uint64_t)n * HASH_PROBE_CHUNK < total)
+    {
+        uint64_t pos;
+        for (int i = 0; rc == NO_ERROR && i < n; i++)
+        {
+            if (probe(st, &hdr, first_id + i, &pos, &recs[i]) == ERR_DB_FILE)
+                rc = ERR_DB_FILE;
+        }
+    }
+    else if (rc == NO_ERROR)
+    {
+        student_t *table = malloc(total * sizeof(student_t));
+        if (table == NULL || read_buckets(st, &hdr, 0, table, total) != NO_ERROR)
+            rc = ERR_DB_FILE;
+        for (uint64_t b = 0; rc == NO_ERROR && b < total; b++)
+        {
+            int id = table[b].id;
+            if (id != DELETED_STUDENT_ID && id >= first_id && id - first_id < n)
+                recs[id - first_id] = table[b];
+        }
+        free(table);
+    }
+    unlock_slots(st->fd, 0, 1);
+    return rc;
+}
+
+/*
+ *  hash_put
+ *      st:  engine state
+ *      id:  student id
+ *      *s:  record to store, an empty record deletes id
+ *
+ *  Inserts, overwrites or deletes the record of id under the write lock on
+ *  slot 0, which serializes every change to the table structure.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int hash_put(db_store_t *st, int id, const student_t *s)
+{
+    db_header_t hdr;
+    uint64_t pos;
+    bool empty = memcmp(s, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) == 0;
+
+    if (lock_slots(st->fd, 0, 1, SDB_LOCK_WRITE) != NO_ERROR)
+        return ERR_DB_FILE;
+    int rc = read_header(st, &hdr);
+    int found = (rc == NO_ERROR) ? probe(st, &hdr, id, &pos, NULL) : rc;
+
+    if (found == ERR_DB_FILE)
+        rc = ERR_DB_FILE;
+    else if (empty)
+    {
+        if (found)
+        {
+            hdr.nlive--;
+            rc = remove_at(st, &hdr, pos);
+            if (rc == NO_ERROR)
+                rc = write_header(st, &hdr);
+        }
+    }
+    else if (found)
+        rc = write_buckets(st, &hdr, pos, s, 1);
+    else if (pos < table_buckets(&hdr) && (hdr.nlive + 1) * 100 <= hdr.nbuckets * HASH_MAX_LOAD)
+    {
+        hdr.nlive++;
+        rc = write_buckets(st, &hdr, pos, s, 1);
+        if (rc == NO_ERROR)
+            rc = write_header(st, &hdr);
+    }
+    else
+        rc = rehash(st, &hdr, s);
+
+    unlock_slots(st->fd, 0, 1);
+    return rc;
+}
@@ -0,0 +1,32 @@
+#ifndef __SDB_HASH_H__
+#define __SDB_HASH_H__
+
+#include <stdint.h>
+
+#include "sdbstore.h"
+
+//The hash layout stores records in an open addressing table of 64 byte
+//buckets instead of at slot id, so a database with a few thousand students
+//spread over a large id space costs a few hundred KB rather than 64 bytes
+//per possible id.  Buckets use linear probing and deletes shift the rest of
+//the cluster back, so there are no tombstones and an empty bucket is an all
+//zero record like an empty slot of the direct layout.  Probing never wraps,
+//HASH_OVERFLOW buckets past the last home bucket catch the clusters that
+//run off the end.  When the table is HASH_MAX_LOAD percent full, or a
+//cluster reaches its end, the table is rebuilt at twice the size after the
+//current one and the old one is punched out of the file.
+#define HASH_MIN_BUCKETS    1024
+#define HASH_OVERFLOW       64
+#define HASH_MAX_LOAD       70
+
+//Buckets read per pread() while probing
+#define HASH_PROBE_CHUNK    16
+
+//prototypes for the hash layout
+void hash_init_header(db_header_t *hdr);
+int hash_attach(db_store_t *st);
+int hash_get(db_store_t *st, int id, student_t *s);
+int hash_get_run(db_store_t *st, int first_id, student_t *recs, int n);
+int hash_put(db_store_t *st, int id, const student_t *s);
+
+#endif
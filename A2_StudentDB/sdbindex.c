@@ -0,0 +1,471 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdbscan.h"
+#include "sdbindex.h"
+
+//Delta entries carry their position so the last operation on a key wins
+typedef struct delta_ref {
+    const lidx_entry_t  *e;
+    int                 pos;
+} delta_ref_t;
+
+static int entry_cmp(const void *a, const void *b)
+{
+    const lidx_entry_t *ea = a;
+    const lidx_entry_t *eb = b;
+    int c = strncmp(ea->lname, eb->lname, sizeof(ea->lname));
+    if (c != 0)
+        return c;
+    return (ea->id > eb->id) - (ea->id < eb->id);
+}
+
+static int delta_cmp(const void *a, const void *b)
+{
+    const delta_ref_t *da = a;
+    const delta_ref_t *db = b;
+    int c = entry_cmp(da->e, db->e);
+    if (c != 0)
+        return c;
+    return da->pos - db->pos;
+}
+
+static bool is_live(const student_t *s)
+{
+    return memcmp(s, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0;
+}
+
+/*
+ *  apply_delta
+ *      *base:    sorted entries
+ *      nbase:    number of base entries
+ *      *delta:   delta entries in the order they were appended
+ *      ndelta:   number of delta entries
+ *      *out:     room for nbase + ndelta entries
+ *
+ *  Merges the delta into the base.  For every key only the last delta
+ *  operation counts, a delete drops the key and an add inserts it.
+ *
+ *  returns:  number of sorted entries written to out, or -1 on error
+ */
+static int apply_delta(const lidx_entry_t *base, int nbase,
+                       const lidx_entry_t *delta, int ndelta, lidx_entry_t *out)
+{
+    delta_ref_t *refs = malloc((ndelta + 1) * sizeof(delta_ref_t));
+    if (refs == NULL)
+        return -1;
+
+    for (int i = 0; i < ndelta; i++)
+    {
+        refs[i].e = &delta[i];
+        refs[i].pos = i;
+    }
+    qsort(refs, ndelta, sizeof(delta_ref_t), delta_cmp);
+
+    // keep only the last operation of each key
+    int nref = 0;
+    for (int i = 0; i < ndelta; i++)
+    {
+        if (i + 1 < ndelta && entry_cmp(refs[i].e, refs[i + 1].e) == 0)
+            continue;
+        refs[nref++] = refs[i];
+    }
+
+    int n = 0, b = 0, d = 0;
+    while (b < nbase || d < nref)
+    {
+        int c = (b == nbase) ? 1 : (d == nref) ? -1 : entry_cmp(&base[b], refs[d].e);
+        if (c < 0)
+        {
+            out[n++] = base[b++];
+            continue;
+        }
+        if (refs[d].e->op == LIDX_OP_ADD)
+        {
+            out[n] = *refs[d].e;
+            out[n++].op = LIDX_OP_ADD;
+        }
+        if (c == 0)
+            b++;
+        d++;
+    }
+
+    free(refs);
+    return n;
+}
+
+/*
+ *  write_base
+ *      st:        engine state with the index open
+ *      *entries:  sorted entries becoming the new base
+ *      n:         number of entries
+ *
+ *  Rewrites the index file in place with an empty delta.  The header is
+ *  flagged while the rewrite is in progress so a crash leaves a file that is
+ *  recognised as broken and rebuilt.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int write_base(db_store_t *st, const lidx_entry_t *entries, int n)
+{
+    struct stat sb;
+    lidx_header_t hdr = {0};
+    size_t len = (size_t)n * sizeof(lidx_entry_t);
+    int rc = NO_ERROR;
+
+    if (fstat(st->fd, &sb) == -1)
+        return ERR_DB_FILE;
+
+    hdr.magic = SDB_LIDX_MAGIC;
+    hdr.version = SDB_LIDX_VERSION;
+    hdr.db_ino = sb.st_ino;
+    hdr.db_dev = sb.st_dev;
+    hdr.merging = 1;
+
+    flock(st->lidx_fd, LOCK_EX);
+    if (pwrite(st->lidx_fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        pwrite(st->lidx_fd, entries, len, sizeof(hdr)) != (ssize_t)len ||
+        ftruncate(st->lidx_fd, sizeof(hdr) + len) == -1)
+        rc = ERR_DB_FILE;
+
+    hdr.base_count = n;
+    hdr.merging = 0;
+    if (rc == NO_ERROR && pwrite(st->lidx_fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+        rc = ERR_DB_FILE;
+    flock(st->lidx_fd, LOCK_UN);
+    return rc;
+}
+
+/*
+ *  lidx_rebuild
+ *      st:  engine state with the index open
+ *
+ *  Rebuilds the index from a block scan of the database.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int lidx_rebuild(db_store_t *st)
+{
+    if (st->lidx_fd == -1)
+        return NO_ERROR;
+
+    int cap = 1024, n = 0;
+    lidx_entry_t *entries = malloc(cap * sizeof(lidx_entry_t));
+    scan_iter_t it;
+    student_t *rec;
+
+    if (entries == NULL || scan_open(&it, st->fd) != NO_ERROR)
+    {
+        free(entries);
+        return ERR_DB_FILE;
+    }
+    while ((rec = scan_next(&it)) != NULL)
+    {
+        if (n == cap)
+        {
+            lidx_entry_t *grown = realloc(entries, 2 * cap * sizeof(lidx_entry_t));
+            if (grown == NULL)
+                break;
+            entries = grown;
+            cap *= 2;
+        }
+        memcpy(entries[n].lname, rec->lname, sizeof(entries[n].lname));
+        entries[n].id = rec->id;
+        entries[n++].op = LIDX_OP_ADD;
+    }
+    int rc = scan_close(&it);
+    if (rc == NO_ERROR && rec != NULL)
+        rc = ERR_DB_FILE;
+
+    if (rc == NO_ERROR)
+    {
+        qsort(entries, n, sizeof(lidx_entry_t), entry_cmp);
+        rc = write_base(st, entries, n);
+    }
+    free(entries);
+    return rc;
+}
+
+/*
+ *  lidx_attach
+ *      st:               engine state of a freshly opened database
+ *      should_truncate:  the database was just emptied
+ *
+ *  Opens the index, rebuilding it if it is missing, belongs to another file,
+ *  was interrupted during a merge, or lists records for an empty database.
+ *  If it cannot be opened st->lidx_fd stays -1 and name lookups scan.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int lidx_attach(db_store_t *st, bool should_truncate)
+{
+    char path[SDB_PATH_MAX];
+    struct stat sb, isb;
+    lidx_header_t hdr;
+
+    st->lidx_fd = -1;
+    if (snprintf(path, sizeof(path), "%s%s", st->path, SDB_LIDX_EXT) >= (int)sizeof(path))
+        return NO_ERROR;
+
+    int flags = O_RDWR | O_CREAT;
+    if (should_truncate)
+        flags |= O_TRUNC;
+    int fd = open(path, flags, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (fd == -1)
+        return NO_ERROR;
+    st->lidx_fd = fd;
+
+    if (fstat(st->fd, &sb) == -1 || fstat(fd, &isb) == -1)
+        return ERR_DB_FILE;
+
+    bool valid = pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+        hdr.magic == SDB_LIDX_MAGIC && hdr.version == SDB_LIDX_VERSION &&
+        hdr.db_ino == (uint64_t)sb.st_ino && hdr.db_dev == (uint64_t)sb.st_dev &&
+        hdr.merging == 0 &&
+        (isb.st_size - (off_t)sizeof(hdr)) % sizeof(lidx_entry_t) == 0 &&
+        isb.st_size >= (off_t)(sizeof(hdr) + hdr.base_count * sizeof(lidx_entry_t)) &&
+        (sb.st_size > 0 || isb.st_size == sizeof(hdr));
+    if (valid)
+        return NO_ERROR;
+    return lidx_rebuild(st);
+}
+
+/*
+ *  load_index
+ *      st:       engine state with the index open
+ *      **all:    malloc'd copy of every entry after the header
+ *      *nbase:   number of sorted base entries at the front of *all
+ *
+ *  returns:  total number of entries (base plus delta), or -1 on error
+ */
+static int load_index(db_store_t *st, lidx_entry_t **all, int *nbase)
+{
+    lidx_header_t hdr;
+    struct stat isb;
+
+    if (fstat(st->lidx_fd, &isb) == -1 ||
+        pread(st->lidx_fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+        return -1;
+
+    size_t len = isb.st_size - sizeof(hdr);
+    *all = malloc(len + sizeof(lidx_entry_t));
+    if (*all == NULL)
+        return -1;
+    if (pread(st->lidx_fd, *all, len, sizeof(hdr)) != (ssize_t)len)
+    {
+        free(*all);
+        return -1;
+    }
+    *nbase = hdr.base_count;
+    return len / sizeof(lidx_entry_t);
+}
+
+/*
+ *  merge_delta
+ *      st:  engine state with the index open and locked exclusively
+ *
+ *  Merges the delta into the base if it has grown too long.
+ */
+static void merge_delta(db_store_t *st)
+{
+    lidx_entry_t *all;
+    int nbase;
+    int n = load_index(st, &all, &nbase);
+    if (n < 0)
+        return;
+
+    int ndelta = n - nbase;
+    if (ndelta > LIDX_MERGE_MIN && ndelta > nbase / LIDX_MERGE_RATIO)
+    {
+        lidx_entry_t *merged = malloc((n + 1) * sizeof(lidx_entry_t));
+        int m = (merged == NULL) ? -1 : apply_delta(all, nbase, all + nbase, ndelta, merged);
+        if (m >= 0)
+            write_base(st, merged, m);
+        free(merged);
+    }
+    free(all);
+}
+
+/*
+ *  lidx_detach
+ *      st:  engine state
+ *
+ *  Merges the delta into the base if it has grown too long, then closes
+ *  the index.
+ */
+void lidx_detach(db_store_t *st)
+{
+    if (st->lidx_fd == -1)
+        return;
+
+    flock(st->lidx_fd, LOCK_EX);
+    merge_delta(st);
+    flock(st->lidx_fd, LOCK_UN);
+
+    close(st->lidx_fd);
+    st->lidx_fd = -1;
+}
+
+/*
+ *  lidx_update
+ *      st:        engine state
+ *      first_id:  id of the first slot written
+ *      *old:      previous contents of the n slots
+ *      *recs:     new contents of the n slots
+ *      n:         number of slots
+ *
+ *  Appends a delete for every live record that is replaced or removed and
+ *  an add for every new live record, all with a single write at the end of
+ *  the file, and merges the delta once it has grown too long, so lookups
+ *  of a long running process do not slow down with every insert.  The
+ *  exclusive lock keeps concurrent appenders and merges from interleaving.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int lidx_update(db_store_t *st, int first_id, const student_t *old, const student_t *recs, int n)
+{
+    if (st == NULL || st->lidx_fd == -1)
+        return NO_ERROR;
+
+    lidx_entry_t local[2];
+    lidx_entry_t *delta = (n == 1) ? local : malloc(2 * n * sizeof(lidx_entry_t));
+    int nd = 0;
+    if (delta == NULL)
+        return ERR_DB_FILE;
+
+    for (int i = 0; i < n; i++)
+    {
+        bool was = is_live(&old[i]);
+        bool now = is_live(&recs[i]);
+        if (was && now && strncmp(old[i].lname, recs[i].lname, sizeof(old[i].lname)) == 0)
+            continue;
+        if (was)
+        {
+            memcpy(delta[nd].lname, old[i].lname, sizeof(delta[nd].lname));
+            delta[nd].id = first_id + i;
+            delta[nd++].op = LIDX_OP_DEL;
+        }
+        if (now)
+        {
+            memcpy(delta[nd].lname, recs[i].lname, sizeof(delta[nd].lname));
+            delta[nd].id = first_id + i;
+            delta[nd++].op = LIDX_OP_ADD;
+        }
+    }
+
+    int rc = NO_ERROR;
+    if (nd > 0)
+    {
+        size_t len = nd * sizeof(lidx_entry_t);
+        struct stat isb;
+        lidx_header_t hdr;
+        flock(st->lidx_fd, LOCK_EX);
+        if (fstat(st->lidx_fd, &isb) == -1 ||
+            pwrite(st->lidx_fd, delta, len, isb.st_size) != (ssize_t)len)
+            rc = ERR_DB_FILE;
+
+        // entries after the base, the header is only read once there are
+        // enough of them to merge
+        off_t ntotal = (isb.st_size + len - sizeof(hdr)) / sizeof(lidx_entry_t);
+        if (rc == NO_ERROR && ntotal > LIDX_MERGE_MIN &&
+            pread(st->lidx_fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+            ntotal - (off_t)hdr.base_count > LIDX_MERGE_MIN)
+            merge_delta(st);
+        flock(st->lidx_fd, LOCK_UN);
+    }
+    if (delta != local)
+        free(delta);
+    return rc;
+}
+
+/*
+ *  lidx_lookup
+ *      st:       engine state with the index open
+ *      *prefix:  last name prefix, "" matches every record
+ *      **ids:    malloc'd array of matching ids, ordered by last name then id
+ *
+ *  Binary searches the mapped base for the first name >= prefix, collects
+ *  the run of entries sharing the prefix and applies the matching delta
+ *  entries.  Costs O(log n) plus the size of the result and the delta.
+ *
+ *  returns:  number of ids, or ERR_DB_FILE
+ */
+int lidx_lookup(db_store_t *st, const char *prefix, int **ids)
+{
+    lidx_header_t *hdr;
+    struct stat isb;
+    size_t plen = strlen(prefix);
+    int rc = ERR_DB_FILE;
+
+    if (plen >= LIDX_NAME_LEN)
+        plen = LIDX_NAME_LEN - 1;
+
+    flock(st->lidx_fd, LOCK_SH);
+    if (fstat(st->lidx_fd, &isb) == -1)
+    {
+        flock(st->lidx_fd, LOCK_UN);
+        return ERR_DB_FILE;
+    }
+    void *map = mmap(NULL, isb.st_size, PROT_READ, MAP_SHARED, st->lidx_fd, 0);
+    if (map == MAP_FAILED)
+    {
+        flock(st->lidx_fd, LOCK_UN);
+        return ERR_DB_FILE;
+    }
+
+    hdr = map;
+    lidx_entry_t *entries = (lidx_entry_t *)(hdr + 1);
+    int nbase = hdr->base_count;
+    int ntotal = (isb.st_size - sizeof(*hdr)) / sizeof(lidx_entry_t);
+
+    // lower bound of the prefix in the sorted base
+    int lo = 0, hi = nbase;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (strncmp(entries[mid].lname, prefix, plen) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    int end = lo;
+    while (end < nbase && strncmp(entries[end].lname, prefix, plen) == 0)
+        end++;
+
+    lidx_entry_t *delta = malloc((ntotal - nbase + 1) * sizeof(lidx_entry_t));
+    lidx_entry_t *out = malloc((end - lo + ntotal - nbase + 1) * sizeof(lidx_entry_t));
+    int ndelta = 0;
+    if (delta != NULL && out != NULL)
+    {
+        for (int i = nbase; i < ntotal; i++)
+        {
+            if (strncmp(entries[i].lname, prefix, plen) == 0)
+                delta[ndelta++] = entries[i];
+        }
+        int n = apply_delta(&entries[lo], end - lo, delta, ndelta, out);
+        *ids = malloc((n + 1) * sizeof(int));
+        if (n >= 0 && *ids != NULL)
+        {
+            for (int i = 0; i < n; i++)
+                (*ids)[i] = out[i].id;
+            rc = n;
+        }
+    }
+
+    free(out);
+    free(delta);
+    munmap(map, isb.st_size);
+    flock(st->lidx_fd, LOCK_UN);
+    return rc;
+}
@@ -0,0 +1,51 @@
+#ifndef __SDB_INDEX_H__
+#define __SDB_INDEX_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdbstore.h"
+
+//Secondary index on last name, kept in <db>.lidx.  The file holds a header,
+//base_count (lname, id) entries sorted by name then id, and after them an
+//unsorted delta of add/delete entries appended by store_write_slot() and
+//store_write_run().  Lookups binary search the base and then apply the
+//delta, once the delta outgrows LIDX_MERGE_MIN and 1/LIDX_MERGE_RATIO of the
+//base it is merged into the base by the next update or when the database
+//is closed.
+#define SDB_LIDX_EXT        ".lidx"
+#define SDB_LIDX_MAGIC      0x5844494cu     // "LIDX"
+#define SDB_LIDX_VERSION    1
+#define LIDX_MERGE_MIN      1024
+#define LIDX_MERGE_RATIO    8
+
+#define LIDX_NAME_LEN       32              // same as student_t.lname
+#define LIDX_OP_ADD         1
+#define LIDX_OP_DEL         2
+
+//merging is set while the file is rewritten in place, a file found with it
+//set was interrupted and is rebuilt
+typedef struct lidx_header {
+    uint32_t    magic;
+    uint32_t    version;
+    uint64_t    db_ino;
+    uint64_t    db_dev;
+    uint64_t    base_count;
+    uint32_t    merging;
+    uint32_t    reserved;
+} lidx_header_t;
+
+typedef struct lidx_entry {
+    char        lname[LIDX_NAME_LEN];
+    int32_t     id;
+    int32_t     op;
+} lidx_entry_t;
+
+//prototypes for the last name index
+int lidx_attach(db_store_t *st, bool should_truncate);
+void lidx_detach(db_store_t *st);
+int lidx_update(db_store_t *st, int first_id, const student_t *old, const student_t *recs, int n);
+int lidx_rebuild(db_store_t *st);
+int lidx_lookup(db_store_t *st, const char *prefix, int **ids);
+
+#endif
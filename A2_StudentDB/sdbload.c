@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdblock.h"
+
+//Rows are staged one id window at a time, a window is 1MB of record slots.
+//Consecutive rows inside a window are flushed with a single pwrite(), gaps of
+//up to BULK_MAX_GAP empty slots are written through as part of the same run
+//since they share a filesystem block with their neighbours anyway.
+#define BULK_WINDOW_SLOTS   16384
+#define BULK_MAX_GAP        64
+#define BULK_IO_BUFF_SZ     (1024 * 1024)
+
+/*
+ *  next_field
+ *      **cursor:  current parse position, advanced past the field
+ *
+ *  Splits the next comma or tab separated field off the line and trims
+ *  surrounding blanks.
+ *
+ *  returns:  pointer to the field, or NULL if the line has no more fields
+ */
+static char *next_field(char **cursor)
+{
+    char *p = *cursor;
+    if (p == NULL)
+        return NULL;
+
+    while (*p == ' ')
+        p++;
+    char *start = p;
+    while (*p != '\0' && *p != ',' && *p != '\t')
+        p++;
+
+    if (*p == '\0')
+        *cursor = NULL;
+    else
+    {
+        *p = '\0';
+        *cursor = p + 1;
+    }
+
+    char *end = p;
+    while (end > start && (end[-1] == ' ' || end[-1] == '\r' || end[-1] == '\n'))
+        *--end = '\0';
+    return start;
+}
+
+/*
+ *  parse_int
+ *      *str:   field text
+ *      *out:   parsed value
+ *
+ *  returns:  true if the whole field is a decimal integer
+ */
+static bool parse_int(const char *str, int *out)
+{
+    char *end;
+    long v = strtol(str, &end, 10);
+    if (end == str || *end != '\0' || v < -2147483647L || v > 2147483647L)
+        return false;
+    *out = (int)v;
+    return true;
+}
+
+/*
+ *  parse_row
+ *      *line:  input line, modified in place
+ *      *s:     record built from the line
+ *
+ *  A row is "id,first_name,last_name,gpa", with tabs accepted in place of
+ *  commas.
+ *
+ *  returns:  true if the row has four fields with numeric id and gpa
+ */
+static bool parse_row(char *line, student_t *s)
+{
+    char *cursor = line;
+    char *f_id = next_field(&cursor);
+    char *f_fname = next_field(&cursor);
+    char *f_lname = next_field(&cursor);
+    char *f_gpa = next_field(&cursor);
+
+    if (f_gpa == NULL || cursor != NULL)
+        return false;
+    if (!parse_int(f_id, &s->id) || !parse_int(f_gpa, &s->gpa))
+        return false;
+
+    memset(s->fname, 0, sizeof(s->fname));
+    memset(s->lname, 0, sizeof(s->lname));
+    strncpy(s->fname, f_fname, sizeof(s->fname) - 1);
+    strncpy(s->lname, f_lname, sizeof(s->lname) - 1);
+    return true;
+}
+
+static int cmp_student_id(const void *a, const void *b)
+{
+    const student_t *sa = a;
+    const student_t *sb = b;
+    return (sa->id > sb->id) - (sa->id < sb->id);
+}
+
+/*
+ *  flush_run
+ *      fd:       database file descriptor
+ *      *window:  staged slots of the current window
+ *      base_id:  id of window[0]
+ *      lo, hi:   first and last id of the run, inclusive
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int flush_run(int fd, student_t *window, int base_id, int lo, int hi)
+{
+    return store_write_run(fd, lo, &window[lo - base_id], hi - lo + 1);
+}
+
+/*
+ *  load_window_locked
+ *      fd, *window, *rows, n, *dups:  as load_window()
+ *      base_id:  id of window[0]
+ *      span:     number of slots of the window the rows reach
+ *
+ *  load_window() for a caller holding the write lock on the window.  The
+ *  rows stored are moved to the front of rows.
+ *
+ *  returns:  number of rows stored, or ERR_DB_FILE
+ */
+static int load_window_locked(int fd, student_t *window, int base_id, int span,
+                              student_t *rows, int n, int *dups)
+{
+    int stored = 0;
+    int run_lo = -1;
+    int run_hi = -1;
+
+    if (store_read_run(fd, base_id, window, span) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    for (int i = 0; i < n; i++)
+    {
+        int id = rows[i].id;
+        student_t *slot = &window[id - base_id];
+        if (memcmp(slot, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0)
+        {
+            printf(M_ERR_DB_ADD_DUP, id);
+            (*dups)++;
+            continue;
+        }
+        *slot = rows[i];
+        rows[stored++] = rows[i];
+
+        if (run_lo != -1 && id - run_hi > BULK_MAX_GAP)
+        {
+            if (flush_run(fd, window, base_id, run_lo, run_hi) != NO_ERROR)
+                return ERR_DB_FILE;
+            run_lo = -1;
+        }
+        if (run_lo == -1)
+            run_lo = id;
+        run_hi = id;
+    }
+
+    if (run_lo != -1 && flush_run(fd, window, base_id, run_lo, run_hi) != NO_ERROR)
+        return ERR_DB_FILE;
+    return stored;
+}
+
+/*
+ *  load_window
+ *      fd:       database file descriptor
+ *      *window:  BULK_WINDOW_SLOTS slot buffer
+ *      *rows:    sorted rows whose ids fall into this window
+ *      n:        number of rows
+ *      *dups:    incremented for every row whose id is already in the db
+ *
+ *  Reads the window once to find ids that are already taken, stages the new
+ *  rows over the empty slots and writes them back as coalesced runs.  The
+ *  gaps inside a run are written with the contents that were just read, so
+ *  existing records are never clobbered.  The rows stored are moved to the
+ *  front of rows.
+ *
+ *  returns:  number of rows stored, or ERR_DB_FILE
+ */
+static int load_window(int fd, student_t *window, student_t *rows, int n, int *dups)
+{
+    int base_id = rows[0].id - (rows[0].id % BULK_WINDOW_SLOTS);
+    int span = rows[n - 1].id - base_id + 1;
+
+    // the window is checked and written under one lock, like add_student()
+    if (lock_slots(fd, base_id, span, SDB_LOCK_WRITE) != NO_ERROR)
+        return ERR_DB_FILE;
+    int rc = load_window_locked(fd, window, base_id, span, rows, n, dups);
+    unlock_slots(fd, base_id, span);
+    return rc;
+}
+
+/*
+ *  load_rows
+ *      fd:         database file descriptor
+ *      *rows:      validated records, in any order, sorted in place
+ *      nrows:      number of records
+ *      *rejected:  incremented for every id already in the db or the rows
+ *
+ *  Sorts the rows by id and writes them window by window with large
+ *  coalesced pwrite() calls.  The rows stored end up at the front of rows,
+ *  in id order.
+ *
+ *  returns:  number of rows stored, or ERR_DB_FILE
+ *
+ *  console:  M_ERR_DB_ADD_DUP  for each id already taken
+ *            M_ERR_DB_WRITE    on error
+ */
+int load_rows(int fd, student_t *rows, int nrows, int *rejected)
+{
+    student_t *window = malloc(BULK_WINDOW_SLOTS * sizeof(student_t));
+    int loaded = 0;
+
+    if (window == NULL)
+        return ERR_DB_FILE;
+    qsort(rows, nrows, sizeof(student_t), cmp_student_id);
+
+    for (int first = 0; first < nrows; )
+    {
+        int window_id = rows[first].id / BULK_WINDOW_SLOTS;
+        int last = first;
+        while (last < nrows && rows[last].id / BULK_WINDOW_SLOTS == window_id)
+            last++;
+
+        int stored = load_window(fd, window, &rows[first], last - first, rejected);
+        if (stored < 0)
+        {
+            printf(M_ERR_DB_WRITE);
+            free(window);
+            return ERR_DB_FILE;
+        }
+        memmove(&rows[loaded], &rows[first], (size_t)stored * sizeof(student_t));
+        loaded += stored;
+        first = last;
+    }
+    free(window);
+    return loaded;
+}
+
+/*
+ *  bulk_load
+ *      fd:     database file descriptor
+ *      *path:  CSV/TSV file to load, or "-" for stdin
+ *
+ *  Loads every row of the input in one pass.  Rows are parsed and validated
+ *  up front, duplicates inside the input are caught with an in-memory id
+ *  bitmap, then the rows are sorted by id and written window by window with
+ *  large coalesced pwrite() calls.  A first line whose id field is not numeric
+ *  is treated as a header and skipped.
+ *
+ *  returns:  NO_ERROR       every row was loaded
+ *            ERR_DB_OP      some rows were rejected (the rest were loaded)
+ *            ERR_DB_FILE    database or input file I/O issue
+ *
+ *  console:  M_ERR_BULK_ROW    for each malformed or out of range row
+ *            M_ERR_DB_ADD_DUP  for each id already in the db or the input
+ *            M_BULK_LOADED     summary on completion
+ */
+int bulk_load(int fd, char *path)
+{
+    FILE *in = stdin;
+    if (strcmp(path, "-") != 0)
+    {
+        in = fopen(path, "r");
+        if (in == NULL)
+        {
+            printf(M_ERR_BULK_OPEN, path);
+            return ERR_DB_FILE;
+        }
+    }
+    setvbuf(in, NULL, _IOFBF, BULK_IO_BUFF_SZ);
+
+    int rc = NO_ERROR;
+    int cap = 4096;
+    int nrows = 0;
+    int loaded = 0;
+    int rejected = 0;
+    int lineno = 0;
+    student_t *rows = malloc(cap * sizeof(student_t));
+    int capacity = store_capacity(fd);
+    uint64_t *seen = calloc((size_t)capacity / 64 + 1, sizeof(uint64_t));
+    char *line = NULL;
+    size_t line_cap = 0;
+
+    if (rows == NULL || seen == NULL)
+    {
+        rc = ERR_DB_FILE;
+        goto done;
+    }
+
+    while (getline(&line, &line_cap, in) != -1)
+    {
+        student_t s;
+        lineno++;
+        if (line[0] == '\n' || line[0] == '\r' || line[0] == '\0')
+            continue;
+        if (!parse_row(line, &s) || validate_range(s.id, s.gpa) != NO_ERROR ||
+            s.id > capacity)
+        {
+            int c = (unsigned char)line[0];
+            if (lineno == 1 && (c < '0' || c > '9'))
+                continue;
+            printf(M_ERR_BULK_ROW, lineno);
+            rejected++;
+            continue;
+        }
+
+        uint64_t bit = 1ULL << (s.id % 64);
+        if (seen[s.id / 64] & bit)
+        {
+            printf(M_ERR_DB_ADD_DUP, s.id);
+            rejected++;
+            continue;
+        }
+        seen[s.id / 64] |= bit;
+
+        if (nrows == cap)
+        {
+            cap *= 2;
+            student_t *grown = realloc(rows, cap * sizeof(student_t));
+            if (grown == NULL)
+            {
+                rc = ERR_DB_FILE;
+                goto done;
+            }
+            rows = grown;
+        }
+        rows[nrows++] = s;
+    }
+    if (ferror(in))
+    {
+        printf(M_ERR_BULK_OPEN, path);
+        rc = ERR_DB_FILE;
+        goto done;
+    }
+
+    loaded = load_rows(fd, rows, nrows, &rejected);
+    if (loaded < 0)
+    {
+        rc = ERR_DB_FILE;
+        goto done;
+    }
+
+    printf(M_BULK_LOADED, loaded, rejected);
+    if (rejected > 0)
+        rc = ERR_DB_OP;
+
+done:
+    free(line);
+    free(seen);
+    free(rows);
+    if (in != stdin)
+        fclose(in);
+    return rc;
+}
@@ -0,0 +1,96 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdblock.h"
+
+//Systems without open file description locks get classic process locks,
+//which behave the same for a single threaded sdbsc process
+#ifdef F_OFD_SETLKW
+#define SDB_SETLKW  F_OFD_SETLKW
+#define SDB_SETLK   F_OFD_SETLK
+#else
+#define SDB_SETLKW  F_SETLKW
+#define SDB_SETLK   F_SETLK
+#endif
+
+/*
+ *  set_lock
+ *      fd:        database file descriptor
+ *      first_id:  first slot of the range
+ *      n:         number of slots, SDB_LOCK_TO_END for the rest of the file
+ *      type:      F_RDLCK, F_WRLCK or F_UNLCK
+ *      cmd:       SDB_SETLKW to wait, SDB_SETLK to not
+ *
+ *  returns:  0 on success, -1 with errno set
+ */
+static int set_lock(int fd, int first_id, int n, int type, int cmd)
+{
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = (off_t)first_id * STUDENT_RECORD_SIZE;
+    fl.l_len = (off_t)n * STUDENT_RECORD_SIZE;
+    fl.l_pid = 0;       // required by open file description locks
+
+    int rc;
+    do
+        rc = fcntl(fd, cmd, &fl);
+    while (rc == -1 && errno == EINTR);
+    return rc;
+}
+
+/*
+ *  lock_slots
+ *      fd:        database file descriptor
+ *      first_id:  first slot of the range
+ *      n:         number of slots, SDB_LOCK_TO_END for the rest of the file
+ *      type:      SDB_LOCK_READ or SDB_LOCK_WRITE
+ *
+ *  Waits until the range can be locked.  A lock taken over a range this
+ *  descriptor already holds replaces it, so callers must not nest a read
+ *  lock inside their own write lock.
+ *
+ *  returns:  NO_ERROR       range locked
+ *            ERR_DB_FILE    the lock could not be taken
+ */
+int lock_slots(int fd, int first_id, int n, int type)
+{
+    return set_lock(fd, first_id, n, type, SDB_SETLKW) == 0 ? NO_ERROR : ERR_DB_FILE;
+}
+
+/*
+ *  try_lock_slots
+ *      fd, first_id, n, type:  as lock_slots()
+ *
+ *  lock_slots() that gives up instead of waiting.
+ *
+ *  returns:  NO_ERROR       range locked
+ *            ERR_DB_OP      another descriptor holds a conflicting lock
+ *            ERR_DB_FILE    the lock could not be taken
+ */
+int try_lock_slots(int fd, int first_id, int n, int type)
+{
+    if (set_lock(fd, first_id, n, type, SDB_SETLK) == 0)
+        return NO_ERROR;
+    return (errno == EAGAIN || errno == EACCES) ? ERR_DB_OP : ERR_DB_FILE;
+}
+
+/*
+ *  unlock_slots
+ *      fd:        database file descriptor
+ *      first_id:  first slot of the range
+ *      n:         number of slots, as passed to lock_slots()
+ */
+void unlock_slots(int fd, int first_id, int n)
+{
+    set_lock(fd, first_id, n, F_UNLCK, SDB_SETLK);
+}
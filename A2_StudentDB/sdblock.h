@@ -0,0 +1,23 @@
+#ifndef __SDB_LOCK_H__
+#define __SDB_LOCK_H__
+
+#include <fcntl.h>
+
+//Record locks.  Every operation that reads a slot, checks it and writes it
+//back holds a write lock on the byte range of the slot for the whole
+//sequence, single record readers hold a read lock on theirs.  Locks are
+//fcntl() open file description locks, so readers never block each other,
+//writers only wait for processes touching the same slots, and a lock goes
+//away with the descriptor if the holder dies.
+#define SDB_LOCK_READ       F_RDLCK
+#define SDB_LOCK_WRITE      F_WRLCK
+
+//Slot count meaning every slot from first_id to the end of the id space
+#define SDB_LOCK_TO_END     0
+
+//prototypes for record locks
+int lock_slots(int fd, int first_id, int n, int type);
+int try_lock_slots(int fd, int first_id, int n, int type);
+void unlock_slots(int fd, int first_id, int n);
+
+#endif
@@ -0,0 +1,589 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdbscan.h"
+#include "sdbfmt.h"
+#include "sdbcrc.h"
+#include "sdbsnap.h"
+#include "sdbpack.h"
+
+_Static_assert(sizeof(pack_row_t) == 16, "packed row must be 16 bytes");
+
+//Name dictionary being built.  buckets hold code + 1 of the name hashed
+//there, 0 when free.  off has nnames + 1 entries, name i is heap bytes
+//[off[i], off[i + 1]).
+typedef struct pack_dict {
+    uint32_t    *buckets;
+    uint32_t    nbuckets;
+    uint32_t    *off;
+    uint32_t    nnames;
+    uint32_t    off_cap;
+    char        *heap;
+    size_t      heap_len;
+    size_t      heap_cap;
+} pack_dict_t;
+
+//A packing in progress, rows in scan order as the partitions are merged.
+//error is set once memory ran out.
+typedef struct pack_build {
+    pack_dict_t dict;
+    pack_row_t  *rows;
+    uint32_t    nrows;
+    uint32_t    cap;
+    int         error;
+} pack_build_t;
+
+//A packed file mapped by map_pack(), rows, off and heap point into buf
+typedef struct pack_view {
+    char                *buf;
+    size_t              len;
+    const pack_header_t *hdr;
+    const pack_row_t    *rows;
+    const uint32_t      *off;
+    const char          *heap;
+} pack_view_t;
+
+static int cmp_row_id(const void *a, const void *b)
+{
+    const pack_row_t *ra = a;
+    const pack_row_t *rb = b;
+    return (ra->id > rb->id) - (ra->id < rb->id);
+}
+
+/*
+ *  name_len
+ *      *name:  fixed size name field
+ *      size:   size of the field
+ *
+ *  returns:  length of the name, which fills the field if not terminated
+ */
+static uint32_t name_len(const char *name, size_t size)
+{
+    return (uint32_t)strnlen(name, size);
+}
+
+/*
+ *  grow_array
+ *      **arr:  array to grow, replaced on success
+ *      *cap:   its capacity in elements, doubled on success
+ *      elem:   size of an element
+ *
+ *  returns:  true, or false if memory ran out (the array is unchanged)
+ */
+static bool grow_array(void **arr, uint32_t *cap, size_t elem)
+{
+    uint32_t n = (*cap == 0) ? 1024 : *cap * 2;
+    void *grown = realloc(*arr, (size_t)n * elem);
+    if (grown == NULL)
+        return false;
+    *arr = grown;
+    *cap = n;
+    return true;
+}
+
+/*
+ *  dict_rehash
+ *      *d:  dictionary whose buckets are half taken
+ *
+ *  returns:  true, or false if memory ran out (the dictionary is unchanged)
+ */
+static bool dict_rehash(pack_dict_t *d)
+{
+    uint32_t n = d->nbuckets * 2;
+    uint32_t *buckets = calloc(n, sizeof(uint32_t));
+    if (buckets == NULL)
+        return false;
+    for (uint32_t code = 0; code < d->nnames; code++)
+    {
+        uint32_t h = crc32c(0, d->heap + d->off[code], d->off[code + 1] - d->off[code]);
+        uint32_t b = h & (n - 1);
+        while (buckets[b] != 0)
+            b = (b + 1) & (n - 1);
+        buckets[b] = code + 1;
+    }
+    free(d->buckets);
+    d->buckets = buckets;
+    d->nbuckets = n;
+    return true;
+}
+
+/*
+ *  dict_intern
+ *      *d:     dictionary
+ *      *name:  name bytes, not terminated
+ *      len:    their length
+ *
+ *  Looks the name up by its CRC-32C, open addressing with linear probing,
+ *  and appends it to the heap if it is new.
+ *
+ *  returns:  the code of the name, or UINT32_MAX if memory ran out
+ */
+static uint32_t dict_intern(pack_dict_t *d, const char *name, uint32_t len)
+{
+    uint32_t h = crc32c(0, name, len);
+    uint32_t b = h & (d->nbuckets - 1);
+    while (d->buckets[b] != 0)
+    {
+        uint32_t code = d->buckets[b] - 1;
+        if (d->off[code + 1] - d->off[code] == len &&
+            memcmp(d->heap + d->off[code], name, len) == 0)
+            return code;
+        b = (b + 1) & (d->nbuckets - 1);
+    }
+
+    if (d->nnames + 2 > d->off_cap && !grow_array((void **)&d->off, &d->off_cap, sizeof(uint32_t)))
+        return UINT32_MAX;
+    if (d->heap_len + len > d->heap_cap)
+    {
+        size_t cap = (d->heap_cap == 0) ? SDB_OUT_BUF_SIZE : d->heap_cap * 2;
+        char *grown = realloc(d->heap, cap);
+        if (grown == NULL)
+            return UINT32_MAX;
+        d->heap = grown;
+        d->heap_cap = cap;
+    }
+    uint32_t code = d->nnames++;
+    memcpy(d->heap + d->heap_len, name, len);
+    d->heap_len += len;
+    d->off[code + 1] = (uint32_t)d->heap_len;
+    d->buckets[b] = code + 1;
+    if (d->nnames * 2 > d->nbuckets && !dict_rehash(d))
+        return UINT32_MAX;
+    return code;
+}
+
+/*
+ *  pack_part
+ *      *it:   iterator over one partition
+ *      *ctx:  out_buf_t receiving the partition's live records
+ *      *arg:  unused
+ *
+ *  returns:  NO_ERROR, or ERR_DB_FILE if the records could not be buffered
+ */
+static int pack_part(scan_iter_t *it, void *ctx, void *arg)
+{
+    out_buf_t *part = ctx;
+    student_t *rec;
+    (void)arg;
+
+    if (out_open(part, -1) != NO_ERROR)
+        return ERR_DB_FILE;
+    while ((rec = scan_next(it)) != NULL)
+        out_bytes(part, (const char *)rec, STUDENT_RECORD_SIZE);
+    return part->error;
+}
+
+/*
+ *  pack_merge
+ *      *ctx:  out_buf_t filled by pack_part()
+ *      *arg:  pack_build_t
+ *      rc:    status of the scan so far
+ *
+ *  Encodes the partition's records into packed rows.
+ *
+ *  returns:  NO_ERROR, or ERR_DB_FILE if memory ran out
+ */
+static int pack_merge(void *ctx, void *arg, int rc)
+{
+    out_buf_t *part = ctx;
+    pack_build_t *pb = arg;
+    const student_t *recs = (const student_t *)part->buf;
+    size_t n = part->len / STUDENT_RECORD_SIZE;
+
+    for (size_t i = 0; rc == NO_ERROR && i < n; i++)
+    {
+        if (pb->nrows == pb->cap && !grow_array((void **)&pb->rows, &pb->cap, sizeof(pack_row_t)))
+            rc = ERR_DB_FILE;
+        if (rc != NO_ERROR)
+            break;
+        pack_row_t *row = &pb->rows[pb->nrows];
+        row->id = recs[i].id;
+        row->gpa = recs[i].gpa;
+        row->fname = dict_intern(&pb->dict, recs[i].fname, name_len(recs[i].fname, sizeof(recs[i].fname)));
+        row->lname = dict_intern(&pb->dict, recs[i].lname, name_len(recs[i].lname, sizeof(recs[i].lname)));
+        if (row->fname == UINT32_MAX || row->lname == UINT32_MAX)
+            rc = ERR_DB_FILE;
+        else
+            pb->nrows++;
+    }
+    if (rc != NO_ERROR)
+        pb->error = rc;
+    out_close(part);
+    return rc;
+}
+
+/*
+ *  write_all
+ *      out_fd:  file to write
+ *      *buf:    bytes to write
+ *      len:     how many
+ *
+ *  returns:  true if everything was written
+ */
+static bool write_all(int out_fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = write(out_fd, p, len);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/*
+ *  pack_db
+ *      fd:     database file descriptor
+ *      *path:  packed file to write
+ *
+ *  Converts the database to the packed format (sdbpack.h).  The records
+ *  come from one parallel scan of a snapshot (see sdbsnap.h), so writers
+ *  carry on, and are encoded as the partitions are merged, then sorted by
+ *  id since the hash layout scans in table order.  Names are interned in a
+ *  hash table keyed by their CRC-32C.
+ *
+ *  returns:  <number>       number of students packed
+ *            ERR_DB_FILE    database or packed file I/O issue, or out of
+ *                           memory
+ *
+ *  console:  M_PACK_PACKED on success, M_ERR_PACK_OPEN if the packed file
+ *            cannot be written, M_ERR_DB_READ otherwise
+ */
+int pack_db(int fd, char *path)
+{
+    pack_build_t pb = {0};
+    snap_view_t view;
+    int rc = ERR_DB_FILE;
+
+    pb.dict.nbuckets = PACK_DICT_BUCKETS;
+    pb.dict.buckets = calloc(pb.dict.nbuckets, sizeof(uint32_t));
+    if (pb.dict.buckets != NULL && grow_array((void **)&pb.dict.off, &pb.dict.off_cap, sizeof(uint32_t)) &&
+        snap_begin(fd, &view) == NO_ERROR)
+    {
+        pb.dict.off[0] = 0;
+        scan_job_t job = {pack_part, pack_merge, sizeof(out_buf_t), &pb, &view, 0};
+        rc = scan_parallel(fd, &job);
+        snap_end(&view);
+    }
+    if (rc != NO_ERROR || pb.error != NO_ERROR)
+    {
+        printf(M_ERR_DB_READ);
+        rc = ERR_DB_FILE;
+        goto out;
+    }
+
+    qsort(pb.rows, pb.nrows, sizeof(pack_row_t), cmp_row_id);
+    pack_dict_t *d = &pb.dict;
+    pack_header_t hdr = {SDB_PACK_MAGIC, SDB_PACK_VERSION, sizeof(pack_row_t), pb.nrows,
+                         d->nnames, (uint32_t)d->heap_len, 0, 0, (uint64_t)store_capacity(fd)};
+    size_t rows_len = (size_t)pb.nrows * sizeof(pack_row_t);
+    size_t off_len = ((size_t)d->nnames + 1) * sizeof(uint32_t);
+    hdr.crc = crc32c(0, pb.rows, rows_len);
+    hdr.crc = crc32c(hdr.crc, d->off, off_len);
+    hdr.crc = crc32c(hdr.crc, d->heap, d->heap_len);
+
+    int out_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (out_fd == -1 || !write_all(out_fd, &hdr, sizeof(hdr)) || !write_all(out_fd, pb.rows, rows_len) ||
+        !write_all(out_fd, d->off, off_len) || !write_all(out_fd, d->heap, d->heap_len) ||
+        close(out_fd) == -1)
+    {
+        if (out_fd != -1)
+            close(out_fd);
+        printf(M_ERR_PACK_OPEN, path);
+        rc = ERR_DB_FILE;
+        goto out;
+    }
+
+    long long packed = (long long)(sizeof(hdr) + rows_len + off_len + d->heap_len);
+    printf(M_PACK_PACKED, pb.nrows, d->nnames, path, packed,
+           (long long)pb.nrows * STUDENT_RECORD_SIZE);
+    rc = (int)pb.nrows;
+out:
+    free(pb.rows);
+    free(pb.dict.buckets);
+    free(pb.dict.off);
+    free(pb.dict.heap);
+    return rc;
+}
+
+/*
+ *  check_pack
+ *      *buf:  whole packed file
+ *      len:   its length
+ *
+ *  returns:  true if the header, length, checksum, name offsets and codes
+ *            are consistent and every name fits its student_t field
+ */
+static bool check_pack(const char *buf, size_t len)
+{
+    const pack_header_t *hdr = (const pack_header_t *)buf;
+    if (len < sizeof(*hdr) || hdr->magic != SDB_PACK_MAGIC || hdr->version != SDB_PACK_VERSION ||
+        hdr->row_size != sizeof(pack_row_t))
+        return false;
+
+    size_t rows_len = (size_t)hdr->nrows * sizeof(pack_row_t);
+    size_t off_len = ((size_t)hdr->nnames + 1) * sizeof(uint32_t);
+    if (len != sizeof(*hdr) + rows_len + off_len + hdr->heap_len ||
+        hdr->crc != crc32c(0, buf + sizeof(*hdr), len - sizeof(*hdr)))
+        return false;
+
+    const pack_row_t *rows = (const pack_row_t *)(buf + sizeof(*hdr));
+    const uint32_t *off = (const uint32_t *)(buf + sizeof(*hdr) + rows_len);
+    if (off[0] != 0 || off[hdr->nnames] != hdr->heap_len)
+        return false;
+    for (uint32_t i = 0; i < hdr->nnames; i++)
+    {
+        if (off[i + 1] < off[i])
+            return false;
+    }
+    for (uint32_t i = 0; i < hdr->nrows; i++)
+    {
+        if (rows[i].fname >= hdr->nnames || rows[i].lname >= hdr->nnames ||
+            off[rows[i].fname + 1] - off[rows[i].fname] > sizeof(((student_t *)0)->fname) ||
+            off[rows[i].lname + 1] - off[rows[i].lname] > sizeof(((student_t *)0)->lname))
+            return false;
+    }
+    return true;
+}
+
+/*
+ *  map_pack
+ *      *path:  packed file written by pack_db()
+ *      by_id:  the rows must be in strictly increasing id order
+ *      *v:     receives the mapped file
+ *
+ *  Maps the file and checks it as a whole.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ *
+ *  console:  M_ERR_PACK_OPEN or M_ERR_PACK_BAD on error
+ */
+static int map_pack(char *path, bool by_id, pack_view_t *v)
+{
+    struct stat sb;
+    int in_fd = open(path, O_RDONLY);
+    if (in_fd == -1 || fstat(in_fd, &sb) == -1 || sb.st_size < (off_t)sizeof(pack_header_t))
+    {
+        if (in_fd != -1)
+            close(in_fd);
+        printf(M_ERR_PACK_OPEN, path);
+        return ERR_DB_FILE;
+    }
+    v->len = sb.st_size;
+    v->buf = mmap(NULL, v->len, PROT_READ, MAP_PRIVATE, in_fd, 0);
+    close(in_fd);
+    if (v->buf == MAP_FAILED)
+    {
+        printf(M_ERR_PACK_OPEN, path);
+        return ERR_DB_FILE;
+    }
+
+    bool good = check_pack(v->buf, v->len);
+    v->hdr = (const pack_header_t *)v->buf;
+    v->rows = (const pack_row_t *)(v->buf + sizeof(*v->hdr));
+    for (uint32_t i = 1; good && by_id && i < v->hdr->nrows; i++)
+        good = v->rows[i - 1].id < v->rows[i].id;
+    if (!good)
+    {
+        munmap(v->buf, v->len);
+        printf(M_ERR_PACK_BAD, path);
+        return ERR_DB_FILE;
+    }
+    v->off = (const uint32_t *)(v->rows + v->hdr->nrows);
+    v->heap = (const char *)(v->off + v->hdr->nnames + 1);
+    return NO_ERROR;
+}
+
+/*
+ *  unpack_row
+ *      *v:  mapped packed file
+ *      *p:  one of its rows
+ *      *s:  receives the student_t the row was packed from
+ */
+static void unpack_row(const pack_view_t *v, const pack_row_t *p, student_t *s)
+{
+    memset(s, 0, sizeof(*s));
+    s->id = p->id;
+    s->gpa = p->gpa;
+    memcpy(s->fname, v->heap + v->off[p->fname], v->off[p->fname + 1] - v->off[p->fname]);
+    memcpy(s->lname, v->heap + v->off[p->lname], v->off[p->lname + 1] - v->off[p->lname]);
+}
+
+/*
+ *  unpack_db
+ *      fd:     database file descriptor
+ *      *path:  packed file written by pack_db()
+ *
+ *  Converts a packed file back to student_t records and adds them to the
+ *  database.  The file is mapped and checked as a whole before anything is
+ *  written, then its records are validated like bulk load rows and loaded
+ *  with the same coalesced window writes.  Ids already in the database are
+ *  rejected, so a packed database is restored into an empty one (-z).
+ *
+ *  returns:  NO_ERROR       every record was loaded
+ *            ERR_DB_OP      some records were rejected (the rest were loaded)
+ *            ERR_DB_FILE    database or packed file I/O issue, or a bad file
+ *
+ *  console:  M_ERR_PACK_OPEN, M_ERR_PACK_BAD, M_ERR_DUMP_REC for each
+ *            record out of range, M_ERR_DB_ADD_DUP for each id already
+ *            taken and M_PACK_UNPACKED on completion
+ */
+int unpack_db(int fd, char *path)
+{
+    pack_view_t v;
+    if (map_pack(path, false, &v) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    student_t *rows = calloc(v.hdr->nrows + 1, sizeof(student_t));
+    if (rows == NULL)
+    {
+        munmap(v.buf, v.len);
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    int capacity = store_capacity(fd);
+    int nrows = 0;
+    int rejected = 0;
+    for (uint32_t i = 0; i < v.hdr->nrows; i++)
+    {
+        const pack_row_t *p = &v.rows[i];
+        if (validate_range(p->id, p->gpa) != NO_ERROR || p->id > capacity)
+        {
+            printf(M_ERR_DUMP_REC, i + 1);
+            rejected++;
+            continue;
+        }
+        unpack_row(&v, p, &rows[nrows++]);
+    }
+    munmap(v.buf, v.len);
+
+    int loaded = load_rows(fd, rows, nrows, &rejected);
+    free(rows);
+    if (loaded < 0)
+        return ERR_DB_FILE;
+
+    printf(M_PACK_UNPACKED, loaded, rejected);
+    return (rejected > 0) ? ERR_DB_OP : NO_ERROR;
+}
+
+/*
+ *  print_pack
+ *      *path:  packed file written by pack_db()
+ *
+ *  print_db() for a packed file, read in place without unpacking it into
+ *  a database.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ *
+ *  console:  If there are records, first prints a header then each record.
+ *            Otherwise, prints M_DB_EMPTY.  M_ERR_PACK_OPEN, M_ERR_PACK_BAD
+ *            or M_ERR_DB_READ on error.
+ */
+int print_pack(char *path)
+{
+    pack_view_t v;
+    out_buf_t out;
+    student_t s;
+
+    if (map_pack(path, true, &v) != NO_ERROR)
+        return ERR_DB_FILE;
+    int rc = out_open(&out, fileno(stdout));
+    if (rc == NO_ERROR)
+    {
+        if (v.hdr->nrows > 0)
+            out_header(&out);
+        for (uint32_t i = 0; i < v.hdr->nrows; i++)
+        {
+            unpack_row(&v, &v.rows[i], &s);
+            out_student(&out, &s);
+        }
+        rc = out_close(&out);
+    }
+    uint32_t nrows = v.hdr->nrows;
+    munmap(v.buf, v.len);
+
+    if (rc != NO_ERROR)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    if (nrows == 0)
+        printf(M_DB_EMPTY);
+    return NO_ERROR;
+}
+
+/*
+ *  find_pack
+ *      *path:   packed file written by pack_db()
+ *      nids:    number of ids on the command line
+ *      **args:  the ids as given on the command line
+ *
+ *  find_students() for a packed file, each id is binary searched in the
+ *  rows, which are in id order.
+ *
+ *  returns:  NO_ERROR        every student was found
+ *            SRCH_NOT_FOUND  at least one id has no student
+ *            ERR_DB_FILE     packed file I/O issue or a bad file
+ *
+ *  console:  M_STD_NOT_FND_MSG for every missing id, M_ERR_PACK_OPEN,
+ *            M_ERR_PACK_BAD or M_ERR_DB_READ on error
+ */
+int find_pack(char *path, int nids, char **args)
+{
+    pack_view_t v;
+    if (map_pack(path, true, &v) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    const pack_row_t **found = malloc((size_t)nids * sizeof(*found));
+    if (found == NULL)
+    {
+        munmap(v.buf, v.len);
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    int nfound = 0;
+    for (int i = 0; i < nids; i++)
+    {
+        pack_row_t key = {0};
+        key.id = atoi(args[i]);
+        found[i] = bsearch(&key, v.rows, v.hdr->nrows, sizeof(pack_row_t), cmp_row_id);
+        nfound += (found[i] != NULL);
+    }
+
+    // same output as find_students()
+    int rc = NO_ERROR;
+    if (nfound > 0)
+        printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
+    for (int i = 0; i < nids; i++)
+    {
+        student_t s;
+        if (found[i] == NULL)
+        {
+            printf(M_STD_NOT_FND_MSG, atoi(args[i]));
+            rc = SRCH_NOT_FOUND;
+            continue;
+        }
+        unpack_row(&v, found[i], &s);
+        printf(STUDENT_PRINT_FMT_STRING, s.id, s.fname, s.lname, s.gpa / 100.0);
+    }
+    free(found);
+    munmap(v.buf, v.len);
+    return rc;
+}
@@ -0,0 +1,48 @@
+#ifndef __SDB_PACK_H__
+#define __SDB_PACK_H__
+
+#include <stdint.h>
+
+#include "db.h" //get student record type
+
+//Packed format written by pack_db() and read back by unpack_db().  The 56
+//bytes of fixed name arrays in a student_t are replaced by two 4 byte codes
+//into a name dictionary shared by first and last names, so a row is 16
+//bytes and four fit where one student_t did.  The file is a header, the
+//rows in id order, nnames + 1 offsets into the string heap (name i is heap
+//bytes [off[i], off[i + 1]), not terminated) and the heap.  crc is a
+//CRC-32C of everything after the header, a damaged file is rejected as a
+//whole.  Conversion is offline, the database keeps its own layout, but -p
+//and -f read a packed file in place when given SDB_PACK_ARG followed by
+//its path.
+#define SDB_PACK_EXT        ".pack"
+#define SDB_PACK_ARG        "--pack="
+#define SDB_PACK_MAGIC      0x4b415053u     // "SPAK"
+#define SDB_PACK_VERSION    1
+
+//Initial number of dictionary buckets, doubled whenever half are taken
+#define PACK_DICT_BUCKETS   4096
+
+//File header.  capacity is the id capacity of the packed database,
+//informational only.
+typedef struct pack_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t row_size;
+    uint32_t nrows;
+    uint32_t nnames;
+    uint32_t heap_len;
+    uint32_t crc;
+    uint32_t reserved;
+    uint64_t capacity;
+} pack_header_t;
+
+//One student, fname and lname are dictionary codes
+typedef struct pack_row {
+    int32_t  id;
+    uint32_t fname;
+    uint32_t lname;
+    int32_t  gpa;
+} pack_row_t;
+
+#endif
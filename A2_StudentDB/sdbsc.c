@@ -5,10 +5,24 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <time.h>
 
 // database include files
 #include "db.h"
 #include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdbbitmap.h"
+#include "sdbscan.h"
+#include "sdbindex.h"
+#include "sdbcolumn.h"
+#include "sdbserver.h"
+#include "sdblock.h"
+#include "sdbbatch.h"
+#include "sdbfmt.h"
+#include "sdbsum.h"
+#include "sdbsnap.h"
+#include "sdbpack.h"
+#include "sdbsort.h"
 
 /*
  *  open_db
@@ -26,45 +40,73 @@ int open_db(char *dbFile, bool should_truncate)
     // Set permissions: rw-rw----
     mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
 
-    // open the file if it exists for Read and Write,
-    // create it if it does not exist
-    int flags = O_RDWR | O_CREAT;
-    if (should_truncate)
-        flags |= O_TRUNC;
-
-    int fd = open(dbFile, flags, mode);
+    // open the file if it exists for Read and Write, create it if it does
+    // not exist.  Emptying it is left to store_attach(), which holds off
+    // the processes that have it open meanwhile.
+    int fd = open(dbFile, O_RDWR | O_CREAT, mode);
     if (fd == -1)
     {
         printf(M_ERR_DB_OPEN);
         return ERR_DB_FILE;
     }
+
+    // attach the storage engine (mmap unless unavailable or overridden)
+    if (store_attach(fd, dbFile, should_truncate) == NULL)
+    {
+        close(fd);
+        printf(M_ERR_DB_OPEN);
+        return ERR_DB_FILE;
+    }
     return fd;
 }
 
 /*
- *  get_student
+ *  close_db
+ *      fd:  database file descriptor returned by open_db()
+ *
+ *  Commits any records written through the storage engine (msync for the
+ *  mmap engine) and closes the file.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    the commit failed
+ *
+ *  console:  M_ERR_DB_WRITE on error
+ */
+int close_db(int fd)
+{
+    int rc = store_detach(fd);
+    close(fd);
+    if (rc != NO_ERROR)
+    {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  read_student
  *      fd:  linux file descriptor
  *      id:  the student id we are looking for
  *      *s:  pointer where the located student data will be copied
  *
- *  returns:  NO_ERROR       student located and copied into *s
- *            ERR_DB_FILE    database file I/O issue
- *            SRCH_NOT_FOUND student was not located in the database
+ *  get_student() without the record lock, for callers that already hold a
+ *  lock on the slot.
  *
- *  console:  Does not produce any console I/O
+ *  returns:  NO_ERROR, ERR_DB_FILE or SRCH_NOT_FOUND as get_student()
  */
-int get_student(int fd, int id, student_t *s)
+static int read_student(int fd, int id, student_t *s)
 {
-    off_t offset = id * STUDENT_RECORD_SIZE;
-    if (lseek(fd, offset, SEEK_SET) == -1)
+    int rc = store_read_slot(fd, id, s);
+    if (rc == ERR_DB_FILE)
     {
         printf(M_ERR_DB_READ);
         return ERR_DB_FILE;
     }
-    ssize_t n = read(fd, s, STUDENT_RECORD_SIZE);
-    if (n < STUDENT_RECORD_SIZE)
+    if (rc == SRCH_NOT_FOUND)
     {
         // If no record is read, treat as not found.
+        memset(s, 0, STUDENT_RECORD_SIZE);
         return SRCH_NOT_FOUND;
     }
     // If the record is all zeros, it is empty (or deleted).
@@ -76,37 +118,139 @@ int get_student(int fd, int id, student_t *s)
 }
 
 /*
- *  add_student
- *      fd:     linux file descriptor
- *      id:     student id (range is defined in db.h )
- *      fname:  student first name
- *      lname:  student last name
- *      gpa:    GPA as an integer (range defined in db.h)
+ *  get_student
+ *      fd:  linux file descriptor
+ *      id:  the student id we are looking for
+ *      *s:  pointer where the located student data will be copied
  *
- *  returns:  NO_ERROR       student added to database
- *            ERR_DB_FILE    database file I/O issue
- *            ERR_DB_OP      student already exists
+ *  The slot is read under a read lock so a concurrent writer is never seen
+ *  half way through.  A slot in the page cache that nobody wrote since it
+ *  was cached needs neither.  What was read is checked against the record
+ *  checksum of id (see sdbsum.h), an empty slot included.  An id below
+ *  MIN_STD_ID is not looked up, slot 0 holds the file header.
  *
- *  console:  M_STD_ADDED       on success
- *            M_ERR_DB_ADD_DUP  if student already exists
- *            M_ERR_DB_READ     error reading the database file
- *            M_ERR_DB_WRITE    error writing to the database file
+ *  returns:  NO_ERROR       student located and copied into *s
+ *            ERR_DB_FILE    database file I/O issue or corrupt record
+ *            SRCH_NOT_FOUND student was not located in the database
+ *
+ *  console:  M_SUM_BAD if the record does not match its checksum
  */
-int add_student(int fd, int id, char *fname, char *lname, int gpa)
+int get_student(int fd, int id, student_t *s)
 {
-    off_t offset = id * STUDENT_RECORD_SIZE;
-    student_t existing;
-    
-    // Seek to the proper offset.
-    if (lseek(fd, offset, SEEK_SET) == -1)
+    db_store_t *st = store_lookup(fd);
+
+    if (id < MIN_STD_ID)
+    {
+        memset(s, 0, STUDENT_RECORD_SIZE);
+        return SRCH_NOT_FOUND;
+    }
+
+    // A cache hit can land between a writer's record and its checksum, a
+    // mismatch there is settled by the locked read.
+    if (store_cache_lookup(fd, id, s) && sum_check(st, id, s))
+        return (memcmp(s, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) == 0) ? SRCH_NOT_FOUND : NO_ERROR;
+
+    if (lock_slots(fd, id, 1, SDB_LOCK_READ) != NO_ERROR)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    int rc = read_student(fd, id, s);
+    if (rc != ERR_DB_FILE && !sum_check(st, id, s))
+    {
+        printf(M_SUM_BAD, id);
+        rc = ERR_DB_FILE;
+    }
+    unlock_slots(fd, id, 1);
+    return rc;
+}
+
+/*
+ *  get_students
+ *      fd:    linux file descriptor
+ *      *ids:  student ids to look up, in any order, duplicates allowed
+ *      n:     number of ids
+ *      *out:  out[i] receives the student with ids[i], or an empty record
+ *             if there is none
+ *
+ *  Batch version of get_student().  One read lock is taken over the span
+ *  of the ids and the records are read in one batch (see sdbbatch.h)
+ *  instead of one lock and read per id.  Every slot read is checked against
+ *  its record checksum like get_student() does.
+ *
+ *  returns:  <number>       number of students found
+ *            ERR_DB_FILE    database file I/O issue or corrupt record
+ *
+ *  console:  M_SUM_BAD for each corrupt record, M_ERR_DB_READ on error
+ */
+int get_students(int fd, const int *ids, int n, student_t *out)
+{
+    int lo = 0, hi = 0, found = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (i == 0 || ids[i] < lo)
+            lo = ids[i];
+        if (i == 0 || ids[i] > hi)
+            hi = ids[i];
+    }
+    if (lo < MIN_STD_ID)
+        lo = MIN_STD_ID;
+    if (n == 0 || hi < lo)
+    {
+        memset(out, 0, (size_t)n * STUDENT_RECORD_SIZE);
+        return 0;
+    }
+
+    if (lock_slots(fd, lo, hi - lo + 1, SDB_LOCK_READ) != NO_ERROR)
     {
         printf(M_ERR_DB_READ);
         return ERR_DB_FILE;
     }
+    int rc = store_read_batch(fd, ids, n, out);
+    db_store_t *st = store_lookup(fd);
+    for (int i = 0; rc == NO_ERROR && i < n; i++)
+    {
+        // slot 0 holds the file header
+        if (ids[i] < MIN_STD_ID)
+            memset(&out[i], 0, STUDENT_RECORD_SIZE);
+        else if (!sum_check(st, ids[i], &out[i]))
+        {
+            printf(M_SUM_BAD, ids[i]);
+            rc = ERR_DB_OP;
+        }
+    }
+    unlock_slots(fd, lo, hi - lo + 1);
+    if (rc == ERR_DB_OP)
+        return ERR_DB_FILE;
+    if (rc != NO_ERROR)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    for (int i = 0; i < n; i++)
+        found += (out[i].id == ids[i] && ids[i] != DELETED_STUDENT_ID);
+    return found;
+}
+
+/*
+ *  add_student_locked
+ *      fd, id, fname, lname, gpa:  as add_student()
+ *
+ *  add_student() for a caller holding the write lock on the slot.
+ */
+static int add_student_locked(int fd, int id, char *fname, char *lname, int gpa)
+{
+    student_t existing;
     
     // Read the record to see if it is already occupied.
-    ssize_t n = read(fd, &existing, STUDENT_RECORD_SIZE);
-    if (n == STUDENT_RECORD_SIZE)
+    int rc = store_read_slot(fd, id, &existing);
+    if (rc == ERR_DB_FILE)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    if (rc == NO_ERROR)
     {
         if (memcmp(&existing, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0)
         {
@@ -124,21 +268,76 @@ int add_student(int fd, int id, char *fname, char *lname, int gpa)
     strncpy(new_student.lname, lname, sizeof(new_student.lname) - 1);
     new_student.gpa = gpa;
     
-    // Seek again to the correct offset.
-    if (lseek(fd, offset, SEEK_SET) == -1)
+    if (store_write_slot(fd, id, &new_student) != NO_ERROR)
+    {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+    
+    printf(M_STD_ADDED, id);
+    return NO_ERROR;
+}
+
+/*
+ *  add_student
+ *      fd:     linux file descriptor
+ *      id:     student id (range is defined in db.h )
+ *      fname:  student first name
+ *      lname:  student last name
+ *      gpa:    GPA as an integer (range defined in db.h)
+ *
+ *  returns:  NO_ERROR       student added to database
+ *            ERR_DB_FILE    database file I/O issue
+ *            ERR_DB_OP      student already exists
+ *
+ *  console:  M_STD_ADDED       on success
+ *            M_ERR_DB_ADD_DUP  if student already exists
+ *            M_ERR_DB_READ     error reading the database file
+ *            M_ERR_DB_WRITE    error writing to the database file
+ */
+int add_student(int fd, int id, char *fname, char *lname, int gpa)
+{
+    // Hold the slot for the whole check-then-write so two processes adding
+    // the same id cannot both succeed.
+    if (lock_slots(fd, id, 1, SDB_LOCK_WRITE) != NO_ERROR)
     {
         printf(M_ERR_DB_WRITE);
         return ERR_DB_FILE;
     }
+    int rc = add_student_locked(fd, id, fname, lname, gpa);
+    unlock_slots(fd, id, 1);
+    return rc;
+}
+
+/*
+ *  del_student_locked
+ *      fd:     linux file descriptor
+ *      id:     student id to be deleted
+ *      *s:     scratch record
+ *
+ *  del_student() for a caller holding the write lock on the slot.
+ */
+static int del_student_locked(int fd, int id, student_t *s)
+{
+    int rc = read_student(fd, id, s);
+    if (rc == SRCH_NOT_FOUND)
+    {
+        printf(M_STD_NOT_FND_MSG, id);
+        return ERR_DB_OP;
+    }
+    else if (rc != NO_ERROR)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
     
-    n = write(fd, &new_student, STUDENT_RECORD_SIZE);
-    if (n < STUDENT_RECORD_SIZE)
+    if (store_write_slot(fd, id, &EMPTY_STUDENT_RECORD) != NO_ERROR)
     {
         printf(M_ERR_DB_WRITE);
         return ERR_DB_FILE;
     }
     
-    printf(M_STD_ADDED, id);
+    printf(M_STD_DEL_MSG, id);
     return NO_ERROR;
 }
 
@@ -147,6 +346,9 @@ int add_student(int fd, int id, char *fname, char *lname, int gpa)
  *      fd:     linux file descriptor
  *      id:     student id to be deleted
  *
+ *  An id below MIN_STD_ID is not in the database, slot 0 holds the file
+ *  header.
+ *
  *  returns:  NO_ERROR       student deleted from database
  *            ERR_DB_FILE    database file I/O issue
  *            ERR_DB_OP      student not in database
@@ -159,33 +361,34 @@ int add_student(int fd, int id, char *fname, char *lname, int gpa)
 int del_student(int fd, int id)
 {
     student_t s;
-    int rc = get_student(fd, id, &s);
-    if (rc == SRCH_NOT_FOUND)
+    if (id < MIN_STD_ID)
     {
         printf(M_STD_NOT_FND_MSG, id);
         return ERR_DB_OP;
     }
-    else if (rc != NO_ERROR)
-    {
-        printf(M_ERR_DB_READ);
-        return ERR_DB_FILE;
-    }
-    
-    off_t offset = id * STUDENT_RECORD_SIZE;
-    if (lseek(fd, offset, SEEK_SET) == -1)
+    if (lock_slots(fd, id, 1, SDB_LOCK_WRITE) != NO_ERROR)
     {
         printf(M_ERR_DB_WRITE);
         return ERR_DB_FILE;
     }
-    
-    ssize_t n = write(fd, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE);
-    if (n < STUDENT_RECORD_SIZE)
-    {
-        printf(M_ERR_DB_WRITE);
-        return ERR_DB_FILE;
-    }
-    
-    printf(M_STD_DEL_MSG, id);
+    int rc = del_student_locked(fd, id, &s);
+    unlock_slots(fd, id, 1);
+    return rc;
+}
+
+//scan_parallel() steps of count_db_records(), ctx is the partition count
+//and arg the total
+static int count_part(scan_iter_t *it, void *ctx, void *arg)
+{
+    (void)arg;
+    *(int *)ctx = scan_count(it);
+    return NO_ERROR;
+}
+
+static int count_merge(void *ctx, void *arg, int rc)
+{
+    if (rc == NO_ERROR)
+        *(int *)arg += *(int *)ctx;
     return NO_ERROR;
 }
 
@@ -198,162 +401,828 @@ int del_student(int fd, int id)
  *
  *  console:  M_DB_RECORD_CNT  if there are records, or M_DB_EMPTY if none
  *            M_ERR_DB_READ    on error
+ *
+ *  When the occupancy bitmap is available the count is a popcount over the
+ *  bitmap, otherwise the file is scanned in parallel with scan_parallel().
  */
 int count_db_records(int fd)
 {
-    if (lseek(fd, 0, SEEK_SET) == -1)
+    db_store_t *st = store_lookup(fd);
+    int count = 0;
+
+    if (st != NULL && st->occ != NULL)
+    {
+        count = occ_count(st);
+        if (count == 0)
+            printf(M_DB_EMPTY);
+        else
+            printf(M_DB_RECORD_CNT, count);
+        return count;
+    }
+
+    scan_job_t job = {count_part, count_merge, sizeof(int), &count, NULL, 0};
+    if (scan_parallel(fd, &job) != NO_ERROR)
     {
         printf(M_ERR_DB_READ);
         return ERR_DB_FILE;
     }
     
-    student_t s;
-    int count = 0;
-    ssize_t n;
+    if (count == 0)
+        printf(M_DB_EMPTY);
+    else
+        printf(M_DB_RECORD_CNT, count);
     
-    while ((n = read(fd, &s, STUDENT_RECORD_SIZE)) == STUDENT_RECORD_SIZE)
+    return count;
+}
+
+//Rows of a scan partition formatted on its own thread.  stats only counts
+//the partition's records for find_by_gpa().
+typedef struct scan_text {
+    out_buf_t   out;
+    gpa_stats_t stats;
+} scan_text_t;
+
+//Where scan partitions are printed, and whether the header went out yet
+typedef struct scan_print {
+    out_buf_t   *out;
+    bool        printedHeader;
+} scan_print_t;
+
+/*
+ *  print_part
+ *      *it:   iterator over one partition
+ *      *ctx:  scan_text_t receiving the formatted rows
+ *      *arg:  unused
+ *
+ *  returns:  NO_ERROR, or ERR_DB_FILE if the rows could not be buffered
+ */
+static int print_part(scan_iter_t *it, void *ctx, void *arg)
+{
+    scan_text_t *text = ctx;
+    student_t *rec;
+    (void)arg;
+
+    if (out_open(&text->out, -1) != NO_ERROR)
+        return ERR_DB_FILE;
+    while ((rec = scan_next(it)) != NULL)
+        out_student(&text->out, rec);
+    return text->out.error;
+}
+
+/*
+ *  print_merge
+ *      *ctx:  scan_text_t filled by print_part()
+ *      *arg:  scan_print_t
+ *      rc:    status of the scan so far
+ *
+ *  Prints the partition's rows, preceded by the header if they are the
+ *  first ones.
+ *
+ *  returns:  NO_ERROR
+ */
+static int print_merge(void *ctx, void *arg, int rc)
+{
+    scan_text_t *text = ctx;
+    scan_print_t *print = arg;
+
+    if (rc == NO_ERROR && text->out.len > 0)
+    {
+        if (!print->printedHeader)
+            out_header(print->out);
+        print->printedHeader = true;
+        out_bytes(print->out, text->out.buf, text->out.len);
+    }
+    out_close(&text->out);
+    return NO_ERROR;
+}
+
+/*
+ *  print_db
+ *      fd:     linux file descriptor
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  If there are valid records, first prints a header then each record.
+ *            Otherwise, prints M_DB_EMPTY.
+ *
+ *  The rows come from a snapshot (see sdbsnap.h), so writers carry on and
+ *  the output is the database as it was when the print started.  When the
+ *  occupancy bitmap is available only the live slots are read, otherwise
+ *  the file is scanned in parallel and every partition is formatted by its
+ *  own thread, then printed in id order.  Rows are rendered with
+ *  format_student() and written SDB_OUT_BUF_SIZE at a time.
+ */
+int print_db(int fd)
+{
+    student_t s;
+    out_buf_t out;
+    scan_print_t print = {&out, false};
+    snap_view_t view;
+    int rc = NO_ERROR;
+
+    if (out_open(&out, fileno(stdout)) != NO_ERROR)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    if (snap_begin(fd, &view) != NO_ERROR)
     {
-        if (memcmp(&s, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0)
+        out_close(&out);
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    if (view.occ != NULL)
+    {
+        for (int id = snap_next(&view, 0); rc == NO_ERROR && id != -1; id = snap_next(&view, id + 1))
         {
-            count++;
+            rc = snap_read(&view, id, &s);
+            if (rc == ERR_DB_FILE)
+                break;
+            rc = NO_ERROR;
+            if (memcmp(&s, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) == 0)
+                continue;
+            if (!print.printedHeader)
+                out_header(&out);
+            print.printedHeader = true;
+            out_student(&out, &s);
         }
     }
+    else
+    {
+        scan_job_t job = {print_part, print_merge, sizeof(scan_text_t), &print, &view, 0};
+        rc = scan_parallel(fd, &job);
+    }
+    snap_end(&view);
+    if (out_close(&out) != NO_ERROR && rc == NO_ERROR)
+        rc = ERR_DB_FILE;
+    if (rc != NO_ERROR)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
     
-    if (count == 0)
+    if (!print.printedHeader)
         printf(M_DB_EMPTY);
+    
+    return NO_ERROR;
+}
+
+static int cmp_student_lname(const void *a, const void *b)
+{
+    const student_t *sa = a;
+    const student_t *sb = b;
+    int c = strncmp(sa->lname, sb->lname, sizeof(sa->lname));
+    if (c != 0)
+        return c;
+    return (sa->id > sb->id) - (sa->id < sb->id);
+}
+
+/*
+ *  find_by_lname
+ *      fd:       linux file descriptor
+ *      *prefix:  last name prefix to look for
+ *
+ *  Looks the prefix up in the last name index, O(log n) plus the number of
+ *  matches, and reads the matching records in one batch.  Without the index the file is
+ *  scanned and the matches sorted.
+ *
+ *  returns:  <number>       number of students found
+ *            SRCH_NOT_FOUND no student has a matching last name
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  a header then each matching student ordered by last name then
+ *            id, M_STD_LNAME_NOT_FND if there are none, M_ERR_DB_READ on
+ *            error
+ */
+int find_by_lname(int fd, char *prefix)
+{
+    db_store_t *st = store_lookup(fd);
+    size_t plen = strlen(prefix);
+    student_t *found = NULL;
+    int nfound = 0;
+
+    if (st != NULL && st->lidx_fd != -1)
+    {
+        int *ids = NULL;
+        int n = lidx_lookup(st, prefix, &ids);
+        found = (n >= 0) ? malloc((n + 1) * sizeof(student_t)) : NULL;
+        if (found == NULL)
+        {
+            free(ids);
+            printf(M_ERR_DB_READ);
+            return ERR_DB_FILE;
+        }
+        if (get_students(fd, ids, n, found) < 0)
+        {
+            free(ids);
+            free(found);
+            return ERR_DB_FILE;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            if (found[i].id == ids[i] && strncmp(found[i].lname, prefix, plen) == 0)
+                found[nfound++] = found[i];
+        }
+        free(ids);
+    }
     else
-        printf(M_DB_RECORD_CNT, count);
+    {
+        scan_iter_t it;
+        student_t *rec;
+        int cap = 64;
+        found = malloc(cap * sizeof(student_t));
+        if (found == NULL || scan_open(&it, fd) != NO_ERROR)
+        {
+            free(found);
+            printf(M_ERR_DB_READ);
+            return ERR_DB_FILE;
+        }
+        while ((rec = scan_next(&it)) != NULL)
+        {
+            if (strncmp(rec->lname, prefix, plen) != 0)
+                continue;
+            if (nfound == cap)
+            {
+                student_t *grown = realloc(found, 2 * cap * sizeof(student_t));
+                if (grown == NULL)
+                    break;
+                found = grown;
+                cap *= 2;
+            }
+            found[nfound++] = *rec;
+        }
+        if (scan_close(&it) != NO_ERROR || rec != NULL)
+        {
+            free(found);
+            printf(M_ERR_DB_READ);
+            return ERR_DB_FILE;
+        }
+        qsort(found, nfound, sizeof(student_t), cmp_student_lname);
+    }
+
+    if (nfound == 0)
+    {
+        free(found);
+        printf(M_STD_LNAME_NOT_FND, prefix);
+        return SRCH_NOT_FOUND;
+    }
+
+    printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST_NAME", "LAST_NAME", "GPA");
+    for (int i = 0; i < nfound; i++)
+    {
+        float real_gpa = found[i].gpa / 100.0;
+        printf(STUDENT_PRINT_FMT_STRING, found[i].id, found[i].fname, found[i].lname, real_gpa);
+    }
+    free(found);
+    return nfound;
+}
+
+/*
+ *  print_gpa_stats
+ *      lo, hi:   gpa range of the query
+ *      *stats:   aggregates of the matching records
+ *
+ *  console:  M_GPA_RANGE_STATS then one histogram line per GPA_HIST_WIDTH
+ *            bucket inside the range, the bar is scaled to the fullest bucket
+ */
+static void print_gpa_stats(int lo, int hi, gpa_stats_t *stats)
+{
+    int widest = 1;
+    int first = (lo - MIN_STD_GPA) / GPA_HIST_WIDTH;
+    int last = (hi - MIN_STD_GPA) / GPA_HIST_WIDTH;
+    char bar[GPA_HIST_BAR_LEN + 2];
+
+    printf(M_GPA_RANGE_STATS, stats->count, lo / 100.0, hi / 100.0,
+           stats->sum / 100.0 / stats->count);
+    for (int b = first; b <= last; b++)
+    {
+        if (stats->hist[b] > widest)
+            widest = stats->hist[b];
+    }
+    for (int b = first; b <= last; b++)
+    {
+        int len = (int)((long long)stats->hist[b] * GPA_HIST_BAR_LEN / widest);
+        if (len == 0 && stats->hist[b] > 0)
+            len = 1;
+        bar[0] = ' ';
+        memset(bar + 1, '#', len);
+        bar[len > 0 ? len + 1 : 0] = '\0';
+
+        // label the part of the bucket that lies inside the range
+        int b_lo = MIN_STD_GPA + b * GPA_HIST_WIDTH;
+        int b_hi = b_lo + GPA_HIST_WIDTH - 1;
+        if (b_lo < lo)
+            b_lo = lo;
+        if (b_hi > hi)
+            b_hi = hi;
+        printf(GPA_HIST_FMT_STRING, b_lo / 100.0, b_hi / 100.0, stats->hist[b], bar);
+    }
+}
+
+//Range, output and running totals of a find_by_gpa() scan
+typedef struct gpa_scan {
+    int         lo;
+    int         hi;
+    out_buf_t   *out;
+    gpa_stats_t stats;
+} gpa_scan_t;
+
+/*
+ *  gpa_part
+ *      *it:   iterator over one partition
+ *      *ctx:  scan_text_t receiving the matching rows and their aggregates
+ *      *arg:  gpa_scan_t with the range
+ *
+ *  returns:  NO_ERROR, or ERR_DB_FILE if the rows could not be buffered
+ */
+static int gpa_part(scan_iter_t *it, void *ctx, void *arg)
+{
+    scan_text_t *text = ctx;
+    gpa_scan_t *scan = arg;
+    student_t *rec;
+
+    if (out_open(&text->out, -1) != NO_ERROR)
+        return ERR_DB_FILE;
+    while ((rec = scan_next(it)) != NULL)
+    {
+        if (rec->gpa < scan->lo || rec->gpa > scan->hi)
+            continue;
+        out_student(&text->out, rec);
+        text->stats.count++;
+        text->stats.sum += rec->gpa;
+        text->stats.hist[(rec->gpa - MIN_STD_GPA) / GPA_HIST_WIDTH]++;
+    }
+    return text->out.error;
+}
+
+/*
+ *  gpa_merge
+ *      *ctx:  scan_text_t filled by gpa_part()
+ *      *arg:  gpa_scan_t with the totals so far
+ *      rc:    status of the scan so far
+ *
+ *  Prints the partition's rows, preceded by the header if they are the
+ *  first ones, and adds its aggregates to the totals.
+ *
+ *  returns:  NO_ERROR
+ */
+static int gpa_merge(void *ctx, void *arg, int rc)
+{
+    scan_text_t *text = ctx;
+    gpa_scan_t *scan = arg;
+
+    if (rc == NO_ERROR && text->stats.count > 0)
+    {
+        if (scan->stats.count == 0)
+            out_header(scan->out);
+        out_bytes(scan->out, text->out.buf, text->out.len);
+        scan->stats.count += text->stats.count;
+        scan->stats.sum += text->stats.sum;
+        for (int b = 0; b < GPA_HIST_BUCKETS; b++)
+            scan->stats.hist[b] += text->stats.hist[b];
+    }
+    out_close(&text->out);
+    return NO_ERROR;
+}
+
+/*
+ *  find_by_gpa
+ *      fd:      linux file descriptor
+ *      lo, hi:  gpa range as integers, inclusive
+ *
+ *  Selects the matching ids and computes the aggregates from the gpa column
+ *  without reading the records, then reads just the matching records to
+ *  print them, SDB_BATCH_IDS at a time.  Without the column the file is
+ *  scanned in parallel.
+ *
+ *  returns:  <number>       number of students in the range
+ *            SRCH_NOT_FOUND no student has a gpa in the range
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  a header then each matching student in id order, followed by
+ *            the count, average and a histogram of the range.
+ *            M_GPA_RANGE_NONE if there are none, M_ERR_DB_READ on error
+ */
+int find_by_gpa(int fd, int lo, int hi)
+{
+    db_store_t *st = store_lookup(fd);
+    gpa_stats_t stats;
+
+    if (st != NULL && st->gpa_col != NULL)
+    {
+        int *ids = malloc((size_t)st->gpa_nslots * sizeof(int));
+        student_t *recs = malloc(SDB_BATCH_IDS * sizeof(student_t));
+        if (ids == NULL || recs == NULL)
+        {
+            free(ids);
+            free(recs);
+            printf(M_ERR_DB_READ);
+            return ERR_DB_FILE;
+        }
+        int n = gpa_range(st, lo, hi, ids, &stats);
+        bool printedHeader = false;
+        for (int first = 0; first < n; first += SDB_BATCH_IDS)
+        {
+            int m = (n - first < SDB_BATCH_IDS) ? n - first : SDB_BATCH_IDS;
+            if (get_students(fd, &ids[first], m, recs) < 0)
+            {
+                free(ids);
+                free(recs);
+                return ERR_DB_FILE;
+            }
+            for (int i = 0; i < m; i++)
+            {
+                if (recs[i].id != ids[first + i])
+                    continue;
+                if (!printedHeader)
+                {
+                    printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST_NAME", "LAST_NAME", "GPA");
+                    printedHeader = true;
+                }
+                printf(STUDENT_PRINT_FMT_STRING, recs[i].id, recs[i].fname, recs[i].lname,
+                       recs[i].gpa / 100.0);
+            }
+        }
+        free(ids);
+        free(recs);
+    }
+    else
+    {
+        out_buf_t out;
+        gpa_scan_t scan = {lo, hi, &out, {0}};
+        scan_job_t job = {gpa_part, gpa_merge, sizeof(scan_text_t), &scan, NULL, 0};
+        if (out_open(&out, fileno(stdout)) != NO_ERROR)
+        {
+            printf(M_ERR_DB_READ);
+            return ERR_DB_FILE;
+        }
+        int rc = scan_parallel(fd, &job);
+        out_close(&out);
+        if (rc != NO_ERROR)
+        {
+            printf(M_ERR_DB_READ);
+            return ERR_DB_FILE;
+        }
+        stats = scan.stats;
+    }
+
+    if (stats.count == 0)
+    {
+        printf(M_GPA_RANGE_NONE, lo / 100.0, hi / 100.0);
+        return SRCH_NOT_FOUND;
+    }
+    print_gpa_stats(lo, hi, &stats);
+    return stats.count;
+}
+
+/*
+ *  grow_db
+ *      fd:        linux file descriptor
+ *      capacity:  new largest student id
+ *
+ *  Grows the id space of the database in place, other processes using the
+ *  database keep running and see the new ids on their next write.
+ *
+ *  returns:  NO_ERROR       capacity grown
+ *            ERR_DB_OP      capacity is not larger than the current one or
+ *                           above SDB_MAX_CAPACITY
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  M_DB_GROWN on success, M_ERR_DB_GROW if the capacity is
+ *            rejected, M_ERR_DB_WRITE on error
+ */
+int grow_db(int fd, long long capacity)
+{
+    int was = store_capacity(fd);
+    if (capacity <= was || capacity > SDB_MAX_CAPACITY)
+    {
+        printf(M_ERR_DB_GROW, was, SDB_MAX_CAPACITY);
+        return ERR_DB_OP;
+    }
+
+    int rc = store_grow(fd, (int)capacity);
+    if (rc == ERR_DB_OP)
+    {
+        printf(M_ERR_DB_GROW, store_capacity(fd), SDB_MAX_CAPACITY);
+        return ERR_DB_OP;
+    }
+    if (rc != NO_ERROR)
+    {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+    printf(M_DB_GROWN, was, (int)capacity);
+    return NO_ERROR;
+}
+
+/*
+ *  print_student
+ *      *s:   pointer to a student_t structure to be printed
+ *
+ *  returns: nothing (void)
+ *
+ *  console:  If s is valid, prints a header and then the student record.
+ *            If s is NULL or s->id is 0, prints M_ERR_STD_PRINT.
+ */
+void print_student(student_t *s)
+{
+    if (s == NULL || s->id == 0)
+    {
+        printf(M_ERR_STD_PRINT);
+        return;
+    }
     
-    return count;
+    printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
+    float real_gpa = s->gpa / 100.0;
+    printf(STUDENT_PRINT_FMT_STRING, s->id, s->fname, s->lname, real_gpa);
 }
 
 /*
- *  print_db
- *      fd:     linux file descriptor
+ *  find_students
+ *      fd:      linux file descriptor
+ *      nids:    number of ids on the command line
+ *      **args:  the ids as given on the command line
+ *
+ *  Looks all the ids up with one get_students() call and prints the found
+ *  students under a single header, in command line order.
+ *
+ *  returns:  NO_ERROR        every student was found
+ *            SRCH_NOT_FOUND  at least one id has no student
+ *            ERR_DB_FILE     database file I/O issue
+ *
+ *  console:  M_STD_NOT_FND_MSG for every missing id
+ *            M_ERR_DB_READ     on error
+ */
+int find_students(int fd, int nids, char **args)
+{
+    int *ids = malloc((size_t)nids * sizeof(int));
+    student_t *recs = malloc((size_t)nids * sizeof(student_t));
+    int rc = NO_ERROR;
+
+    if (ids == NULL || recs == NULL)
+    {
+        free(ids);
+        free(recs);
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    for (int i = 0; i < nids; i++)
+        ids[i] = atoi(args[i]);
+
+    int found = get_students(fd, ids, nids, recs);
+    if (found < 0)
+        rc = ERR_DB_FILE;
+    else
+    {
+        if (found > 0)
+            printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
+        for (int i = 0; i < nids; i++)
+        {
+            if (ids[i] != DELETED_STUDENT_ID && recs[i].id == ids[i])
+                printf(STUDENT_PRINT_FMT_STRING, recs[i].id, recs[i].fname, recs[i].lname,
+                       recs[i].gpa / 100.0);
+            else
+            {
+                printf(M_STD_NOT_FND_MSG, ids[i]);
+                rc = SRCH_NOT_FOUND;
+            }
+        }
+    }
+    free(ids);
+    free(recs);
+    return rc;
+}
+
+/*
+ *  elapsed_ms
+ *      *t0:  start time from clock_gettime(CLOCK_MONOTONIC)
+ *
+ *  returns:  milliseconds since t0
+ */
+static double elapsed_ms(struct timespec *t0)
+{
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) * 1e3 + (t1.tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+/*
+ *  print_compress_stats
+ *      *before:  stat of the database before compaction
+ *      *after:   stat of the database after compaction
+ *      *t0:      time compaction started
+ *
+ *  console:  M_DB_COMPRESS_STATS with the allocated bytes reclaimed
+ */
+static void print_compress_stats(struct stat *before, struct stat *after, struct timespec *t0)
+{
+    long long was = (long long)before->st_blocks * 512;
+    long long now = (long long)after->st_blocks * 512;
+    printf(M_DB_COMPRESS_STATS, was - now, was, now, elapsed_ms(t0));
+}
+
+/*
+ *  write_run
+ *      dst_fd:  file receiving the records
+ *      first:   slot of the first record
+ *      *run:    consecutive records
+ *      n:       number of records
+ *
+ *  returns:  NO_ERROR or ERR_DB_OP if the write failed
+ */
+static int write_run(int dst_fd, int first, student_t *run, int n)
+{
+    off_t offset = (off_t)first * STUDENT_RECORD_SIZE;
+    size_t len = (size_t)n * STUDENT_RECORD_SIZE;
+    return (pwrite(dst_fd, run, len, offset) == (ssize_t)len) ? NO_ERROR : ERR_DB_OP;
+}
+
+/*
+ *  copy_part
+ *      *it:   iterator over one partition of the database being compacted
+ *      *ctx:  unused
+ *      *arg:  int, file descriptor receiving the live records
+ *
+ *  returns:  NO_ERROR or ERR_DB_OP if a write failed
+ */
+static int copy_part(scan_iter_t *it, void *ctx, void *arg)
+{
+    int dst_fd = *(int *)arg;
+    student_t *rec;
+    student_t *run = malloc(SCAN_BLOCK_SIZE);
+    int run_first = 0;
+    int run_len = 0;
+    int rc = NO_ERROR;
+    (void)ctx;
+
+    if (run == NULL)
+        return ERR_DB_FILE;
+    while (rc == NO_ERROR && (rec = scan_next(it)) != NULL)
+    {
+        int slot = it->first_id + (int)(rec - it->block);
+        if (run_len > 0 && (slot != run_first + run_len || run_len == SCAN_BLOCK_SLOTS))
+        {
+            rc = write_run(dst_fd, run_first, run, run_len);
+            run_len = 0;
+        }
+        if (run_len == 0)
+            run_first = slot;
+        run[run_len++] = *rec;
+    }
+    if (rc == NO_ERROR && run_len > 0)
+        rc = write_run(dst_fd, run_first, run, run_len);
+    free(run);
+    return rc;
+}
+
+/*
+ *  copy_live_records
+ *      src_fd:  database being compacted
+ *      dst_fd:  empty file receiving the live records at their own slots
  *
- *  returns:  NO_ERROR       on success
- *            ERR_DB_FILE    database file I/O issue
+ *  Copies the header, then scans src_fd in parallel, each partition
+ *  writing its runs of consecutive live slots to dst_fd with one pwrite()
+ *  per run.  Empty slots are never written so they stay holes.
  *
- *  console:  If there are valid records, first prints a header then each record.
- *            Otherwise, prints M_DB_EMPTY.
+ *  returns:  NO_ERROR       every live record copied
+ *            ERR_DB_FILE    database file I/O issue (message printed)
  */
-int print_db(int fd)
+static int copy_live_records(int src_fd, int dst_fd)
 {
-    if (lseek(fd, 0, SEEK_SET) == -1)
+    student_t hdr;
+    if (store_read_run(src_fd, 0, &hdr, 1) != NO_ERROR)
     {
         printf(M_ERR_DB_READ);
         return ERR_DB_FILE;
     }
-    
-    student_t s;
-    bool printedHeader = false;
-    bool foundAny = false;
-    
-    while (read(fd, &s, STUDENT_RECORD_SIZE) == STUDENT_RECORD_SIZE)
+
+    // the header in slot 0 carries over unchanged
+    if (pwrite(dst_fd, &hdr, STUDENT_RECORD_SIZE, 0) != STUDENT_RECORD_SIZE)
     {
-        if (memcmp(&s, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0)
-        {
-            if (!printedHeader)
-            {
-                printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST_NAME", "LAST_NAME", "GPA");
-                printedHeader = true;
-            }
-            float real_gpa = s.gpa / 100.0;
-            printf(STUDENT_PRINT_FMT_STRING, s.id, s.fname, s.lname, real_gpa);
-            foundAny = true;
-        }
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
     }
-    
-    if (!foundAny)
-        printf(M_DB_EMPTY);
-    
-    return NO_ERROR;
+
+    scan_job_t job = {copy_part, NULL, 0, &dst_fd, NULL, 0};
+    int rc = scan_parallel(src_fd, &job);
+    if (rc == ERR_DB_OP)
+        printf(M_ERR_DB_WRITE);
+    else if (rc != NO_ERROR)
+        printf(M_ERR_DB_READ);
+    return (rc == NO_ERROR) ? NO_ERROR : ERR_DB_FILE;
 }
 
 /*
- *  print_student
- *      *s:   pointer to a student_t structure to be printed
- *
- *  returns: nothing (void)
+ *  sync_parent_dir
+ *      *path:  file whose directory entry must be made durable
  *
- *  console:  If s is valid, prints a header and then the student record.
- *            If s is NULL or s->id is 0, prints M_ERR_STD_PRINT.
+ *  returns:  NO_ERROR or ERR_DB_FILE
  */
-void print_student(student_t *s)
+static int sync_parent_dir(const char *path)
 {
-    if (s == NULL || s->id == 0)
-    {
-        printf(M_ERR_STD_PRINT);
-        return;
-    }
-    
-    printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
-    float real_gpa = s->gpa / 100.0;
-    printf(STUDENT_PRINT_FMT_STRING, s->id, s->fname, s->lname, real_gpa);
+    char dir[SDB_PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    if (slash == NULL)
+        strcpy(dir, ".");
+    else if (slash == path)
+        strcpy(dir, "/");
+    else
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
+
+    int dir_fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (dir_fd == -1)
+        return ERR_DB_FILE;
+    int rc = (fsync(dir_fd) == -1) ? ERR_DB_FILE : NO_ERROR;
+    close(dir_fd);
+    return rc;
 }
 
 /*
  *  compress_db (Extra Credit)
  *      fd:     linux file descriptor of the active database file
  *
+ *  Copies the live records into a temporary file next to the database
+ *  (.tmp_<name>), fsyncs it, renames it over the database and fsyncs the
+ *  directory.  If the machine dies at any point either the old or the
+ *  compacted file is in place, never a partial one.
+ *
  *  returns:  file descriptor of the new (compressed) database file
  *            ERR_DB_FILE    on any file I/O error
  *
- *  console:  M_DB_COMPRESSED_OK on success, or appropriate error messages
+ *  console:  M_DB_COMPRESSED_OK and M_DB_COMPRESS_STATS on success, or
+ *            appropriate error messages
  */
 int compress_db(int fd)
 {
-    // Rewind the original database file.
-    if (lseek(fd, 0, SEEK_SET) == -1)
+    struct timespec t0;
+    struct stat before, after;
+    char db_path[SDB_PATH_MAX];
+    char tmp_path[SDB_PATH_MAX];
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    db_store_t *st = store_lookup(fd);
+    strcpy(db_path, (st != NULL) ? st->path : DB_FILE);
+
+    // Writers are held off until the copy has replaced the file, the lock
+    // goes away with fd in close_db() after the rename, or is released if
+    // no copy is made.
+    if (lock_slots(fd, 0, SDB_LOCK_TO_END, SDB_LOCK_WRITE) != NO_ERROR)
     {
-        printf(M_ERR_DB_READ);
+        printf(M_ERR_DB_WRITE);
         return ERR_DB_FILE;
     }
-    
+
+    // The temporary file lives in the same directory so rename() is atomic.
+    const char *slash = strrchr(db_path, '/');
+    const char *base = (slash != NULL) ? slash + 1 : db_path;
+    int dir_len = (int)(base - db_path);
+    int temp_fd = -1;
+    if (snprintf(tmp_path, sizeof(tmp_path), "%.*s" TMP_DB_PREFIX "%s",
+                 dir_len, db_path, base) >= (int)sizeof(tmp_path) ||
+        fstat(fd, &before) == -1)
+    {
+        printf(M_ERR_DB_OPEN);
+        goto fail;
+    }
+
     // Open the temporary database file.
-    int temp_fd = open(TMP_DB_FILE, O_RDWR | O_CREAT | O_TRUNC,
-                       S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    temp_fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC,
+                   S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
     if (temp_fd == -1)
     {
         printf(M_ERR_DB_OPEN);
-        return ERR_DB_FILE;
+        goto fail;
     }
-    
-    student_t s;
-    // Copy each valid record to the temporary file at its proper offset.
-    while (read(fd, &s, STUDENT_RECORD_SIZE) == STUDENT_RECORD_SIZE)
+
+    if (copy_live_records(fd, temp_fd) != NO_ERROR)
+        goto fail;
+
+    // The copy must be on disk before it can replace the database.
+    if (fsync(temp_fd) == -1 || fstat(temp_fd, &after) == -1)
     {
-        if (memcmp(&s, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0)
-        {
-            off_t offset = s.id * STUDENT_RECORD_SIZE;
-            if (lseek(temp_fd, offset, SEEK_SET) == -1)
-            {
-                printf(M_ERR_DB_WRITE);
-                close(temp_fd);
-                return ERR_DB_FILE;
-            }
-            if (write(temp_fd, &s, STUDENT_RECORD_SIZE) < STUDENT_RECORD_SIZE)
-            {
-                printf(M_ERR_DB_WRITE);
-                close(temp_fd);
-                return ERR_DB_FILE;
-            }
-        }
+        printf(M_ERR_DB_WRITE);
+        goto fail;
     }
     
-    // Close both file descriptors.
-    close(fd);
+    // Rename the temporary file to the actual database file and make the
+    // new directory entry durable while writers are still held off, one
+    // that got in before the rename would write to the old file.
     close(temp_fd);
-    
-    // Rename the temporary file to the actual database file.
-    if (rename(TMP_DB_FILE, DB_FILE) == -1)
+    int rc = NO_ERROR;
+    if (rename(tmp_path, db_path) == -1 || sync_parent_dir(db_path) != NO_ERROR)
+        rc = ERR_DB_FILE;
+    close_db(fd);
+    if (rc != NO_ERROR)
     {
         printf(M_ERR_DB_CREATE);
+        unlink(tmp_path);
         return ERR_DB_FILE;
     }
     
     // Reopen the compressed database file.
-    int new_fd = open_db(DB_FILE, false);
+    int new_fd = open_db(db_path, false);
     if (new_fd == ERR_DB_FILE)
     {
         printf(M_ERR_DB_OPEN);
@@ -361,7 +1230,133 @@ int compress_db(int fd)
     }
     
     printf(M_DB_COMPRESSED_OK);
+    print_compress_stats(&before, &after, &t0);
     return new_fd;
+
+fail:
+    // the database is left as it was, open and unlocked
+    if (temp_fd != -1)
+    {
+        close(temp_fd);
+        unlink(tmp_path);
+    }
+    unlock_slots(fd, 0, SDB_LOCK_TO_END);
+    return ERR_DB_FILE;
+}
+
+//Live span of a compress_db_in_place() partition, or of everything merged
+//so far: first live byte (0 if none) and the end of the last live record
+typedef struct punch_span {
+    int     fd;
+    off_t   first_live;
+    off_t   live_end;
+} punch_span_t;
+
+/*
+ *  punch_part
+ *      *it:   iterator over one partition
+ *      *ctx:  punch_span_t receiving the partition's live span
+ *      *arg:  punch_span_t of the whole file, for the file descriptor
+ *
+ *  Punches the empty slots between the live records of the partition.
+ *
+ *  returns:  NO_ERROR or the store_punch() error
+ */
+static int punch_part(scan_iter_t *it, void *ctx, void *arg)
+{
+    punch_span_t *span = ctx;
+    int fd = ((punch_span_t *)arg)->fd;
+    student_t *rec;
+    int rc = NO_ERROR;
+
+    while ((rec = scan_next(it)) != NULL)
+    {
+        off_t offset = (off_t)(it->first_id + (int)(rec - it->block)) * STUDENT_RECORD_SIZE;
+        if (span->live_end == 0)
+            span->first_live = offset;
+        else if (offset > span->live_end && (rc = store_punch(fd, span->live_end, offset)) != NO_ERROR)
+            break;
+        span->live_end = offset + STUDENT_RECORD_SIZE;
+    }
+    return rc;
+}
+
+/*
+ *  punch_merge
+ *      *ctx:  punch_span_t of the partition
+ *      *arg:  punch_span_t of the partitions merged so far
+ *      rc:    status of the scan so far
+ *
+ *  Punches the empty slots between the previous partitions' last live
+ *  record and this partition's first one.
+ *
+ *  returns:  NO_ERROR or the store_punch() error
+ */
+static int punch_merge(void *ctx, void *arg, int rc)
+{
+    punch_span_t *part = ctx;
+    punch_span_t *span = arg;
+
+    if (rc != NO_ERROR || part->live_end == 0)
+        return NO_ERROR;
+    if (part->first_live > span->live_end &&
+        (rc = store_punch(span->fd, span->live_end, part->first_live)) != NO_ERROR)
+        return rc;
+    span->live_end = part->live_end;
+    return NO_ERROR;
+}
+
+/*
+ *  compress_db_in_place
+ *      fd:     linux file descriptor of the active database file
+ *
+ *  Online alternative to compress_db().  Every run of empty slots between
+ *  live records is deallocated with fallocate(FALLOC_FL_PUNCH_HOLE) and the
+ *  empty slots after the last live record are truncated away.  Each step
+ *  only removes zeros, so a crash at any point leaves a valid database and
+ *  the file descriptor stays open throughout.  Partitions of the file are
+ *  punched in parallel, the gaps between them as they are merged.
+ *  Filesystems that cannot punch holes fall back to compress_db().
+ *
+ *  returns:  fd on success (or the new fd from the compress_db() fallback)
+ *            ERR_DB_FILE    on any file I/O error
+ *
+ *  console:  M_DB_COMPRESSED_OK and M_DB_COMPRESS_STATS on success, or
+ *            appropriate error messages
+ */
+int compress_db_in_place(int fd)
+{
+    struct timespec t0;
+    struct stat before, after;
+    punch_span_t span = {fd, 0, STUDENT_RECORD_SIZE};     // keep the header in slot 0
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (lock_slots(fd, 0, SDB_LOCK_TO_END, SDB_LOCK_WRITE) != NO_ERROR ||
+        fstat(fd, &before) == -1)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    scan_job_t job = {punch_part, punch_merge, sizeof(punch_span_t), &span, NULL, 0};
+    int rc = scan_parallel(fd, &job);
+    off_t live_end = span.live_end;
+
+    if (rc == ERR_DB_OP)
+        return compress_db(fd);
+    if (rc == NO_ERROR && store_truncate(fd, live_end) != NO_ERROR)
+        rc = ERR_DB_FILE;
+    if (rc != NO_ERROR || fsync(fd) == -1 || fstat(fd, &after) == -1)
+    {
+        unlock_slots(fd, 0, SDB_LOCK_TO_END);
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+    unlock_slots(fd, 0, SDB_LOCK_TO_END);
+
+    printf(M_DB_COMPRESSED_OK);
+    print_compress_stats(&before, &after, &t0);
+    return fd;
 }
 
 /*
@@ -369,6 +1364,10 @@ int compress_db(int fd)
  *      id:  proposed student id
  *      gpa: proposed gpa
  *
+ *  The id is checked against the largest capacity any database can have,
+ *  callers that write check the capacity of their database with
+ *  store_capacity().
+ *
  *  returns:    NO_ERROR       on success, both ID and GPA are in range
  *              EXIT_FAIL_ARGS if either ID or GPA is out of range
  *
@@ -376,7 +1375,7 @@ int compress_db(int fd)
  */
 int validate_range(int id, int gpa)
 {
-    if ((id < MIN_STD_ID) || (id > MAX_STD_ID))
+    if ((id < MIN_STD_ID) || (id > SDB_MAX_CAPACITY))
         return EXIT_FAIL_ARGS;
     if ((gpa < MIN_STD_GPA) || (gpa > MAX_STD_GPA))
         return EXIT_FAIL_ARGS;
@@ -395,18 +1394,36 @@ int validate_range(int id, int gpa)
  */
 void usage(char *exename)
 {
-    printf("usage: %s -[h|a|c|d|f|p|z] options.  Where:\n", exename);
+    printf("usage: %s -[h|a|b|c|d|e|f|g|G|i|k|l|p|r|s|S|u|v|x|z] options.  Where:\n", exename);
     printf("\t-h:  prints help\n");
     printf("\t-a id first_name last_name gpa(as 3 digit int):  adds a student\n");
+    printf("\t-b file|-:  bulk loads id,first_name,last_name,gpa rows (CSV or TSV)\n");
     printf("\t-c:  counts the records in the database\n");
     printf("\t-d id:  deletes a student\n");
-    printf("\t-f id:  finds and prints a student in the database\n");
-    printf("\t-p:  prints all records in the student database\n");
-    printf("\t-x:  compress the database file [EXTRA CREDIT]\n");
+    printf("\t-e csv|bin [file|-]:  exports every record as CSV rows or a checksummed binary dump (default stdout)\n");
+    printf("\t-f id [id ...] [--pack=file]:  finds and prints students in the database, or in a file written by -k\n");
+    printf("\t-g lo hi:  finds students with lo <= gpa <= hi (3 digit ints) and summarizes them\n");
+    printf("\t-G capacity:  grows the database to hold ids up to capacity\n");
+    printf("\t-i csv|bin file|-:  imports records exported with -e, ids already in the database are rejected\n");
+    printf("\t-k [file]:  packs the database with dictionary coded names into file (default %s%s)\n", DB_FILE, SDB_PACK_EXT);
+    printf("\t-l last_name:  finds students whose last name starts with last_name\n");
+    printf("\t-p [--sort=lname|fname|gpa | --pack=file]:  prints all records in the student database, by id or sorted (gpa highest first), or in a file written by -k\n");
+    printf("\t-r file|-:  applies a change feed written by -since to this database (a replica)\n");
+    printf("\t-since seq [file|-]:  streams the records changed after sequence seq, 0 for all (default stdout)\n");
+    printf("\t-S [socket]:  serves requests on a Unix domain socket (default %s%s) until SIGINT/SIGTERM\n", DB_FILE, SDB_SOCK_EXT);
+    printf("\t-u file:  unpacks a file written by -k into the database, ids already in the database are rejected\n");
+    printf("\t-v:  verifies every record against its checksum\n");
+    printf("\t-x [punch]:  compress the database file (punch: deallocate empty slots in place)\n");
     printf("\t-z:  zero db file (remove all records)\n");
+    printf("\tenv SDB_LAYOUT=hash:  new database files keep records in a hash table sized by the number of students\n");
+    printf("\tenv SDB_SORT_MEM_KB=n:  memory a sorted print uses before it spills sorted runs to disk\n");
+    printf("\tenv SDB_SCAN_THREADS=n:  threads used by full table scans (default one per CPU)\n");
+    printf("\tenv SDB_WAL_BATCH=n SDB_WAL_INTERVAL_MS=n:  log group commit size and interval, SDB_WAL=off disables the log\n");
 }
 
-// Welcome to main()
+// Welcome to main(), benchmarks link this file with SDBSC_NO_MAIN defined
+// to call the functions above directly
+#ifndef SDBSC_NO_MAIN
 int main(int argc, char *argv[])
 {
     char opt;      // user selected option
@@ -415,6 +1432,8 @@ int main(int argc, char *argv[])
     int exit_code; // exit code to shell
     int id;        // student id
     int gpa;       // gpa
+    int lo, hi;    // gpa range
+    int capacity;  // largest id the database holds
 
     // Space for a student structure to be used by various functions.
     student_t student = {0};
@@ -457,6 +1476,8 @@ int main(int argc, char *argv[])
         id = atoi(argv[2]);
         gpa = atoi(argv[5]);
         exit_code = validate_range(id, gpa);
+        if (exit_code == EXIT_OK && id > store_capacity(fd))
+            exit_code = EXIT_FAIL_ARGS;
         if (exit_code == EXIT_FAIL_ARGS)
         {
             printf(M_ERR_STD_RNG);
@@ -467,6 +1488,19 @@ int main(int argc, char *argv[])
             exit_code = EXIT_FAIL_DB;
         break;
 
+    case 'b':
+        // Expected arguments: -b file|-
+        if (argc != 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = bulk_load(fd, argv[2]);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
     case 'c':
         rc = count_db_records(fd);
         if (rc < 0)
@@ -486,13 +1520,42 @@ int main(int argc, char *argv[])
             exit_code = EXIT_FAIL_DB;
         break;
 
+    case 'e':
+        // Expected arguments: -e csv|bin [file|-]
+        if ((argc != 3 && argc != 4) ||
+            (strcmp(argv[2], "csv") != 0 && strcmp(argv[2], "bin") != 0))
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = export_db(fd, strcmp(argv[2], "bin") == 0, (argc == 4) ? argv[3] : "-");
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
     case 'f':
-        if (argc != 3)
+        // Expected arguments: -f id [id ...] [--pack=file]
+        if (argc > 3 && strncmp(argv[argc - 1], SDB_PACK_ARG, strlen(SDB_PACK_ARG)) == 0)
+        {
+            // the ids are looked up in a packed file instead
+            if (find_pack(argv[argc - 1] + strlen(SDB_PACK_ARG), argc - 3, &argv[2]) != NO_ERROR)
+                exit_code = EXIT_FAIL_DB;
+            break;
+        }
+        if (argc < 3)
         {
             usage(argv[0]);
             exit_code = EXIT_FAIL_ARGS;
             break;
         }
+        if (argc > 3)
+        {
+            // several ids are looked up in one batch
+            if (find_students(fd, argc - 2, &argv[2]) != NO_ERROR)
+                exit_code = EXIT_FAIL_DB;
+            break;
+        }
         id = atoi(argv[2]);
         rc = get_student(fd, id, &student);
         switch (rc)
@@ -511,24 +1574,197 @@ int main(int argc, char *argv[])
         }
         break;
 
+    case 'g':
+        // Expected arguments: -g lo hi
+        if (argc != 4)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        lo = atoi(argv[2]);
+        hi = atoi(argv[3]);
+        if (validate_range(MIN_STD_ID, lo) != NO_ERROR ||
+            validate_range(MIN_STD_ID, hi) != NO_ERROR || lo > hi)
+        {
+            printf(M_ERR_GPA_RNG);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = find_by_gpa(fd, lo, hi);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'i':
+        // Expected arguments: -i csv|bin file|-
+        if (argc != 4 || (strcmp(argv[2], "csv") != 0 && strcmp(argv[2], "bin") != 0))
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = import_db(fd, strcmp(argv[2], "bin") == 0, argv[3]);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'k':
+        // Expected arguments: -k [file]
+        if (argc > 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = pack_db(fd, (argc == 3) ? argv[2] : DB_FILE SDB_PACK_EXT);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'l':
+        if (argc != 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = find_by_lname(fd, argv[2]);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
     case 'p':
-        rc = print_db(fd);
+        // Expected arguments: -p [--sort=lname|fname|gpa | --pack=file]
+        if (argc > 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        if (argc == 3)
+        {
+            if (strncmp(argv[2], SDB_PACK_ARG, strlen(SDB_PACK_ARG)) == 0)
+                rc = print_pack(argv[2] + strlen(SDB_PACK_ARG));
+            else if (strcmp(argv[2], "--sort=lname") == 0)
+                rc = print_db_sorted(fd, SDB_SORT_LNAME);
+            else if (strcmp(argv[2], "--sort=fname") == 0)
+                rc = print_db_sorted(fd, SDB_SORT_FNAME);
+            else if (strcmp(argv[2], "--sort=gpa") == 0)
+                rc = print_db_sorted(fd, SDB_SORT_GPA);
+            else
+            {
+                usage(argv[0]);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+        }
+        else
+            rc = print_db(fd);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'r':
+        // Expected arguments: -r file|-
+        if (argc != 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = apply_feed(fd, argv[2]);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 's':
+        // Expected arguments: -since seq [file|-]
+        if ((argc != 3 && argc != 4) || *argv[2] == '\0' || strspn(argv[2], "0123456789") != strlen(argv[2]))
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = change_feed(fd, strtoull(argv[2], NULL, 10), (argc == 4) ? argv[3] : "-");
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'S':
+        // Serve requests on a Unix domain socket, -S [socket_path]
+        if (argc > 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        if (argc == 3)
+            rc = serve_db(fd, argv[2]);
+        else
+            rc = serve_db(fd, DB_FILE SDB_SOCK_EXT);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'G':
+        // Grow the id space, -G capacity
+        if (argc != 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = grow_db(fd, atoll(argv[2]));
+        if (rc == ERR_DB_OP)
+            exit_code = EXIT_FAIL_ARGS;
+        else if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'u':
+        // Expected arguments: -u file
+        if (argc != 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = unpack_db(fd, argv[2]);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'v':
+        rc = verify_db(fd);
         if (rc < 0)
             exit_code = EXIT_FAIL_DB;
         break;
 
     case 'x':
-        // Compress the database file (extra credit).
-        fd = compress_db(fd);
+        // Compress the database file (extra credit), -x punch compacts in place.
+        if (argc > 3 || (argc == 3 && strcmp(argv[2], "punch") != 0))
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        if (argc == 3)
+            fd = compress_db_in_place(fd);
+        else
+            fd = compress_db(fd);
         if (fd < 0)
             exit_code = EXIT_FAIL_DB;
         break;
 
     case 'z':
-        // Zero the database (remove all records).
-        close(fd);
+        // Zero the database (remove all records), keeping a grown capacity
+        // and the layout unless SDB_LAYOUT asks for another one.
+        capacity = store_capacity(fd);
+        setenv(SDB_LAYOUT_ENV, store_layout(fd) == SDB_LAYOUT_HASH ? "hash" : "direct", 0);
+        close_db(fd);
         fd = open_db(DB_FILE, true);
-        if (fd < 0)
+        if (fd < 0 || (capacity > store_capacity(fd) && store_grow(fd, capacity) != NO_ERROR))
         {
             exit_code = EXIT_FAIL_DB;
             break;
@@ -542,6 +1778,8 @@ int main(int argc, char *argv[])
         exit_code = EXIT_FAIL_ARGS;
     }
 
-    close(fd);
+    if (fd >= 0 && close_db(fd) != NO_ERROR)
+        exit_code = EXIT_FAIL_DB;
     exit(exit_code);
 }
+#endif
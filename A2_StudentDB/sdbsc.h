@@ -4,14 +4,34 @@
 
 //prototypes for functions go below for this assignment
 int open_db(char *dbFile, bool should_truncate);
+int close_db(int fd);
 int add_student(int fd, int id, char *fname, char *lname, int gpa);
 int get_student(int fd, int id, student_t *s);
+int get_students(int fd, const int *ids, int n, student_t *out);
 int del_student(int fd, int id);
 int compress_db(int fd);
+int compress_db_in_place(int fd);
 void print_student(student_t *s);
 int validate_range(int id, int gpa);
 int count_db_records(int fd);
 int print_db(int fd);
+int print_db_sorted(int fd, int key);
+int bulk_load(int fd, char *path);
+int load_rows(int fd, student_t *rows, int nrows, int *rejected);
+int export_db(int fd, bool binary, char *path);
+int import_db(int fd, bool binary, char *path);
+int verify_db(int fd);
+int change_feed(int fd, unsigned long long since, char *path);
+int apply_feed(int fd, char *path);
+int pack_db(int fd, char *path);
+int unpack_db(int fd, char *path);
+int print_pack(char *path);
+int find_pack(char *path, int nids, char **args);
+int find_by_lname(int fd, char *prefix);
+int find_by_gpa(int fd, int lo, int hi);
+int find_students(int fd, int nids, char **args);
+int serve_db(int fd, char *sock_path);
+int grow_db(int fd, long long capacity);
 void usage(char *);
 
 //error codes to be returned from individual functions
@@ -48,11 +68,45 @@ void usage(char *);
 #define M_STD_ADDED       "Student %d added to database.\n"
 #define M_STD_DEL_MSG     "Student %d was deleted from database.\n"
 #define M_STD_NOT_FND_MSG "Student %d was not found in database.\n"
+#define M_STD_LNAME_NOT_FND "No students with a last name starting with %s.\n"
+#define M_GPA_RANGE_NONE  "No students with GPA between %.2f and %.2f.\n"
+#define M_GPA_RANGE_STATS "%d student(s) with GPA between %.2f and %.2f, average %.2f.\n"
+#define M_ERR_GPA_RNG     "Cant query, GPA range must be two values with lo <= hi in the allowable range!\n"
+#define M_SERVE_START     "Serving requests on %s.\n"
+#define M_SERVE_STOP      "Server stopped after %llu request(s).\n"
+#define M_CACHE_STATS     "Page cache: %llu hit(s), %llu miss(es).\n"
+#define M_ERR_SERVE_SOCK  "Cant listen on socket %s, path too long or already served.\n"
+#define M_DB_GROWN        "Database capacity grown from %d to %d ids.\n"
+#define M_ERR_DB_GROW     "Cant grow database, capacity must be above %d and at most %d.\n"
 #define M_DB_COMPRESSED_OK "Database successfully compressed!\n"
+#define M_DB_COMPRESS_STATS "Reclaimed %lld bytes (%lld -> %lld bytes allocated) in %.3f ms.\n"
 #define M_DB_ZERO_OK      "All database records removed!\n"
 #define M_DB_EMPTY        "Database contains no student records.\n"
 #define M_DB_RECORD_CNT   "Database contains %d student record(s).\n"
 #define M_NOT_IMPL        "The requested operation is not implemented yet!\n"
+#define M_ERR_BULK_OPEN   "Cant read bulk load input %s\n"
+#define M_ERR_BULK_ROW    "Skipping line %d, expected id,first_name,last_name,gpa within allowable range.\n"
+#define M_BULK_LOADED     "Bulk load added %d student(s), rejected %d row(s).\n"
+#define M_ERR_DUMP_OPEN   "Cant open dump file %s\n"
+#define M_ERR_DUMP_BAD    "%s is not a complete student db dump (bad header, length or checksum).\n"
+#define M_ERR_DUMP_REC    "Skipping record %d, id or gpa out of allowable range.\n"
+#define M_DUMP_EXPORTED   "Exported %d student(s) to %s.\n"
+#define M_DUMP_IMPORTED   "Import added %d student(s), rejected %d record(s).\n"
+#define M_ERR_FEED_OPEN   "Cant open change feed %s\n"
+#define M_ERR_FEED_BAD    "%s is not a complete change feed (bad header, length or checksum).\n"
+#define M_ERR_FEED_REC    "Skipping change %d, id or gpa out of allowable range.\n"
+#define M_ERR_NO_SEQ      "Cant stream changes, the change sequence is unavailable.\n"
+#define M_FEED_STREAMED   "Streamed %d change(s) after sequence %llu up to %llu to %s.\n"
+#define M_FEED_APPLIED    "Applied %d change(s) and %d deletion(s), rejected %d, replica is at sequence %llu.\n"
+#define M_ERR_PACK_OPEN   "Cant open packed file %s\n"
+#define M_ERR_PACK_BAD    "%s is not a complete packed student db (bad header, length, checksum or names).\n"
+#define M_PACK_PACKED     "Packed %d student(s) with %d distinct name(s) into %s, %lld bytes (%lld as student records).\n"
+#define M_PACK_UNPACKED   "Unpack added %d student(s), rejected %d record(s).\n"
+#define M_SUM_BAD         "Student %d record does not match its checksum, the database is corrupt.\n"
+#define M_SUM_MISSING     "Student %d record is missing, its slot is empty but has a checksum.\n"
+#define M_SUM_VERIFIED    "Verified %d student record(s), all checksums match.\n"
+#define M_SUM_CORRUPT     "Verified %d student record(s), %d corrupt or missing.\n"
+#define M_ERR_NO_SUMS     "Cant verify, the record checksums are unavailable.\n"
 
 //useful format strings for print students
 //For example to print the header in the required output:
@@ -60,5 +114,7 @@ void usage(char *);
 //                                   "LAST_NAME", "GPA");
 #define  STUDENT_PRINT_HDR_STRING   "%-6s %-24s %-32s %-3s\n"
 #define  STUDENT_PRINT_FMT_STRING   "%-6d %-24.24s %-32.32s %-3.2f\n"
+#define  GPA_HIST_FMT_STRING        "%4.2f-%4.2f %6d%s\n"
+#define  GPA_HIST_BAR_LEN           40
 
 #endif
@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdbscan.h"
+#include "sdbsnap.h"
+
+//end of a scan that covers the whole file
+#define SCAN_END    ((off_t)1 << 62)
+
+//One partition of a parallel scan and the thread scanning it
+typedef struct scan_part {
+    scan_iter_t it;
+    scan_job_t  *job;
+    void        *ctx;
+    int         rc;
+    pthread_t   tid;
+    bool        threaded;
+} scan_part_t;
+
+/*
+ *  scan_open
+ *      *it:  iterator to initialize
+ *      fd:   database file descriptor
+ *
+ *  Prepares a full table scan of fd and tells the kernel the file will be
+ *  read sequentially so it can read ahead aggressively.
+ *
+ *  returns:  NO_ERROR       iterator ready
+ *            ERR_DB_FILE    the block buffer could not be allocated
+ */
+int scan_open(scan_iter_t *it, int fd)
+{
+    memset(it, 0, sizeof(*it));
+    it->fd = fd;
+    it->end = SCAN_END;
+    it->block = malloc(SCAN_BLOCK_SIZE);
+    if (it->block == NULL)
+        return ERR_DB_FILE;
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return NO_ERROR;
+}
+
+/*
+ *  fill_block
+ *      *it:  iterator whose block has been consumed
+ *
+ *  Reads the next block of the current data extent, moving on to the next
+ *  extent when this one is used up, and classifies its slots as live or
+ *  empty in one pass.  Nothing at or after it->end is read.  The block
+ *  after the one being read is handed to the kernel as readahead.
+ *
+ *  returns:  true if a block was read, false at the end of the file or on
+ *            error (it->error is set)
+ */
+static bool fill_block(scan_iter_t *it)
+{
+    while (it->pos >= it->hole)
+    {
+        off_t data, hole;
+        int rc = (it->hole < it->end) ? store_next_extent(it->fd, it->hole, &data, &hole) : 0;
+        if (rc == 1 && data >= it->end)
+            rc = 0;
+        if (rc != 1)
+        {
+            it->error = (rc < 0) ? ERR_DB_FILE : NO_ERROR;
+            return false;
+        }
+        it->pos = data;
+        it->hole = (hole < it->end) ? hole : it->end;
+    }
+
+    size_t want = SCAN_BLOCK_SIZE;
+    if ((off_t)want > it->hole - it->pos)
+        want = it->hole - it->pos;
+
+    ssize_t n = pread(it->fd, it->block, want, it->pos);
+    if (n == -1)
+    {
+        it->error = ERR_DB_FILE;
+        return false;
+    }
+    if (n < STUDENT_RECORD_SIZE)
+    {
+        // short extent at EOF, nothing more to read
+        it->pos = it->hole;
+        return fill_block(it);
+    }
+
+    off_t ahead = it->pos + n;
+    if (ahead < it->hole)
+        posix_fadvise(it->fd, ahead, SCAN_BLOCK_SIZE, POSIX_FADV_WILLNEED);
+
+    it->first_id = it->pos / STUDENT_RECORD_SIZE;
+    it->nslots = n / STUDENT_RECORD_SIZE;
+    it->next = 0;
+    if (it->snap != NULL && snap_overlay(it->snap, it->first_id, it->block, it->nslots) < 0)
+    {
+        it->error = ERR_DB_FILE;
+        return false;
+    }
+    classify_records(it->block, it->nslots, it->live);
+    if (it->first_id == 0)
+        it->live[0] &= ~1ULL;       // slot 0 holds the file header
+    it->pos += (off_t)it->nslots * STUDENT_RECORD_SIZE;
+    return true;
+}
+
+/*
+ *  scan_next
+ *      *it:  iterator returned by scan_open()
+ *
+ *  returns:  pointer to the next live record inside the block buffer, valid
+ *            until the following call, or NULL when the scan is over.  Check
+ *            scan_close() to tell the end of the file from an I/O error.
+ */
+student_t *scan_next(scan_iter_t *it)
+{
+    for (;;)
+    {
+        while (it->next < it->nslots)
+        {
+            int i = it->next;
+            uint64_t word = it->live[i / 64] & (~0ULL << (i % 64));
+            if (word == 0)
+            {
+                it->next = (i / 64 + 1) * 64;
+                continue;
+            }
+            i = (i / 64) * 64 + __builtin_ctzll(word);
+            it->next = i + 1;
+            return &it->block[i];
+        }
+        if (!fill_block(it))
+            return NULL;
+    }
+}
+
+/*
+ *  scan_count
+ *      *it:  iterator returned by scan_open()
+ *
+ *  Consumes the rest of the scan without looking at the records, counting
+ *  live slots straight off the classification masks.
+ *
+ *  returns:  number of live records left in the scan
+ */
+int scan_count(scan_iter_t *it)
+{
+    int count = 0;
+    for (;;)
+    {
+        if (it->next < it->nslots)
+        {
+            int i = it->next;
+            count += __builtin_popcountll(it->live[i / 64] & (~0ULL << (i % 64)));
+            for (int w = i / 64 + 1; w < LIVE_MASK_WORDS(it->nslots); w++)
+                count += __builtin_popcountll(it->live[w]);
+            it->next = it->nslots;
+        }
+        if (!fill_block(it))
+            return count;
+    }
+}
+
+/*
+ *  scan_close
+ *      *it:  iterator returned by scan_open()
+ *
+ *  Releases the block buffer and restores normal readahead on the file.
+ *
+ *  returns:  NO_ERROR       the scan reached the end of the file
+ *            ERR_DB_FILE    the scan stopped on an I/O error
+ */
+int scan_close(scan_iter_t *it)
+{
+    free(it->block);
+    it->block = NULL;
+    posix_fadvise(it->fd, 0, 0, POSIX_FADV_NORMAL);
+    return it->error;
+}
+
+/*
+ *  scan_threads
+ *
+ *  returns:  number of threads a parallel scan may use, from
+ *            SDB_SCAN_THREADS_ENV or the number of online CPUs
+ */
+static int scan_threads(void)
+{
+    char *env = getenv(SDB_SCAN_THREADS_ENV);
+    long n = (env != NULL) ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1)
+        n = 1;
+    return (n > SCAN_MAX_THREADS) ? SCAN_MAX_THREADS : (int)n;
+}
+
+static void *part_main(void *arg)
+{
+    scan_part_t *p = arg;
+    p->rc = p->job->part(&p->it, p->ctx, p->job->arg);
+    if (p->rc == NO_ERROR)
+        p->rc = p->it.error;
+    return NULL;
+}
+
+/*
+ *  scan_parallel
+ *      fd:    database file descriptor
+ *      *job:  what to do with every partition, see scan_job_t
+ *
+ *  Scans the file with up to scan_threads() threads, each reading its own
+ *  partition with pread().  Partitions are sized so every thread gets one,
+ *  up to SCAN_PART_MAX_BLOCKS blocks each, and are handed out one round of
+ *  threads at a time so merge() sees them in file order and at most one
+ *  partition per thread is held in memory, job->mem_max shrinks the
+ *  partitions so all of them together span at most that many bytes.  A
+ *  file small enough for one partition is scanned on the calling thread.  With job->snap set the
+ *  scan reads the slots as of the snapshot, and a copy-on-write one ends
+ *  it at the slots the snapshot covers.
+ *
+ *  returns:  NO_ERROR       every partition scanned and merged
+ *            ERR_DB_FILE    database file I/O issue or out of memory
+ *            <rc>           the first error part() or merge() returned
+ */
+int scan_parallel(int fd, scan_job_t *job)
+{
+    struct stat sb;
+    if (fstat(fd, &sb) == -1)
+        return ERR_DB_FILE;
+    if (job->snap != NULL && job->snap->cow)
+        sb.st_size = (off_t)job->snap->nslots * STUDENT_RECORD_SIZE;
+
+    int nthreads = scan_threads();
+    off_t part_len = sb.st_size / nthreads;
+    part_len = (part_len + SCAN_BLOCK_SIZE - 1) / SCAN_BLOCK_SIZE * SCAN_BLOCK_SIZE;
+    if (part_len < (off_t)SCAN_BLOCK_SIZE)
+        part_len = SCAN_BLOCK_SIZE;
+    if (part_len > (off_t)SCAN_PART_MAX_BLOCKS * (off_t)SCAN_BLOCK_SIZE)
+        part_len = (off_t)SCAN_PART_MAX_BLOCKS * SCAN_BLOCK_SIZE;
+    if (job->mem_max > 0 && part_len > (off_t)(job->mem_max / nthreads))
+    {
+        // slot aligned, the iterator numbers slots from the partition start
+        part_len = (off_t)(job->mem_max / nthreads) / STUDENT_RECORD_SIZE * STUDENT_RECORD_SIZE;
+        if (part_len < (off_t)SCAN_PART_MIN_SLOTS * STUDENT_RECORD_SIZE)
+            part_len = (off_t)SCAN_PART_MIN_SLOTS * STUDENT_RECORD_SIZE;
+    }
+    int nparts = (int)((sb.st_size + part_len - 1) / part_len);
+    if (nparts < 1)
+        nparts = 1;
+    int width = (nparts < nthreads) ? nparts : nthreads;
+
+    scan_part_t *parts = calloc(width, sizeof(scan_part_t));
+    char *ctxs = calloc(width, job->ctx_size ? job->ctx_size : 1);
+    int rc = (parts != NULL && ctxs != NULL) ? NO_ERROR : ERR_DB_FILE;
+    for (int i = 0; rc == NO_ERROR && i < width; i++)
+    {
+        parts[i].it.block = malloc(SCAN_BLOCK_SIZE);
+        if (parts[i].it.block == NULL)
+            rc = ERR_DB_FILE;
+    }
+
+    // the classifier picks its kernel once, before any thread needs it
+    classify_impl_name();
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    for (int first = 0; rc == NO_ERROR && first < nparts; first += width)
+    {
+        int n = (nparts - first < width) ? nparts - first : width;
+        for (int i = 0; i < n; i++)
+        {
+            scan_part_t *p = &parts[i];
+            student_t *block = p->it.block;
+            memset(&p->it, 0, sizeof(p->it));
+            p->it.fd = fd;
+            p->it.block = block;
+            p->it.pos = p->it.hole = (off_t)(first + i) * part_len;
+            p->it.end = p->it.pos + part_len;
+            p->it.snap = job->snap;
+            if (job->snap != NULL && p->it.end > sb.st_size)
+                p->it.end = sb.st_size;
+            p->job = job;
+            p->ctx = ctxs + (size_t)i * job->ctx_size;
+            memset(p->ctx, 0, job->ctx_size);
+            p->threaded = (n > 1 && pthread_create(&p->tid, NULL, part_main, p) == 0);
+            if (!p->threaded)
+                part_main(p);
+        }
+        for (int i = 0; i < n; i++)
+        {
+            if (parts[i].threaded)
+                pthread_join(parts[i].tid, NULL);
+        }
+        for (int i = 0; i < n; i++)
+        {
+            if (rc == NO_ERROR)
+                rc = parts[i].rc;
+            int merged = (job->merge != NULL) ? job->merge(parts[i].ctx, job->arg, rc) : NO_ERROR;
+            if (rc == NO_ERROR)
+                rc = merged;
+        }
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_NORMAL);
+
+    for (int i = 0; parts != NULL && i < width; i++)
+        free(parts[i].it.block);
+    free(parts);
+    free(ctxs);
+    return rc;
+}
@@ -0,0 +1,73 @@
+#ifndef __SDB_SCAN_H__
+#define __SDB_SCAN_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "db.h" //get student record type
+#include "sdbsimd.h"
+
+//Full table scans read the data extents of the database in blocks of
+//SCAN_BLOCK_SLOTS records (1MB) and hand out pointers into the block, so a
+//scan costs one pread() per megabyte instead of one read() per record.
+#define SCAN_BLOCK_SLOTS    16384
+#define SCAN_BLOCK_SIZE     (SCAN_BLOCK_SLOTS * sizeof(student_t))
+
+//A parallel scan splits the file into partitions of whole blocks, at most
+//SCAN_PART_MAX_BLOCKS each, and scans up to one partition per thread at a
+//time.  SDB_SCAN_THREADS_ENV sets the number of threads, the default is one per
+//online CPU.  A job with a memory limit gets partitions of fewer slots, but
+//never fewer than SCAN_PART_MIN_SLOTS.
+#define SCAN_PART_MAX_BLOCKS    64
+#define SCAN_PART_MIN_SLOTS     64
+#define SCAN_MAX_THREADS        64
+#define SDB_SCAN_THREADS_ENV    "SDB_SCAN_THREADS"
+
+//Scan iterator state.  block holds nslots records starting at slot first_id,
+//next is the index of the next slot to examine.  live has one bit per slot
+//of the block, filled by classify_records() when the block is read.
+//[pos, hole) is what is left of the data extent being read, the scan stops
+//at end.  snap is the snapshot view the scan reads (see sdbsnap.h), NULL
+//to read the file as it is.
+typedef struct scan_iter {
+    int         fd;
+    student_t   *block;
+    uint64_t    live[LIVE_MASK_WORDS(SCAN_BLOCK_SLOTS)];
+    int         nslots;
+    int         next;
+    int         first_id;
+    off_t       pos;
+    off_t       hole;
+    off_t       end;
+    struct snap_view *snap;
+    int         error;
+} scan_iter_t;
+
+//What a parallel scan does.  part() runs on a worker thread with an
+//iterator over one partition and a zeroed ctx_size byte context of its own.
+//merge() then runs on the calling thread for every partition in file order
+//with that context and rc, the status of the scan up to and including the
+//partition, so results are combined (and printed) in id order.  merge()
+//must release whatever part() left in the context and only use the result
+//when rc is NO_ERROR, it may be NULL if there is nothing to combine.  arg is
+//handed to both.  snap, if set, is the snapshot view every partition reads.
+//mem_max, if set, bounds the bytes spanned by the partitions scanned at
+//once, for a part() that keeps its partition's records until merge().
+typedef struct scan_job {
+    int         (*part)(scan_iter_t *it, void *ctx, void *arg);
+    int         (*merge)(void *ctx, void *arg, int rc);
+    size_t      ctx_size;
+    void        *arg;
+    struct snap_view *snap;
+    size_t      mem_max;
+} scan_job_t;
+
+//prototypes for the scan iterator
+int scan_open(scan_iter_t *it, int fd);
+student_t *scan_next(scan_iter_t *it);
+int scan_count(scan_iter_t *it);
+int scan_close(scan_iter_t *it);
+int scan_parallel(int fd, scan_job_t *job);
+
+#endif
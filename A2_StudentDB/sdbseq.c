@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdbseq.h"
+
+/*
+ *  seq_attach
+ *      st:               engine state of a freshly opened database
+ *      should_truncate:  the database was just emptied
+ *
+ *  Maps the change sequence sized for st->capacity, creating or growing
+ *  the sidecar if needed.  The sidecar is never truncated, last_seq has to
+ *  keep counting up for the replicas, it is reset instead when the
+ *  database was emptied or the header does not match the database file.
+ *  If the sidecar cannot be created the database still works, changes are
+ *  just not numbered when st->seqs is NULL.
+ *
+ *  returns:  NO_ERROR
+ */
+int seq_attach(db_store_t *st, bool should_truncate)
+{
+    int nslots = st->capacity + 1;
+    size_t len = sizeof(seq_header_t) + (size_t)nslots * sizeof(uint64_t);
+    char path[SDB_PATH_MAX];
+    struct stat sb, isb;
+
+    if (fstat(st->fd, &sb) == -1 ||
+        snprintf(path, sizeof(path), "%s%s", st->path, SDB_SEQ_EXT) >= (int)sizeof(path))
+        return NO_ERROR;
+
+    int fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (fd == -1)
+        return NO_ERROR;
+
+    // a process that grew the database may already have grown the sidecar
+    if (fstat(fd, &isb) == 0 && isb.st_size > (off_t)len &&
+        (isb.st_size - sizeof(seq_header_t)) % sizeof(uint64_t) == 0)
+    {
+        len = isb.st_size;
+        nslots = (len - sizeof(seq_header_t)) / sizeof(uint64_t);
+    }
+    if (isb.st_size < (off_t)len && ftruncate(fd, len) == -1)
+    {
+        close(fd);
+        return NO_ERROR;
+    }
+    void *base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NO_ERROR;
+
+    st->seq_hdr = base;
+    st->seqs = (uint64_t *)((char *)base + sizeof(seq_header_t));
+    st->seq_nslots = nslots;
+    st->seq_len = len;
+
+    // Growing the id space only adds ids that never changed, the 0
+    // ftruncate() filled the new tail with.
+    seq_header_t *hdr = st->seq_hdr;
+    if (hdr->magic == SDB_SEQ_MAGIC && hdr->nslots < (uint64_t)nslots)
+        hdr->nslots = nslots;
+
+    if (should_truncate || hdr->magic != SDB_SEQ_MAGIC || hdr->version != SDB_SEQ_VERSION ||
+        hdr->nslots != (uint64_t)nslots ||
+        hdr->db_ino != (uint64_t)sb.st_ino || hdr->db_dev != (uint64_t)sb.st_dev)
+        seq_reset(st);
+    return NO_ERROR;
+}
+
+/*
+ *  seq_detach
+ *      st:  engine state
+ *
+ *  Unmaps the change sequence, the kernel writes back the shared pages.
+ */
+void seq_detach(db_store_t *st)
+{
+    if (st->seq_hdr != NULL)
+        munmap(st->seq_hdr, st->seq_len);
+    st->seq_hdr = NULL;
+    st->seqs = NULL;
+}
+
+/*
+ *  seq_reset
+ *      st:  engine state, may be NULL
+ *
+ *  Forgets the per-id sequence numbers and moves base_seq past the last
+ *  number handed out, so every feed asked for from before now resends the
+ *  whole database.  A sidecar that is not one yet gets its header.
+ */
+void seq_reset(db_store_t *st)
+{
+    struct stat sb;
+    if (st == NULL || st->seq_hdr == NULL || fstat(st->fd, &sb) == -1)
+        return;
+
+    seq_header_t *hdr = st->seq_hdr;
+    uint64_t last = 0;
+    if (hdr->magic == SDB_SEQ_MAGIC && hdr->version == SDB_SEQ_VERSION)
+        last = __atomic_load_n(&hdr->last_seq, __ATOMIC_ACQUIRE);
+
+    memset(st->seqs, 0, (size_t)st->seq_nslots * sizeof(uint64_t));
+    hdr->magic = SDB_SEQ_MAGIC;
+    hdr->version = SDB_SEQ_VERSION;
+    hdr->nslots = st->seq_nslots;
+    hdr->db_ino = sb.st_ino;
+    hdr->db_dev = sb.st_dev;
+    __atomic_store_n(&hdr->base_seq, last + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&hdr->last_seq, last + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ *  seq_update
+ *      st:  engine state
+ *      id:  slot about to be written
+ *
+ *  Takes the next sequence number for id.  Called with the slot write
+ *  locked, so a feed that waited for in-flight writes finds every change
+ *  up to the last number handed out in the data file, and the numbers of
+ *  one slot follow the order of its writes.
+ *
+ *  returns:  the number, or 0 if changes are not numbered
+ */
+uint64_t seq_update(db_store_t *st, int id)
+{
+    if (st == NULL || st->seqs == NULL || id < MIN_STD_ID || id >= st->seq_nslots)
+        return 0;
+    uint64_t seq = __atomic_add_fetch(&st->seq_hdr->last_seq, 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&st->seqs[id], seq, __ATOMIC_RELEASE);
+    return seq;
+}
@@ -0,0 +1,40 @@
+#ifndef __SDB_SEQ_H__
+#define __SDB_SEQ_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdbstore.h"
+
+//Change sequence.  Every write to a student slot takes the next number of a
+//change sequence shared by all processes, and a sidecar file next to the
+//database holds the number of the last change of every id as a packed
+//uint64, 800KB for MAX_STD_ID ids, for the change feed (see sdbfeed.h).
+//Changes up to base_seq are not tracked individually: the sidecar
+//is reset (base_seq moves past the last number handed out) when the
+//database is emptied, replaced by compaction, recovered from the log or
+//the sidecar is missing.
+#define SDB_SEQ_EXT         ".seq"
+#define SDB_SEQ_MAGIC       0x31514553u     // "SEQ1"
+#define SDB_SEQ_VERSION     1
+
+//Sidecar file header, the per-id sequence numbers follow it.  last_seq is
+//the last number handed out.  See occ_header_t for the reason the database
+//inode and device are recorded.
+typedef struct seq_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t nslots;
+    uint64_t db_ino;
+    uint64_t db_dev;
+    uint64_t last_seq;
+    uint64_t base_seq;
+} seq_header_t;
+
+//prototypes for the change sequence
+int seq_attach(db_store_t *st, bool should_truncate);
+void seq_detach(db_store_t *st);
+uint64_t seq_update(db_store_t *st, int id);
+void seq_reset(db_store_t *st);
+
+#endif
@@ -0,0 +1,504 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdbbitmap.h"
+#include "sdbscan.h"
+#include "sdbwal.h"
+#include "sdbcache.h"
+#include "sdbserver.h"
+
+//Records sent per write() when streaming SDB_OP_PRINT
+#define PRINT_BATCH     256
+
+static volatile sig_atomic_t serve_stop = 0;
+
+//A connected client.  req holds the have bytes of a request frame received
+//so far, held a write acknowledgement waiting for its log group, with
+//held.status SDB_STATUS_MORE if there is none.
+typedef struct serve_client {
+    sdb_request_t   req;
+    size_t          have;
+    sdb_response_t  held;
+} serve_client_t;
+
+static void on_stop_signal(int sig)
+{
+    (void)sig;
+    serve_stop = 1;
+}
+
+/*
+ *  send_all
+ *      sock:  connected client socket
+ *      *buf:  bytes to send
+ *      len:   number of bytes
+ *
+ *  Waits for a client that is slow to read, the socket is non-blocking.
+ *
+ *  returns:  NO_ERROR, or ERR_DB_OP if the client went away
+ */
+static int send_all(int sock, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = send(sock, p, len, MSG_NOSIGNAL);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            struct pollfd pfd = {sock, POLLOUT, 0};
+            if (poll(&pfd, 1, -1) == -1 && errno != EINTR)
+                return ERR_DB_OP;
+            continue;
+        }
+        if (n <= 0)
+            return ERR_DB_OP;
+        p += n;
+        len -= n;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  serve_print
+ *      fd:    database file descriptor
+ *      sock:  client socket
+ *
+ *  Streams every live record as an SDB_STATUS_MORE frame, PRINT_BATCH frames
+ *  per write, followed by the final frame carrying the count.  Uses the
+ *  occupancy bitmap when available, like print_db().
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE or ERR_DB_OP if the client went away
+ */
+static int serve_print(int fd, int sock)
+{
+    db_store_t *st = store_lookup(fd);
+    sdb_response_t frames[PRINT_BATCH];
+    int nframes = 0;
+    int count = 0;
+    int rc = NO_ERROR;
+    scan_iter_t it;
+    student_t *rec;
+    student_t s;
+    bool use_occ = (st != NULL && st->occ != NULL);
+    int id = -1;
+
+    if (!use_occ && scan_open(&it, fd) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    for (;;)
+    {
+        if (use_occ)
+        {
+            id = occ_next(st, id + 1);
+            if (id == -1)
+                break;
+            int grc = get_student(fd, id, &s);
+            if (grc == SRCH_NOT_FOUND)
+                continue;
+            if (grc != NO_ERROR)
+            {
+                rc = ERR_DB_FILE;
+                break;
+            }
+            rec = &s;
+        }
+        else if ((rec = scan_next(&it)) == NULL)
+            break;
+
+        frames[nframes].status = SDB_STATUS_MORE;
+        frames[nframes].value = 0;
+        frames[nframes++].rec = *rec;
+        count++;
+        if (nframes == PRINT_BATCH)
+        {
+            rc = send_all(sock, frames, sizeof(frames));
+            nframes = 0;
+            if (rc != NO_ERROR)
+                break;
+        }
+    }
+    if (!use_occ && scan_close(&it) != NO_ERROR && rc == NO_ERROR)
+        rc = ERR_DB_FILE;
+    if (rc == ERR_DB_OP)
+        return rc;
+
+    memset(&frames[nframes], 0, sizeof(frames[nframes]));
+    frames[nframes].status = rc;
+    frames[nframes++].value = count;
+    if (send_all(sock, frames, nframes * sizeof(sdb_response_t)) != NO_ERROR)
+        return ERR_DB_OP;
+    return rc;
+}
+
+/*
+ *  serve_request
+ *      fd:     database file descriptor
+ *      sock:   client socket
+ *      *req:   request frame read from sock
+ *      *wrote: set if the request modified the database
+ *      *failed: set if a write failed with a file error, which may have
+ *              been the commit of its log group
+ *      *held:  receives the response of a write still in an uncommitted
+ *              log group, with held->status set to SDB_STATUS_MORE if
+ *              there is none
+ *
+ *  Runs the request through the same functions the command line uses and
+ *  sends the response, unless it acknowledges a write that is not durable
+ *  yet.  That one is left in *held for release_acks().
+ *
+ *  returns:  NO_ERROR, or ERR_DB_OP if the client went away or sent a bad
+ *            frame and should be dropped
+ */
+static int serve_request(int fd, int sock, sdb_request_t *req, bool *wrote, bool *failed,
+                         sdb_response_t *held)
+{
+    db_store_t *st = store_lookup(fd);
+    sdb_response_t resp;
+    memset(&resp, 0, sizeof(resp));
+    held->status = SDB_STATUS_MORE;
+
+    switch (req->op)
+    {
+    case SDB_OP_GET:
+        resp.status = get_student(fd, req->id, &resp.rec);
+        break;
+
+    case SDB_OP_ADD:
+        // names are not trusted to be terminated
+        req->rec.fname[sizeof(req->rec.fname) - 1] = '\0';
+        req->rec.lname[sizeof(req->rec.lname) - 1] = '\0';
+        if (validate_range(req->id, req->rec.gpa) != NO_ERROR || req->id > store_capacity(fd))
+        {
+            resp.status = ERR_DB_OP;
+            break;
+        }
+        resp.status = add_student(fd, req->id, req->rec.fname, req->rec.lname, req->rec.gpa);
+        *wrote = *wrote || resp.status == NO_ERROR;
+        break;
+
+    case SDB_OP_DEL:
+        resp.status = del_student(fd, req->id);
+        *wrote = *wrote || resp.status == NO_ERROR;
+        break;
+
+    case SDB_OP_COUNT:
+        resp.value = count_db_records(fd);
+        resp.status = resp.value < 0 ? resp.value : NO_ERROR;
+        break;
+
+    case SDB_OP_PRINT:
+        return serve_print(fd, sock) == ERR_DB_OP ? ERR_DB_OP : NO_ERROR;
+
+    default:
+        return ERR_DB_OP;
+    }
+
+    if ((req->op == SDB_OP_ADD || req->op == SDB_OP_DEL) && resp.status == ERR_DB_FILE)
+        *failed = true;
+    if ((req->op == SDB_OP_ADD || req->op == SDB_OP_DEL) && st != NULL && st->wal != NULL &&
+        st->wal->nbuf > 0)
+    {
+        *held = resp;
+        return NO_ERROR;
+    }
+    return send_all(sock, &resp, sizeof(resp));
+}
+
+/*
+ *  holding
+ *      *clients:  client per poll set entry
+ *      nfds:      number of entries
+ *
+ *  returns:  true if any client waits for the ack of a write
+ */
+static bool holding(const serve_client_t *clients, int nfds)
+{
+    for (int i = 1; i < nfds; i++)
+    {
+        if (clients[i].held.status != SDB_STATUS_MORE)
+            return true;
+    }
+    return false;
+}
+
+/*
+ *  drop_client
+ *      *fds:      poll set, client sockets from index 1
+ *      *nfds:     number of entries, lowered by one
+ *      *clients:  client per poll set entry
+ *      i:         entry to drop
+ *
+ *  Closes the socket and moves the last entry into its place.
+ */
+static void drop_client(struct pollfd *fds, int *nfds, serve_client_t *clients, int i)
+{
+    close(fds[i].fd);
+    fds[i] = fds[--*nfds];
+    clients[i] = clients[*nfds];
+}
+
+/*
+ *  read_request
+ *      *c:    client whose socket is readable
+ *      sock:  its socket
+ *
+ *  Receives what has arrived of the client's next request frame without
+ *  waiting for the rest, so a client that sent part of one holds nobody up.
+ *
+ *  returns:  1 once c->req is complete, 0 while part of it is missing,
+ *            ERR_DB_OP if the client went away
+ */
+static int read_request(serve_client_t *c, int sock)
+{
+    ssize_t n = recv(sock, (char *)&c->req + c->have, sizeof(c->req) - c->have, 0);
+    if (n == -1 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
+    if (n <= 0)
+        return ERR_DB_OP;
+    c->have += n;
+    if (c->have < sizeof(c->req))
+        return 0;
+    c->have = 0;
+    return 1;
+}
+
+/*
+ *  release_acks
+ *      *fds:      poll set, client sockets from index 1
+ *      *nfds:     number of entries, lowered for every client dropped
+ *      *clients:  client per poll set entry
+ *      failed:    the group holding the writes could not be committed
+ *
+ *  Sends every held acknowledgement once the log group with its write is
+ *  committed, as an ERR_DB_FILE status if the commit failed.  Clients that
+ *  went away are dropped.
+ */
+static void release_acks(struct pollfd *fds, int *nfds, serve_client_t *clients, bool failed)
+{
+    for (int i = *nfds - 1; i >= 1; i--)
+    {
+        sdb_response_t *held = &clients[i].held;
+        if (held->status == SDB_STATUS_MORE)
+            continue;
+        if (failed)
+            held->status = ERR_DB_FILE;
+        int rc = send_all(fds[i].fd, held, sizeof(*held));
+        held->status = SDB_STATUS_MORE;
+        if (rc != NO_ERROR)
+            drop_client(fds, nfds, clients, i);
+    }
+}
+
+/*
+ *  listen_on
+ *      *sock_path:  path of the Unix domain socket
+ *
+ *  A socket file left behind by a server that is gone is replaced, one
+ *  that still accepts connections is not.
+ *
+ *  returns:  listening socket, or ERR_DB_FILE
+ */
+static int listen_on(char *sock_path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(sock_path) >= sizeof(addr.sun_path))
+        return ERR_DB_FILE;
+    strcpy(addr.sun_path, sock_path);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1)
+        return ERR_DB_FILE;
+
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+    {
+        close(sock);
+        return ERR_DB_FILE;
+    }
+    unlink(sock_path);
+
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+        listen(sock, SDB_SERVE_MAX_CLIENTS) == -1)
+    {
+        close(sock);
+        return ERR_DB_FILE;
+    }
+    return sock;
+}
+
+/*
+ *  serve_db
+ *      fd:          database file descriptor returned by open_db()
+ *      *sock_path:  Unix domain socket to listen on
+ *
+ *  Serves sdb_request_t frames until SIGINT or SIGTERM.  Clients are
+ *  multiplexed with poll() on a single thread, so requests are applied one
+ *  at a time in arrival order.  Client sockets are non-blocking and a
+ *  request is served once its whole frame has arrived.  Logged writes are group committed on the
+ *  log sync interval while the server is busy, and checkpointed after
+ *  SDB_SERVE_IDLE_MS without writes.  A write is acknowledged only once
+ *  its group is committed, its client is not read from meanwhile so its
+ *  responses stay in order.  A group with acks waiting is committed as soon
+ *  as no client has a request ready, rather than after the sync interval.  Console output of the request
+ *  handlers is buffered and flushed whenever the server goes idle.
+ *
+ *  returns:  NO_ERROR       stopped by a signal
+ *            ERR_DB_FILE    the socket could not be set up, or a commit
+ *                           failed
+ *
+ *  console:  M_SERVE_START when ready, M_SERVE_STOP on exit followed by
+ *            M_CACHE_STATS with the pread engine, the console output of
+ *            every request in between.  M_ERR_SERVE_SOCK if the socket
+ *            cannot be set up
+ */
+int serve_db(int fd, char *sock_path)
+{
+    struct pollfd fds[SDB_SERVE_MAX_CLIENTS + 1];
+    serve_client_t clients[SDB_SERVE_MAX_CLIENTS + 1];
+    int nfds = 1;
+    bool failed = false;
+    unsigned long long served = 0;
+    bool wrote = false;
+    int rc = NO_ERROR;
+    db_store_t *st = store_lookup(fd);
+
+    fds[0].fd = listen_on(sock_path);
+    if (fds[0].fd < 0)
+    {
+        printf(M_ERR_SERVE_SOCK, sock_path);
+        return ERR_DB_FILE;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printf(M_SERVE_START, sock_path);
+    fflush(stdout);
+    setvbuf(stdout, NULL, _IOFBF, BUFSIZ);
+
+    while (!serve_stop)
+    {
+        // Writes waiting for their ack are committed as soon as no client
+        // has a request ready, the next group fills while this one syncs.
+        int timeout = -1;
+        if (st != NULL && st->wal != NULL && st->wal->nbuf > 0)
+            timeout = holding(clients, nfds) ? 0 : st->wal->interval_ms;
+        else if (wrote)
+            timeout = SDB_SERVE_IDLE_MS;
+
+        // stop accepting while every client slot is taken, and reading from
+        // a client waiting for its write to be acknowledged
+        fds[0].events = (nfds <= SDB_SERVE_MAX_CLIENTS) ? POLLIN : 0;
+        for (int i = 1; i < nfds; i++)
+            fds[i].events = (clients[i].held.status == SDB_STATUS_MORE) ? POLLIN : 0;
+        fflush(stdout);
+        int ready = poll(fds, nfds, timeout);
+        if (ready == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            rc = ERR_DB_FILE;
+            break;
+        }
+        if (ready == 0)
+        {
+            if (st != NULL && st->wal != NULL && st->wal->nbuf > 0)
+            {
+                rc = wal_commit(st);
+                release_acks(fds, &nfds, clients, rc != NO_ERROR);
+            }
+            else
+            {
+                rc = store_commit(fd);
+                wrote = false;
+            }
+            if (rc != NO_ERROR)
+                break;
+            continue;
+        }
+
+        for (int i = nfds - 1; i >= 1; i--)
+        {
+            if (fds[i].revents == 0)
+                continue;
+            // nobody is left to acknowledge
+            if (clients[i].held.status != SDB_STATUS_MORE)
+            {
+                drop_client(fds, &nfds, clients, i);
+                continue;
+            }
+
+            int got = read_request(&clients[i], fds[i].fd);
+            if (got == 0)
+                continue;
+            if (got < 0 || serve_request(fd, fds[i].fd, &clients[i].req, &wrote, &failed,
+                                             &clients[i].held) != NO_ERROR)
+            {
+                drop_client(fds, &nfds, clients, i);
+                continue;
+            }
+            served++;
+        }
+        // a full batch or an old group is committed by the write that fills it
+        if (st != NULL && st->wal != NULL && st->wal->nbuf == 0)
+        {
+            release_acks(fds, &nfds, clients, failed);
+            failed = false;
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            int client = accept(fds[0].fd, NULL, NULL);
+            if (client != -1 && fcntl(client, F_SETFL, O_NONBLOCK) == -1)
+            {
+                close(client);
+                client = -1;
+            }
+            if (client != -1)
+            {
+                fds[nfds].fd = client;
+                fds[nfds].events = POLLIN;
+                fds[nfds].revents = 0;
+                clients[nfds].have = 0;
+                clients[nfds++].held.status = SDB_STATUS_MORE;
+            }
+        }
+    }
+
+    // the writes still waiting for their group get it committed now
+    if (st != NULL && st->wal != NULL)
+    {
+        int crc = wal_commit(st);
+        release_acks(fds, &nfds, clients, crc != NO_ERROR || rc != NO_ERROR);
+        if (rc == NO_ERROR)
+            rc = crc;
+    }
+    for (int i = 0; i < nfds; i++)
+        close(fds[i].fd);
+    unlink(sock_path);
+    printf(M_SERVE_STOP, served);
+    if (st != NULL && st->cache != NULL)
+        printf(M_CACHE_STATS, (unsigned long long)st->cache->hits,
+               (unsigned long long)st->cache->misses);
+    fflush(stdout);
+    return rc;
+}
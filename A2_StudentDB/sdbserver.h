@@ -0,0 +1,45 @@
+#ifndef __SDB_SERVER_H__
+#define __SDB_SERVER_H__
+
+#include <stdint.h>
+
+#include "db.h" //get student record type
+
+//Server mode keeps the database open and serves requests over a Unix domain
+//socket, so a lookup costs one round trip instead of a process start plus
+//open_db() and close_db().  The socket defaults to <db>.sock.
+#define SDB_SOCK_EXT            ".sock"
+#define SDB_SERVE_MAX_CLIENTS   64
+
+//With nothing to do the server checkpoints the log (see sdbwal.h) after
+//this long, so the log of a long running server stays short
+#define SDB_SERVE_IDLE_MS       1000
+
+//Request operations
+#define SDB_OP_GET      1       // id           -> rec
+#define SDB_OP_ADD      2       // rec          -> status
+#define SDB_OP_DEL      3       // id           -> status
+#define SDB_OP_COUNT    4       //              -> value = number of records
+#define SDB_OP_PRINT    5       //              -> one SDB_STATUS_MORE frame per
+                                //                 record, then value = count
+
+//Status of a response frame that is followed by more frames for the same
+//request, the other statuses are the NO_ERROR, ERR_DB_* and SRCH_NOT_FOUND
+//return codes of sdbsc.h
+#define SDB_STATUS_MORE 1
+
+//Frames are fixed size and in host byte order, the socket never leaves the
+//machine.  Every request gets at least one response, in order.
+typedef struct sdb_request {
+    uint32_t    op;
+    int32_t     id;
+    student_t   rec;
+} sdb_request_t;
+
+typedef struct sdb_response {
+    int32_t     status;
+    int32_t     value;
+    student_t   rec;
+} sdb_response_t;
+
+#endif
@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SDB_HAVE_X86_SIMD
+#endif
+
+// database include files
+#include "db.h"
+#include "sdbsimd.h"
+
+typedef void (*classify_fn)(const student_t *recs, int n, uint64_t *live_mask);
+
+/*
+ *  classify_scalar
+ *
+ *  Portable kernel, ORs the eight 64 bit words of each slot.
+ */
+static void classify_scalar(const student_t *recs, int n, uint64_t *live_mask)
+{
+    memset(live_mask, 0, LIVE_MASK_WORDS(n) * sizeof(uint64_t));
+    for (int i = 0; i < n; i++)
+    {
+        uint64_t w[8];
+        memcpy(w, &recs[i], sizeof(w));
+        uint64_t any = w[0] | w[1] | w[2] | w[3] | w[4] | w[5] | w[6] | w[7];
+        if (any != 0)
+            live_mask[i / 64] |= 1ULL << (i % 64);
+    }
+}
+
+#ifdef SDB_HAVE_X86_SIMD
+/*
+ *  classify_sse2
+ *
+ *  Four 16 byte loads per slot ORed together, a slot is empty when every
+ *  byte of the result compares equal to zero.
+ */
+__attribute__((target("sse2")))
+static void classify_sse2(const student_t *recs, int n, uint64_t *live_mask)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const char *p = (const char *)recs;
+
+    memset(live_mask, 0, LIVE_MASK_WORDS(n) * sizeof(uint64_t));
+    for (int i = 0; i < n; i++, p += sizeof(student_t))
+    {
+        __m128i v = _mm_or_si128(
+            _mm_or_si128(_mm_loadu_si128((const __m128i *)p),
+                         _mm_loadu_si128((const __m128i *)(p + 16))),
+            _mm_or_si128(_mm_loadu_si128((const __m128i *)(p + 32)),
+                         _mm_loadu_si128((const __m128i *)(p + 48))));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) != 0xFFFF)
+            live_mask[i / 64] |= 1ULL << (i % 64);
+    }
+}
+
+/*
+ *  classify_avx2
+ *
+ *  Two 32 byte loads per slot ORed together and tested with vptest.
+ */
+__attribute__((target("avx2")))
+static void classify_avx2(const student_t *recs, int n, uint64_t *live_mask)
+{
+    const char *p = (const char *)recs;
+
+    memset(live_mask, 0, LIVE_MASK_WORDS(n) * sizeof(uint64_t));
+    for (int i = 0; i < n; i++, p += sizeof(student_t))
+    {
+        __m256i v = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)p),
+                                    _mm256_loadu_si256((const __m256i *)(p + 32)));
+        if (!_mm256_testz_si256(v, v))
+            live_mask[i / 64] |= 1ULL << (i % 64);
+    }
+}
+#endif
+
+static classify_fn classify_impl = NULL;
+static const char *classify_name = "scalar";
+
+/*
+ *  select_impl
+ *
+ *  Picks the widest kernel the CPU supports unless SDB_SIMD_ENV asks for a
+ *  specific one.
+ */
+static void select_impl(void)
+{
+    const char *want = getenv(SDB_SIMD_ENV);
+    classify_impl = classify_scalar;
+    classify_name = "scalar";
+
+#ifdef SDB_HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (want != NULL && strcmp(want, "scalar") == 0)
+        return;
+    if ((want == NULL || strcmp(want, "avx2") == 0) && __builtin_cpu_supports("avx2"))
+    {
+        classify_impl = classify_avx2;
+        classify_name = "avx2";
+        return;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        classify_impl = classify_sse2;
+        classify_name = "sse2";
+    }
+#else
+    (void)want;
+#endif
+}
+
+/*
+ *  classify_records
+ *      *recs:       n consecutive record slots
+ *      n:           number of slots
+ *      *live_mask:  LIVE_MASK_WORDS(n) words, bit i is set when recs[i] is
+ *                   a live record and clear when it is empty
+ */
+void classify_records(const student_t *recs, int n, uint64_t *live_mask)
+{
+    if (classify_impl == NULL)
+        select_impl();
+    classify_impl(recs, n, live_mask);
+}
+
+/*
+ *  classify_impl_name
+ *
+ *  returns:  name of the kernel classify_records() dispatches to
+ */
+const char *classify_impl_name(void)
+{
+    if (classify_impl == NULL)
+        select_impl();
+    return classify_name;
+}
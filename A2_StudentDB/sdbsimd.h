@@ -0,0 +1,22 @@
+#ifndef __SDB_SIMD_H__
+#define __SDB_SIMD_H__
+
+#include <stdint.h>
+
+#include "db.h" //get student record type
+
+//A student_t is exactly one 64 byte cache line, so telling an empty slot
+//from a live one is an OR across the line followed by a test against zero.
+//classify_records() does that for a whole block of slots with the widest
+//vector unit the CPU has (AVX2, SSE2 or plain 64 bit words), picked at run
+//time.  SDB_SIMD_ENV can force "avx2", "sse2" or "scalar".
+#define SDB_SIMD_ENV        "SDB_SIMD"
+
+//Number of uint64_t mask words needed to classify n slots
+#define LIVE_MASK_WORDS(n)  (((n) + 63) / 64)
+
+//prototypes for the record classifier
+void classify_records(const student_t *recs, int n, uint64_t *live_mask);
+const char *classify_impl_name(void);
+
+#endif
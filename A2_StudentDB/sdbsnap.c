@@ -0,0 +1,417 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdblock.h"
+#include "sdbsnap.h"
+
+/*
+ *  snap_copied
+ *      st:  engine state with the sidecar mapped
+ *      id:  slot
+ *
+ *  returns:  true if the old record of id has been copied to the sidecar
+ */
+static bool snap_copied(db_store_t *st, long id)
+{
+    uint64_t word = __atomic_load_n(&st->snap_bits[id / 64], __ATOMIC_ACQUIRE);
+    return (word & (1ULL << (id % 64))) != 0;
+}
+
+/*
+ *  snap_cow_enabled
+ *
+ *  returns:  false if SDB_SNAP_ENV asks for locked snapshots, true otherwise
+ */
+static bool snap_cow_enabled(void)
+{
+    char *mode = getenv(SDB_SNAP_ENV);
+    return mode == NULL || strcmp(mode, "lock") != 0;
+}
+
+/*
+ *  snap_drop_copies
+ *      st:  engine state with the sidecar mapped
+ *
+ *  Truncates the copied records off the sidecar, keeping the header and
+ *  the largest bitmap any process has mapped.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int snap_drop_copies(db_store_t *st)
+{
+    off_t len = (off_t)(sizeof(snap_header_t) + st->snap_hdr->nbits / 8);
+    return (ftruncate(st->snap_fd, len) == 0) ? NO_ERROR : ERR_DB_FILE;
+}
+
+/*
+ *  snap_attach
+ *      st:               engine state of a freshly opened database
+ *      should_truncate:  the database was just emptied
+ *
+ *  Maps the snapshot sidecar with a bitmap sized for st->capacity, or
+ *  larger if another process grew it, and keeps its descriptor open for
+ *  the copied records and the snapshot lock.  A snapshot left open by a
+ *  process that died is closed.  Called again after the capacity grew, it
+ *  remaps the bitmap on the same descriptor so a snapshot this process has
+ *  open stays open.  Hash layout files take no snapshots.  If the sidecar
+ *  cannot be created, snap_begin() falls back to locking.
+ *
+ *  returns:  NO_ERROR       sidecar attached (or unavailable)
+ *            ERR_DB_FILE    database file I/O issue
+ */
+int snap_attach(db_store_t *st, bool should_truncate)
+{
+    uint64_t nbits = ((uint64_t)st->capacity + 1 + 63) / 64 * 64;
+    char path[SDB_PATH_MAX];
+    struct stat sb, isb;
+    snap_header_t hdr;
+
+    if (st->layout != SDB_LAYOUT_DIRECT)
+        return NO_ERROR;
+    if (fstat(st->fd, &sb) == -1)
+        return ERR_DB_FILE;
+    if (snprintf(path, sizeof(path), "%s%s", st->path, SDB_SNAP_EXT) >= (int)sizeof(path))
+        return NO_ERROR;
+
+    bool reattach = (st->snap_fd != -1);
+    int fd = st->snap_fd;
+    if (reattach)
+    {
+        munmap(st->snap_hdr, st->snap_len);
+        st->snap_hdr = NULL;
+        st->snap_bits = NULL;
+        st->snap_fd = -1;
+    }
+    else
+    {
+        int flags = O_RDWR | O_CREAT;
+        if (should_truncate)
+            flags |= O_TRUNC;
+        fd = open(path, flags, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+        if (fd == -1)
+            return NO_ERROR;
+    }
+
+    // a process that grew the database may already have grown the bitmap
+    if (pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) && hdr.magic == SDB_SNAP_MAGIC &&
+        hdr.nbits > nbits && hdr.nbits <= (uint64_t)SDB_MAX_CAPACITY + 64)
+        nbits = hdr.nbits;
+    size_t len = sizeof(snap_header_t) + nbits / 8;
+    if (fstat(fd, &isb) == -1 || (isb.st_size < (off_t)len && ftruncate(fd, len) == -1))
+    {
+        close(fd);
+        return NO_ERROR;
+    }
+    void *base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+        close(fd);
+        return NO_ERROR;
+    }
+
+    st->snap_hdr = base;
+    st->snap_bits = (uint64_t *)((char *)base + sizeof(snap_header_t));
+    st->snap_nwords = (int)(nbits / 64);
+    st->snap_len = len;
+    st->snap_fd = fd;
+
+    snap_header_t *h = st->snap_hdr;
+    if (h->magic != SDB_SNAP_MAGIC || h->version != SDB_SNAP_VERSION ||
+        h->db_ino != (uint64_t)sb.st_ino || h->db_dev != (uint64_t)sb.st_dev)
+    {
+        memset(base, 0, len);
+        h->magic = SDB_SNAP_MAGIC;
+        h->version = SDB_SNAP_VERSION;
+        h->db_ino = sb.st_ino;
+        h->db_dev = sb.st_dev;
+    }
+    if (h->nbits < nbits)
+        h->nbits = nbits;
+
+    // nobody holds the snapshot lock of an open snapshot, its owner died
+    if (!reattach && h->active && try_lock_slots(fd, 0, 1, SDB_LOCK_WRITE) == NO_ERROR)
+    {
+        __atomic_store_n(&h->active, 0, __ATOMIC_RELEASE);
+        snap_drop_copies(st);
+        unlock_slots(fd, 0, 1);
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  snap_detach
+ *      st:  engine state
+ *
+ *  Unmaps the sidecar and closes its descriptor.
+ */
+void snap_detach(db_store_t *st)
+{
+    if (st->snap_hdr != NULL)
+        munmap(st->snap_hdr, st->snap_len);
+    if (st->snap_fd != -1)
+        close(st->snap_fd);
+    st->snap_hdr = NULL;
+    st->snap_bits = NULL;
+    st->snap_fd = -1;
+}
+
+/*
+ *  snap_preserve
+ *      st:        engine state, may be NULL
+ *      first_id:  first of n consecutive slots about to be written
+ *      *old:      their current contents
+ *      n:         number of slots
+ *
+ *  Called with the slots write locked, before they are written.  When a
+ *  snapshot is open, the slots it covers that have not been copied yet are
+ *  copied to the sidecar, one pwrite() per run, and only then marked, so a
+ *  reader that sees the mark finds the copy.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE if a copy could not be written
+ */
+int snap_preserve(db_store_t *st, int first_id, const student_t *old, int n)
+{
+    if (st == NULL || st->snap_hdr == NULL ||
+        !__atomic_load_n(&st->snap_hdr->active, __ATOMIC_ACQUIRE))
+        return NO_ERROR;
+
+    long limit = (long)st->snap_hdr->nslots_snap;
+    if (limit > (long)st->snap_nwords * 64)
+        limit = (long)st->snap_nwords * 64;
+
+    int i = 0;
+    while (i < n && first_id + i < limit)
+    {
+        if (snap_copied(st, first_id + i))
+        {
+            i++;
+            continue;
+        }
+        int j = i + 1;
+        while (j < n && first_id + j < limit && !snap_copied(st, first_id + j))
+            j++;
+
+        size_t len = (size_t)(j - i) * STUDENT_RECORD_SIZE;
+        off_t offset = SNAP_REC_BASE + (off_t)(first_id + i) * STUDENT_RECORD_SIZE;
+        if (pwrite(st->snap_fd, &old[i], len, offset) != (ssize_t)len)
+            return ERR_DB_FILE;
+        for (long id = first_id + i; id < first_id + j; id++)
+            __atomic_fetch_or(&st->snap_bits[id / 64], 1ULL << (id % 64), __ATOMIC_RELEASE);
+        i = j;
+    }
+    // the marks must be visible before the new records are
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return NO_ERROR;
+}
+
+/*
+ *  snap_begin
+ *      fd:     database file descriptor
+ *      *view:  receives the view
+ *
+ *  Waits for in-flight writes with a read lock over the whole file, then
+ *  opens a copy-on-write snapshot and lets writers go again.  If another
+ *  snapshot is open, the sidecar is unavailable, the file has grown past
+ *  the bitmap of this process or SDB_SNAP_ENV is "lock", the read lock is kept until snap_end()
+ *  instead, which gives the same view at the cost of holding off writers.
+ *  A copy-on-write view covers the slots the file had, a locked one every
+ *  id up to the capacity.
+ *
+ *  returns:  NO_ERROR       view ready, release it with snap_end()
+ *            ERR_DB_FILE    the file could not be locked
+ */
+int snap_begin(int fd, snap_view_t *view)
+{
+    db_store_t *st = store_lookup(fd);
+    struct stat sb;
+
+    memset(view, 0, sizeof(*view));
+    view->fd = fd;
+    view->st = st;
+    if (lock_slots(fd, 0, SDB_LOCK_TO_END, SDB_LOCK_READ) != NO_ERROR)
+        return ERR_DB_FILE;
+    if (fstat(fd, &sb) == -1)
+    {
+        unlock_slots(fd, 0, SDB_LOCK_TO_END);
+        return ERR_DB_FILE;
+    }
+    view->nslots = (int)(sb.st_size / STUDENT_RECORD_SIZE);
+    // before the bitmap is taken, a grown capacity remaps it
+    int all_slots = (st != NULL) ? store_capacity(fd) + 1 : view->nslots;
+    if (st != NULL && st->occ != NULL)
+    {
+        view->occ = st->occ;
+        view->occ_nwords = st->occ_nwords;
+    }
+
+    if (!snap_cow_enabled() || st == NULL || st->snap_hdr == NULL ||
+        view->nslots > (long)st->snap_nwords * 64 ||
+        try_lock_slots(st->snap_fd, 0, 1, SDB_LOCK_WRITE) != NO_ERROR)
+    {
+        // nothing moves under the read lock, and a hash layout file places
+        // ids apart from its size, so the view covers every id
+        if (all_slots > view->nslots)
+            view->nslots = all_slots;
+        return NO_ERROR;
+    }
+
+    uint64_t *occ = NULL;
+    if (view->occ != NULL)
+    {
+        occ = malloc((size_t)view->occ_nwords * sizeof(uint64_t));
+        if (occ != NULL)
+            memcpy(occ, view->occ, (size_t)view->occ_nwords * sizeof(uint64_t));
+    }
+    // clear what the previous snapshot copied
+    memset(st->snap_bits, 0, (size_t)st->snap_nwords * sizeof(uint64_t));
+    if ((view->occ != NULL && occ == NULL) || snap_drop_copies(st) != NO_ERROR)
+    {
+        free(occ);
+        unlock_slots(st->snap_fd, 0, 1);
+        return NO_ERROR;
+    }
+
+    st->snap_hdr->nslots_snap = view->nslots;
+    __atomic_store_n(&st->snap_hdr->active, 1, __ATOMIC_RELEASE);
+    view->occ = occ;
+    view->cow = true;
+    unlock_slots(fd, 0, SDB_LOCK_TO_END);
+    return NO_ERROR;
+}
+
+/*
+ *  snap_overlay
+ *      *view:     view from snap_begin()
+ *      first_id:  slot of recs[0]
+ *      *recs:     n consecutive slots just read from the database file
+ *      n:         number of slots
+ *
+ *  Replaces the slots written since the snapshot was taken with their
+ *  copies and empties the slots past the end of the snapshot.  Nothing
+ *  changes in a locked view.
+ *
+ *  returns:  number of slots replaced, or ERR_DB_FILE if a copy could not
+ *            be read
+ */
+int snap_overlay(snap_view_t *view, int first_id, student_t *recs, int n)
+{
+    if (!view->cow)
+        return 0;
+
+    // the slots must have been read before the marks are
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    db_store_t *st = view->st;
+    int replaced = 0;
+    int i = 0;
+    while (i < n)
+    {
+        long id = (long)first_id + i;
+        if (id >= view->nslots)
+        {
+            memset(&recs[i], 0, (size_t)(n - i) * STUDENT_RECORD_SIZE);
+            break;
+        }
+        uint64_t word = __atomic_load_n(&st->snap_bits[id / 64], __ATOMIC_ACQUIRE) >> (id % 64);
+        if (word == 0)
+        {
+            i += 64 - (int)(id % 64);
+            continue;
+        }
+        i += __builtin_ctzll(word);
+        id = (long)first_id + i;
+        if (i >= n || id >= view->nslots)
+            continue;
+        off_t offset = SNAP_REC_BASE + (off_t)id * STUDENT_RECORD_SIZE;
+        if (pread(st->snap_fd, &recs[i], STUDENT_RECORD_SIZE, offset) != STUDENT_RECORD_SIZE)
+            return ERR_DB_FILE;
+        replaced++;
+        i++;
+    }
+    return replaced;
+}
+
+/*
+ *  snap_read
+ *      *view:  view from snap_begin()
+ *      id:     student id whose slot should be read
+ *      *s:     where the slot contents as of the view are copied
+ *
+ *  returns:  NO_ERROR, SRCH_NOT_FOUND or ERR_DB_FILE as store_read_slot()
+ */
+int snap_read(snap_view_t *view, int id, student_t *s)
+{
+    int rc = store_read_slot(view->fd, id, s);
+    if (!view->cow || rc == ERR_DB_FILE)
+        return rc;
+    if (id >= view->nslots)
+    {
+        memset(s, 0, STUDENT_RECORD_SIZE);
+        return SRCH_NOT_FOUND;
+    }
+    int replaced = snap_overlay(view, id, s, 1);
+    if (replaced < 0)
+        return ERR_DB_FILE;
+    return (replaced > 0) ? NO_ERROR : rc;
+}
+
+/*
+ *  snap_next
+ *      *view:  view from snap_begin() with an occupancy bitmap
+ *      from:   first id to consider
+ *
+ *  returns:  the smallest id >= from that was live when the view was
+ *            taken, or -1 if there is none
+ */
+int snap_next(snap_view_t *view, int from)
+{
+    if (from < 0)
+        from = 0;
+    int w = from / 64;
+    if (view->occ == NULL || w >= view->occ_nwords)
+        return -1;
+
+    uint64_t word = view->occ[w] & (~0ULL << (from % 64));
+    while (word == 0)
+    {
+        if (++w == view->occ_nwords)
+            return -1;
+        word = view->occ[w];
+    }
+    int id = w * 64 + __builtin_ctzll(word);
+    return (id < view->nslots) ? id : -1;
+}
+
+/*
+ *  snap_end
+ *      *view:  view from snap_begin()
+ *
+ *  Closes the snapshot and drops the copied records, or releases the read
+ *  lock of a locked view.  A writer that saw the snapshot open just before
+ *  may still copy a record after this, the next snapshot clears it.
+ */
+void snap_end(snap_view_t *view)
+{
+    db_store_t *st = view->st;
+    if (view->cow)
+    {
+        __atomic_store_n(&st->snap_hdr->active, 0, __ATOMIC_RELEASE);
+        snap_drop_copies(st);
+        unlock_slots(st->snap_fd, 0, 1);
+        free(view->occ);
+    }
+    else
+        unlock_slots(view->fd, 0, SDB_LOCK_TO_END);
+    view->occ = NULL;
+    view->cow = false;
+}
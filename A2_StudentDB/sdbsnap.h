@@ -0,0 +1,71 @@
+#ifndef __SDB_SNAP_H__
+#define __SDB_SNAP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "sdbstore.h"
+
+//Snapshot reads.  A long report takes a snapshot with snap_begin() and
+//reads the database as it was at that moment while writers carry on.  The
+//snapshot sidecar holds a flag saying a snapshot is open and a bitmap with
+//one bit per slot.  While the flag is set, a writer about to overwrite a
+//slot for the first time copies its old record into the sidecar at
+//SNAP_REC_BASE + slot offset and sets the slot's bit before the new record
+//goes in, so readers take a slot from the sidecar when its bit is set and
+//from the database otherwise.  Only the slots written during the snapshot
+//are copied.  One snapshot can be open per database, a second reader (and
+//any reader of a hash layout file, whose records move on rehash) holds off
+//writers with a read lock for the duration instead.  SDB_SNAP_ENV set to
+//"lock" makes every snapshot do that.
+#define SDB_SNAP_EXT        ".snap"
+#define SDB_SNAP_ENV        "SDB_SNAP"
+#define SDB_SNAP_MAGIC      0x31504e53u     // "SNP1"
+#define SDB_SNAP_VERSION    1
+
+//Where the copied records start in the sidecar, past the bitmap of a file
+//grown to SDB_MAX_CAPACITY (256MB).  The file is sparse, only the copied
+//records take space.
+#define SNAP_REC_BASE       ((off_t)1 << 30)
+
+//Sidecar file header, the bitmap follows it.  active is set while a
+//snapshot is open and nslots_snap is the number of slots the database file
+//had when it was taken, writes past it are never copied.  See occ_header_t
+//for the reason the database inode and device are recorded.
+typedef struct snap_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t nbits;
+    uint64_t db_ino;
+    uint64_t db_dev;
+    uint32_t active;
+    uint32_t pad;
+    uint64_t nslots_snap;
+} snap_header_t;
+
+//A consistent view of the database from snap_begin() to snap_end().  cow
+//is true for a copy-on-write snapshot and false when writers are held off
+//with a read lock instead.  nslots is the number of slots the view covers.
+//occ is the occupancy bitmap as of snap_begin() (a copy when cow is set),
+//NULL if the database has none.
+typedef struct snap_view {
+    int         fd;
+    db_store_t  *st;
+    bool        cow;
+    int         nslots;
+    uint64_t    *occ;
+    int         occ_nwords;
+} snap_view_t;
+
+//prototypes for snapshot reads
+int snap_attach(db_store_t *st, bool should_truncate);
+void snap_detach(db_store_t *st);
+int snap_preserve(db_store_t *st, int first_id, const student_t *old, int n);
+int snap_begin(int fd, snap_view_t *view);
+int snap_read(snap_view_t *view, int id, student_t *s);
+int snap_overlay(snap_view_t *view, int first_id, student_t *recs, int n);
+int snap_next(snap_view_t *view, int from);
+void snap_end(snap_view_t *view);
+
+#endif
@@ -0,0 +1,526 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbscan.h"
+#include "sdbfmt.h"
+#include "sdbsnap.h"
+#include "sdbsort.h"
+
+//One sorted run in the spill file, first is its offset
+typedef struct sort_run {
+    off_t       first;
+    int         count;
+} sort_run_t;
+
+//Sort key of a name sort, the first 8 bytes of the name and the index of
+//the record in the buffer
+typedef struct sort_key {
+    uint64_t    prefix;
+    uint32_t    idx;
+    uint32_t    pad;
+} sort_key_t;
+
+//A sort in progress.  recs holds up to cap records as the partitions are
+//merged in id order, aux, keys and key_aux are the scratch space of the
+//in-memory sort.
+//Full buffers are sorted and appended to spill_fd as runs.  error is set
+//once memory ran out or a run could not be written.
+typedef struct sort_state {
+    int         key;
+    student_t   *recs;
+    student_t   *aux;
+    sort_key_t  *keys;
+    sort_key_t  *key_aux;
+    int         nrecs;
+    int         cap;
+    int         spill_fd;
+    off_t       spill_len;
+    sort_run_t  *runs;
+    int         nruns;
+    int         runs_cap;
+    int         error;
+} sort_state_t;
+
+//Read side of a run during the merge, buffered up to cap records at a
+//time.  left counts the records of the run not read yet, n those in buf.
+typedef struct run_reader {
+    off_t       pos;
+    int         left;
+    student_t   *buf;
+    int         cap;
+    int         n;
+    int         next;
+} run_reader_t;
+
+/*
+ *  sort_budget
+ *
+ *  returns:  the memory budget in bytes, from SDB_SORT_MEM_ENV or
+ *            SDB_SORT_DEF_MEM_KB
+ */
+static size_t sort_budget(void)
+{
+    char *env = getenv(SDB_SORT_MEM_ENV);
+    long kb = (env != NULL) ? atol(env) : 0;
+    if (kb <= 0)
+        kb = SDB_SORT_DEF_MEM_KB;
+    return (size_t)kb * 1024;
+}
+
+/*
+ *  cmp_key
+ *      *a, *b:  records to compare
+ *      key:     SDB_SORT_LNAME, SDB_SORT_FNAME or SDB_SORT_GPA
+ *
+ *  returns:  <0, 0 or >0 as a sorts before, with or after b, ties broken
+ *            by id
+ */
+static int cmp_key(const student_t *a, const student_t *b, int key)
+{
+    int c;
+    if (key == SDB_SORT_GPA)
+        c = b->gpa - a->gpa;
+    else if (key == SDB_SORT_FNAME)
+        c = strncmp(a->fname, b->fname, sizeof(a->fname));
+    else
+        c = strncmp(a->lname, b->lname, sizeof(a->lname));
+    if (c != 0)
+        return c;
+    return (a->id > b->id) - (a->id < b->id);
+}
+
+/*
+ *  count_sort_gpa
+ *      *recs:  records to sort by gpa, highest first
+ *      *aux:   scratch space for n records
+ *      n:      number of records
+ *
+ *  One counting pass over the gpa values.  The sort is stable, records
+ *  handed over in id order stay in id order within a gpa.
+ */
+static void count_sort_gpa(student_t *recs, student_t *aux, int n)
+{
+    int start[MAX_STD_GPA - MIN_STD_GPA + 2] = {0};
+
+    for (int i = 0; i < n; i++)
+        start[MAX_STD_GPA - recs[i].gpa + 1]++;
+    for (int g = 1; g <= MAX_STD_GPA - MIN_STD_GPA + 1; g++)
+        start[g] += start[g - 1];
+    for (int i = 0; i < n; i++)
+        aux[start[MAX_STD_GPA - recs[i].gpa]++] = recs[i];
+    memcpy(recs, aux, (size_t)n * sizeof(student_t));
+}
+
+/*
+ *  name_prefix
+ *      *name:  name field
+ *
+ *  returns:  the first 8 bytes of the name, zero padded past its end, as a
+ *            big endian number so prefixes compare like the names do
+ */
+static uint64_t name_prefix(const char *name)
+{
+    uint64_t prefix = 0;
+    int i = 0;
+    for (; i < 8 && name[i] != '\0'; i++)
+        prefix = (prefix << 8) | (unsigned char)name[i];
+    return prefix << (8 * (8 - i));
+}
+
+/*
+ *  cmp_name_key
+ *      *a, *b:  keys to compare
+ *      *recs:   records the keys index
+ *      key:     SDB_SORT_LNAME or SDB_SORT_FNAME
+ *
+ *  returns:  <0, 0 or >0 as cmp_key() on the records, going to the records
+ *            only when the prefixes are equal and longer names may differ
+ */
+static int cmp_name_key(const sort_key_t *a, const sort_key_t *b, const student_t *recs, int key)
+{
+    if (a->prefix != b->prefix)
+        return (a->prefix > b->prefix) ? 1 : -1;
+    if ((a->prefix & 0xff) != 0)
+    {
+        const student_t *ra = &recs[a->idx];
+        const student_t *rb = &recs[b->idx];
+        int c = (key == SDB_SORT_FNAME) ?
+                strncmp(ra->fname + 8, rb->fname + 8, sizeof(ra->fname) - 8) :
+                strncmp(ra->lname + 8, rb->lname + 8, sizeof(ra->lname) - 8);
+        if (c != 0)
+            return c;
+    }
+    return (a->idx > b->idx) - (a->idx < b->idx);
+}
+
+/*
+ *  merge_sort_names
+ *      *ss:  sort state with records in recs
+ *
+ *  Sorts 16 byte keys holding the first 8 bytes of the name and the record
+ *  index with a bottom up merge sort, passes alternating between keys and
+ *  key_aux, then gathers the records in key order into aux and swaps it
+ *  with recs.  Records arrive in id order, so the index breaks ties by id.
+ */
+static void merge_sort_names(sort_state_t *ss)
+{
+    int n = ss->nrecs;
+    sort_key_t *src = ss->keys;
+    sort_key_t *dst = ss->key_aux;
+
+    for (int i = 0; i < n; i++)
+    {
+        src[i].prefix = name_prefix((ss->key == SDB_SORT_FNAME) ? ss->recs[i].fname : ss->recs[i].lname);
+        src[i].idx = i;
+    }
+    for (int width = 1; width < n; width *= 2)
+    {
+        for (int lo = 0; lo < n; lo += 2 * width)
+        {
+            int mid = (lo + width < n) ? lo + width : n;
+            int hi = (lo + 2 * width < n) ? lo + 2 * width : n;
+            int i = lo, j = mid, k = lo;
+            while (i < mid && j < hi)
+                dst[k++] = (cmp_name_key(&src[j], &src[i], ss->recs, ss->key) < 0) ? src[j++] : src[i++];
+            while (i < mid)
+                dst[k++] = src[i++];
+            while (j < hi)
+                dst[k++] = src[j++];
+        }
+        sort_key_t *t = src;
+        src = dst;
+        dst = t;
+    }
+
+    for (int i = 0; i < n; i++)
+        ss->aux[i] = ss->recs[src[i].idx];
+    student_t *t = ss->recs;
+    ss->recs = ss->aux;
+    ss->aux = t;
+}
+
+/*
+ *  sort_buffer
+ *      *ss:  sort state with records in recs, sorted in recs on return
+ */
+static void sort_buffer(sort_state_t *ss)
+{
+    if (ss->key == SDB_SORT_GPA)
+        count_sort_gpa(ss->recs, ss->aux, ss->nrecs);
+    else
+        merge_sort_names(ss);
+}
+
+/*
+ *  spill_run
+ *      *ss:  sort state with a full buffer
+ *
+ *  Sorts the buffer and appends it to the spill file as a new run, creating
+ *  the file on the first spill.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int spill_run(sort_state_t *ss)
+{
+    if (ss->spill_fd == -1)
+    {
+        char path[] = SORT_SPILL_TEMPLATE;
+        ss->spill_fd = mkstemp(path);
+        if (ss->spill_fd == -1)
+            return ERR_DB_FILE;
+        unlink(path);
+    }
+    if (ss->nruns == ss->runs_cap)
+    {
+        int cap = (ss->runs_cap == 0) ? 16 : ss->runs_cap * 2;
+        sort_run_t *grown = realloc(ss->runs, (size_t)cap * sizeof(sort_run_t));
+        if (grown == NULL)
+            return ERR_DB_FILE;
+        ss->runs = grown;
+        ss->runs_cap = cap;
+    }
+
+    sort_buffer(ss);
+    size_t len = (size_t)ss->nrecs * sizeof(student_t);
+    if (pwrite(ss->spill_fd, ss->recs, len, ss->spill_len) != (ssize_t)len)
+        return ERR_DB_FILE;
+    ss->runs[ss->nruns].first = ss->spill_len;
+    ss->runs[ss->nruns].count = ss->nrecs;
+    ss->nruns++;
+    ss->spill_len += len;
+    ss->nrecs = 0;
+    return NO_ERROR;
+}
+
+/*
+ *  sort_part
+ *      *it:   iterator over one partition
+ *      *ctx:  out_buf_t receiving the partition's live records
+ *      *arg:  unused
+ *
+ *  returns:  NO_ERROR, or ERR_DB_FILE if the records could not be buffered
+ */
+static int sort_part(scan_iter_t *it, void *ctx, void *arg)
+{
+    out_buf_t *part = ctx;
+    student_t *rec;
+    (void)arg;
+
+    if (out_open(part, -1) != NO_ERROR)
+        return ERR_DB_FILE;
+    while ((rec = scan_next(it)) != NULL)
+        out_bytes(part, (const char *)rec, STUDENT_RECORD_SIZE);
+    return part->error;
+}
+
+/*
+ *  sort_merge
+ *      *ctx:  out_buf_t filled by sort_part()
+ *      *arg:  sort_state_t
+ *      rc:    status of the scan so far
+ *
+ *  Adds the partition's records to the buffer, spilling a run whenever it
+ *  fills up.
+ *
+ *  returns:  NO_ERROR, or ERR_DB_FILE if a run could not be spilled
+ */
+static int sort_merge(void *ctx, void *arg, int rc)
+{
+    out_buf_t *part = ctx;
+    sort_state_t *ss = arg;
+    const student_t *recs = (const student_t *)part->buf;
+    int n = (int)(part->len / STUDENT_RECORD_SIZE);
+
+    for (int i = 0; rc == NO_ERROR && i < n; )
+    {
+        int take = (n - i < ss->cap - ss->nrecs) ? n - i : ss->cap - ss->nrecs;
+        memcpy(&ss->recs[ss->nrecs], &recs[i], (size_t)take * sizeof(student_t));
+        ss->nrecs += take;
+        i += take;
+        if (ss->nrecs == ss->cap)
+            rc = spill_run(ss);
+    }
+    if (rc != NO_ERROR)
+        ss->error = rc;
+    out_close(part);
+    return rc;
+}
+
+/*
+ *  reader_peek
+ *      *r:        reader of one run
+ *      spill_fd:  spill file
+ *
+ *  returns:  the run's next record, refilling the buffer if needed, or
+ *            NULL when the run is done or could not be read (left is set
+ *            to -1 then)
+ */
+static student_t *reader_peek(run_reader_t *r, int spill_fd)
+{
+    if (r->next < r->n)
+        return &r->buf[r->next];
+    if (r->left <= 0)
+        return NULL;
+
+    int n = (r->left < r->cap) ? r->left : r->cap;
+    size_t len = (size_t)n * sizeof(student_t);
+    if (pread(spill_fd, r->buf, len, r->pos) != (ssize_t)len)
+    {
+        r->left = -1;
+        return NULL;
+    }
+    r->pos += len;
+    r->left -= n;
+    r->n = n;
+    r->next = 0;
+    return &r->buf[0];
+}
+
+/*
+ *  heap_sift
+ *      *heap:  run indices, a min heap on the runs' next records
+ *      n:      heap size
+ *      i:      position to sift down from
+ *      *rd:    run readers
+ *      key:    sort key
+ */
+static void heap_sift(int *heap, int n, int i, run_reader_t *rd, int key)
+{
+    for (;;)
+    {
+        int l = 2 * i + 1, m = i;
+        if (l < n && cmp_key(&rd[heap[l]].buf[rd[heap[l]].next], &rd[heap[m]].buf[rd[heap[m]].next], key) < 0)
+            m = l;
+        if (l + 1 < n && cmp_key(&rd[heap[l + 1]].buf[rd[heap[l + 1]].next], &rd[heap[m]].buf[rd[heap[m]].next], key) < 0)
+            m = l + 1;
+        if (m == i)
+            return;
+        int t = heap[i];
+        heap[i] = heap[m];
+        heap[m] = t;
+        i = m;
+    }
+}
+
+/*
+ *  merge_runs
+ *      *ss:   sort state with every record spilled
+ *      *out:  where the rows are printed
+ *
+ *  k-way merge of the runs, the budget is split between the runs' read
+ *  buffers.
+ *
+ *  returns:  number of records printed, or ERR_DB_FILE
+ */
+static int merge_runs(sort_state_t *ss, out_buf_t *out)
+{
+    int per = (ss->cap * 2) / ss->nruns;
+    if (per < SORT_MIN_RUN)
+        per = SORT_MIN_RUN;
+    run_reader_t *rd = calloc(ss->nruns, sizeof(run_reader_t));
+    int *heap = malloc((size_t)ss->nruns * sizeof(int));
+    student_t *bufs = malloc((size_t)ss->nruns * per * sizeof(student_t));
+    int nheap = 0, printed = 0, rc = NO_ERROR;
+
+    if (rd == NULL || heap == NULL || bufs == NULL)
+        rc = ERR_DB_FILE;
+    for (int r = 0; rc == NO_ERROR && r < ss->nruns; r++)
+    {
+        rd[r].pos = ss->runs[r].first;
+        rd[r].left = ss->runs[r].count;
+        rd[r].buf = bufs + (size_t)r * per;
+        rd[r].cap = per;
+        if (reader_peek(&rd[r], ss->spill_fd) != NULL)
+            heap[nheap++] = r;
+        else if (rd[r].left < 0)
+            rc = ERR_DB_FILE;
+    }
+    for (int i = nheap / 2 - 1; i >= 0; i--)
+        heap_sift(heap, nheap, i, rd, ss->key);
+
+    while (rc == NO_ERROR && nheap > 0)
+    {
+        run_reader_t *r = &rd[heap[0]];
+        if (printed++ == 0)
+            out_header(out);
+        out_student(out, &r->buf[r->next]);
+        r->next++;
+        if (reader_peek(r, ss->spill_fd) == NULL)
+        {
+            if (r->left < 0)
+                rc = ERR_DB_FILE;
+            heap[0] = heap[--nheap];
+        }
+        heap_sift(heap, nheap, 0, rd, ss->key);
+    }
+    free(bufs);
+    free(heap);
+    free(rd);
+    return (rc == NO_ERROR) ? printed : rc;
+}
+
+/*
+ *  print_db_sorted
+ *      fd:   linux file descriptor
+ *      key:  SDB_SORT_LNAME, SDB_SORT_FNAME or SDB_SORT_GPA
+ *
+ *  print_db() ordered by last name, first name or gpa (highest first)
+ *  instead of id.  The records come from one parallel scan of a snapshot
+ *  (see sdbsnap.h).  Up to the memory budget (SDB_SORT_MEM_ENV) they are
+ *  sorted in memory, past it sorted runs are spilled to a temporary file
+ *  and merged, see sdbsort.h.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    database or spill file I/O issue, or out of
+ *                           memory
+ *
+ *  console:  If there are valid records, first prints a header then each
+ *            record.  Otherwise, prints M_DB_EMPTY.
+ */
+int print_db_sorted(int fd, int key)
+{
+    sort_state_t ss = {0};
+    snap_view_t view;
+    out_buf_t out;
+    int printed = 0;
+    int rc = ERR_DB_FILE;
+
+    ss.key = key;
+    ss.spill_fd = -1;
+    ss.cap = (int)(sort_budget() / (2 * sizeof(student_t) + 2 * sizeof(sort_key_t)));
+    if (ss.cap < SORT_MIN_RUN)
+        ss.cap = SORT_MIN_RUN;
+    ss.recs = malloc((size_t)ss.cap * sizeof(student_t));
+    ss.aux = malloc((size_t)ss.cap * sizeof(student_t));
+    if (key != SDB_SORT_GPA)
+    {
+        ss.keys = malloc((size_t)ss.cap * sizeof(sort_key_t));
+        ss.key_aux = malloc((size_t)ss.cap * sizeof(sort_key_t));
+    }
+
+    if (ss.recs != NULL && ss.aux != NULL && (key == SDB_SORT_GPA || (ss.keys != NULL && ss.key_aux != NULL)) &&
+        snap_begin(fd, &view) == NO_ERROR)
+    {
+        scan_job_t job = {sort_part, sort_merge, sizeof(out_buf_t), &ss, &view, sort_budget()};
+        rc = scan_parallel(fd, &job);
+        snap_end(&view);
+    }
+    if (rc == NO_ERROR && ss.error == NO_ERROR && out_open(&out, fileno(stdout)) == NO_ERROR)
+    {
+        if (ss.nruns == 0)
+        {
+            sort_buffer(&ss);
+            if (ss.nrecs > 0)
+                out_header(&out);
+            for (int i = 0; i < ss.nrecs; i++)
+                out_student(&out, &ss.recs[i]);
+            printed = ss.nrecs;
+        }
+        else
+        {
+            // the buffer goes out as the last run, its memory is reused
+            // for the read buffers
+            if (ss.nrecs > 0)
+                rc = spill_run(&ss);
+            free(ss.aux);
+            ss.aux = NULL;
+            free(ss.keys);
+            ss.keys = NULL;
+            free(ss.key_aux);
+            ss.key_aux = NULL;
+            free(ss.recs);
+            ss.recs = NULL;
+            printed = (rc == NO_ERROR) ? merge_runs(&ss, &out) : rc;
+        }
+        if (out_close(&out) != NO_ERROR || printed < 0)
+            rc = ERR_DB_FILE;
+    }
+    else
+        rc = ERR_DB_FILE;
+
+    if (ss.spill_fd != -1)
+        close(ss.spill_fd);
+    free(ss.runs);
+    free(ss.key_aux);
+    free(ss.keys);
+    free(ss.aux);
+    free(ss.recs);
+
+    if (rc != NO_ERROR)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    if (printed == 0)
+        printf(M_DB_EMPTY);
+    return NO_ERROR;
+}
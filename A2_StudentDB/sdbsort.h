@@ -0,0 +1,27 @@
+#ifndef __SDB_SORT_H__
+#define __SDB_SORT_H__
+
+//Sorted prints.  print_db_sorted() collects the live records of a snapshot
+//and sorts them in memory, gpa with a counting sort over the 501 possible
+//values and names with a merge sort of 16 byte keys holding the first 8
+//bytes of the name, going to the record only to break a tie.  When the records outgrow the memory
+//budget, each budget's worth is sorted and spilled to a run in one
+//temporary file next to the database, and the runs are merged k ways with
+//a heap.  Ties are printed in id order.  SDB_SORT_MEM_ENV sets the budget
+//in KB, the scan partitions held until they are added to the buffer span
+//at most the budget as well.
+#define SDB_SORT_MEM_ENV        "SDB_SORT_MEM_KB"
+#define SDB_SORT_DEF_MEM_KB     (64 * 1024)
+
+//Smallest number of records a run holds, whatever the budget
+#define SORT_MIN_RUN            64
+
+//Temporary spill file, created in the current directory and unlinked
+#define SORT_SPILL_TEMPLATE     TMP_DB_PREFIX "sort_XXXXXX"
+
+//Sort keys, names ascending and gpa descending
+#define SDB_SORT_LNAME          0
+#define SDB_SORT_FNAME          1
+#define SDB_SORT_GPA            2
+
+#endif
@@ -0,0 +1,939 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdbbitmap.h"
+#include "sdbwal.h"
+#include "sdbindex.h"
+#include "sdbcolumn.h"
+#include "sdbsum.h"
+#include "sdbsnap.h"
+#include "sdbseq.h"
+#include "sdblock.h"
+#include "sdbhash.h"
+#include "sdbcache.h"
+#include "sdbbatch.h"
+
+_Static_assert(sizeof(db_header_t) == sizeof(student_t), "header must fill slot 0");
+
+static db_store_t stores[SDB_MAX_OPEN_DB];
+static int num_stores = 0;
+
+/*
+ *  slot_offset
+ *      id:  student id
+ *
+ *  returns:  byte offset of the record slot for id, computed in off_t so the
+ *            multiplication cannot overflow an int
+ */
+static off_t slot_offset(int id)
+{
+    return (off_t)id * STUDENT_RECORD_SIZE;
+}
+
+/*
+ *  load_header
+ *      st:  engine state with fd and file_size set
+ *
+ *  Reads the header in slot 0 into st->capacity, st->layout and
+ *  st->generation.  An empty file gets a header for MAX_STD_ID ids in the
+ *  layout SDB_LAYOUT_ENV asks for first, carrying st->generation on, one
+ *  from before the header existed gets a direct layout one.
+ *
+ *  returns:  NO_ERROR       header loaded
+ *            ERR_DB_OP      the file is not a database this version reads
+ *            ERR_DB_FILE    database file I/O issue
+ */
+static int load_header(db_store_t *st)
+{
+    db_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    if (pread(st->fd, &hdr, sizeof(hdr), 0) == -1)
+        return ERR_DB_FILE;
+
+    if (memcmp(&hdr, &EMPTY_STUDENT_RECORD, sizeof(hdr)) == 0)
+    {
+        hdr.magic = SDB_HDR_MAGIC;
+        hdr.version = SDB_FORMAT_VERSION;
+        hdr.record_size = STUDENT_RECORD_SIZE;
+        hdr.capacity = MAX_STD_ID;
+        hdr.generation = st->generation;
+        char *layout = getenv(SDB_LAYOUT_ENV);
+        if (st->file_size <= (off_t)sizeof(hdr) && layout != NULL && strcmp(layout, "hash") == 0)
+            hash_init_header(&hdr);
+        if (pwrite(st->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+            return ERR_DB_FILE;
+        if (st->file_size < (off_t)sizeof(hdr))
+            st->file_size = sizeof(hdr);
+    }
+    else if (hdr.magic != SDB_HDR_MAGIC || hdr.version > SDB_FORMAT_VERSION ||
+             hdr.record_size != (uint32_t)STUDENT_RECORD_SIZE || hdr.layout > SDB_LAYOUT_HASH ||
+             hdr.capacity < MIN_STD_ID || hdr.capacity > SDB_MAX_CAPACITY)
+        return ERR_DB_OP;
+
+    st->capacity = (int)hdr.capacity;
+    st->layout = hdr.layout;
+    st->generation = hdr.generation;
+    return NO_ERROR;
+}
+
+/*
+ *  empty_file
+ *      st:  engine state with fd set, the caller holds the whole file write
+ *           lock
+ *
+ *  Truncates the data file to nothing for load_header() to write a new
+ *  header, whose generation is the old one plus one so processes that have
+ *  the file mapped see it shrank.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int empty_file(db_store_t *st)
+{
+    db_header_t hdr;
+    if (pread(st->fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) && hdr.magic == SDB_HDR_MAGIC)
+        st->generation = hdr.generation + 1;
+    if (ftruncate(st->fd, 0) == -1)
+        return ERR_DB_FILE;
+    st->file_size = 0;
+    return NO_ERROR;
+}
+
+/*
+ *  resize_store
+ *      st:        engine state
+ *      capacity:  new largest id
+ *
+ *  Extends the mapping and the sidecars to cover ids 0..capacity.  The
+ *  sidecars are reattached, which grows their files in place.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int resize_store(db_store_t *st, int capacity)
+{
+    if (st->engine == SDB_ENGINE_MMAP)
+    {
+        size_t len = (size_t)slot_offset(capacity + 1);
+        void *base = mremap(st->base, st->map_len, len, MREMAP_MAYMOVE);
+        if (base == MAP_FAILED)
+            return ERR_DB_FILE;
+        st->base = base;
+        st->map_len = len;
+    }
+    st->capacity = capacity;
+
+    occ_detach(st);
+    gpa_detach(st);
+    sum_detach(st);
+    seq_detach(st);
+    cache_detach(st);
+    if (occ_attach(st, false) != NO_ERROR || gpa_attach(st, false) != NO_ERROR ||
+        sum_attach(st, false) != NO_ERROR || snap_attach(st, false) != NO_ERROR ||
+        seq_attach(st, false) != NO_ERROR || cache_attach(st, false) != NO_ERROR)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+/*
+ *  refresh_capacity
+ *      st:  engine state
+ *
+ *  Picks up a capacity grown by another process since the header was read.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int refresh_capacity(db_store_t *st)
+{
+    db_header_t hdr;
+    if (pread(st->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || hdr.magic != SDB_HDR_MAGIC)
+        return ERR_DB_FILE;
+    if (hdr.capacity <= (uint64_t)st->capacity || hdr.capacity > SDB_MAX_CAPACITY)
+        return NO_ERROR;
+    return resize_store(st, (int)hdr.capacity);
+}
+
+/*
+ *  check_capacity
+ *      st:       engine state, may be NULL
+ *      last_id:  largest id about to be written
+ *
+ *  returns:  NO_ERROR if last_id fits the id space, re-reading the header
+ *            once in case it was grown.  ERR_DB_OP if it does not fit,
+ *            ERR_DB_FILE on I/O error
+ */
+static int check_capacity(db_store_t *st, int last_id)
+{
+    if (st == NULL || last_id <= st->capacity)
+        return NO_ERROR;
+    if (refresh_capacity(st) != NO_ERROR)
+        return ERR_DB_FILE;
+    return (last_id <= st->capacity) ? NO_ERROR : ERR_DB_OP;
+}
+
+/*
+ *  store_attach
+ *      fd:               file descriptor returned by open()
+ *      *path:            path the database was opened with
+ *      should_truncate:  empty the database
+ *
+ *  Sets up the storage engine for fd.  The file is emptied under the whole
+ *  file write lock if asked to, then the header is read, or written if the
+ *  file has none yet.  A hash layout file always uses the pread
+ *  engine, otherwise the mmap engine reserves a shared mapping
+ *  covering every id up to the capacity, the mapping may extend past the
+ *  end of the file, store_read_slot() and store_write_slot() never touch the
+ *  part of it that is beyond file_size.  The occupancy bitmap, gpa column,
+ *  record checksums, snapshot, change sequence, last name index and page
+ *  version sidecars, the page cache and the write-ahead log are attached as
+ *  well, replaying the log if a previous process crashed before its
+ *  checkpoint.
+ *
+ *  returns:  pointer to the engine state, or NULL if no slot is free, the
+ *            file is not a database this version reads, a sidecar could
+ *            not be rebuilt or the log could not be replayed
+ */
+db_store_t *store_attach(int fd, const char *path, bool should_truncate)
+{
+    if (num_stores == SDB_MAX_OPEN_DB || strlen(path) >= SDB_PATH_MAX)
+        return NULL;
+
+    db_store_t *st = &stores[num_stores++];
+    memset(st, 0, sizeof(*st));
+    st->fd = fd;
+    st->engine = SDB_ENGINE_PREAD;
+    st->lidx_fd = -1;
+    st->snap_fd = -1;
+    strcpy(st->path, path);
+
+    struct stat sb;
+    if (fstat(fd, &sb) == 0)
+        st->file_size = sb.st_size;
+    if (should_truncate && lock_slots(fd, 0, SDB_LOCK_TO_END, SDB_LOCK_WRITE) != NO_ERROR)
+    {
+        num_stores--;
+        return NULL;
+    }
+    int rc = should_truncate ? empty_file(st) : NO_ERROR;
+    if (rc == NO_ERROR)
+        rc = load_header(st);
+    if (should_truncate)
+        unlock_slots(fd, 0, SDB_LOCK_TO_END);
+    if (rc != NO_ERROR || (st->layout == SDB_LAYOUT_HASH && hash_attach(st) != NO_ERROR))
+    {
+        num_stores--;
+        return NULL;
+    }
+
+    char *engine = getenv(SDB_ENGINE_ENV);
+    size_t len = (size_t)slot_offset(st->capacity + 1);
+    if (st->layout == SDB_LAYOUT_DIRECT && (engine == NULL || strcmp(engine, "pread") != 0))
+    {
+        void *base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base != MAP_FAILED)
+        {
+            st->engine = SDB_ENGINE_MMAP;
+            st->base = base;
+            st->map_len = len;
+        }
+    }
+
+    if (occ_attach(st, should_truncate) != NO_ERROR ||
+        gpa_attach(st, should_truncate) != NO_ERROR ||
+        sum_attach(st, should_truncate) != NO_ERROR ||
+        snap_attach(st, should_truncate) != NO_ERROR ||
+        seq_attach(st, should_truncate) != NO_ERROR ||
+        lidx_attach(st, should_truncate) != NO_ERROR ||
+        cache_attach(st, should_truncate) != NO_ERROR ||
+        wal_attach(st, should_truncate) != NO_ERROR)
+    {
+        store_detach(fd);
+        return NULL;
+    }
+
+    // A replayed log means a process died mid-write, the derived sidecars
+    // may have missed updates the data file did get.
+    if (st->wal_replayed && (occ_rebuild(st) != NO_ERROR || gpa_rebuild(st) != NO_ERROR ||
+                             sum_rebuild(st) != NO_ERROR || lidx_rebuild(st) != NO_ERROR))
+    {
+        store_detach(fd);
+        return NULL;
+    }
+    if (st->wal_replayed)
+        seq_reset(st);
+    return st;
+}
+
+/*
+ *  store_lookup
+ *      fd:  database file descriptor
+ *
+ *  returns:  the engine state attached to fd, or NULL if fd was not opened
+ *            through open_db()
+ */
+db_store_t *store_lookup(int fd)
+{
+    for (int i = 0; i < num_stores; i++)
+    {
+        if (stores[i].fd == fd)
+            return &stores[i];
+    }
+    return NULL;
+}
+
+/*
+ *  mapped_slot
+ *      st:  engine state
+ *      id:  student id
+ *
+ *  The caller holds a lock on the slot, so no other process can shrink the
+ *  file until it is done with the pointer.
+ *
+ *  returns:  pointer into the mapping for the slot of id, or NULL if the slot
+ *            is not mapped or lies past the end of the file.  The cached file
+ *            size is refreshed before giving up since another process may
+ *            have grown the file, and whenever the header generation says
+ *            another process made it shorter.
+ */
+static char *mapped_slot(db_store_t *st, int id)
+{
+    if (st == NULL || st->engine != SDB_ENGINE_MMAP)
+        return NULL;
+
+    off_t offset = slot_offset(id);
+    if (offset < 0 || offset + STUDENT_RECORD_SIZE > (off_t)st->map_len)
+        return NULL;
+
+    // the header is never truncated away outside the whole file lock
+    db_header_t *hdr = (db_header_t *)st->base;
+    uint64_t gen = __atomic_load_n(&hdr->generation, __ATOMIC_ACQUIRE);
+    if (gen != st->generation || offset + STUDENT_RECORD_SIZE > st->file_size)
+    {
+        struct stat sb;
+        if (fstat(st->fd, &sb) == -1)
+            return NULL;
+        st->file_size = sb.st_size;
+        st->generation = gen;
+        if (offset + STUDENT_RECORD_SIZE > st->file_size)
+            return NULL;
+    }
+    return st->base + offset;
+}
+
+/*
+ *  slot_changes
+ *      *old:  current contents of a slot
+ *      *rec:  contents about to be written to it
+ *
+ *  returns:  true if the write changes the slot
+ */
+static bool slot_changes(const student_t *old, const student_t *rec)
+{
+    return memcmp(old, rec, STUDENT_RECORD_SIZE) != 0;
+}
+
+/*
+ *  slots_changing
+ *      st:        engine state, may be NULL
+ *      first_id:  first of n consecutive slots about to be written
+ *      *old:      receives the current contents of the slots
+ *      *recs:     contents about to be written
+ *      n:         number of slots
+ *
+ *  Runs before a write reaches the data file: captures the old contents the
+ *  sidecars need, copies the slots that change for an open snapshot, takes
+ *  their change sequence numbers and appends their new contents to the
+ *  write-ahead log under those numbers.  The caller holds the slots' write
+ *  lock, so the numbers of a slot follow the order of its writes.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int slots_changing(db_store_t *st, int first_id, student_t *old, const student_t *recs, int n)
+{
+    if (st == NULL)
+        return NO_ERROR;
+
+    if (n == 1)
+    {
+        int rc = store_read_slot(st->fd, first_id, old);
+        if (rc == ERR_DB_FILE)
+            return ERR_DB_FILE;
+        if (rc == SRCH_NOT_FOUND)
+            memset(old, 0, STUDENT_RECORD_SIZE);
+    }
+    else if (store_read_run(st->fd, first_id, old, n) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    // slots written with what they already hold, such as the gaps of a bulk
+    // load run, need neither a snapshot copy nor a log record
+    int i = 0;
+    while (i < n)
+    {
+        if (!slot_changes(&old[i], &recs[i]))
+        {
+            i++;
+            continue;
+        }
+        int j = i + 1;
+        while (j < n && slot_changes(&old[j], &recs[j]))
+            j++;
+
+        if (snap_preserve(st, first_id + i, &old[i], j - i) != NO_ERROR)
+            return ERR_DB_FILE;
+        for (int k = i; k < j; k++)
+        {
+            uint64_t seq = seq_update(st, first_id + k);
+            if (st->wal != NULL && wal_append(st, first_id + k, &recs[k], seq) != NO_ERROR)
+                return ERR_DB_FILE;
+        }
+        i = j;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  slots_changed
+ *      st:        engine state, may be NULL
+ *      first_id:  first of n consecutive slots just written
+ *      *old:      previous contents from slots_changing()
+ *      *recs:     contents now in the data file
+ *      n:         number of slots
+ *
+ *  Brings the occupancy bitmap, gpa column, record checksums and last name
+ *  index up to date for the slots that changed.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int slots_changed(db_store_t *st, int first_id, const student_t *old, const student_t *recs, int n)
+{
+    if (st == NULL)
+        return NO_ERROR;
+
+    for (int i = 0; i < n; i++)
+    {
+        if (!slot_changes(&old[i], &recs[i]))
+            continue;
+        occ_update(st, first_id + i, &recs[i]);
+        gpa_update(st, first_id + i, &recs[i]);
+        sum_update(st, first_id + i, &recs[i]);
+    }
+    return lidx_update(st, first_id, old, recs, n);
+}
+
+/*
+ *  store_cache_lookup
+ *      fd:  database file descriptor
+ *      id:  student id
+ *      *s:  receives the slot contents on a hit
+ *
+ *  Serves the slot from the page cache if the page is cached and no process
+ *  has written to it since, without taking the record lock.
+ *
+ *  returns:  true on a hit, false if the slot has to be read with
+ *            store_read_slot()
+ */
+bool store_cache_lookup(int fd, int id, student_t *s)
+{
+    db_store_t *st = store_lookup(fd);
+    return st != NULL && cache_get(st, id, s);
+}
+
+/*
+ *  store_read_slot
+ *      fd:  database file descriptor
+ *      id:  student id whose slot should be read
+ *      *s:  where the raw slot contents are copied
+ *
+ *  In the hash layout the record of id is looked up in the table, an id
+ *  that is not stored reads as an empty record.  The pread engine reads
+ *  the whole page around the slot into the page cache.
+ *
+ *  returns:  NO_ERROR       slot copied into *s (it may be an empty record)
+ *            SRCH_NOT_FOUND slot lies past the end of the file
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  Does not produce any console I/O
+ */
+int store_read_slot(int fd, int id, student_t *s)
+{
+    off_t offset = slot_offset(id);
+    if (offset < 0)
+        return ERR_DB_FILE;
+
+    db_store_t *st = store_lookup(fd);
+    if (st != NULL && st->layout == SDB_LAYOUT_HASH && id >= MIN_STD_ID)
+        return hash_get(st, id, s);
+
+    char *slot = mapped_slot(st, id);
+    if (slot != NULL)
+    {
+        memcpy(s, slot, STUDENT_RECORD_SIZE);
+        return NO_ERROR;
+    }
+    if (st != NULL && st->cache != NULL)
+        return cache_read(st, id, s);
+
+    ssize_t n = pread(fd, s, STUDENT_RECORD_SIZE, offset);
+    if (n == -1)
+        return ERR_DB_FILE;
+    if (n < STUDENT_RECORD_SIZE)
+        return SRCH_NOT_FOUND;
+    return NO_ERROR;
+}
+
+/*
+ *  store_write_slot
+ *      fd:  database file descriptor
+ *      id:  student id whose slot should be written
+ *      *s:  record to store in the slot
+ *
+ *  The slot is logged to the write-ahead log first and the sidecars are
+ *  updated after it is written.  Slots inside the file
+ *  are written through the mapping.  A slot past the end of the file is
+ *  written with pwrite(), which grows the file without ever shrinking it if
+ *  another process extended it concurrently.  In the hash layout the record
+ *  is stored in the table instead.
+ *
+ *  returns:  NO_ERROR       slot written
+ *            ERR_DB_OP      id is slot 0 or beyond the capacity
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  Does not produce any console I/O
+ */
+int store_write_slot(int fd, int id, const student_t *s)
+{
+    off_t offset = slot_offset(id);
+    if (offset < 0)
+        return ERR_DB_FILE;
+    if (id < MIN_STD_ID)
+        return ERR_DB_OP;
+
+    db_store_t *st = store_lookup(fd);
+    int rc = check_capacity(st, id);
+    if (rc != NO_ERROR)
+        return rc;
+
+    student_t old;
+    if (slots_changing(st, id, &old, s, 1) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    if (st != NULL && st->layout == SDB_LAYOUT_HASH)
+    {
+        if (hash_put(st, id, s) != NO_ERROR)
+            return ERR_DB_FILE;
+        return slots_changed(st, id, &old, s, 1);
+    }
+
+    if (st != NULL)
+        cache_begin_write(st, id, 1);
+    char *slot = mapped_slot(st, id);
+    if (slot != NULL)
+    {
+        memcpy(slot, s, STUDENT_RECORD_SIZE);
+        if (st->dirty_hi == 0 || offset < st->dirty_lo)
+            st->dirty_lo = offset;
+        if (offset + STUDENT_RECORD_SIZE > st->dirty_hi)
+            st->dirty_hi = offset + STUDENT_RECORD_SIZE;
+        cache_end_write(st, id, s, 1);
+        return slots_changed(st, id, &old, s, 1);
+    }
+
+    ssize_t n = pwrite(fd, s, STUDENT_RECORD_SIZE, offset);
+    if (st != NULL)
+        cache_end_write(st, id, (n == STUDENT_RECORD_SIZE) ? s : NULL, 1);
+    if (n < STUDENT_RECORD_SIZE)
+        return ERR_DB_FILE;
+    if (st != NULL && offset + STUDENT_RECORD_SIZE > st->file_size)
+        st->file_size = offset + STUDENT_RECORD_SIZE;
+    return slots_changed(st, id, &old, s, 1);
+}
+
+/*
+ *  store_read_run
+ *      fd:         database file descriptor
+ *      first_id:   id of the first slot to read
+ *      *recs:      buffer for n consecutive slots
+ *      n:          number of slots to read
+ *
+ *  Reads n consecutive slots with a single pread().  Slots past the end of
+ *  the file are returned as empty records.  In the hash layout the ids are
+ *  looked up in the table, slot 0 is the header in both layouts.
+ *
+ *  returns:  NO_ERROR       slots copied into recs
+ *            ERR_DB_FILE    database file I/O issue
+ */
+int store_read_run(int fd, int first_id, student_t *recs, int n)
+{
+    off_t offset = slot_offset(first_id);
+    size_t len = (size_t)n * STUDENT_RECORD_SIZE;
+    if (offset < 0)
+        return ERR_DB_FILE;
+
+    db_store_t *st = store_lookup(fd);
+    if (st != NULL && st->layout == SDB_LAYOUT_HASH && first_id >= MIN_STD_ID)
+        return hash_get_run(st, first_id, recs, n);
+
+    ssize_t got = pread(fd, recs, len, offset);
+    if (got == -1)
+        return ERR_DB_FILE;
+    memset((char *)recs + got, 0, len - got);
+    return NO_ERROR;
+}
+
+/*
+ *  store_read_batch
+ *      fd:    database file descriptor
+ *      *ids:  ids to read, in any order
+ *      n:     number of ids
+ *      *out:  out[i] receives the slot of ids[i]
+ *
+ *  Reads the slots of many ids with as few system calls as possible, see
+ *  sdbbatch.h.  The hash layout looks the ids up one by one.  Ids without a
+ *  record read as empty records.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int store_read_batch(int fd, const int *ids, int n, student_t *out)
+{
+    db_store_t *st = store_lookup(fd);
+    if (st != NULL && st->layout == SDB_LAYOUT_DIRECT)
+        return batch_read(st, ids, n, out);
+
+    for (int i = 0; i < n; i++)
+    {
+        int rc = store_read_slot(fd, ids[i], &out[i]);
+        if (rc == ERR_DB_FILE)
+            return ERR_DB_FILE;
+        if (rc == SRCH_NOT_FOUND || ids[i] < MIN_STD_ID)
+            memset(&out[i], 0, STUDENT_RECORD_SIZE);
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  store_write_run
+ *      fd:         database file descriptor
+ *      first_id:   id of the first slot to write
+ *      *recs:      n consecutive slots, empty records included
+ *      n:          number of slots to write
+ *
+ *  Logs the slots to the write-ahead log, writes them with a single pwrite()
+ *  and updates the sidecars.  The write goes through the page cache shared with the mapping
+ *  so both engines see it at once.  In the hash layout only the ids whose
+ *  record changes are stored, one table update each.
+ *
+ *  returns:  NO_ERROR       slots written
+ *            ERR_DB_OP      the run covers slot 0 or ids beyond the capacity
+ *            ERR_DB_FILE    database file I/O issue
+ */
+int store_write_run(int fd, int first_id, const student_t *recs, int n)
+{
+    off_t offset = slot_offset(first_id);
+    size_t len = (size_t)n * STUDENT_RECORD_SIZE;
+    if (offset < 0)
+        return ERR_DB_FILE;
+    if (first_id < MIN_STD_ID)
+        return ERR_DB_OP;
+
+    db_store_t *st = store_lookup(fd);
+    int rc = check_capacity(st, first_id + n - 1);
+    if (rc != NO_ERROR)
+        return rc;
+
+    student_t *old = NULL;
+    if (st != NULL)
+    {
+        old = malloc(len);
+        if (old == NULL || slots_changing(st, first_id, old, recs, n) != NO_ERROR)
+        {
+            free(old);
+            return ERR_DB_FILE;
+        }
+    }
+
+    if (st != NULL && st->layout == SDB_LAYOUT_HASH)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            if (memcmp(&old[i], &recs[i], STUDENT_RECORD_SIZE) != 0 &&
+                hash_put(st, first_id + i, &recs[i]) != NO_ERROR)
+            {
+                free(old);
+                return ERR_DB_FILE;
+            }
+        }
+    }
+    else
+    {
+        if (st != NULL)
+            cache_begin_write(st, first_id, n);
+        bool written = pwrite(fd, recs, len, offset) == (ssize_t)len;
+        if (st != NULL)
+            cache_end_write(st, first_id, written ? recs : NULL, n);
+        if (!written)
+        {
+            free(old);
+            return ERR_DB_FILE;
+        }
+    }
+
+    if (st != NULL && st->layout == SDB_LAYOUT_DIRECT && offset + (off_t)len > st->file_size)
+        st->file_size = offset + len;
+    rc = slots_changed(st, first_id, old, recs, n);
+    free(old);
+    return rc;
+}
+
+/*
+ *  store_next_extent
+ *      fd:      database file descriptor
+ *      from:    offset to start looking at
+ *      *data:   start of the next region holding data, slot aligned
+ *      *hole:   end of that region (start of the following hole or EOF)
+ *
+ *  Uses lseek(SEEK_DATA/SEEK_HOLE) so scans skip the unallocated parts of a
+ *  sparse database.  Filesystems without hole reporting make the rest of the
+ *  file a single extent.
+ *
+ *  returns:  1              an extent was found
+ *            0              no data at or after from
+ *            ERR_DB_FILE    database file I/O issue
+ */
+int store_next_extent(int fd, off_t from, off_t *data, off_t *hole)
+{
+    struct stat sb;
+    if (fstat(fd, &sb) == -1)
+        return ERR_DB_FILE;
+    if (from >= sb.st_size)
+        return 0;
+
+    off_t d = lseek(fd, from, SEEK_DATA);
+    if (d == -1)
+    {
+        if (errno == ENXIO)
+            return 0;
+        if (errno != EINVAL)
+            return ERR_DB_FILE;
+        *data = from;
+        *hole = sb.st_size;
+        return 1;
+    }
+
+    off_t h = lseek(fd, d, SEEK_HOLE);
+    if (h == -1)
+        h = sb.st_size;
+
+    *data = d - (d % STUDENT_RECORD_SIZE);
+    *hole = h;
+    return 1;
+}
+
+/*
+ *  store_punch
+ *      fd:      database file descriptor
+ *      lo, hi:  byte range [lo, hi) known to hold only empty slots
+ *
+ *  Deallocates the whole filesystem blocks inside the range with
+ *  fallocate(FALLOC_FL_PUNCH_HOLE).  The file size does not change and the
+ *  range still reads back as empty slots, so this is safe at any time.
+ *
+ *  returns:  NO_ERROR       range punched (or nothing to punch)
+ *            ERR_DB_OP      the filesystem cannot punch holes
+ *            ERR_DB_FILE    database file I/O issue
+ */
+int store_punch(int fd, off_t lo, off_t hi)
+{
+    struct stat sb;
+    if (fstat(fd, &sb) == -1)
+        return ERR_DB_FILE;
+
+    off_t blk = sb.st_blksize;
+    lo = ((lo + blk - 1) / blk) * blk;
+    hi = (hi / blk) * blk;
+    if (hi <= lo)
+        return NO_ERROR;
+
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, lo, hi - lo) == -1)
+        return (errno == EOPNOTSUPP || errno == ENOSYS) ? ERR_DB_OP : ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+/*
+ *  store_truncate
+ *      fd:   database file descriptor
+ *      len:  new file size
+ *
+ *  Truncates the file and the cached size together so the mmap engine never
+ *  touches pages past the new end of file, and bumps the header generation
+ *  so other processes refresh theirs.  The caller holds the whole file
+ *  write lock.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int store_truncate(int fd, off_t len)
+{
+    db_store_t *st = store_lookup(fd);
+    db_header_t hdr;
+    if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+        return ERR_DB_FILE;
+    hdr.generation++;
+    if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+        return ERR_DB_FILE;
+    if (st != NULL)
+        st->generation = hdr.generation;
+
+    if (st != NULL && len < st->file_size)
+        st->file_size = len;
+    if (ftruncate(fd, len) == -1)
+        return ERR_DB_FILE;
+    if (st != NULL)
+        st->file_size = len;
+    return NO_ERROR;
+}
+
+/*
+ *  store_capacity
+ *      fd:  database file descriptor
+ *
+ *  returns:  the largest id the database can hold, re-read from the header
+ *            so growth by another process is seen
+ */
+int store_capacity(int fd)
+{
+    db_store_t *st = store_lookup(fd);
+    if (st == NULL)
+        return MAX_STD_ID;
+    refresh_capacity(st);
+    return st->capacity;
+}
+
+/*
+ *  store_layout
+ *      fd:  database file descriptor
+ *
+ *  returns:  SDB_LAYOUT_DIRECT or SDB_LAYOUT_HASH
+ */
+int store_layout(int fd)
+{
+    db_store_t *st = store_lookup(fd);
+    return (st == NULL) ? SDB_LAYOUT_DIRECT : st->layout;
+}
+
+/*
+ *  store_grow
+ *      fd:        database file descriptor
+ *      capacity:  new largest id
+ *
+ *  Grows the id space without rewriting the file, the slots of the new ids
+ *  are simply past the end of the file until they are written.  The whole
+ *  file is locked meanwhile.  The mapping and sidecars are extended before
+ *  the header announces the new capacity, other processes pick it up the
+ *  first time they write an id beyond their old capacity.
+ *
+ *  returns:  NO_ERROR       capacity grown
+ *            ERR_DB_OP      capacity is not larger than the current one or
+ *                           above SDB_MAX_CAPACITY
+ *            ERR_DB_FILE    database file I/O issue
+ */
+int store_grow(int fd, int capacity)
+{
+    db_store_t *st = store_lookup(fd);
+    db_header_t hdr;
+
+    if (st == NULL || lock_slots(fd, 0, SDB_LOCK_TO_END, SDB_LOCK_WRITE) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    int rc = refresh_capacity(st);
+    if (rc == NO_ERROR && (capacity <= st->capacity || capacity > SDB_MAX_CAPACITY))
+        rc = ERR_DB_OP;
+    if (rc == NO_ERROR)
+        rc = resize_store(st, capacity);
+    if (rc == NO_ERROR)
+    {
+        if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+            rc = ERR_DB_FILE;
+        hdr.capacity = capacity;
+        if (rc == NO_ERROR && (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || fdatasync(fd) == -1))
+            rc = ERR_DB_FILE;
+    }
+
+    unlock_slots(fd, 0, SDB_LOCK_TO_END);
+    return rc;
+}
+
+/*
+ *  store_commit
+ *      fd:  database file descriptor
+ *
+ *  Makes every write so far durable.  With the write-ahead log this is a
+ *  checkpoint (log group committed, data file synced, log truncated).
+ *  Without it records written through the mapping are flushed with
+ *  msync(MS_SYNC), only the pages covering the dirty range are synced.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    the sync failed
+ */
+int store_commit(int fd)
+{
+    db_store_t *st = store_lookup(fd);
+    if (st != NULL && st->wal != NULL)
+    {
+        st->dirty_lo = 0;
+        st->dirty_hi = 0;
+        return wal_checkpoint(st);
+    }
+    if (st == NULL || st->engine != SDB_ENGINE_MMAP || st->dirty_hi == 0)
+        return NO_ERROR;
+
+    off_t page = sysconf(_SC_PAGESIZE);
+    off_t lo = st->dirty_lo - (st->dirty_lo % page);
+    if (msync(st->base + lo, st->dirty_hi - lo, MS_SYNC) == -1)
+        return ERR_DB_FILE;
+
+    st->dirty_lo = 0;
+    st->dirty_hi = 0;
+    return NO_ERROR;
+}
+
+/*
+ *  store_detach
+ *      fd:  database file descriptor
+ *
+ *  Commits outstanding writes, unmaps the sidecars and releases the engine
+ *  state for fd.  The file descriptor itself is left open.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    the final commit failed
+ */
+int store_detach(int fd)
+{
+    db_store_t *st = store_lookup(fd);
+    if (st == NULL)
+        return NO_ERROR;
+
+    int rc = store_commit(fd);
+    wal_detach(st);
+    batch_detach(st);
+    cache_detach(st);
+    lidx_detach(st);
+    seq_detach(st);
+    snap_detach(st);
+    sum_detach(st);
+    gpa_detach(st);
+    occ_detach(st);
+    if (st->base != NULL)
+        munmap(st->base, st->map_len);
+
+    *st = stores[--num_stores];
+    return rc;
+}
@@ -0,0 +1,145 @@
+#ifndef __SDB_STORE_H__
+#define __SDB_STORE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "db.h" //get student record type
+
+//Storage engines that can sit behind a database file descriptor.  The mmap
+//engine maps the whole id range once in open_db() so that record reads and
+//in-place writes are plain memory copies against the page cache.  The pread
+//engine is the fallback when the file cannot be mapped.
+#define SDB_ENGINE_PREAD    0
+#define SDB_ENGINE_MMAP     1
+
+//Environment variable used to force an engine, "mmap" (default) or "pread"
+#define SDB_ENGINE_ENV      "SDB_ENGINE"
+
+//On-disk layouts.  The direct layout keeps the record of id in slot id, the
+//hash layout keeps records in a hash table sized by the number of live
+//records (see sdbhash.h) and always uses the pread engine.  The layout is
+//chosen when open_db() creates the file and recorded in its header.
+#define SDB_LAYOUT_DIRECT   0
+#define SDB_LAYOUT_HASH     1
+
+//Environment variable used to choose the layout of new files, "direct"
+//(default) or "hash"
+#define SDB_LAYOUT_ENV      "SDB_LAYOUT"
+
+//Every database file starts with a header in slot 0, which is never a valid
+//student id, so the direct addressed layout is unchanged.  capacity is the
+//largest id the file can hold, new files start at MAX_STD_ID and the id
+//space can be grown later with store_grow() while other processes have the
+//file open.  A file whose slot 0 is empty predates the header and gets one
+//when it is opened.  The hash layout keeps its table position, size and
+//number of live records in the header as well.  generation is bumped under
+//the whole file write lock every time the file is made shorter, a process
+//with the file mapped refreshes its cached file size when it moves.
+#define SDB_HDR_MAGIC       0x31424453u     // "SDB1"
+#define SDB_FORMAT_VERSION  1
+#define SDB_MAX_CAPACITY    (INT32_MAX - 1)
+
+typedef struct db_header {
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    record_size;
+    uint32_t    layout;
+    uint64_t    capacity;
+    uint64_t    table_slot;
+    uint64_t    nbuckets;
+    uint64_t    nlive;
+    uint64_t    generation;
+    uint8_t     pad[8];
+} db_header_t;
+
+//Maximum number of database files that can be open at the same time
+#define SDB_MAX_OPEN_DB     8
+
+//Longest database path, sidecar files are named <path><extension>
+#define SDB_PATH_MAX        4096
+
+//Per file descriptor engine state, created by open_db() and released by
+//close_db().  layout is the on-disk layout from the header.  capacity is the
+//largest id as of the last time the header was read, the mapping and the
+//sidecars cover ids 0..capacity.  generation is the header generation
+//file_size was last checked against.
+//dirty_lo/dirty_hi track the byte range written through the mapping since
+//the last commit so msync() only flushes what changed.  occ
+//is the occupancy bitmap sidecar (see sdbbitmap.h) and wal the write-ahead
+//log (see sdbwal.h), each NULL if unavailable.  wal_replayed counts the log
+//records recovered by open_db().  lidx_fd is the last name index (see
+//sdbindex.h), -1 if unavailable.  gpa_col is the gpa column sidecar (see
+//sdbcolumn.h), NULL if unavailable.  sums are the record checksums (see
+//sdbsum.h), NULL if unavailable.  snap_hdr is the snapshot sidecar (see
+//sdbsnap.h), NULL if unavailable, snap_fd its descriptor or -1.  seqs are
+//the change sequence numbers (see sdbseq.h), NULL if unavailable.  pgv is
+//the page version sidecar and cache the page cache of the pread engine
+//(see sdbcache.h), NULL if unavailable.  ring is the io_uring of batched reads (see sdbbatch.h),
+//batch_io the backend they use, chosen on the first batch.
+typedef struct db_store {
+    int     fd;
+    int     engine;
+    int     layout;
+    int     capacity;
+    char    path[SDB_PATH_MAX];
+    char    *base;
+    size_t  map_len;
+    off_t   file_size;
+    uint64_t generation;
+    off_t   dirty_lo;
+    off_t   dirty_hi;
+    struct occ_header *occ_hdr;
+    uint64_t *occ;
+    int     occ_nwords;
+    size_t  occ_len;
+    struct wal_state *wal;
+    int     wal_replayed;
+    int     lidx_fd;
+    struct gpa_header *gpa_hdr;
+    int16_t *gpa_col;
+    int     gpa_nslots;
+    size_t  gpa_len;
+    struct sum_header *sum_hdr;
+    uint32_t *sums;
+    int     sum_nslots;
+    size_t  sum_len;
+    struct snap_header *snap_hdr;
+    uint64_t *snap_bits;
+    int     snap_nwords;
+    size_t  snap_len;
+    int     snap_fd;
+    struct seq_header *seq_hdr;
+    uint64_t *seqs;
+    int     seq_nslots;
+    size_t  seq_len;
+    struct pgv_header *pgv_hdr;
+    uint64_t *pgv;
+    int     pgv_npages;
+    size_t  pgv_len;
+    struct page_cache *cache;
+    struct batch_ring *ring;
+    int     batch_io;
+} db_store_t;
+
+//prototypes for the storage layer
+db_store_t *store_attach(int fd, const char *path, bool should_truncate);
+db_store_t *store_lookup(int fd);
+bool store_cache_lookup(int fd, int id, student_t *s);
+int store_read_slot(int fd, int id, student_t *s);
+int store_write_slot(int fd, int id, const student_t *s);
+int store_read_run(int fd, int first_id, student_t *recs, int n);
+int store_read_batch(int fd, const int *ids, int n, student_t *out);
+int store_write_run(int fd, int first_id, const student_t *recs, int n);
+int store_next_extent(int fd, off_t from, off_t *data, off_t *hole);
+int store_punch(int fd, off_t lo, off_t hi);
+int store_truncate(int fd, off_t len);
+int store_capacity(int fd);
+int store_layout(int fd);
+int store_grow(int fd, int capacity);
+int store_commit(int fd);
+int store_detach(int fd);
+
+#endif
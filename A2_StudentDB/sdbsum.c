@@ -0,0 +1,377 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdbscan.h"
+#include "sdblock.h"
+#include "sdbcrc.h"
+#include "sdbsum.h"
+
+//Records a verify_db() partition checksums together with crc32c_rows()
+#define SUM_BATCH           64
+
+//Checksum of an empty record, set when the first sidecar is attached
+static uint32_t empty_sum;
+
+/*
+ *  record_sum
+ *      *s:  record
+ *
+ *  returns:  the value the sidecar stores for *s, 0 for an empty record
+ */
+static uint32_t record_sum(const student_t *s)
+{
+    return crc32c(0, s, STUDENT_RECORD_SIZE) ^ empty_sum;
+}
+
+/*
+ *  sum_valid
+ *      st:  engine state with the sidecar mapped
+ *      sb:  stat of the database file
+ *
+ *  returns:  true if the sidecar header matches this database file and,
+ *            in the direct layout, no checksum is recorded for an id past
+ *            the end of the file
+ */
+static bool sum_valid(db_store_t *st, struct stat *sb)
+{
+    sum_header_t *hdr = st->sum_hdr;
+    if (hdr->magic != SDB_SUM_MAGIC || hdr->version != SDB_SUM_VERSION ||
+        hdr->nslots != (uint64_t)st->sum_nslots ||
+        hdr->db_ino != (uint64_t)sb->st_ino || hdr->db_dev != (uint64_t)sb->st_dev)
+        return false;
+    if (st->layout != SDB_LAYOUT_DIRECT)
+        return true;
+
+    long first_beyond = sb->st_size / STUDENT_RECORD_SIZE;
+    for (long id = first_beyond; id < st->sum_nslots; id++)
+    {
+        if (st->sums[id] != 0)
+            return false;
+    }
+    return true;
+}
+
+/*
+ *  sum_attach
+ *      st:               engine state of a freshly opened database
+ *      should_truncate:  the database was just emptied
+ *
+ *  Maps the checksums sized for st->capacity, creating or growing the
+ *  sidecar if needed.  Missing or foreign checksums are recomputed with one
+ *  scan of the database file.  If the sidecar cannot be created the
+ *  database still works, records are just not checked when st->sums is
+ *  NULL.
+ *
+ *  returns:  NO_ERROR       checksums attached (or unavailable)
+ *            ERR_DB_FILE    database file I/O issue during the rebuild
+ */
+int sum_attach(db_store_t *st, bool should_truncate)
+{
+    int nslots = st->capacity + 1;
+    size_t len = sizeof(sum_header_t) + (size_t)nslots * sizeof(uint32_t);
+    char path[SDB_PATH_MAX];
+    struct stat sb, isb;
+
+    empty_sum = crc32c(0, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE);
+    if (fstat(st->fd, &sb) == -1)
+        return ERR_DB_FILE;
+    if (snprintf(path, sizeof(path), "%s%s", st->path, SDB_SUM_EXT) >= (int)sizeof(path))
+        return NO_ERROR;
+
+    int flags = O_RDWR | O_CREAT;
+    if (should_truncate)
+        flags |= O_TRUNC;
+    int fd = open(path, flags, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (fd == -1)
+        return NO_ERROR;
+
+    // a process that grew the database may already have grown the sidecar
+    if (fstat(fd, &isb) == 0 && isb.st_size > (off_t)len &&
+        (isb.st_size - sizeof(sum_header_t)) % sizeof(uint32_t) == 0)
+    {
+        len = isb.st_size;
+        nslots = (len - sizeof(sum_header_t)) / sizeof(uint32_t);
+    }
+    if (ftruncate(fd, len) == -1)
+    {
+        close(fd);
+        return NO_ERROR;
+    }
+    void *base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NO_ERROR;
+
+    st->sum_hdr = base;
+    st->sums = (uint32_t *)((char *)base + sizeof(sum_header_t));
+    st->sum_nslots = nslots;
+    st->sum_len = len;
+
+    // Growing the id space only adds empty ids, whose checksum is the 0
+    // ftruncate() filled the new tail with.
+    if (st->sum_hdr->magic == SDB_SUM_MAGIC && st->sum_hdr->nslots < (uint64_t)nslots)
+        st->sum_hdr->nslots = nslots;
+
+    if (sum_valid(st, &sb))
+        return NO_ERROR;
+
+    st->sum_hdr->magic = SDB_SUM_MAGIC;
+    st->sum_hdr->version = SDB_SUM_VERSION;
+    st->sum_hdr->nslots = nslots;
+    st->sum_hdr->db_ino = sb.st_ino;
+    st->sum_hdr->db_dev = sb.st_dev;
+    return sum_rebuild(st);
+}
+
+/*
+ *  sum_detach
+ *      st:  engine state
+ *
+ *  Unmaps the checksums, the kernel writes back the shared pages.
+ */
+void sum_detach(db_store_t *st)
+{
+    if (st->sum_hdr != NULL)
+        munmap(st->sum_hdr, st->sum_len);
+    st->sum_hdr = NULL;
+    st->sums = NULL;
+}
+
+/*
+ *  sum_update
+ *      st:  engine state
+ *      id:  slot that was just written
+ *      *s:  record now stored in the slot
+ *
+ *  The 32 bit store is atomic so concurrent readers see the old or new
+ *  checksum.
+ */
+void sum_update(db_store_t *st, int id, const student_t *s)
+{
+    if (st == NULL || st->sums == NULL || id < 0 || id >= st->sum_nslots)
+        return;
+    __atomic_store_n(&st->sums[id], record_sum(s), __ATOMIC_RELAXED);
+}
+
+/*
+ *  sum_rebuild
+ *      st:  engine state with the checksums mapped
+ *
+ *  Recomputes the checksums from a block scan of the database file.
+ *
+ *  returns:  NO_ERROR       checksums rebuilt
+ *            ERR_DB_FILE    database file I/O issue
+ */
+int sum_rebuild(db_store_t *st)
+{
+    if (st->sums == NULL)
+        return NO_ERROR;
+
+    memset(st->sums, 0, (size_t)st->sum_nslots * sizeof(uint32_t));
+
+    scan_iter_t it;
+    student_t *rec;
+    if (scan_open(&it, st->fd) != NO_ERROR)
+        return ERR_DB_FILE;
+    while ((rec = scan_next(&it)) != NULL)
+        sum_update(st, rec->id, rec);
+    return scan_close(&it);
+}
+
+/*
+ *  sum_check
+ *      st:  engine state, may be NULL
+ *      id:  id the record was read for
+ *      *s:  slot contents read, an empty record if there was none
+ *
+ *  returns:  false if the checksum recorded for id does not match *s,
+ *            true if it does or there is no checksum to check against
+ */
+bool sum_check(db_store_t *st, int id, const student_t *s)
+{
+    if (st == NULL || st->sums == NULL || id < 0 || id >= st->sum_nslots)
+        return true;
+    return __atomic_load_n(&st->sums[id], __ATOMIC_RELAXED) == record_sum(s);
+}
+
+//Ids verify_db() found corrupt in one partition, in file order.  ids keeps
+//the first SUM_REPORT_MAX of them.
+typedef struct verify_part {
+    int     checked;
+    int     bad;
+    int     nids;
+    int     ids[SUM_REPORT_MAX];
+} verify_part_t;
+
+//State of a verify_db() scan.  seen has one bit per id whose record the
+//scan checked, the ids with a checksum but no record are the rest.
+typedef struct verify_scan {
+    db_store_t  *st;
+    uint64_t    *seen;
+    int         checked;
+    int         bad;
+    int         reported;
+} verify_scan_t;
+
+/*
+ *  verify_batch
+ *      *vs:    verify_db() state
+ *      *part:  partition results
+ *      *recs:  records copied out of the scan
+ *      *ids:   id each record was stored under
+ *      n:      number of records
+ */
+static void verify_batch(verify_scan_t *vs, verify_part_t *part, const student_t *recs,
+                         const int *ids, int n)
+{
+    uint32_t crcs[SUM_BATCH];
+    crc32c_rows(recs, STUDENT_RECORD_SIZE, n, crcs);
+
+    for (int i = 0; i < n; i++)
+    {
+        int id = ids[i];
+        bool ok = (id >= 0 && id < vs->st->sum_nslots &&
+                   vs->st->sums[id] == (crcs[i] ^ empty_sum));
+        if (id >= 0 && id < vs->st->sum_nslots)
+            __atomic_fetch_or(&vs->seen[id / 64], 1ULL << (id % 64), __ATOMIC_RELAXED);
+        part->checked++;
+        if (ok)
+            continue;
+        part->bad++;
+        if (part->nids < SUM_REPORT_MAX)
+            part->ids[part->nids++] = id;
+    }
+}
+
+/*
+ *  verify_scan_part
+ *      *it:   iterator over one partition
+ *      *ctx:  verify_part_t receiving the results
+ *      *arg:  verify_scan_t
+ *
+ *  Records are copied out SUM_BATCH at a time and checksummed together.
+ *  In the direct layout a record is checked against the slot it sits in,
+ *  so a damaged id field is caught as well.
+ *
+ *  returns:  NO_ERROR
+ */
+static int verify_scan_part(scan_iter_t *it, void *ctx, void *arg)
+{
+    verify_part_t *part = ctx;
+    verify_scan_t *vs = arg;
+    student_t recs[SUM_BATCH];
+    int ids[SUM_BATCH];
+    int n = 0;
+    student_t *rec;
+
+    while ((rec = scan_next(it)) != NULL)
+    {
+        recs[n] = *rec;
+        ids[n] = (vs->st->layout == SDB_LAYOUT_DIRECT) ? it->first_id + (int)(rec - it->block)
+                                                       : rec->id;
+        if (++n == SUM_BATCH)
+        {
+            verify_batch(vs, part, recs, ids, n);
+            n = 0;
+        }
+    }
+    verify_batch(vs, part, recs, ids, n);
+    return NO_ERROR;
+}
+
+/*
+ *  verify_scan_merge
+ *      *ctx:  verify_part_t filled by verify_scan_part()
+ *      *arg:  verify_scan_t
+ *      rc:    status of the scan so far
+ *
+ *  returns:  rc
+ *
+ *  console:  M_SUM_BAD for each corrupt record, up to SUM_REPORT_MAX
+ */
+static int verify_scan_merge(void *ctx, void *arg, int rc)
+{
+    verify_part_t *part = ctx;
+    verify_scan_t *vs = arg;
+
+    if (rc != NO_ERROR)
+        return rc;
+    for (int i = 0; i < part->nids && vs->reported < SUM_REPORT_MAX; i++, vs->reported++)
+        printf(M_SUM_BAD, part->ids[i]);
+    vs->checked += part->checked;
+    vs->bad += part->bad;
+    return NO_ERROR;
+}
+
+/*
+ *  verify_db
+ *      fd:  database file descriptor
+ *
+ *  Checks every record against its checksum in one parallel scan, with
+ *  writers held off so none is caught between its record and its checksum.
+ *  Ids that have a checksum but whose slot is empty are reported as well,
+ *  those records were lost.
+ *
+ *  returns:  <number>       number of records checked, all of them intact
+ *            ERR_DB_OP      some records are corrupt or missing, or there
+ *                           are no checksums to check against
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  M_SUM_BAD and M_SUM_MISSING for each damaged record, up to
+ *            SUM_REPORT_MAX, then M_SUM_VERIFIED or M_SUM_CORRUPT.
+ *            M_ERR_NO_SUMS or M_ERR_DB_READ on error
+ */
+int verify_db(int fd)
+{
+    db_store_t *st = store_lookup(fd);
+    if (st == NULL || st->sums == NULL)
+    {
+        printf(M_ERR_NO_SUMS);
+        return ERR_DB_OP;
+    }
+
+    verify_scan_t vs = {st, NULL, 0, 0, 0};
+    vs.seen = calloc(LIVE_MASK_WORDS(st->sum_nslots), sizeof(uint64_t));
+    if (vs.seen == NULL || lock_slots(fd, 0, SDB_LOCK_TO_END, SDB_LOCK_READ) != NO_ERROR)
+    {
+        free(vs.seen);
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    scan_job_t job = {verify_scan_part, verify_scan_merge, sizeof(verify_part_t), &vs, NULL, 0};
+    int rc = scan_parallel(fd, &job);
+    for (int id = 0; rc == NO_ERROR && id < st->sum_nslots; id++)
+    {
+        if (st->sums[id] == 0 || (vs.seen[id / 64] & (1ULL << (id % 64))) != 0)
+            continue;
+        if (vs.reported++ < SUM_REPORT_MAX)
+            printf(M_SUM_MISSING, id);
+        vs.bad++;
+    }
+    unlock_slots(fd, 0, SDB_LOCK_TO_END);
+    free(vs.seen);
+
+    if (rc != NO_ERROR)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    if (vs.bad > 0)
+    {
+        printf(M_SUM_CORRUPT, vs.checked, vs.bad);
+        return ERR_DB_OP;
+    }
+    printf(M_SUM_VERIFIED, vs.checked);
+    return vs.checked;
+}
@@ -0,0 +1,41 @@
+#ifndef __SDB_SUM_H__
+#define __SDB_SUM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdbstore.h"
+
+//Record checksums are a sidecar file next to the database holding a
+//CRC-32C of every id's record as a packed uint32, 400KB for MAX_STD_ID ids.
+//The stored value is the checksum of the record XORed with the checksum of
+//an empty record, so an empty slot and the zero filled tail of a grown file
+//both hold 0.  It is kept current from store_write_slot() and
+//store_write_run() like the gpa column, get_student() and get_students()
+//check the records they return against it and verify_db() checks the whole
+//file in one parallel scan.
+#define SDB_SUM_EXT         ".sum"
+#define SDB_SUM_MAGIC       0x314d5553u     // "SUM1"
+#define SDB_SUM_VERSION     1
+
+//Sidecar file header, the checksums follow it.  See occ_header_t for the
+//reason the database inode and device are recorded.
+typedef struct sum_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t nslots;
+    uint64_t db_ino;
+    uint64_t db_dev;
+} sum_header_t;
+
+//Corrupt ids verify_db() lists before it only counts them
+#define SUM_REPORT_MAX      100
+
+//prototypes for the record checksums
+int sum_attach(db_store_t *st, bool should_truncate);
+void sum_detach(db_store_t *st);
+void sum_update(db_store_t *st, int id, const student_t *s);
+int sum_rebuild(db_store_t *st);
+bool sum_check(db_store_t *st, int id, const student_t *s);
+
+#endif
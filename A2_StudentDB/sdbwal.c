@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstore.h"
+#include "sdbwal.h"
+#include "sdbcrc.h"
+#include "sdblock.h"
+
+//CRC-32C of a record, used to find the torn tail of a crashed log
+static uint32_t record_crc(const wal_record_t *r)
+{
+    return crc32c(0, &r->seq, sizeof(*r) - offsetof(wal_record_t, seq));
+}
+
+//Replay order of a record, seq is the change sequence number it was
+//written under, idx its position in the log
+typedef struct wal_order {
+    uint64_t    seq;
+    int         idx;
+} wal_order_t;
+
+static int cmp_order(const void *a, const void *b)
+{
+    const wal_order_t *x = a;
+    const wal_order_t *y = b;
+    if (x->seq != y->seq)
+        return (x->seq > y->seq) - (x->seq < y->seq);
+    return (x->idx > y->idx) - (x->idx < y->idx);
+}
+
+static int env_int(const char *name, int def)
+{
+    char *v = getenv(name);
+    if (v == NULL || atoi(v) <= 0)
+        return def;
+    return atoi(v);
+}
+
+/*
+ *  wal_replay
+ *      st:  engine state, st->wal is not set yet so replayed writes are not
+ *           logged again
+ *      fd:  log file descriptor, its owner lock held for writing by the
+ *           caller so no live process writes the database
+ *
+ *  Re-applies every intact record of the log to the data file in change
+ *  sequence order, counting them in st->wal_replayed, and syncs the data
+ *  file.  A record without a number was committed under its slot lock and
+ *  keeps its place after the numbered record before it.  The log ends at
+ *  the first record with a bad magic or checksum, which is where a crashed
+ *  append was torn.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int wal_replay(db_store_t *st, int fd)
+{
+    struct stat sb;
+    if (fstat(fd, &sb) == -1)
+        return ERR_DB_FILE;
+    if (sb.st_size < (off_t)sizeof(wal_record_t))
+        return NO_ERROR;
+
+    wal_record_t *log = malloc(sb.st_size);
+    if (log == NULL)
+        return ERR_DB_FILE;
+    if (pread(fd, log, sb.st_size, 0) != sb.st_size)
+    {
+        free(log);
+        return ERR_DB_FILE;
+    }
+
+    int n = sb.st_size / sizeof(wal_record_t);
+    wal_order_t *order = malloc(n * sizeof(wal_order_t));
+    if (order == NULL)
+    {
+        free(log);
+        return ERR_DB_FILE;
+    }
+    int nintact = 0;
+    uint64_t seq = 0;
+    for (; nintact < n; nintact++)
+    {
+        wal_record_t *r = &log[nintact];
+        if (r->magic != SDB_WAL_MAGIC || r->crc != record_crc(r))
+            break;
+        if (r->seq != 0)
+            seq = r->seq;
+        order[nintact].seq = seq;
+        order[nintact].idx = nintact;
+    }
+    qsort(order, nintact, sizeof(wal_order_t), cmp_order);
+
+    int rc = NO_ERROR;
+    for (int i = 0; rc == NO_ERROR && i < nintact; i++)
+    {
+        wal_record_t *r = &log[order[i].idx];
+        if (store_write_slot(st->fd, r->id, &r->rec) != NO_ERROR)
+            rc = ERR_DB_FILE;
+        st->wal_replayed++;
+    }
+    free(order);
+    free(log);
+    if (rc != NO_ERROR)
+        return rc;
+
+    if (fdatasync(st->fd) == -1)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+/*
+ *  wal_attach
+ *      st:               engine state of a freshly opened database
+ *      should_truncate:  the database was just emptied, drop the log too
+ *
+ *  Opens <db>.wal and takes its owner lock.  If no other process holds the
+ *  log, anything left in it was written by processes that died and is
+ *  replayed and truncated.  Then sets up group commit with the batch size
+ *  and interval from the environment.  If the log is disabled or cannot be
+ *  opened st->wal stays NULL and writes go straight to the data file as
+ *  before.
+ *
+ *  returns:  NO_ERROR       log attached (or disabled)
+ *            ERR_DB_FILE    replay failed
+ */
+int wal_attach(db_store_t *st, bool should_truncate)
+{
+    char path[SDB_PATH_MAX];
+    char *mode = getenv(SDB_WAL_ENV);
+    if (mode != NULL && strcmp(mode, "off") == 0)
+        return NO_ERROR;
+    if (snprintf(path, sizeof(path), "%s%s", st->path, SDB_WAL_EXT) >= (int)sizeof(path))
+        return NO_ERROR;
+
+    int flags = O_RDWR | O_CREAT | O_APPEND;
+    if (should_truncate)
+        flags |= O_TRUNC;
+    int fd = open(path, flags, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (fd == -1)
+        return NO_ERROR;
+
+    struct stat sb;
+    int rc = NO_ERROR;
+    if (try_lock_slots(fd, WAL_LOCK_OWNER, 1, SDB_LOCK_WRITE) == NO_ERROR &&
+        fstat(fd, &sb) == 0 && sb.st_size > 0)
+    {
+        rc = wal_replay(st, fd);
+        if (rc == NO_ERROR && ftruncate(fd, 0) == -1)
+            rc = ERR_DB_FILE;
+    }
+    // converting a write lock to a read lock is atomic, no other process
+    // can take the log for writing in between
+    if (rc == NO_ERROR && lock_slots(fd, WAL_LOCK_OWNER, 1, SDB_LOCK_READ) != NO_ERROR)
+    {
+        close(fd);
+        return NO_ERROR;
+    }
+
+    wal_state_t *wal = calloc(1, sizeof(wal_state_t));
+    if (rc != NO_ERROR || wal == NULL)
+    {
+        free(wal);
+        close(fd);
+        return rc;
+    }
+
+    wal->fd = fd;
+    wal->batch = env_int(SDB_WAL_BATCH_ENV, SDB_WAL_DEF_BATCH);
+    wal->interval_ms = env_int(SDB_WAL_INTERVAL_ENV, SDB_WAL_DEF_INTERVAL_MS);
+    wal->buf = malloc(wal->batch * sizeof(wal_record_t));
+    if (wal->buf == NULL)
+    {
+        free(wal);
+        close(fd);
+        return NO_ERROR;
+    }
+    st->wal = wal;
+    return NO_ERROR;
+}
+
+/*
+ *  wal_append
+ *      st:   engine state
+ *      id:   slot about to be written, write locked by the caller
+ *      *s:   record about to be stored in the slot
+ *      seq:  change sequence number of the write, 0 if it has none
+ *
+ *  Adds a redo record to the current group and commits the group once it is
+ *  full or its oldest record has waited longer than the sync interval.  A
+ *  record without a number is committed at once, its place in the log is
+ *  the only order replay has for it.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int wal_append(db_store_t *st, int id, const student_t *s, uint64_t seq)
+{
+    wal_state_t *wal = st->wal;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (wal->nbuf == 0)
+        wal->oldest = now;
+
+    wal->logged = true;
+    wal_record_t *r = &wal->buf[wal->nbuf++];
+    r->magic = SDB_WAL_MAGIC;
+    r->seq = seq;
+    r->id = id;
+    r->reserved = 0;
+    r->rec = *s;
+
+    long waited_ms = (now.tv_sec - wal->oldest.tv_sec) * 1000 +
+                     (now.tv_nsec - wal->oldest.tv_nsec) / 1000000;
+    if (seq == 0 || wal->nbuf == wal->batch || waited_ms >= wal->interval_ms)
+        return wal_commit(st);
+    return NO_ERROR;
+}
+
+/*
+ *  wal_commit
+ *      st:  engine state
+ *
+ *  Writes the buffered group with a single append and makes it durable
+ *  with one fdatasync().
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int wal_commit(db_store_t *st)
+{
+    wal_state_t *wal = st->wal;
+    if (wal == NULL || wal->nbuf == 0)
+        return NO_ERROR;
+
+    size_t len = wal->nbuf * sizeof(wal_record_t);
+    if (lock_slots(wal->fd, WAL_LOCK_APPEND, 1, SDB_LOCK_WRITE) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    for (int i = 0; i < wal->nbuf; i++)
+        wal->buf[i].crc = record_crc(&wal->buf[i]);
+
+    int rc = NO_ERROR;
+    if (write(wal->fd, wal->buf, len) != (ssize_t)len || fdatasync(wal->fd) == -1)
+        rc = ERR_DB_FILE;
+    unlock_slots(wal->fd, WAL_LOCK_APPEND, 1);
+
+    wal->nbuf = 0;
+    return rc;
+}
+
+/*
+ *  wal_checkpoint
+ *      st:  engine state
+ *
+ *  Commits the open group and syncs the data file (including pages dirtied
+ *  through the mapping).  The log is truncated only if no other process
+ *  has the database open, records of a live writer may not be in the data
+ *  file yet.  Does nothing if nothing was logged since the last checkpoint
+ *  and the log is empty.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int wal_checkpoint(db_store_t *st)
+{
+    wal_state_t *wal = st->wal;
+    struct stat sb;
+    if (wal == NULL || (!wal->logged && (fstat(wal->fd, &sb) == -1 || sb.st_size == 0)))
+        return NO_ERROR;
+    if (wal_commit(st) != NO_ERROR || fdatasync(st->fd) == -1)
+        return ERR_DB_FILE;
+
+    // a failed conversion keeps the read lock
+    int rc = try_lock_slots(wal->fd, WAL_LOCK_OWNER, 1, SDB_LOCK_WRITE);
+    if (rc == ERR_DB_OP)
+        return NO_ERROR;
+    if (rc == NO_ERROR && ftruncate(wal->fd, 0) == -1)
+        rc = ERR_DB_FILE;
+    if (lock_slots(wal->fd, WAL_LOCK_OWNER, 1, SDB_LOCK_READ) != NO_ERROR)
+        rc = ERR_DB_FILE;
+    wal->logged = false;
+    return rc;
+}
+
+/*
+ *  wal_detach
+ *      st:  engine state
+ *
+ *  Releases the log and its owner lock, the caller checkpoints first.
+ */
+void wal_detach(db_store_t *st)
+{
+    wal_state_t *wal = st->wal;
+    if (wal == NULL)
+        return;
+    close(wal->fd);
+    free(wal->buf);
+    free(wal);
+    st->wal = NULL;
+}
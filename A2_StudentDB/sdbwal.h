@@ -0,0 +1,68 @@
+#ifndef __SDB_WAL_H__
+#define __SDB_WAL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "sdbstore.h"
+
+//Write-ahead log.  Every slot written by store_write_slot() and
+//store_write_run() is first appended to <db>.wal as a redo record.  Records
+//are buffered and written with one write() and one fdatasync() per group
+//(group commit), a group is committed when it reaches the batch size, when
+//the oldest record in it is older than the sync interval, or on close.
+//close_db() checkpoints: the data file is synced and the log truncated
+//once no other process has the database open.  open_db() replays whatever
+//crashed processes left in the log.
+//
+//Every process holds a read lock on WAL_LOCK_OWNER of the log for as long
+//as it has the database open, so a log whose owner lock can be taken for
+//writing has no live writer and only then is it replayed or truncated.
+//Groups are appended under a write lock on WAL_LOCK_APPEND.  A record
+//carries the change sequence number its write took under the slot lock
+//(see sdbseq.h), and replay applies records in that order: processes may
+//commit their groups in another order than they wrote the slots.  A write
+//without a number is committed before its slot lock is released.
+#define SDB_WAL_EXT             ".wal"
+#define SDB_WAL_MAGIC           0x314c4157u     // "WAL1"
+#define WAL_LOCK_OWNER          0               // lock ranges, in records
+#define WAL_LOCK_APPEND         1
+
+//Options, read from the environment when the database is opened
+#define SDB_WAL_ENV             "SDB_WAL"               // "off" disables the log
+#define SDB_WAL_BATCH_ENV       "SDB_WAL_BATCH"         // records per fdatasync
+#define SDB_WAL_INTERVAL_ENV    "SDB_WAL_INTERVAL_MS"   // max age of an unsynced record
+#define SDB_WAL_DEF_BATCH       256
+#define SDB_WAL_DEF_INTERVAL_MS 10
+
+//One redo record, crc covers every field after it
+typedef struct wal_record {
+    uint32_t    magic;
+    uint32_t    crc;
+    uint64_t    seq;
+    int32_t     id;
+    int32_t     reserved;
+    student_t   rec;
+} wal_record_t;
+
+//Log state hung off the engine state of an open database, logged is set
+//once anything was appended since the last checkpoint
+typedef struct wal_state {
+    int             fd;
+    int             batch;
+    int             interval_ms;
+    bool            logged;
+    int             nbuf;
+    struct timespec oldest;
+    wal_record_t    *buf;
+} wal_state_t;
+
+//prototypes for the write-ahead log
+int wal_attach(db_store_t *st, bool should_truncate);
+int wal_append(db_store_t *st, int id, const student_t *s, uint64_t seq);
+int wal_commit(db_store_t *st);
+int wal_checkpoint(db_store_t *st);
+void wal_detach(db_store_t *st);
+
+#endif
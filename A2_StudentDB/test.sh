@@ -8,6 +8,68 @@ setup_file() {
     fi
 }
 
+# Sends one request to a running sdbsc -S on student.db.sock and prints the
+# status, followed by the record for get and the value for count:
+#   sdb_client get|del|count [id]
+#   sdb_client add id first_name last_name gpa
+sdb_client() {
+    python3 - "$@" <<'PY'
+import socket, struct, sys
+op, args = sys.argv[1], sys.argv[2:]
+rec = "=i24s32si"
+sid = int(args[0]) if args else 0
+body = struct.pack(rec, 0, b"", b"", 0)
+if op == "add":
+    body = struct.pack(rec, sid, args[1].encode(), args[2].encode(), int(args[3]))
+s = socket.socket(socket.AF_UNIX)
+s.connect("student.db.sock")
+s.sendall(struct.pack("=Ii", {"get": 1, "add": 2, "del": 3, "count": 4}[op], sid) + body)
+resp = b""
+while len(resp) < 72:
+    chunk = s.recv(72 - len(resp))
+    if not chunk:
+        sys.exit(1)
+    resp += chunk
+status, value = struct.unpack("=ii", resp[:8])
+rid, fname, lname, gpa = struct.unpack(rec, resp[8:])
+if op == "get" and status == 0:
+    print(status, rid, fname.rstrip(b"\0").decode(), lname.rstrip(b"\0").decode(), gpa)
+elif op == "count":
+    print(status, value)
+else:
+    print(status)
+PY
+}
+
+# Starts sdbsc -S in the background with the environment given as
+# arguments and waits for its socket, stop_server stops it
+start_server() {
+    rm -f student.db.sock
+    env "$@" ./sdbsc -S >/dev/null 2>&1 3>&- &
+    server=$!
+    for _ in $(seq 100); do
+        [ -S student.db.sock ] && return 0
+        sleep 0.05
+    done
+    return 1
+}
+
+stop_server() {
+    kill "$server"
+    wait "$server"
+    server=
+}
+
+# A test that failed with the server running leaves no server behind
+teardown() {
+    if [ -n "${server:-}" ]; then
+        kill "$server" 2>/dev/null || true
+    fi
+    if [ -n "${holder:-}" ]; then
+        kill "$holder" 2>/dev/null || true
+    fi
+}
+
 @test "Check if database is empty to start" {
     run ./sdbsc -p
     [ "$status" -eq 0 ]
@@ -134,6 +196,28 @@ setup_file() {
     }
 }
 
+@test "Id 0 is never found, its slot holds the file header" {
+    run ./sdbsc -f 0
+    [ "$status" -eq 1 ]  || {
+        echo "Expecting status of 1, got:  $status"
+        return 1
+    }
+    [ "${lines[0]}" = "Student 0 was not found in database." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -d 0
+    [ "$status" -eq 1 ]  || {
+        echo "Expecting status of 1, got:  $status"
+        return 1
+    }
+    [ "${lines[0]}" = "Student 0 was not found in database." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
 @test "Check student count again, should be 4 now" {
     run ./sdbsc -c
     [ "$status" -eq 0 ]
@@ -193,3 +277,651 @@ setup_file() {
         return 1
     }
 }
+
+@test "Bulk load students from CSV and TSV rows on stdin" {
+    run bash -c 'printf "id,fname,lname,gpa\n10,amy,lee,380\n11\tbob\tray\t299\n3,dup,row,300\n" | ./sdbsc -b -'
+    [ "$status" -eq 1 ]  || {
+        echo "Expecting status of 1, got:  $status"
+        return 1
+    }
+    [ "${lines[0]}" = "Cant add student with ID=3, already exists in db." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+    [ "${lines[1]}" = "Bulk load added 2 student(s), rejected 1 row(s)." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Check student count after bulk load" {
+    run ./sdbsc -c
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Database contains 5 student record(s)." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Compress db in place by punching holes" {
+    run ./sdbsc -x punch
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Database successfully compressed!" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -c
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Database contains 5 student record(s)." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Find by last name prefix" {
+    run ./sdbsc -l do
+
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "ID     FIRST_NAME               LAST_NAME                        GPA" ]
+    [ "${lines[1]}" = "1      john                     doe                              3.45" ]
+    [ "${lines[2]}" = "3      jane                     doe                              3.90" ]
+    [ "${lines[3]}" = "63     jim                      doe                              2.85" ]
+    [ "${#lines[@]}" -eq 4 ]
+}
+
+@test "Find by GPA range with aggregates" {
+    run ./sdbsc -g 300 400
+
+    [ "$status" -eq 0 ]
+    [ "${lines[1]}" = "1      john                     doe                              3.45" ]
+    [ "${lines[2]}" = "3      jane                     doe                              3.90" ]
+    [ "${lines[3]}" = "10     amy                      lee                              3.80" ]
+    [ "${lines[4]}" = "3 student(s) with GPA between 3.00 and 4.00, average 3.72." ]
+    [ "${lines[6]}" = "3.25-3.49      1 ####################" ]
+    [ "${lines[8]}" = "3.75-3.99      2 ########################################" ]
+}
+
+@test "Find several students in one batch" {
+    run ./sdbsc -f 63 3 64
+
+    [ "$status" -eq 1 ]
+    [ "${lines[1]}" = "63     jim                      doe                              2.85" ]
+    [ "${lines[2]}" = "3      jane                     doe                              3.90" ]
+    [ "${lines[3]}" = "Student 64 was not found in database." ]
+}
+
+@test "Export and re-import a binary dump" {
+    run ./sdbsc -e csv
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "id,first_name,last_name,gpa" ]
+    [ "${lines[1]}" = "1,john,doe,345" ]
+
+    run ./sdbsc -e bin student.db.dump
+    [ "$status" -eq 0 ]
+    count=$(./sdbsc -c | tr -dc '0-9')
+    [ "$output" = "Exported $count student(s) to student.db.dump." ]
+
+    # every id is already in the database
+    run ./sdbsc -i bin student.db.dump
+    rm -f student.db.dump
+    [ "$status" -eq 1 ]
+    [ "${lines[-1]}" = "Import added 0 student(s), rejected $count record(s)." ]
+}
+
+@test "Grow the id space and add a student beyond the old limit" {
+    run ./sdbsc -a 150000 far away 300
+    [ "$status" -eq 2 ]
+
+    run ./sdbsc -G 200000
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Database capacity grown from 100000 to 200000 ids." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -a 150000 far away 300
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Student 150000 added to database." ]
+
+    run ./sdbsc -c
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Database contains 6 student record(s)." ]
+}
+
+@test "Hash layout stores sparse ids compactly" {
+    run env SDB_LAYOUT=hash ./sdbsc -z
+    [ "$status" -eq 0 ]
+
+    run ./sdbsc -a 99999 sparse id 250
+    [ "$status" -eq 0 ]
+    run ./sdbsc -a 7 small id 350
+    [ "$status" -eq 0 ]
+    run ./sdbsc -d 7
+    [ "$status" -eq 0 ]
+
+    run ./sdbsc -f 99999
+    [ "$status" -eq 0 ]
+    [ "${lines[1]}" = "99999  sparse                   id                               2.50" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -c
+    [ "${lines[0]}" = "Database contains 1 student record(s)." ]
+    [ "$(stat -c %s student.db)" -lt 100000 ]
+
+    run env SDB_LAYOUT=direct ./sdbsc -z
+    [ "$status" -eq 0 ]
+}
+
+@test "Print lists every student of a hash layout file" {
+    run env SDB_LAYOUT=hash ./sdbsc -z
+    [ "$status" -eq 0 ]
+
+    run bash -c 'seq 1 136 | sed "s/.*/&,first,last,300/" | ./sdbsc -b -'
+    [ "$status" -eq 0 ]
+    run ./sdbsc -a 150000 far away 250
+    [ "$status" -eq 0 ]
+
+    run ./sdbsc -p
+    [ "$status" -eq 0 ]
+    [ "${#lines[@]}" -eq 138 ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+    [ "${lines[137]}" = "150000 far                      away                             2.50" ]
+
+    run env SDB_LAYOUT=direct ./sdbsc -z
+    [ "$status" -eq 0 ]
+}
+
+@test "Verify catches a corrupted record" {
+    run ./sdbsc -a 42 check sum 321
+    [ "$status" -eq 0 ]
+    run ./sdbsc -v
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Verified 1 student record(s), all checksums match." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    # flip the gpa of student 42 behind the database's back
+    printf '\x07' | dd of=student.db bs=1 seek=$((42 * 64 + 60)) conv=notrunc 2>/dev/null
+
+    run ./sdbsc -f 42
+    [ "$status" -eq 1 ]
+    [ "${lines[0]}" = "Student 42 record does not match its checksum, the database is corrupt." ]
+
+    run ./sdbsc -v
+    [ "$status" -eq 1 ]
+    [ "${lines[1]}" = "Verified 1 student record(s), 1 corrupt or missing." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -z
+    [ "$status" -eq 0 ]
+}
+
+@test "Print reads a snapshot and a dead reader's snapshot is closed" {
+    run ./sdbsc -a 5 snap shot 250
+    [ "$status" -eq 0 ]
+    run ./sdbsc -a 6 copy write 275
+    [ "$status" -eq 0 ]
+
+    cow=$(./sdbsc -p)
+    locked=$(SDB_SNAP=lock ./sdbsc -p)
+    [ "$cow" = "$locked" ]
+    [ "$(echo "$cow" | wc -l)" -eq 3 ]
+
+    # mark a snapshot over every slot open, as a reader that died would leave it
+    printf '\x01\x00\x00\x00\x00\x00\x00\x00\xff\xff\x00\x00' | dd of=student.db.snap bs=1 seek=32 conv=notrunc 2>/dev/null
+
+    run ./sdbsc -d 5
+    [ "$status" -eq 0 ]
+    # no record was copied for the dead snapshot
+    [ "$(stat -c %s student.db.snap)" -lt 1073741824 ]
+
+    run ./sdbsc -z
+    [ "$status" -eq 0 ]
+}
+
+@test "Pack names into a dictionary and unpack them again" {
+    run ./sdbsc -a 1 john doe 345
+    [ "$status" -eq 0 ]
+    run ./sdbsc -a 3 jane doe 390
+    [ "$status" -eq 0 ]
+    run ./sdbsc -a 99999 big dude 205
+    [ "$status" -eq 0 ]
+    before=$(./sdbsc -p)
+
+    run ./sdbsc -k
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Packed 3 student(s) with 5 distinct name(s) into student.db.pack, 130 bytes (192 as student records)." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -z
+    [ "$status" -eq 0 ]
+
+    # the packed file is read in place, the database is empty
+    [ "$(./sdbsc -p --pack=student.db.pack)" = "$before" ]
+    run ./sdbsc -f 3 4 99999 --pack=student.db.pack
+    [ "$status" -eq 1 ]
+    [ "${lines[1]}" = "3      jane                     doe                              3.90" ]
+    [ "${lines[2]}" = "Student 4 was not found in database." ]
+    [ "${lines[3]}" = "99999  big                      dude                             2.05" ]
+
+    run ./sdbsc -u student.db.pack
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Unpack added 3 student(s), rejected 0 record(s)." ]
+    [ "$(./sdbsc -p)" = "$before" ]
+
+    # a damaged packed file is rejected as a whole
+    printf 'x' | dd of=student.db.pack bs=1 seek=40 conv=notrunc 2>/dev/null
+    run ./sdbsc -u student.db.pack
+    rm -f student.db.pack
+    [ "$status" -eq 1 ]
+    [ "${lines[0]}" = "student.db.pack is not a complete packed student db (bad header, length, checksum or names)." ]
+
+    run ./sdbsc -z
+    [ "$status" -eq 0 ]
+}
+
+@test "Print sorted by name and gpa, in memory and through spilled runs" {
+    printf '10,zoe,brown,300\n11,amy,adams,450\n12,bob,adams,300\n13,cal,young,120\n' | ./sdbsc -b -
+    run ./sdbsc -p --sort=lname
+    [ "$status" -eq 0 ]
+    [ "${lines[1]}" = "11     amy                      adams                            4.50" ]
+    [ "${lines[2]}" = "12     bob                      adams                            3.00" ]
+    [ "${lines[4]}" = "13     cal                      young                            1.20" ]
+
+    run ./sdbsc -p --sort=gpa
+    [ "$status" -eq 0 ]
+    [ "${lines[1]}" = "11     amy                      adams                            4.50" ]
+    [ "${lines[2]}" = "10     zoe                      brown                            3.00" ]
+    [ "${lines[3]}" = "12     bob                      adams                            3.00" ]
+
+    # a budget below the smallest run spills every 64 records
+    seq 100 399 | awk '{ printf "%d,f%d,l%d,%d\n", $1, $1 % 7, $1 % 13, $1 }' | ./sdbsc -b -
+    [ "$(SDB_SORT_MEM_KB=1 ./sdbsc -p --sort=fname)" = "$(./sdbsc -p --sort=fname)" ]
+
+    run ./sdbsc -p --sort=id
+    [ "$status" -eq 2 ]
+
+    run ./sdbsc -z
+    [ "$status" -eq 0 ]
+}
+
+@test "Stream changes to a replica, incrementally and as a full resync" {
+    replica=$(mktemp -d)
+    cp ./sdbsc "$replica"
+    run ./sdbsc -a 1 john doe 345
+    [ "$status" -eq 0 ]
+    run ./sdbsc -a 2 jane roe 390
+    [ "$status" -eq 0 ]
+
+    run ./sdbsc -s 0 student.db.feed
+    [ "$status" -eq 0 ]
+    upto=$(echo "${lines[0]}" | sed 's/.* up to \([0-9]*\) .*/\1/')
+    (cd "$replica" && ./sdbsc -r "$OLDPWD/student.db.feed")
+    [ "$(cd "$replica" && ./sdbsc -p)" = "$(./sdbsc -p)" ]
+
+    # only the ids changed since upto are streamed, a delete included
+    run ./sdbsc -d 2
+    [ "$status" -eq 0 ]
+    run ./sdbsc -a 3 new kid 400
+    [ "$status" -eq 0 ]
+    run bash -c "./sdbsc -s $upto | (cd $replica && ./sdbsc -r -)"
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Applied 1 change(s) and 1 deletion(s), rejected 0, replica is at sequence $((upto + 2))." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+    [ "$(cd "$replica" && ./sdbsc -p)" = "$(./sdbsc -p)" ]
+
+    # emptying the database forgets the changes, the next feed is a full one
+    run ./sdbsc -z
+    [ "$status" -eq 0 ]
+    run ./sdbsc -a 7 only one 100
+    [ "$status" -eq 0 ]
+    run bash -c "./sdbsc -s $((upto + 2)) | (cd $replica && ./sdbsc -r -)"
+    [ "$status" -eq 0 ]
+    [ "$(cd "$replica" && ./sdbsc -p)" = "$(./sdbsc -p)" ]
+
+    # a damaged feed is rejected as a whole
+    printf 'x' | dd of=student.db.feed bs=1 seek=40 conv=notrunc 2>/dev/null
+    run bash -c "cd $replica && ./sdbsc -r $PWD/student.db.feed"
+    rm -rf "$replica" student.db.feed
+    [ "$status" -eq 1 ]
+
+    run ./sdbsc -z
+    [ "$status" -eq 0 ]
+}
+
+@test "A second process does not replay the log of a running server" {
+    command -v python3 >/dev/null || skip "python3 is needed to talk to the server"
+    run ./sdbsc -a 1 before server 300
+    [ "$status" -eq 0 ]
+    upto=$(./sdbsc -s 0 /dev/null | sed 's/.* up to \([0-9]*\) .*/\1/')
+
+    start_server
+    [ "$(sdb_client add 77 log ged 310)" = "0" ]
+    # the add is in the server's log, the delete is newer than anything in it
+    run env SDB_WAL=off ./sdbsc -d 77
+    [ "$status" -eq 0 ]
+
+    run ./sdbsc -f 77
+    [ "${lines[0]}" = "Student 77 was not found in database." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+    run ./sdbsc -c
+    [ "$status" -eq 0 ]
+    stop_server
+
+    run ./sdbsc -f 77
+    [ "${lines[0]}" = "Student 77 was not found in database." ]
+    # nothing was replayed, the change sequence was kept and the feed holds
+    # just id 77
+    run ./sdbsc -s "$upto" /dev/null
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Streamed 1 change(s) after sequence $upto up to $((upto + 2)) to /dev/null." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -z
+    [ "$status" -eq 0 ]
+}
+
+@test "A running server survives another process shrinking the file" {
+    command -v python3 >/dev/null || skip "python3 is needed to talk to the server"
+    run ./sdbsc -a 99999 far away 300
+    [ "$status" -eq 0 ]
+    start_server
+    [ "$(sdb_client get 99999)" = "0 99999 far away 300" ]
+
+    run ./sdbsc -z
+    [ "$status" -eq 0 ]
+    [ "$(sdb_client get 99999)" = "-3" ]
+
+    run ./sdbsc -a 99998 near end 200
+    [ "$status" -eq 0 ]
+    [ "$(sdb_client get 99998)" = "0 99998 near end 200" ]
+    run ./sdbsc -d 99998
+    [ "$status" -eq 0 ]
+    run ./sdbsc -x punch
+    [ "$status" -eq 0 ]
+    [ "$(sdb_client get 99998)" = "-3" ]
+    [ "$(sdb_client count)" = "0 0" ]
+    stop_server
+
+    run ./sdbsc -z
+    [ "$status" -eq 0 ]
+}
+
+@test "Serve add, get, count and delete over the socket, acking writes once committed" {
+    command -v python3 >/dev/null || skip "python3 is needed to talk to the server"
+    start_server SDB_WAL_INTERVAL_MS=5000
+    [ "$(sdb_client add 12 sock et 333)" = "0" ]
+    # acknowledged means in the log, long before the sync interval is up
+    [ "$(stat -c %s student.db.wal)" -gt 0 ]
+    [ "$(sdb_client add 12 sock et 333)" = "-2" ]
+    [ "$(sdb_client get 12)" = "0 12 sock et 333" ]
+    [ "$(sdb_client get 13)" = "-3" ]
+    [ "$(sdb_client count)" = "0 1" ]
+
+    [ "$(sdb_client del 12)" = "0" ]
+    [ "$(sdb_client get 12)" = "-3" ]
+    stop_server
+
+    run ./sdbsc -f 12
+    [ "${lines[0]}" = "Student 12 was not found in database." ]
+}
+
+@test "A client that sent part of a request holds up no other client" {
+    command -v python3 >/dev/null || skip "python3 is needed to talk to the server"
+    start_server
+    run python3 - <<'PY'
+import socket, struct
+def frame(op, sid, body):
+    return struct.pack("=Ii", op, sid) + body
+def status(s):
+    resp = b""
+    while len(resp) < 72:
+        chunk = s.recv(72 - len(resp))
+        assert chunk
+        resp += chunk
+    return struct.unpack("=ii", resp[:8])
+slow = socket.socket(socket.AF_UNIX)
+slow.connect("student.db.sock")
+add = frame(2, 21, struct.pack("=i24s32si", 21, b"half", b"frame", 321))
+slow.sendall(add[:30])
+other = socket.socket(socket.AF_UNIX)
+other.settimeout(2)
+other.connect("student.db.sock")
+other.sendall(frame(4, 0, bytes(64)))
+print(*status(other))
+slow.sendall(add[30:])
+print(*status(slow))
+PY
+    [ "$status" -eq 0 ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+    [ "${lines[0]}" = "0 0" ]
+    [ "${lines[1]}" = "0 0" ]
+    [ "$(sdb_client get 21)" = "0 21 half frame 321" ]
+    [ "$(sdb_client del 21)" = "0" ]
+    stop_server
+}
+
+@test "A running server merges the last name delta once it grows too long" {
+    command -v python3 >/dev/null || skip "python3 is needed to talk to the server"
+    start_server
+    # one connection adding more students than LIDX_MERGE_MIN
+    python3 - <<'PY'
+import socket, struct
+s = socket.socket(socket.AF_UNIX)
+s.connect("student.db.sock")
+for sid in range(1, 1101):
+    s.sendall(struct.pack("=Iii24s32si", 2, sid, sid, b"bulk", b"name%d" % sid, 300))
+    resp = b""
+    while len(resp) < 72:
+        resp += s.recv(72 - len(resp))
+    assert struct.unpack("=i", resp[:4])[0] == 0
+PY
+    # the base already holds them while the server is still running
+    base=$(python3 -c 'import struct; print(struct.unpack_from("=Q", open("student.db.lidx", "rb").read(40), 24)[0])')
+    [ "$base" -gt 1000 ] || {
+        echo "base_count:  $base"
+        return 1
+    }
+    run ./sdbsc -l name1099
+    [ "${lines[1]}" = "1099   bulk                     name1099                         3.00" ]
+    [ "${#lines[@]}" -eq 2 ]
+    stop_server
+
+    run ./sdbsc -z
+    [ "$status" -eq 0 ]
+}
+
+@test "A bulk load run records only the slots it changes" {
+    run ./sdbsc -a 9 x y 100
+    [ "$status" -eq 0 ]
+    upto=$(./sdbsc -s 0 /dev/null | sed 's/.* up to \([0-9]*\) .*/\1/')
+
+    # ids 2 to 4 are written empty as they were, only 1 and 5 change
+    run ./sdbsc -b - <<< $'1,a,b,300\n5,c,d,310'
+    [ "$status" -eq 0 ]
+    run ./sdbsc -s "$upto" /dev/null
+    [ "${lines[0]}" = "Streamed 2 change(s) after sequence $upto up to $((upto + 2)) to /dev/null." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -z
+    [ "$status" -eq 0 ]
+}
+
+@test "An import whose checksum fails deletes what it loaded" {
+    run ./sdbsc -b - < <(seq 1000 20999 | sed 's/.*/&,first,last,300/')
+    [ "$status" -eq 0 ]
+    run ./sdbsc -e bin student.db.dump
+    [ "$status" -eq 0 ]
+    run ./sdbsc -z
+    [ "$status" -eq 0 ]
+
+    # a name byte of the first row, long before the trailer is read
+    cp student.db.dump student.db.bad
+    printf 'F' | dd of=student.db.bad bs=1 seek=$((64 + 4)) conv=notrunc 2>/dev/null
+    run ./sdbsc -i bin student.db.bad
+    rm -f student.db.bad
+    [ "$status" -eq 1 ]
+    [ "${lines[-1]}" = "student.db.bad is not a complete student db dump (bad header, length or checksum)." ]
+    run ./sdbsc -c
+    [ "${lines[0]}" = "Database contains no student records." ]
+
+    run ./sdbsc -i bin - < student.db.dump
+    rm -f student.db.dump
+    [ "$status" -eq 0 ]
+    [ "${lines[-1]}" = "Import added 20000 student(s), rejected 0 record(s)." ]
+    run ./sdbsc -c
+    [ "${lines[0]}" = "Database contains 20000 student record(s)." ]
+
+    run ./sdbsc -z
+    [ "$status" -eq 0 ]
+}
+
+@test "The occupancy bitmap is shared by processes and rebuilt for a replaced file" {
+    command -v python3 >/dev/null || skip "python3 is needed to talk to the server"
+    start_server
+    run ./sdbsc -a 5 five bits 300
+    [ "$status" -eq 0 ]
+    run ./sdbsc -a 6 six bits 300
+    [ "$status" -eq 0 ]
+    [ "$(sdb_client count)" = "0 2" ]
+    run ./sdbsc -d 5
+    [ "$status" -eq 0 ]
+    [ "$(sdb_client count)" = "0 1" ]
+    stop_server
+
+    # id 6 plus a stray bit for id 4, then a copy of the database takes its place
+    printf '\x50' | dd of=student.db.occ bs=1 seek=32 conv=notrunc 2>/dev/null
+    run ./sdbsc -c
+    [ "${lines[0]}" = "Database contains 2 student record(s)." ]
+    cp student.db student.db.copy
+    mv student.db.copy student.db
+    run ./sdbsc -c
+    [ "${lines[0]}" = "Database contains 1 student record(s)." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -z
+    [ "$status" -eq 0 ]
+}
+
+@test "A slot locked by another process holds up writers of that slot only" {
+    command -v python3 >/dev/null || skip "python3 is needed to hold the lock"
+    # write locks the byte range of slot 5 until student.db.held goes away
+    python3 - <<'PY' &
+import fcntl, os, time
+fd = os.open("student.db", os.O_RDWR)
+fcntl.lockf(fd, fcntl.LOCK_EX, 64, 5 * 64)
+open("student.db.held", "w").close()
+while os.path.exists("student.db.held"):
+    time.sleep(0.05)
+PY
+    holder=$!
+    for _ in $(seq 100); do
+        [ -f student.db.held ] && break
+        sleep 0.05
+    done
+
+    run timeout 2 ./sdbsc -a 6 next door 300
+    [ "$status" -eq 0 ]
+    run timeout 1 ./sdbsc -a 5 held up 300
+    [ "$status" -eq 124 ]
+
+    rm -f student.db.held
+    wait "$holder"
+    holder=
+    run timeout 2 ./sdbsc -a 5 held up 300
+    [ "$status" -eq 0 ]
+    run ./sdbsc -c
+    [ "${lines[0]}" = "Database contains 2 student record(s)." ]
+
+    run ./sdbsc -z
+    [ "$status" -eq 0 ]
+}
+
+@test "Another process's write invalidates the page a pread server cached" {
+    command -v python3 >/dev/null || skip "python3 is needed to talk to the server"
+    # without record checksums a stale cached page would not be caught
+    # another way
+    rm -f student.db.sum
+    mkdir student.db.sum
+    run ./sdbsc -a 21 page mate 300
+    [ "$status" -eq 0 ]
+    start_server SDB_ENGINE=pread
+    # caches the page holding ids 20 and 21
+    [ "$(sdb_client get 21)" = "0 21 page mate 300" ]
+    [ "$(sdb_client get 20)" = "-3" ]
+
+    run ./sdbsc -a 20 cached once 310
+    [ "$status" -eq 0 ]
+    [ "$(sdb_client get 20)" = "0 20 cached once 310" ]
+    run ./sdbsc -d 20
+    [ "$status" -eq 0 ]
+    run ./sdbsc -a 20 cached twice 320
+    [ "$status" -eq 0 ]
+    [ "$(sdb_client get 20)" = "0 20 cached twice 320" ]
+    run ./sdbsc -d 21
+    [ "$status" -eq 0 ]
+    [ "$(sdb_client get 21)" = "-3" ]
+    stop_server
+    rmdir student.db.sum
+
+    run ./sdbsc -z
+    [ "$status" -eq 0 ]
+}
+
+@test "Replay applies logged writes in the order they were made, not committed" {
+    command -v python3 >/dev/null || skip "python3 is needed to write the log"
+    run ./sdbsc -c
+    [ "$status" -eq 0 ]
+
+    # a delete of id 5 committed before the add it followed, as when the
+    # adding process commits its group late and then crashes
+    python3 - <<'PY'
+import struct
+def crc32c(data):
+    crc = 0xffffffff
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = (crc >> 1) ^ (0x82f63b78 if crc & 1 else 0)
+    return crc ^ 0xffffffff
+def record(seq, sid, rec):
+    body = struct.pack("=Qii", seq, sid, 0) + rec
+    return struct.pack("=II", 0x314c4157, crc32c(body)) + body
+added = struct.pack("=i24s32si", 5, b"stale", b"add", 300)
+with open("student.db.wal", "wb") as f:
+    f.write(record(1000002, 5, bytes(64)) + record(1000001, 5, added) +
+            record(1000003, 6, struct.pack("=i24s32si", 6, b"later", b"add", 310)))
+PY
+    run ./sdbsc -f 5
+    [ "${lines[0]}" = "Student 5 was not found in database." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+    run ./sdbsc -f 6
+    [ "${lines[1]}" = "6      later                    add                              3.10" ]
+
+    run ./sdbsc -z
+    [ "$status" -eq 0 ]
+}